@@ -0,0 +1,115 @@
+#include "AsyncFileWriter.h"
+#include "Profiler.h"
+#include <fstream>
+#include <utility>
+
+AsyncFileWriter::AsyncFileWriter(size_t maxQueuedBytes)
+    : maxQueuedBytes(maxQueuedBytes)
+{
+    if (maxQueuedBytes > 0)
+        thread = std::thread(&AsyncFileWriter::Run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+    if (!thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    thread.join();
+}
+
+void AsyncFileWriter::Write(const std::string& path, std::vector<uint8_t>&& data)
+{
+    const size_t bytes = data.size();
+    Enqueue(Job{ path, std::move(data), std::string(), true }, bytes);
+}
+
+void AsyncFileWriter::Write(const std::string& path, std::string&& text)
+{
+    const size_t bytes = text.size();
+    Enqueue(Job{ path, std::vector<uint8_t>(), std::move(text), false }, bytes);
+}
+
+void AsyncFileWriter::Enqueue(Job&& job, size_t bytes)
+{
+    if (!thread.joinable())
+    {
+        Finish(job, WriteFile(job), 0);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    // a file bigger than the whole budget still goes, once the queue is empty
+    queueChanged.wait(lock, [&]() { return queuedBytes == 0 || queuedBytes + bytes <= maxQueuedBytes; });
+    queue.push_back(std::move(job));
+    queuedBytes += bytes;
+    ++queuedCount;
+    lock.unlock();
+    queueChanged.notify_all();
+}
+
+void AsyncFileWriter::Finish(const Job& job, bool ok, size_t bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok)
+            failed.erase(job.path);
+        else
+            failed.insert(job.path);
+        queuedBytes -= bytes;
+        ++finishedCount;
+    }
+    queueChanged.notify_all();
+}
+
+void AsyncFileWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    const uint64_t target = queuedCount;
+    queueChanged.wait(lock, [&]() { return finishedCount >= target; });
+}
+
+bool AsyncFileWriter::Failed(const std::string& path) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed.count(path) > 0;
+}
+
+void AsyncFileWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        queueChanged.wait(lock, [&]() { return stopping || !queue.empty(); });
+        if (queue.empty())
+            return;
+        Job job = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+        // the job's bytes stay counted until they are on disk
+        const size_t bytes = job.binary ? job.data.size() : job.text.size();
+        const bool ok = WriteFile(job);
+        Finish(job, ok, bytes);
+        lock.lock();
+    }
+}
+
+/*static*/ bool AsyncFileWriter::WriteFile(const Job& job)
+{
+    Profiler::Scope scope("WriteFile", job.path);
+    std::ios_base::openmode mode = std::ofstream::out | std::ofstream::trunc;
+    if (job.binary)
+        mode |= std::ofstream::binary;
+    std::ofstream ofs(job.path, mode);
+    if (!ofs.is_open())
+        return false;
+    const char* data = job.binary ? reinterpret_cast<const char*>(job.data.data()) : job.text.data();
+    const size_t size = job.binary ? job.data.size() : job.text.size();
+    ofs.write(data, static_cast<std::streamsize>(size));
+    ofs.close();
+    scope.SetCounts(size, size);
+    return static_cast<bool>(ofs);
+}
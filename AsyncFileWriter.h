@@ -0,0 +1,60 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Writes whole output files on a dedicated I/O thread, so converting the next mesh
+// overlaps flushing the last one to (possibly network attached) storage. Files are
+// written in the order they are queued. Queued data is bounded: Write blocks while
+// maxQueuedBytes are waiting, unless nothing is. With maxQueuedBytes 0 there is no
+// thread and every Write happens on the calling thread. Thread-safe.
+class AsyncFileWriter
+{
+public:
+    explicit AsyncFileWriter(size_t maxQueuedBytes);
+    // Finishes every queued write
+    ~AsyncFileWriter();
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+    // Queues data to replace the file at path, in binary mode
+    void Write(const std::string& path, std::vector<uint8_t>&& data);
+    // Queues text to replace the file at path, in text mode like the JSON outputs
+    void Write(const std::string& path, std::string&& text);
+
+    // Waits until every write queued before the call has finished
+    void Flush();
+    // Whether the last finished write of path failed
+    bool Failed(const std::string& path) const;
+
+private:
+    struct Job
+    {
+        std::string path;
+        std::vector<uint8_t> data;
+        std::string text;
+        bool binary;
+    };
+
+    void Enqueue(Job&& job, size_t bytes);
+    void Finish(const Job& job, bool ok, size_t bytes);
+    void Run();
+    static bool WriteFile(const Job& job);
+
+    const size_t maxQueuedBytes;
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Job> queue;
+    size_t queuedBytes = 0;     // of the jobs queued or being written
+    uint64_t queuedCount = 0;   // jobs ever queued
+    uint64_t finishedCount = 0;
+    bool stopping = false;
+    std::unordered_set<std::string> failed;
+    std::thread thread;
+};
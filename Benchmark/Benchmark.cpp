@@ -0,0 +1,605 @@
+// Benchmark.cpp : Measures the FBX2ITP pipeline stages that run after the FBX import on
+// synthetic meshes, and optionally the whole converter on a real file.
+// Usage: FBX2ITPBench.exe [options]
+// Run with -h for the list of options (see PrintUsage).
+// Doesn't need the FBX SDK; the end-to-end run starts the FBX2ITP executable.
+
+#include "EngineMathSimd.h"
+#include "ItpAnim.h"
+#include "ItpMesh.h"
+#include "MeshBounds.h"
+#include "MeshBuilder.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "SyntheticMesh.h"
+#include "TangentGenerator.h"
+#include "ThreadPool.h"
+#include "VertexWelder.h"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static SyntheticMesh::Settings s_settings;
+static unsigned s_repeat;
+static uint32_t s_influenceCount;
+static unsigned s_jobCount;
+static std::string s_isaName;
+static std::string s_outputPath;
+static std::string s_csvPath;
+static std::string s_exePath;
+static std::string s_fbxPath;
+static std::string s_stageFilter;
+
+struct BenchResult
+{
+    std::string stage;
+    double seconds = 0.0;       // best of s_repeat runs
+    uint64_t items = 0;         // elements processed per run
+    const char* itemName = "";
+    uint64_t bytes = 0;         // bytes read or written per run, 0 if not meaningful
+};
+
+static std::vector<BenchResult> s_results;
+
+static bool IsStageSelected(const std::string& stage)
+{
+    return s_stageFilter.empty() || stage.find(s_stageFilter) != std::string::npos;
+}
+
+// Runs setup then run s_repeat times and keeps the fastest run; only run is timed
+static void Measure(const std::string& stage, uint64_t items, const char* itemName, uint64_t bytes,
+    const std::function<void()>& setup, const std::function<void()>& run)
+{
+    if (!IsStageSelected(stage))
+        return;
+    BenchResult result;
+    result.stage = stage;
+    result.items = items;
+    result.itemName = itemName;
+    result.bytes = bytes;
+    result.seconds = 1e30;
+    for (unsigned r = 0; r < s_repeat; ++r)
+    {
+        if (setup)
+            setup();
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        result.seconds = std::min(result.seconds, seconds);
+    }
+    result.seconds = std::max(result.seconds, 1e-9);
+
+    std::cout << std::left << std::setw(28) << result.stage << std::right << std::fixed
+        << std::setw(10) << std::setprecision(3) << result.seconds * 1e3 << " ms"
+        << std::setw(12) << std::setprecision(2) << result.items / result.seconds * 1e-6 << " M" << result.itemName << "/s";
+    if (result.bytes > 0)
+        std::cout << std::setw(10) << std::setprecision(1) << result.bytes / result.seconds / (1 << 20) << " MB/s";
+    std::cout << "\n" << std::defaultfloat;
+    s_results.push_back(result);
+}
+
+static uint64_t GetFileSize(const std::string& path)
+{
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    return ec ? 0 : static_cast<uint64_t>(size);
+}
+
+// The per-corner vertex FBX2ITP builds before welding (see BuildCornerVertex)
+static VertexData BuildCornerVertex(const SyntheticMesh& source, size_t c,
+    const std::vector<MeshBuilder::SkinSlots>& ctrlBones, const std::vector<MeshBuilder::SkinSlots>& ctrlWeights)
+{
+    size_t cp = static_cast<size_t>(source.cornerControlPoints[c]);
+    VertexData vert;
+    vert.pos = source.cornerPositions[c];
+    vert.norm = source.cornerNormals[c];
+    vert.tan = Vector3(0.0f, 0.0f, 0.0f);
+    vert.tanSign = 1.0f;
+    vert.uv = Vector2(source.cornerUVs[c].x, 1.0f - source.cornerUVs[c].y);
+    for (int k = 0; k < VertexData::MaxInfluences; ++k)
+    {
+        vert.bones[k] = ctrlBones[cp][k];
+        vert.weights[k] = ctrlWeights[cp][k];
+    }
+    return vert;
+}
+
+static void WeldMesh(const SyntheticMesh& source, const std::vector<MeshBuilder::SkinSlots>& ctrlBones,
+    const std::vector<MeshBuilder::SkinSlots>& ctrlWeights, ItpMesh::Mesh& out)
+{
+    const size_t cornerCount = source.GetCornerCount();
+    out.verts.clear();
+    out.indices.resize(cornerCount / 3);
+    std::vector<uint32_t> cornerVertices(cornerCount);
+    VertexWelder welder(out.format, cornerCount);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        VertexData vert = BuildCornerVertex(source, c, ctrlBones, ctrlWeights);
+        bool isNew = false;
+        uint32_t index = welder.Weld(vert, isNew);
+        if (isNew)
+            out.verts.emplace_back(vert);
+        cornerVertices[c] = index;
+        // reverse the winding order
+        out.indices[c / 3].index[2 - c % 3] = index;
+    }
+    out.vertexMap.Build(source.controlPointCount, source.cornerControlPoints.data(), cornerVertices.data(), cornerCount);
+}
+
+static void ComputeTarget(const ItpMesh::Mesh& mesh, const SyntheticMesh& source, size_t t, ItpMesh::BlendShape& bs)
+{
+    const SyntheticMesh::Target& target = source.targets[t];
+    bs = ItpMesh::BlendShape();
+    bs.name = mesh.name + "_target" + std::to_string(t);
+    bs.format.hasNormal = true;
+    MeshBuilder::ComputeBlendDeltas(mesh, target.positions.data(), target.normals.data(), nullptr,
+        source.controlPointCount, bs);
+    bs.MakeSparse(1e-5f, 0.5f);
+}
+
+static void RunMeshStages(const SyntheticMesh& source)
+{
+    const size_t cornerCount = source.GetCornerCount();
+    const size_t cpCount = source.controlPointCount;
+
+    ItpMesh::Mesh mesh;
+    mesh.name = "synthetic";
+    mesh.format.hasNormal = true;
+    mesh.format.hasUV = true;
+    mesh.format.hasSkin = true;
+    mesh.format.influenceCount = s_influenceCount;
+    if (source.bones.size() > 256)
+        mesh.format.boneEncoding = ItpMesh::VertexFormat::BoneUint16;
+
+    std::vector<MeshBuilder::SkinSlots> ctrlBones, ctrlWeights;
+    Measure("PackInfluences", cpCount, "cp", 0, nullptr,
+        [&]() { MeshBuilder::PackInfluences(source.influences, mesh.format, ctrlBones, ctrlWeights); });
+    if (ctrlBones.empty()) // stage filtered out
+        MeshBuilder::PackInfluences(source.influences, mesh.format, ctrlBones, ctrlWeights);
+    Measure("Weld", cornerCount, "corners", cornerCount * sizeof(VertexData), nullptr,
+        [&]() { WeldMesh(source, ctrlBones, ctrlWeights, mesh); });
+    if (mesh.verts.empty())
+        WeldMesh(source, ctrlBones, ctrlWeights, mesh);
+    std::cout << "  " << cornerCount << " corners -> " << mesh.verts.size() << " vertices (duplicate ratio "
+        << std::fixed << std::setprecision(3) << 1.0 - static_cast<double>(mesh.verts.size()) / cornerCount
+        << ")\n" << std::defaultfloat;
+
+    {
+        std::vector<Vector3> tangents(cornerCount);
+        std::vector<float> signs(cornerCount);
+        Measure("Tangents", cornerCount, "corners", 0, nullptr, [&]()
+        {
+            TangentGenerator::Generate(source.cornerPositions.data(), source.cornerNormals.data(), source.cornerUVs.data(),
+                cornerCount, tangents.data(), signs.data(), s_jobCount);
+        });
+    }
+
+    Measure("BlendDeltas", static_cast<uint64_t>(source.targets.size()) * mesh.verts.size(), "deltas", 0, nullptr, [&]()
+    {
+        mesh.blendShapes.resize(source.targets.size());
+        ThreadPool::ParallelFor(source.targets.size(), s_jobCount, [&](size_t t)
+        {
+            ComputeTarget(mesh, source, t, mesh.blendShapes[t]);
+        });
+    });
+    if (mesh.blendShapes.size() != source.targets.size())
+    {
+        mesh.blendShapes.resize(source.targets.size());
+        for (size_t t = 0; t < source.targets.size(); ++t)
+            ComputeTarget(mesh, source, t, mesh.blendShapes[t]);
+    }
+
+    {
+        const size_t indexCount = mesh.indices.size() * 3;
+        const size_t vertexCount = mesh.verts.size();
+        const float* positions = &mesh.verts[0].pos.x;
+        std::vector<uint32_t> indices;
+        std::vector<uint32_t> remap;
+        auto copyIndices = [&]() { indices.assign(mesh.indices[0].index, mesh.indices[0].index + indexCount); };
+        Measure("OptimizeVertexCache", mesh.indices.size(), "tris", 0, copyIndices,
+            [&]() { MeshOptimizer::OptimizeVertexCache(indices.data(), indexCount, vertexCount); });
+        Measure("OptimizeOverdraw", mesh.indices.size(), "tris", 0, copyIndices, [&]()
+        {
+            MeshOptimizer::OptimizeOverdraw(indices.data(), indexCount, positions, vertexCount, sizeof(VertexData), 1.05f);
+        });
+        Measure("BuildFetchRemap", mesh.indices.size(), "tris", 0, copyIndices,
+            [&]() { MeshOptimizer::BuildFetchRemap(remap, indices.data(), indexCount, vertexCount); });
+        std::vector<uint32_t> lodIndices;
+        Measure("SimplifyQuarter", mesh.indices.size(), "tris", 0, nullptr, [&]()
+        {
+            MeshSimplifier::Simplify(mesh.verts.data(), vertexCount, mesh.format, mesh.indices[0].index, indexCount,
+                indexCount / 12 * 3, FLT_MAX, lodIndices);
+        });
+        std::vector<ItpMesh::Meshlet> meshlets;
+        std::vector<uint32_t> meshletVertices;
+        std::vector<uint8_t> meshletTriangles;
+        Measure("BuildMeshlets", mesh.indices.size(), "tris", 0, nullptr, [&]()
+        {
+            MeshletBuilder::Build(mesh.indices[0].index, indexCount, positions, vertexCount, sizeof(VertexData), 64, 124, 0.25f,
+                meshlets, meshletVertices, meshletTriangles);
+        });
+        std::vector<ItpMesh::BvhNode> bvhNodes;
+        std::vector<uint32_t> bvhTriangles;
+        Measure("BuildBvh", mesh.indices.size(), "tris", 0, nullptr, [&]()
+        {
+            MeshBounds::BuildBvh(mesh.indices[0].index, indexCount, positions, sizeof(VertexData), Vector3::Zero, 4, bvhNodes, bvhTriangles);
+        });
+        Measure("RemapVertices", vertexCount, "verts", 0, nullptr, [&]()
+        {
+            // identity: only the cost of moving verts, indices, deltas and the vertex map
+            remap.resize(vertexCount);
+            for (size_t i = 0; i < vertexCount; ++i)
+                remap[i] = static_cast<uint32_t>(i);
+            mesh.RemapVertices(remap);
+        });
+    }
+
+    {   // stream codecs; the byte counts are the decoded sizes
+        const size_t indexCount = mesh.indices.size() * 3;
+        const uint32_t stride = mesh.format.GetStride();
+        std::vector<uint8_t> packed(stride * mesh.verts.size());
+        for (size_t i = 0; i < mesh.verts.size(); ++i)
+            mesh.format.PackVertex(mesh.verts[i], packed.data() + stride * i);
+        std::vector<uint8_t> encodedIndices;
+        std::vector<uint8_t> encodedVertices;
+        std::vector<uint32_t> decodedIndices(indexCount);
+        std::vector<uint8_t> decodedVertices(packed.size());
+        // encoded once up front so the decoders have input when only they are selected
+        MeshCodec::EncodeIndices(mesh.indices[0].index, indexCount, encodedIndices);
+        MeshCodec::EncodeVertices(packed.data(), mesh.verts.size(), stride, encodedVertices);
+        Measure("EncodeIndices", mesh.indices.size(), "tris", indexCount * sizeof(uint32_t),
+            [&]() { encodedIndices.clear(); },
+            [&]() { MeshCodec::EncodeIndices(mesh.indices[0].index, indexCount, encodedIndices); });
+        Measure("DecodeIndices", mesh.indices.size(), "tris", indexCount * sizeof(uint32_t), nullptr,
+            [&]() { MeshCodec::DecodeIndices(decodedIndices.data(), indexCount, encodedIndices.data(), encodedIndices.size()); });
+        Measure("EncodeVertices", mesh.verts.size(), "verts", packed.size(),
+            [&]() { encodedVertices.clear(); },
+            [&]() { MeshCodec::EncodeVertices(packed.data(), mesh.verts.size(), stride, encodedVertices); });
+        Measure("DecodeVertices", mesh.verts.size(), "verts", packed.size(), nullptr, [&]()
+        {
+            MeshCodec::DecodeVertices(decodedVertices.data(), mesh.verts.size(), stride, encodedVertices.data(), encodedVertices.size());
+        });
+        if (!encodedIndices.empty() && !encodedVertices.empty())
+        {
+            std::cout << std::fixed << std::setprecision(1) << "  encoded indices " << encodedIndices.size() << " bytes ("
+                << 8.0 * encodedIndices.size() / std::max<size_t>(mesh.indices.size(), 1) << " bits/tri), vertices "
+                << encodedVertices.size() << " of " << packed.size() << " bytes\n" << std::defaultfloat;
+        }
+    }
+
+    // writers, each measured with its output file size
+    const std::string meshPath = mesh.name + ".itpmesh3";
+    const std::string binaryPath = mesh.name + ".bin.itpmesh3";
+    const std::string streamPath = mesh.name + ".stream.itpmesh3";
+    const std::string skelPath = mesh.name + ".itpskel";
+    auto writeJson = [&]()
+    {
+        JsonWriter json;
+        mesh.WriteToJson(json);
+        std::ofstream ofs(meshPath, std::ofstream::out | std::ofstream::trunc);
+        json.WriteTo(ofs);
+    };
+    auto writeBinary = [&]()
+    {
+        std::ofstream ofs(binaryPath, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        mesh.WriteToBinary(ofs);
+    };
+    auto writeStream = [&]()
+    {
+        ItpMesh::BinaryStreamWriter writer(mesh.format, mesh.name);
+        if (writer.Open(streamPath))
+        {
+            writer.WriteVertices(mesh.verts.data(), mesh.verts.size());
+            writer.WriteTriangles(mesh.indices.data(), mesh.indices.size(), 0);
+            writer.Finish();
+        }
+    };
+    mesh.bones = source.bones;
+    auto writeSkeleton = [&]()
+    {
+        JsonWriter json;
+        mesh.WriteSkelToJson(json);
+        std::ofstream ofs(skelPath, std::ofstream::out | std::ofstream::trunc);
+        json.WriteTo(ofs);
+    };
+    auto writeBlendShapes = [&]()
+    {
+        ThreadPool::ParallelFor(mesh.blendShapes.size(), s_jobCount, [&](size_t i)
+        {
+            const ItpMesh::BlendShape& bs = mesh.blendShapes[i];
+            JsonWriter json;
+            bs.WriteToJson(json);
+            std::ofstream ofs(bs.name + ".itpblend", std::ofstream::out | std::ofstream::trunc);
+            json.WriteTo(ofs);
+        });
+    };
+    auto blendBytes = [&]()
+    {
+        uint64_t bytes = 0;
+        for (const ItpMesh::BlendShape& bs : mesh.blendShapes)
+            bytes += GetFileSize(bs.name + ".itpblend");
+        return bytes;
+    };
+
+    // one untimed run first so the byte counts are known up front
+    struct Writer
+    {
+        const char* stage;
+        std::function<void()> write;
+        std::function<uint64_t()> size;
+    };
+    const Writer writers[] = {
+        { "WriteMeshJson", writeJson, [&]() { return GetFileSize(meshPath); } },
+        { "WriteMeshBinary", writeBinary, [&]() { return GetFileSize(binaryPath); } },
+        { "WriteMeshStream", writeStream, [&]() { return GetFileSize(streamPath); } },
+        { "WriteSkeleton", writeSkeleton, [&]() { return GetFileSize(skelPath); } },
+        { "WriteBlendShapes", writeBlendShapes, blendBytes },
+    };
+    for (const Writer& writer : writers)
+    {
+        if (!IsStageSelected(writer.stage))
+            continue;
+        writer.write();
+        uint64_t items = std::string(writer.stage) == "WriteSkeleton" ? mesh.bones.size() : mesh.verts.size();
+        Measure(writer.stage, items, std::string(writer.stage) == "WriteSkeleton" ? "bones" : "verts",
+            writer.size(), nullptr, writer.write);
+    }
+}
+
+static void RunMathStages(const SyntheticMesh& source)
+{
+    const size_t count = source.controlPointCount;
+    std::vector<float> x(count), y(count), z(count), outX(count), outY(count), outZ(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        x[i] = source.controlPoints[i].x;
+        y[i] = source.controlPoints[i].y;
+        z[i] = source.controlPoints[i].z;
+    }
+    const Matrix4 mat = Matrix4::CreateRotationY(0.3f) * Matrix4::CreateTranslation(Vector3(1.0f, 2.0f, 3.0f));
+    const uint64_t bytes = count * 6 * sizeof(float);
+
+    // four weight rows of count values
+    std::vector<float> weightSource(4 * count), weights;
+    for (size_t i = 0; i < weightSource.size(); ++i)
+        weightSource[i] = 0.05f + static_cast<float>(i % 97) / 97.0f;
+    weights = weightSource; // same size from here on, so the rows stay valid
+    float* weightRows[4];
+    for (size_t k = 0; k < 4; ++k)
+        weightRows[k] = weights.data() + k * count;
+    const uint64_t weightBytes = weightSource.size() * 2 * sizeof(float);
+
+    const MathSimd::Isa isas[] = { MathSimd::Isa::Scalar, MathSimd::Isa::SSE, MathSimd::Isa::AVX2, MathSimd::Isa::NEON };
+    const MathSimd::Isa defaultIsa = MathSimd::GetIsa();
+    for (MathSimd::Isa isa : isas)
+    {
+        const std::string name = MathSimd::GetIsaName(isa);
+        if (!s_isaName.empty() && s_isaName != name)
+            continue;
+        if (!MathSimd::SetIsa(isa))
+            continue;
+        Measure("TransformPoints." + name, count, "points", bytes, nullptr,
+            [&]() { MathSimd::TransformPoints(mat, x.data(), y.data(), z.data(), outX.data(), outY.data(), outZ.data(), count); });
+        Measure("NormalizeVectors." + name, count, "vectors", bytes,
+            [&]() { outX = x; outY = y; outZ = z; },
+            [&]() { MathSimd::NormalizeVectors(outX.data(), outY.data(), outZ.data(), count); });
+        Measure("NormalizeWeights." + name, count, "sets", weightBytes,
+            [&]() { weights = weightSource; },
+            [&]() { MathSimd::NormalizeWeights(weightRows, 4, count, 65535.0f); });
+        Vector3 boundsMin, boundsMax;
+        Measure("ComputeBounds." + name, count, "points", count * 3 * sizeof(float), nullptr,
+            [&]() { MathSimd::ComputeBounds(x.data(), y.data(), z.data(), count, boundsMin, boundsMax); });
+    }
+    MathSimd::SetIsa(defaultIsa);
+}
+
+// Key reduction of a clip on the synthetic skeleton: every bone swings at its own rate
+// with a hold in the middle, which is what lets keys go
+static void RunAnimStages(const SyntheticMesh& source)
+{
+    const uint32_t frameCount = 300;
+    const size_t boneCount = source.bones.size();
+    std::vector<Quaternion> rotations(frameCount);
+    std::vector<Vector3> translations(frameCount);
+    ItpAnim::Clip sampled;
+    sampled.frameCount = frameCount;
+    sampled.tracks.resize(boneCount);
+    for (size_t b = 0; b < boneCount; ++b)
+    {
+        for (uint32_t f = 0; f < frameCount; ++f)
+        {
+            const float phase = f > frameCount / 3 && f < 2 * frameCount / 3 ? frameCount / 3.0f : static_cast<float>(f);
+            const float angle = 0.6f * sinf(phase * 0.02f * (1.0f + b % 5));
+            rotations[f] = Quaternion(Vector3(0.0f, 0.0f, 1.0f), angle);
+            translations[f] = source.bones[b].bindPose.trans + Vector3(0.0f, 0.1f * angle, 0.0f);
+        }
+        sampled.tracks[b].SetSamples(rotations.data(), translations.data(), frameCount);
+    }
+
+    ItpAnim::Clip clip;
+    Measure("ReduceAnim", boneCount * frameCount, "samples", boneCount * frameCount * (sizeof(Quaternion) + sizeof(Vector3)),
+        [&]() { clip = sampled; },
+        [&]() { clip.Reduce(Math::ToRadians(0.05f), 0.01f, s_jobCount); });
+    if (!clip.tracks.empty())
+        std::cout << "  " << boneCount * frameCount * 2 << " samples -> " << clip.GetKeyCount() << " keys\n";
+}
+
+// Converts s_fbxPath with blendshapes and skinning, timing the whole process. The
+// converter's own -profile report has the per-stage breakdown.
+static void RunEndToEnd()
+{
+    if (!IsStageSelected("EndToEnd"))
+        return;
+    if (s_exePath.empty() || !fs::exists(s_exePath) || s_fbxPath.empty() || !fs::exists(s_fbxPath))
+    {
+        std::cout << "EndToEnd: skipped, converter '" << s_exePath << "' or input '" << s_fbxPath << "' not found\n";
+        return;
+    }
+    std::string command = "\"" + s_exePath + "\" \"" + s_fbxPath + "\" -b -s -j " + std::to_string(s_jobCount)
+        + " -profile endtoend_profile.json > endtoend.log 2>&1";
+#if defined(_WIN32)
+    command = "\"" + command + "\""; // cmd /c strips the outer quotes
+#endif
+    int status = 0;
+    Measure("EndToEnd", 1, "files", GetFileSize(s_fbxPath), nullptr, [&]() { status = std::system(command.c_str()); });
+    if (status != 0)
+        std::cout << "  converter exited with status " << status << ", see endtoend.log\n";
+    else
+        std::cout << "  stage breakdown in endtoend_profile.json\n";
+}
+
+static bool WriteCsv(const std::string& path)
+{
+    std::ofstream ofs(path, std::ofstream::out | std::ofstream::trunc);
+    if (!ofs.is_open())
+        return false;
+    ofs << "stage,seconds,items,item,items_per_second,bytes,megabytes_per_second\n";
+    for (const BenchResult& r : s_results)
+    {
+        ofs << r.stage << ',' << r.seconds << ',' << r.items << ',' << r.itemName << ',' << r.items / r.seconds
+            << ',' << r.bytes << ',' << r.bytes / r.seconds / (1 << 20) << '\n';
+    }
+    return !ofs.fail();
+}
+
+static void PrintUsage(const char* exe)
+{
+    std::cerr << "Usage: " << exe << " [options]\n"
+        << "Options:\n"
+        << "  -corners N    corners of the synthetic mesh (default 1048576)\n"
+        << "  -dup R        fraction of corners that weld away, up to about 0.83 (default 0.8)\n"
+        << "  -bones N      bones of the synthetic skeleton, 1 to 65536 (default 64; 16 bit indices past 256)\n"
+        << "  -influences N bones per vertex, 4 or 8 (default 4)\n"
+        << "  -targets N    blendshape targets (default 16)\n"
+        << "  -coverage F   fraction of control points each target moves (default 0.2)\n"
+        << "  -repeat N     runs per stage, the fastest is reported (default 5)\n"
+        << "  -j N          threads for the parallel stages (default 1, 0 = one per hardware thread)\n"
+        << "  -isa name     only benchmark the math kernels with one of scalar, SSE, AVX2, NEON\n"
+        << "  -stage text   only run the stages whose name contains text\n"
+        << "  -out dir      directory for the written files (default bench_out)\n"
+        << "  -csv path     also write the results as CSV\n"
+        << "  -exe path     FBX2ITP executable for the end-to-end run (default: next to this one)\n"
+        << "  -fbx path     input of the end-to-end run (default Gunan_animated.fbx)\n";
+}
+
+static bool ReadOptions(int argc, char** argv)
+{
+    s_settings = SyntheticMesh::Settings();
+    s_repeat = 5;
+    s_influenceCount = 4;
+    s_jobCount = 1;
+    s_isaName.clear();
+    s_stageFilter.clear();
+    s_outputPath = "bench_out";
+    s_csvPath.clear();
+    s_fbxPath = "Gunan_animated.fbx";
+    // the converter builds to the same output directory
+    fs::path self = argc > 0 ? fs::path(argv[0]) : fs::path();
+#if defined(_WIN32)
+    s_exePath = (self.parent_path() / "FBX2ITP.exe").string();
+#else
+    s_exePath = (self.parent_path() / "FBX2ITP").string();
+#endif
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-corners" && hasValue)
+            s_settings.cornerCount = static_cast<size_t>(std::max(3ll, std::atoll(argv[++i])));
+        else if (arg == "-dup" && hasValue)
+            s_settings.duplicateRatio = static_cast<float>(std::atof(argv[++i]));
+        else if (arg == "-bones" && hasValue)
+            s_settings.boneCount = static_cast<uint32_t>(std::max(1, std::min(65536, std::atoi(argv[++i]))));
+        else if (arg == "-influences" && hasValue)
+            s_influenceCount = std::atoi(argv[++i]) > 4 ? 8 : 4;
+        else if (arg == "-targets" && hasValue)
+            s_settings.targetCount = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+        else if (arg == "-coverage" && hasValue)
+            s_settings.targetCoverage = std::max(0.0f, std::min(1.0f, static_cast<float>(std::atof(argv[++i]))));
+        else if (arg == "-repeat" && hasValue)
+            s_repeat = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        else if (arg == "-j" && hasValue)
+        {
+            s_jobCount = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+            if (s_jobCount == 0)
+                s_jobCount = ThreadPool::HardwareThreads();
+        }
+        else if (arg == "-isa" && hasValue)
+            s_isaName = argv[++i];
+        else if (arg == "-stage" && hasValue)
+            s_stageFilter = argv[++i];
+        else if (arg == "-out" && hasValue)
+            s_outputPath = argv[++i];
+        else if (arg == "-csv" && hasValue)
+            s_csvPath = argv[++i];
+        else if (arg == "-exe" && hasValue)
+            s_exePath = argv[++i];
+        else if (arg == "-fbx" && hasValue)
+            s_fbxPath = argv[++i];
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (!ReadOptions(argc, argv))
+    {
+        PrintUsage(argc > 0 ? argv[0] : "FBX2ITPBench");
+        return 1;
+    }
+
+    // resolve the inputs before moving to the output directory
+    std::error_code ec;
+    if (!s_exePath.empty())
+        s_exePath = fs::absolute(s_exePath, ec).string();
+    if (!s_fbxPath.empty())
+        s_fbxPath = fs::absolute(s_fbxPath, ec).string();
+    if (!s_csvPath.empty())
+        s_csvPath = fs::absolute(s_csvPath, ec).string();
+    fs::create_directories(s_outputPath, ec);
+    fs::current_path(s_outputPath, ec);
+    if (ec)
+    {
+        std::cerr << "Failed to use output directory: " << s_outputPath << "\n";
+        return 1;
+    }
+
+    SyntheticMesh source;
+    auto start = std::chrono::steady_clock::now();
+    source.Generate(s_settings);
+    std::cout << "Synthetic mesh: " << source.GetCornerCount() << " corners, " << source.controlPointCount
+        << " control points, " << source.bones.size() << " bones, " << source.targets.size() << " targets ("
+        << std::fixed << std::setprecision(1)
+        << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3 << " ms, "
+        << source.GetSourceBytes() / double(1 << 20) << " MB)\n" << std::defaultfloat;
+    std::cout << "Threads: " << s_jobCount << ", best of " << s_repeat << " runs, math ISA "
+        << MathSimd::GetIsaName(MathSimd::GetIsa()) << "\n\n";
+
+    RunMeshStages(source);
+    RunMathStages(source);
+    RunAnimStages(source);
+    RunEndToEnd();
+
+    if (!s_csvPath.empty() && !WriteCsv(s_csvPath))
+    {
+        std::cerr << "Failed to write " << s_csvPath << "\n";
+        return 1;
+    }
+    return 0;
+}
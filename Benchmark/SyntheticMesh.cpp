@@ -0,0 +1,153 @@
+#include "SyntheticMesh.h"
+#include <algorithm>
+#include <cmath>
+
+// xorshift32: deterministic across platforms, unlike std::uniform_*_distribution
+class Random
+{
+public:
+    explicit Random(uint32_t seed) : state(seed ? seed : 0x9E3779B9u) {}
+
+    uint32_t Next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // [0, 1)
+    float NextFloat() { return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f); }
+    uint32_t NextBelow(uint32_t bound) { return static_cast<uint32_t>((static_cast<uint64_t>(Next()) * bound) >> 32); }
+
+private:
+    uint32_t state;
+};
+
+static float Height(float x, float z)
+{
+    return 0.1f * std::sin(x * 6.0f) * std::cos(z * 4.0f);
+}
+
+static Vector3 HeightNormal(float x, float z)
+{
+    float dx = 0.6f * std::cos(x * 6.0f) * std::cos(z * 4.0f);
+    float dz = -0.4f * std::sin(x * 6.0f) * std::sin(z * 4.0f);
+    return Vector3::Normalize(Vector3(-dx, 1.0f, -dz));
+}
+
+void SyntheticMesh::Generate(const Settings& settings)
+{
+    Random random(settings.seed);
+
+    // n x n quads, two triangles each
+    const size_t n = std::max<size_t>(1, static_cast<size_t>(std::ceil(std::sqrt(settings.cornerCount / 6.0))));
+    const size_t rowPoints = n + 1;
+    controlPointCount = rowPoints * rowPoints;
+    const size_t cornerCount = n * n * 6;
+
+    controlPoints.resize(controlPointCount);
+    controlNormals.resize(controlPointCount);
+    for (size_t j = 0; j < rowPoints; ++j)
+    {
+        for (size_t i = 0; i < rowPoints; ++i)
+        {
+            float x = static_cast<float>(i) / n;
+            float z = static_cast<float>(j) / n;
+            controlPoints[j * rowPoints + i] = Vector3(x, Height(x, z), z);
+            controlNormals[j * rowPoints + i] = HeightNormal(x, z);
+        }
+    }
+
+    // Every control point but the grid border is shared by six corners. Splitting the
+    // uv of a corner gives it a vertex of its own, so with a probability of split per
+    // corner the expected vertex count is controlPointCount + split * (corners - controlPointCount).
+    const float naturalUnique = static_cast<float>(controlPointCount) / cornerCount;
+    const float wantedUnique = std::min(1.0f, std::max(naturalUnique, 1.0f - settings.duplicateRatio));
+    const float split = (wantedUnique - naturalUnique) / (1.0f - naturalUnique);
+
+    cornerControlPoints.resize(cornerCount);
+    cornerPositions.resize(cornerCount);
+    cornerNormals.resize(cornerCount);
+    cornerUVs.resize(cornerCount);
+    size_t c = 0;
+    for (size_t j = 0; j < n; ++j)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            const int p00 = static_cast<int>(j * rowPoints + i);
+            const int p10 = p00 + 1;
+            const int p01 = p00 + static_cast<int>(rowPoints);
+            const int p11 = p01 + 1;
+            const int quad[6] = { p00, p10, p11, p00, p11, p01 };
+            for (int k = 0; k < 6; ++k, ++c)
+            {
+                const int cp = quad[k];
+                cornerControlPoints[c] = cp;
+                cornerPositions[c] = controlPoints[static_cast<size_t>(cp)];
+                cornerNormals[c] = controlNormals[static_cast<size_t>(cp)];
+                Vector2 uv(cornerPositions[c].x, cornerPositions[c].z);
+                if (random.NextFloat() < split)
+                    uv.x += 1.0f + static_cast<float>(c) / cornerCount; // unique, away from the grid's range
+                cornerUVs[c] = uv;
+            }
+        }
+    }
+
+    // a chain of bones along x; each control point is influenced by bones near its x
+    const uint32_t boneCount = std::max(1u, std::min(256u, settings.boneCount));
+    bones.resize(boneCount);
+    for (uint32_t b = 0; b < boneCount; ++b)
+    {
+        ItpMesh::Bone& bone = bones[b];
+        bone.name = "bone" + std::to_string(b);
+        bone.parentIndex = static_cast<int32_t>(b) - 1;
+        bone.bindPose.rot = Quaternion(0.0f, 0.0f, 0.0f, 1.0f);
+        bone.bindPose.trans = Vector3(-static_cast<float>(b) / boneCount, 0.0f, 0.0f);
+    }
+    // one control point at a time, so each is counted and added right away
+    influences.Reset(controlPointCount);
+    std::vector<uint32_t> influenceCounts(controlPointCount);
+    for (size_t cp = 0; cp < controlPointCount; ++cp)
+    {
+        influenceCounts[cp] = 1 + random.NextBelow(std::max(1u, settings.maxInfluences));
+        for (uint32_t k = 0; k < influenceCounts[cp]; ++k)
+            influences.Count(cp);
+    }
+    influences.Allocate();
+    for (size_t cp = 0; cp < controlPointCount; ++cp)
+    {
+        const uint32_t nearest = std::min(boneCount - 1, static_cast<uint32_t>(controlPoints[cp].x * boneCount));
+        for (uint32_t k = 0; k < influenceCounts[cp]; ++k)
+        {
+            uint32_t bone = std::min(boneCount - 1, nearest + random.NextBelow(4));
+            influences.Add(cp, static_cast<uint16_t>(bone), 0.05f + random.NextFloat());
+        }
+    }
+
+    // each target raises a random band of rows
+    targets.resize(settings.targetCount);
+    const size_t bandRows = std::max<size_t>(1, static_cast<size_t>(settings.targetCoverage * rowPoints));
+    for (Target& target : targets)
+    {
+        target.positions = controlPoints;
+        target.normals = controlNormals;
+        const size_t firstRow = random.NextBelow(static_cast<uint32_t>(rowPoints - std::min(rowPoints - 1, bandRows - 1)));
+        const float lift = 0.01f + 0.1f * random.NextFloat();
+        for (size_t j = firstRow; j < std::min(rowPoints, firstRow + bandRows); ++j)
+        {
+            for (size_t i = 0; i < rowPoints; ++i)
+            {
+                size_t cp = j * rowPoints + i;
+                target.positions[cp].y += lift * std::sin(static_cast<float>(i) / n * 3.14159265f);
+                target.normals[cp] = Vector3::Normalize(controlNormals[cp] + Vector3(0.0f, 0.0f, lift));
+            }
+        }
+    }
+}
+
+size_t SyntheticMesh::GetSourceBytes() const
+{
+    size_t bytes = GetCornerCount() * (sizeof(int) + 2 * sizeof(Vector3) + sizeof(Vector2));
+    bytes += influences.offsets.size() * sizeof(uint32_t) + influences.GetEntryCount() * (sizeof(uint16_t) + sizeof(float));
+    return bytes;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "ItpMesh.h"
+#include "MeshBuilder.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A procedural stand-in for the data FBX2ITP copies out of an FBX scene: a triangulated
+// height field grid given as control points and per-corner attributes, skin influences
+// per control point, a bone chain and blendshape targets.
+struct SyntheticMesh
+{
+    struct Settings
+    {
+        size_t cornerCount = 1 << 20;   // rounded up to a whole grid
+        // fraction of corners that weld to an earlier vertex, at most the grid's own
+        // (about 5/6); lower ratios come from splitting uvs at random corners
+        float duplicateRatio = 0.8f;
+        uint32_t boneCount = 64;        // at most 256
+        uint32_t maxInfluences = 6;     // per control point, before packing to 4 or 8
+        uint32_t targetCount = 16;
+        float targetCoverage = 0.2f;    // fraction of control points each target moves
+        uint32_t seed = 1;
+    };
+
+    struct Target
+    {
+        std::vector<Vector3> positions; // per control point
+        std::vector<Vector3> normals;
+    };
+
+    size_t controlPointCount = 0;
+    std::vector<Vector3> controlPoints;
+    std::vector<Vector3> controlNormals;
+
+    // corner 3 * t + k is vertex k of triangle t, source (FBX) winding
+    std::vector<int> cornerControlPoints;
+    std::vector<Vector3> cornerPositions;
+    std::vector<Vector3> cornerNormals;
+    std::vector<Vector2> cornerUVs;     // V not flipped, like the FBX
+
+    MeshBuilder::InfluenceTable influences;
+    std::vector<ItpMesh::Bone> bones;
+    std::vector<Target> targets;
+
+    void Generate(const Settings& settings);
+
+    size_t GetCornerCount() const { return cornerControlPoints.size(); }
+    // Approximate size of the source data, for MB/s figures
+    size_t GetSourceBytes() const;
+};
@@ -0,0 +1,291 @@
+#include "BuildCache.h"
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static uint64_t RotateLeft(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+void ContentHash::AddWord(uint64_t word)
+{
+    state ^= word * 0x87C37B91114253D5ull;
+    state = RotateLeft(state, 31) * 0x4CF5AD432745937Full + 0x52DCE729ull;
+}
+
+ContentHash& ContentHash::Add(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    length += size;
+    while (size > 0 && tailSize > 0)
+    {
+        tail[tailSize++] = *bytes++;
+        --size;
+        if (tailSize == sizeof(tail))
+        {
+            uint64_t word;
+            memcpy(&word, tail, sizeof(word));
+            AddWord(word);
+            tailSize = 0;
+        }
+    }
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t), bytes += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        AddWord(word);
+    }
+    memcpy(tail, bytes, size);
+    tailSize = size;
+    return *this;
+}
+
+ContentHash& ContentHash::AddString(const std::string& text)
+{
+    return AddArray(text.data(), text.size());
+}
+
+uint64_t ContentHash::Get() const
+{
+    ContentHash last = *this;
+    uint64_t word = 0;
+    memcpy(&word, tail, tailSize);
+    last.AddWord(word);
+    last.AddWord(length);
+    // murmur3 finalizer
+    uint64_t h = last.state;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+std::string ContentHash::GetHex() const
+{
+    static const char digits[] = "0123456789abcdef";
+    uint64_t h = Get();
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i, h >>= 4)
+        hex[static_cast<size_t>(i)] = digits[h & 0xF];
+    return hex;
+}
+
+bool ContentHash::AddFile(const std::string& path)
+{
+    std::ifstream ifs(path, std::ifstream::in | std::ifstream::binary);
+    if (!ifs.is_open())
+        return false;
+    std::vector<char> buffer(size_t(1) << 20);
+    while (ifs)
+    {
+        ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        Add(buffer.data(), static_cast<size_t>(ifs.gcount()));
+    }
+    return ifs.eof();
+}
+
+// Name for a temporary file or directory next to path that no other writer uses
+static std::string GetTempPath(const std::string& path)
+{
+    static std::atomic<uint32_t> counter(0);
+    ContentHash hash;
+    hash.AddValue(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    hash.AddValue(std::chrono::steady_clock::now().time_since_epoch().count());
+    hash.AddValue(counter.fetch_add(1));
+    return path + ".tmp" + hash.GetHex();
+}
+
+static bool HasSameContents(const fs::path& a, const fs::path& b)
+{
+    std::error_code ec;
+    uintmax_t size = fs::file_size(a, ec);
+    if (ec || fs::file_size(b, ec) != size || ec)
+        return false;
+    std::ifstream fa(a, std::ifstream::in | std::ifstream::binary);
+    std::ifstream fb(b, std::ifstream::in | std::ifstream::binary);
+    std::vector<char> bufferA(size_t(64) << 10), bufferB(size_t(64) << 10);
+    while (fa && fb)
+    {
+        fa.read(bufferA.data(), static_cast<std::streamsize>(bufferA.size()));
+        fb.read(bufferB.data(), static_cast<std::streamsize>(bufferB.size()));
+        if (fa.gcount() != fb.gcount() || memcmp(bufferA.data(), bufferB.data(), static_cast<size_t>(fa.gcount())) != 0)
+            return false;
+    }
+    return fa.eof() && fb.eof();
+}
+
+// Reads "key value" lines after the "itpcache <version>" line; false on another version
+static bool ReadEntryLines(const fs::path& path, std::vector<std::pair<std::string, std::string>>& lines)
+{
+    std::ifstream ifs(path);
+    std::string line;
+    if (!std::getline(ifs, line) || line != "itpcache " + std::to_string(BuildCache::Version))
+        return false;
+    while (std::getline(ifs, line))
+    {
+        size_t space = line.find(' ');
+        if (space == std::string::npos)
+            lines.emplace_back(line, std::string());
+        else
+            lines.emplace_back(line.substr(0, space), line.substr(space + 1));
+    }
+    return true;
+}
+
+// A count written by StoreMesh; false for an empty, truncated or out of range value
+static bool ParseCount(const std::string& text, size_t& value)
+{
+    unsigned long long parsed = 0;
+    const char* end = text.data() + text.size();
+    const std::from_chars_result result = std::from_chars(text.data(), end, parsed);
+    if (result.ec != std::errc() || result.ptr != end || parsed > SIZE_MAX)
+        return false;
+    value = static_cast<size_t>(parsed);
+    return true;
+}
+
+BuildCache::BuildCache(const std::string& directory)
+    : directory(directory)
+{
+}
+
+std::string BuildCache::GetMeshDirectory(const std::string& meshKey) const
+{
+    return (fs::path(directory) / "meshes" / meshKey).string();
+}
+
+bool BuildCache::LoadFile(const std::string& fileKey, std::vector<std::string>& meshKeys) const
+{
+    std::vector<std::pair<std::string, std::string>> lines;
+    if (!ReadEntryLines(fs::path(directory) / "files" / (fileKey + ".txt"), lines))
+        return false;
+    meshKeys.clear();
+    for (const auto& line : lines)
+    {
+        if (line.first == "mesh")
+            meshKeys.push_back(line.second);
+    }
+    return true;
+}
+
+bool BuildCache::StoreFile(const std::string& fileKey, const std::vector<std::string>& meshKeys) const
+{
+    std::error_code ec;
+    fs::path filesDir = fs::path(directory) / "files";
+    fs::create_directories(filesDir, ec);
+    std::string path = (filesDir / (fileKey + ".txt")).string();
+    std::string tempPath = GetTempPath(path);
+    {
+        std::ofstream ofs(tempPath, std::ofstream::out | std::ofstream::trunc);
+        if (!ofs.is_open())
+            return false;
+        ofs << "itpcache " << Version << "\n";
+        for (const std::string& key : meshKeys)
+            ofs << "mesh " << key << "\n";
+        if (!ofs)
+            return false;
+    }
+    fs::rename(tempPath, path, ec);
+    if (ec)
+        fs::remove(tempPath, ec);
+    return !ec;
+}
+
+bool BuildCache::LoadMesh(const std::string& meshKey, MeshEntry& entry) const
+{
+    std::vector<std::pair<std::string, std::string>> lines;
+    if (!ReadEntryLines(fs::path(GetMeshDirectory(meshKey)) / "entry.txt", lines))
+        return false;
+    entry = MeshEntry();
+    entry.key = meshKey;
+    bool hasVertices = false;
+    bool hasTriangles = false;
+    for (const auto& line : lines)
+    {
+        if (line.first == "name")
+            entry.name = line.second;
+        else if (line.first == "vertices")
+            hasVertices = ParseCount(line.second, entry.vertexCount);
+        else if (line.first == "triangles")
+            hasTriangles = ParseCount(line.second, entry.triangleCount);
+        else if (line.first == "file")
+            entry.files.push_back(line.second);
+    }
+    // a damaged entry is a miss; the mesh is rebuilt and StoreMesh replaces it
+    return hasVertices && hasTriangles;
+}
+
+bool BuildCache::StoreMesh(const MeshEntry& entry) const
+{
+    std::error_code ec;
+    const fs::path meshDir = GetMeshDirectory(entry.key);
+    if (fs::exists(meshDir / "entry.txt", ec))
+    {
+        MeshEntry existing;
+        if (LoadMesh(entry.key, existing))
+            return true;
+        fs::remove_all(meshDir, ec);
+    }
+    fs::create_directories(meshDir.parent_path(), ec);
+
+    // fill a private directory, then publish it with one rename
+    const fs::path tempDir = GetTempPath(meshDir.string());
+    fs::create_directory(tempDir, ec);
+    bool ok = !ec;
+    for (size_t i = 0; ok && i < entry.files.size(); ++i)
+    {
+        fs::copy_file(entry.files[i], tempDir / std::to_string(i), fs::copy_options::overwrite_existing, ec);
+        ok = !ec;
+    }
+    if (ok)
+    {
+        std::ofstream ofs(tempDir / "entry.txt", std::ofstream::out | std::ofstream::trunc);
+        ofs << "itpcache " << Version << "\n"
+            << "name " << entry.name << "\n"
+            << "vertices " << entry.vertexCount << "\n"
+            << "triangles " << entry.triangleCount << "\n";
+        for (const std::string& file : entry.files)
+            ofs << "file " << file << "\n";
+        ok = static_cast<bool>(ofs);
+    }
+    if (ok)
+    {
+        fs::rename(tempDir, meshDir, ec);
+        ok = !ec || fs::exists(meshDir / "entry.txt", ec); // another writer got there first
+    }
+    fs::remove_all(tempDir, ec);
+    return ok;
+}
+
+bool BuildCache::RestoreMesh(const MeshEntry& entry, size_t& written) const
+{
+    written = 0;
+    std::error_code ec;
+    const fs::path meshDir = GetMeshDirectory(entry.key);
+    for (size_t i = 0; i < entry.files.size(); ++i)
+    {
+        if (!fs::is_regular_file(meshDir / std::to_string(i), ec))
+            return false;
+    }
+    for (size_t i = 0; i < entry.files.size(); ++i)
+    {
+        const fs::path cached = meshDir / std::to_string(i);
+        if (HasSameContents(cached, entry.files[i]))
+            continue;
+        fs::copy_file(cached, entry.files[i], fs::copy_options::overwrite_existing, ec);
+        if (ec)
+            return false;
+        ++written;
+    }
+    return true;
+}
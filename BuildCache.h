@@ -0,0 +1,81 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 64-bit streaming hash for cache keys: fast, not cryptographic. The same bytes give the
+// same value however they are split across Add calls.
+class ContentHash
+{
+public:
+    ContentHash& Add(const void* data, size_t size);
+    template<typename T>
+    ContentHash& AddValue(const T& value) { return Add(&value, sizeof(value)); }
+    // length-prefixed, so "ab" + "c" and "a" + "bc" differ
+    ContentHash& AddString(const std::string& text);
+    template<typename T>
+    ContentHash& AddArray(const T* values, size_t count)
+    {
+        AddValue(static_cast<uint64_t>(count));
+        return Add(values, count * sizeof(T));
+    }
+
+    uint64_t Get() const;
+    std::string GetHex() const; // 16 lowercase hex digits
+
+    // Adds the bytes of a file; false if it can't be read
+    bool AddFile(const std::string& path);
+
+private:
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    uint64_t length = 0;
+    uint8_t tail[8] = {};
+    size_t tailSize = 0;
+
+    void AddWord(uint64_t word);
+};
+
+// On-disk cache of converter outputs (-cache dir). Keys include the converter options
+// and BuildCache::Version, so any setting that changes output bytes misses.
+//   dir/files/<key>.txt    file entry: the mesh keys of one input file, keyed by its bytes
+//   dir/meshes/<key>/      mesh entry: entry.txt plus a copy of every file the mesh wrote,
+//                          keyed by the mesh's source data
+// A file hit restores every mesh without importing the FBX. After a file miss each mesh
+// is still looked up on its own, so editing one mesh only converts that one. Restoring
+// leaves outputs that already hold the cached bytes untouched.
+class BuildCache
+{
+public:
+    // bump whenever a converter change alters the bytes of any output file
+    static const uint32_t Version = 3;
+
+    struct MeshEntry
+    {
+        std::string key;
+        std::string name;                   // mesh name, for the log
+        size_t vertexCount = 0;
+        size_t triangleCount = 0;
+        std::vector<std::string> files;     // output paths as the converter wrote them
+    };
+
+    explicit BuildCache(const std::string& directory);
+
+    bool LoadFile(const std::string& fileKey, std::vector<std::string>& meshKeys) const;
+    bool StoreFile(const std::string& fileKey, const std::vector<std::string>& meshKeys) const;
+
+    // False when the entry is missing or damaged (a count field absent or malformed)
+    bool LoadMesh(const std::string& meshKey, MeshEntry& entry) const;
+    // Copies entry.files into a new mesh entry, replacing one LoadMesh can't read; safe
+    // to call for the same key from several threads or processes, the first complete
+    // copy wins
+    bool StoreMesh(const MeshEntry& entry) const;
+    // Copies the cached files back to their output paths; written counts the files that
+    // had to be rewritten. False if the entry is incomplete.
+    bool RestoreMesh(const MeshEntry& entry, size_t& written) const;
+
+private:
+    std::string directory;
+
+    std::string GetMeshDirectory(const std::string& meshKey) const;
+};
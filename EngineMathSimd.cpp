@@ -0,0 +1,716 @@
+#include "EngineMathSimd.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_ARM64) || defined(__aarch64__) || defined(__arm64__)
+#define ITP_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define ITP_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define ITP_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define ITP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Keep a * b + c as two roundings in the scalar paths too, so they match the vector paths
+#if defined(__clang__)
+#pragma clang fp contract(off)
+#endif
+
+// The kernels all take the same arguments so the dispatch can switch on the path.
+// The vector kernels run whole registers and leave the tail (from index i) to the
+// scalar kernel.
+struct TransformArgs
+{
+    float m[3][3];      // rotation/scale rows 0-2, columns 0-2
+    float t[3];         // w * row 3
+};
+
+static TransformArgs MakeTransformArgs(const Matrix4& mat, float w)
+{
+    TransformArgs args;
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+            args.m[r][c] = mat.mat[r][c];
+    }
+    for (int c = 0; c < 3; ++c)
+        args.t[c] = w * mat.mat[3][c];
+    return args;
+}
+
+//------------------------------------------------------------------------------------
+// Scalar
+//------------------------------------------------------------------------------------
+
+static void TransformScalar(const TransformArgs& a, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t i, size_t count)
+{
+    for (; i < count; ++i)
+    {
+        float vx = x[i], vy = y[i], vz = z[i];
+        outX[i] = vx * a.m[0][0] + vy * a.m[1][0] + vz * a.m[2][0] + a.t[0];
+        outY[i] = vx * a.m[0][1] + vy * a.m[1][1] + vz * a.m[2][1] + a.t[1];
+        outZ[i] = vx * a.m[0][2] + vy * a.m[1][2] + vz * a.m[2][2] + a.t[2];
+    }
+}
+
+static void RotateScalar(const Quaternion& q, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t i, size_t count)
+{
+    // v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v), as Quaternion::Transform
+    for (; i < count; ++i)
+    {
+        float vx = x[i], vy = y[i], vz = z[i];
+        float tx = (q.y * vz - q.z * vy) + q.w * vx;
+        float ty = (q.z * vx - q.x * vz) + q.w * vy;
+        float tz = (q.x * vy - q.y * vx) + q.w * vz;
+        outX[i] = vx + 2.0f * (q.y * tz - q.z * ty);
+        outY[i] = vy + 2.0f * (q.z * tx - q.x * tz);
+        outZ[i] = vz + 2.0f * (q.x * ty - q.y * tx);
+    }
+}
+
+static void NormalizeScalar(float* x, float* y, float* z, size_t i, size_t count)
+{
+    for (; i < count; ++i)
+    {
+        float lengthSq = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+        float inv = lengthSq > 0.0f ? 1.0f / sqrtf(lengthSq) : 0.0f;
+        x[i] *= inv;
+        y[i] *= inv;
+        z[i] *= inv;
+    }
+}
+
+static void BoundsScalar(const float* x, const float* y, const float* z, size_t i, size_t count,
+    float outMin[3], float outMax[3])
+{
+    for (; i < count; ++i)
+    {
+        outMin[0] = Math::Min(outMin[0], x[i]);
+        outMin[1] = Math::Min(outMin[1], y[i]);
+        outMin[2] = Math::Min(outMin[2], z[i]);
+        outMax[0] = Math::Max(outMax[0], x[i]);
+        outMax[1] = Math::Max(outMax[1], y[i]);
+        outMax[2] = Math::Max(outMax[2], z[i]);
+    }
+}
+
+static void NormalizeWeightsScalar(float* const* weights, size_t slotCount, float scale, size_t i, size_t count)
+{
+    for (; i < count; ++i)
+    {
+        float total = 0.0f;
+        for (size_t k = 0; k < slotCount; ++k)
+            total += weights[k][i];
+        float inv = total > 0.0f ? scale / total : 0.0f;
+        for (size_t k = 0; k < slotCount; ++k)
+            weights[k][i] *= inv;
+    }
+}
+
+#if ITP_SIMD_X86
+//------------------------------------------------------------------------------------
+// SSE, 4 lanes
+//------------------------------------------------------------------------------------
+
+static size_t TransformSSE(const TransformArgs& a, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    __m128 m[3][3];
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+            m[r][c] = _mm_set1_ps(a.m[r][c]);
+    }
+    const __m128 t0 = _mm_set1_ps(a.t[0]), t1 = _mm_set1_ps(a.t[1]), t2 = _mm_set1_ps(a.t[2]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m[0][0]), _mm_mul_ps(vy, m[1][0])), _mm_mul_ps(vz, m[2][0])), t0);
+        __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m[0][1]), _mm_mul_ps(vy, m[1][1])), _mm_mul_ps(vz, m[2][1])), t1);
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, m[0][2]), _mm_mul_ps(vy, m[1][2])), _mm_mul_ps(vz, m[2][2])), t2);
+        _mm_storeu_ps(outX + i, rx);
+        _mm_storeu_ps(outY + i, ry);
+        _mm_storeu_ps(outZ + i, rz);
+    }
+    return i;
+}
+
+static size_t RotateSSE(const Quaternion& q, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const __m128 qx = _mm_set1_ps(q.x), qy = _mm_set1_ps(q.y), qz = _mm_set1_ps(q.z), qw = _mm_set1_ps(q.w);
+    const __m128 two = _mm_set1_ps(2.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+        __m128 tx = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qy, vz), _mm_mul_ps(qz, vy)), _mm_mul_ps(qw, vx));
+        __m128 ty = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qz, vx), _mm_mul_ps(qx, vz)), _mm_mul_ps(qw, vy));
+        __m128 tz = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qx, vy), _mm_mul_ps(qy, vx)), _mm_mul_ps(qw, vz));
+        _mm_storeu_ps(outX + i, _mm_add_ps(vx, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qy, tz), _mm_mul_ps(qz, ty)))));
+        _mm_storeu_ps(outY + i, _mm_add_ps(vy, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qz, tx), _mm_mul_ps(qx, tz)))));
+        _mm_storeu_ps(outZ + i, _mm_add_ps(vz, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, ty), _mm_mul_ps(qy, tx)))));
+    }
+    return i;
+}
+
+static size_t NormalizeSSE(float* x, float* y, float* z, size_t count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+        __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        __m128 inv = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(lengthSq)), _mm_cmpgt_ps(lengthSq, zero));
+        _mm_storeu_ps(x + i, _mm_mul_ps(vx, inv));
+        _mm_storeu_ps(y + i, _mm_mul_ps(vy, inv));
+        _mm_storeu_ps(z + i, _mm_mul_ps(vz, inv));
+    }
+    return i;
+}
+
+static size_t NormalizeWeightsSSE(float* const* weights, size_t slotCount, float scale, size_t count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 vscale = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 total = zero;
+        for (size_t k = 0; k < slotCount; ++k)
+            total = _mm_add_ps(total, _mm_loadu_ps(weights[k] + i));
+        __m128 inv = _mm_and_ps(_mm_div_ps(vscale, total), _mm_cmpgt_ps(total, zero));
+        for (size_t k = 0; k < slotCount; ++k)
+            _mm_storeu_ps(weights[k] + i, _mm_mul_ps(_mm_loadu_ps(weights[k] + i), inv));
+    }
+    return i;
+}
+
+static size_t BoundsSSE(const float* x, const float* y, const float* z, size_t count, float outMin[3], float outMax[3])
+{
+    if (count < 4)
+        return 0;
+    __m128 minX = _mm_loadu_ps(x), minY = _mm_loadu_ps(y), minZ = _mm_loadu_ps(z);
+    __m128 maxX = minX, maxY = minY, maxZ = minZ;
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i), vz = _mm_loadu_ps(z + i);
+        minX = _mm_min_ps(minX, vx);
+        minY = _mm_min_ps(minY, vy);
+        minZ = _mm_min_ps(minZ, vz);
+        maxX = _mm_max_ps(maxX, vx);
+        maxY = _mm_max_ps(maxY, vy);
+        maxZ = _mm_max_ps(maxZ, vz);
+    }
+    float lanes[6][4];
+    _mm_storeu_ps(lanes[0], minX);
+    _mm_storeu_ps(lanes[1], minY);
+    _mm_storeu_ps(lanes[2], minZ);
+    _mm_storeu_ps(lanes[3], maxX);
+    _mm_storeu_ps(lanes[4], maxY);
+    _mm_storeu_ps(lanes[5], maxZ);
+    for (int l = 0; l < 4; ++l)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            outMin[c] = Math::Min(outMin[c], lanes[c][l]);
+            outMax[c] = Math::Max(outMax[c], lanes[3 + c][l]);
+        }
+    }
+    return i;
+}
+
+//------------------------------------------------------------------------------------
+// AVX2, 8 lanes
+//------------------------------------------------------------------------------------
+
+ITP_TARGET_AVX2 static size_t TransformAVX2(const TransformArgs& a, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    __m256 m[3][3];
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+            m[r][c] = _mm256_set1_ps(a.m[r][c]);
+    }
+    const __m256 t0 = _mm256_set1_ps(a.t[0]), t1 = _mm256_set1_ps(a.t[1]), t2 = _mm256_set1_ps(a.t[2]);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m[0][0]), _mm256_mul_ps(vy, m[1][0])), _mm256_mul_ps(vz, m[2][0])), t0);
+        __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m[0][1]), _mm256_mul_ps(vy, m[1][1])), _mm256_mul_ps(vz, m[2][1])), t1);
+        __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, m[0][2]), _mm256_mul_ps(vy, m[1][2])), _mm256_mul_ps(vz, m[2][2])), t2);
+        _mm256_storeu_ps(outX + i, rx);
+        _mm256_storeu_ps(outY + i, ry);
+        _mm256_storeu_ps(outZ + i, rz);
+    }
+    return i;
+}
+
+ITP_TARGET_AVX2 static size_t RotateAVX2(const Quaternion& q, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const __m256 qx = _mm256_set1_ps(q.x), qy = _mm256_set1_ps(q.y), qz = _mm256_set1_ps(q.z), qw = _mm256_set1_ps(q.w);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        __m256 tx = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(qy, vz), _mm256_mul_ps(qz, vy)), _mm256_mul_ps(qw, vx));
+        __m256 ty = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(qz, vx), _mm256_mul_ps(qx, vz)), _mm256_mul_ps(qw, vy));
+        __m256 tz = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(qx, vy), _mm256_mul_ps(qy, vx)), _mm256_mul_ps(qw, vz));
+        _mm256_storeu_ps(outX + i, _mm256_add_ps(vx, _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(qy, tz), _mm256_mul_ps(qz, ty)))));
+        _mm256_storeu_ps(outY + i, _mm256_add_ps(vy, _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(qz, tx), _mm256_mul_ps(qx, tz)))));
+        _mm256_storeu_ps(outZ + i, _mm256_add_ps(vz, _mm256_mul_ps(two, _mm256_sub_ps(_mm256_mul_ps(qx, ty), _mm256_mul_ps(qy, tx)))));
+    }
+    return i;
+}
+
+ITP_TARGET_AVX2 static size_t NormalizeAVX2(float* x, float* y, float* z, size_t count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        __m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+        __m256 inv = _mm256_and_ps(_mm256_div_ps(one, _mm256_sqrt_ps(lengthSq)), _mm256_cmp_ps(lengthSq, zero, _CMP_GT_OQ));
+        _mm256_storeu_ps(x + i, _mm256_mul_ps(vx, inv));
+        _mm256_storeu_ps(y + i, _mm256_mul_ps(vy, inv));
+        _mm256_storeu_ps(z + i, _mm256_mul_ps(vz, inv));
+    }
+    return i;
+}
+
+ITP_TARGET_AVX2 static size_t NormalizeWeightsAVX2(float* const* weights, size_t slotCount, float scale, size_t count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 vscale = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 total = zero;
+        for (size_t k = 0; k < slotCount; ++k)
+            total = _mm256_add_ps(total, _mm256_loadu_ps(weights[k] + i));
+        __m256 inv = _mm256_and_ps(_mm256_div_ps(vscale, total), _mm256_cmp_ps(total, zero, _CMP_GT_OQ));
+        for (size_t k = 0; k < slotCount; ++k)
+            _mm256_storeu_ps(weights[k] + i, _mm256_mul_ps(_mm256_loadu_ps(weights[k] + i), inv));
+    }
+    return i;
+}
+
+ITP_TARGET_AVX2 static size_t BoundsAVX2(const float* x, const float* y, const float* z, size_t count, float outMin[3], float outMax[3])
+{
+    if (count < 8)
+        return 0;
+    __m256 minX = _mm256_loadu_ps(x), minY = _mm256_loadu_ps(y), minZ = _mm256_loadu_ps(z);
+    __m256 maxX = minX, maxY = minY, maxZ = minZ;
+    size_t i = 8;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i), vz = _mm256_loadu_ps(z + i);
+        minX = _mm256_min_ps(minX, vx);
+        minY = _mm256_min_ps(minY, vy);
+        minZ = _mm256_min_ps(minZ, vz);
+        maxX = _mm256_max_ps(maxX, vx);
+        maxY = _mm256_max_ps(maxY, vy);
+        maxZ = _mm256_max_ps(maxZ, vz);
+    }
+    float lanes[6][8];
+    _mm256_storeu_ps(lanes[0], minX);
+    _mm256_storeu_ps(lanes[1], minY);
+    _mm256_storeu_ps(lanes[2], minZ);
+    _mm256_storeu_ps(lanes[3], maxX);
+    _mm256_storeu_ps(lanes[4], maxY);
+    _mm256_storeu_ps(lanes[5], maxZ);
+    for (int l = 0; l < 8; ++l)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            outMin[c] = Math::Min(outMin[c], lanes[c][l]);
+            outMax[c] = Math::Max(outMax[c], lanes[3 + c][l]);
+        }
+    }
+    return i;
+}
+
+static bool CpuHasAVX2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) // the OS saves the ymm registers
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    const bool osxsave = (ecx & (1u << 27)) != 0;
+    const bool avx = (ecx & (1u << 28)) != 0;
+    if (!osxsave || !avx)
+        return false;
+    unsigned xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    if ((xcr0Low & 6) != 6) // the OS saves the ymm registers
+        return false;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ebx & (1u << 5)) != 0;
+#endif
+}
+#endif // ITP_SIMD_X86
+
+#if ITP_SIMD_NEON
+//------------------------------------------------------------------------------------
+// NEON, 4 lanes
+//------------------------------------------------------------------------------------
+
+static size_t TransformNEON(const TransformArgs& a, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    float32x4_t m[3][3];
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 3; ++c)
+            m[r][c] = vdupq_n_f32(a.m[r][c]);
+    }
+    const float32x4_t t0 = vdupq_n_f32(a.t[0]), t1 = vdupq_n_f32(a.t[1]), t2 = vdupq_n_f32(a.t[2]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t vx = vld1q_f32(x + i), vy = vld1q_f32(y + i), vz = vld1q_f32(z + i);
+        float32x4_t rx = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(vx, m[0][0]), vmulq_f32(vy, m[1][0])), vmulq_f32(vz, m[2][0])), t0);
+        float32x4_t ry = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(vx, m[0][1]), vmulq_f32(vy, m[1][1])), vmulq_f32(vz, m[2][1])), t1);
+        float32x4_t rz = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(vx, m[0][2]), vmulq_f32(vy, m[1][2])), vmulq_f32(vz, m[2][2])), t2);
+        vst1q_f32(outX + i, rx);
+        vst1q_f32(outY + i, ry);
+        vst1q_f32(outZ + i, rz);
+    }
+    return i;
+}
+
+static size_t RotateNEON(const Quaternion& q, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const float32x4_t qx = vdupq_n_f32(q.x), qy = vdupq_n_f32(q.y), qz = vdupq_n_f32(q.z), qw = vdupq_n_f32(q.w);
+    const float32x4_t two = vdupq_n_f32(2.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t vx = vld1q_f32(x + i), vy = vld1q_f32(y + i), vz = vld1q_f32(z + i);
+        float32x4_t tx = vaddq_f32(vsubq_f32(vmulq_f32(qy, vz), vmulq_f32(qz, vy)), vmulq_f32(qw, vx));
+        float32x4_t ty = vaddq_f32(vsubq_f32(vmulq_f32(qz, vx), vmulq_f32(qx, vz)), vmulq_f32(qw, vy));
+        float32x4_t tz = vaddq_f32(vsubq_f32(vmulq_f32(qx, vy), vmulq_f32(qy, vx)), vmulq_f32(qw, vz));
+        vst1q_f32(outX + i, vaddq_f32(vx, vmulq_f32(two, vsubq_f32(vmulq_f32(qy, tz), vmulq_f32(qz, ty)))));
+        vst1q_f32(outY + i, vaddq_f32(vy, vmulq_f32(two, vsubq_f32(vmulq_f32(qz, tx), vmulq_f32(qx, tz)))));
+        vst1q_f32(outZ + i, vaddq_f32(vz, vmulq_f32(two, vsubq_f32(vmulq_f32(qx, ty), vmulq_f32(qy, tx)))));
+    }
+    return i;
+}
+
+static size_t NormalizeNEON(float* x, float* y, float* z, size_t count)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t vx = vld1q_f32(x + i), vy = vld1q_f32(y + i), vz = vld1q_f32(z + i);
+        float32x4_t lengthSq = vaddq_f32(vaddq_f32(vmulq_f32(vx, vx), vmulq_f32(vy, vy)), vmulq_f32(vz, vz));
+        uint32x4_t positive = vcgtq_f32(lengthSq, zero);
+        float32x4_t inv = vbslq_f32(positive, vdivq_f32(one, vsqrtq_f32(lengthSq)), zero);
+        vst1q_f32(x + i, vmulq_f32(vx, inv));
+        vst1q_f32(y + i, vmulq_f32(vy, inv));
+        vst1q_f32(z + i, vmulq_f32(vz, inv));
+    }
+    return i;
+}
+
+static size_t NormalizeWeightsNEON(float* const* weights, size_t slotCount, float scale, size_t count)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t total = zero;
+        for (size_t k = 0; k < slotCount; ++k)
+            total = vaddq_f32(total, vld1q_f32(weights[k] + i));
+        uint32x4_t positive = vcgtq_f32(total, zero);
+        float32x4_t inv = vbslq_f32(positive, vdivq_f32(vscale, total), zero);
+        for (size_t k = 0; k < slotCount; ++k)
+            vst1q_f32(weights[k] + i, vmulq_f32(vld1q_f32(weights[k] + i), inv));
+    }
+    return i;
+}
+
+static size_t BoundsNEON(const float* x, const float* y, const float* z, size_t count, float outMin[3], float outMax[3])
+{
+    if (count < 4)
+        return 0;
+    float32x4_t minX = vld1q_f32(x), minY = vld1q_f32(y), minZ = vld1q_f32(z);
+    float32x4_t maxX = minX, maxY = minY, maxZ = minZ;
+    size_t i = 4;
+    for (; i + 4 <= count; i += 4)
+    {
+        float32x4_t vx = vld1q_f32(x + i), vy = vld1q_f32(y + i), vz = vld1q_f32(z + i);
+        minX = vminq_f32(minX, vx);
+        minY = vminq_f32(minY, vy);
+        minZ = vminq_f32(minZ, vz);
+        maxX = vmaxq_f32(maxX, vx);
+        maxY = vmaxq_f32(maxY, vy);
+        maxZ = vmaxq_f32(maxZ, vz);
+    }
+    outMin[0] = Math::Min(outMin[0], vminvq_f32(minX));
+    outMin[1] = Math::Min(outMin[1], vminvq_f32(minY));
+    outMin[2] = Math::Min(outMin[2], vminvq_f32(minZ));
+    outMax[0] = Math::Max(outMax[0], vmaxvq_f32(maxX));
+    outMax[1] = Math::Max(outMax[1], vmaxvq_f32(maxY));
+    outMax[2] = Math::Max(outMax[2], vmaxvq_f32(maxZ));
+    return i;
+}
+#endif // ITP_SIMD_NEON
+
+//------------------------------------------------------------------------------------
+// Dispatch
+//------------------------------------------------------------------------------------
+
+static bool IsSupported(MathSimd::Isa isa)
+{
+    switch (isa)
+    {
+    case MathSimd::Isa::Scalar:
+        return true;
+#if ITP_SIMD_X86
+    case MathSimd::Isa::SSE:
+        return true; // x64 baseline
+    case MathSimd::Isa::AVX2:
+    {
+        static const bool hasAVX2 = CpuHasAVX2();
+        return hasAVX2;
+    }
+#endif
+#if ITP_SIMD_NEON
+    case MathSimd::Isa::NEON:
+        return true; // arm64 baseline
+#endif
+    default:
+        return false;
+    }
+}
+
+static MathSimd::Isa& CurrentIsa()
+{
+    static MathSimd::Isa isa = IsSupported(MathSimd::Isa::AVX2) ? MathSimd::Isa::AVX2
+        : IsSupported(MathSimd::Isa::SSE) ? MathSimd::Isa::SSE
+        : IsSupported(MathSimd::Isa::NEON) ? MathSimd::Isa::NEON
+        : MathSimd::Isa::Scalar;
+    return isa;
+}
+
+MathSimd::Isa MathSimd::GetIsa()
+{
+    return CurrentIsa();
+}
+
+const char* MathSimd::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::SSE: return "SSE";
+    case Isa::AVX2: return "AVX2";
+    case Isa::NEON: return "NEON";
+    default: return "scalar";
+    }
+}
+
+bool MathSimd::SetIsa(Isa isa)
+{
+    if (!IsSupported(isa))
+        return false;
+    CurrentIsa() = isa;
+    return true;
+}
+
+static void Transform(const TransformArgs& args, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    size_t i = 0;
+    switch (CurrentIsa())
+    {
+#if ITP_SIMD_X86
+    case MathSimd::Isa::AVX2: i = TransformAVX2(args, x, y, z, outX, outY, outZ, count); break;
+    case MathSimd::Isa::SSE: i = TransformSSE(args, x, y, z, outX, outY, outZ, count); break;
+#endif
+#if ITP_SIMD_NEON
+    case MathSimd::Isa::NEON: i = TransformNEON(args, x, y, z, outX, outY, outZ, count); break;
+#endif
+    default: break;
+    }
+    TransformScalar(args, x, y, z, outX, outY, outZ, i, count);
+}
+
+void MathSimd::TransformPoints(const Matrix4& mat, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    Transform(MakeTransformArgs(mat, 1.0f), x, y, z, outX, outY, outZ, count);
+}
+
+void MathSimd::TransformVectors(const Matrix4& mat, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    Transform(MakeTransformArgs(mat, 0.0f), x, y, z, outX, outY, outZ, count);
+}
+
+void MathSimd::RotateVectors(const Quaternion& q, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    size_t i = 0;
+    switch (CurrentIsa())
+    {
+#if ITP_SIMD_X86
+    case Isa::AVX2: i = RotateAVX2(q, x, y, z, outX, outY, outZ, count); break;
+    case Isa::SSE: i = RotateSSE(q, x, y, z, outX, outY, outZ, count); break;
+#endif
+#if ITP_SIMD_NEON
+    case Isa::NEON: i = RotateNEON(q, x, y, z, outX, outY, outZ, count); break;
+#endif
+    default: break;
+    }
+    RotateScalar(q, x, y, z, outX, outY, outZ, i, count);
+}
+
+void MathSimd::NormalizeVectors(float* x, float* y, float* z, size_t count)
+{
+    size_t i = 0;
+    switch (CurrentIsa())
+    {
+#if ITP_SIMD_X86
+    case Isa::AVX2: i = NormalizeAVX2(x, y, z, count); break;
+    case Isa::SSE: i = NormalizeSSE(x, y, z, count); break;
+#endif
+#if ITP_SIMD_NEON
+    case Isa::NEON: i = NormalizeNEON(x, y, z, count); break;
+#endif
+    default: break;
+    }
+    NormalizeScalar(x, y, z, i, count);
+}
+
+void MathSimd::NormalizeWeights(float* const* weights, size_t slotCount, size_t count, float scale)
+{
+    size_t i = 0;
+    switch (CurrentIsa())
+    {
+#if ITP_SIMD_X86
+    case Isa::AVX2: i = NormalizeWeightsAVX2(weights, slotCount, scale, count); break;
+    case Isa::SSE: i = NormalizeWeightsSSE(weights, slotCount, scale, count); break;
+#endif
+#if ITP_SIMD_NEON
+    case Isa::NEON: i = NormalizeWeightsNEON(weights, slotCount, scale, count); break;
+#endif
+    default: break;
+    }
+    NormalizeWeightsScalar(weights, slotCount, scale, i, count);
+}
+
+void MathSimd::ComputeBounds(const float* x, const float* y, const float* z, size_t count,
+    Vector3& outMin, Vector3& outMax)
+{
+    float boundsMin[3] = { x[0], y[0], z[0] };
+    float boundsMax[3] = { x[0], y[0], z[0] };
+    size_t i = 0;
+    switch (CurrentIsa())
+    {
+#if ITP_SIMD_X86
+    case Isa::AVX2: i = BoundsAVX2(x, y, z, count, boundsMin, boundsMax); break;
+    case Isa::SSE: i = BoundsSSE(x, y, z, count, boundsMin, boundsMax); break;
+#endif
+#if ITP_SIMD_NEON
+    case Isa::NEON: i = BoundsNEON(x, y, z, count, boundsMin, boundsMax); break;
+#endif
+    default: break;
+    }
+    BoundsScalar(x, y, z, i, count, boundsMin, boundsMax);
+    outMin.Set(boundsMin[0], boundsMin[1], boundsMin[2]);
+    outMax.Set(boundsMax[0], boundsMax[1], boundsMax[2]);
+}
+
+static const size_t s_blockSize = 256;
+
+static void Deinterleave(const float* xyz, size_t strideBytes, size_t count, float* x, float* y, float* z)
+{
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(xyz);
+    for (size_t i = 0; i < count; ++i, src += strideBytes)
+    {
+        const float* v = reinterpret_cast<const float*>(src);
+        x[i] = v[0];
+        y[i] = v[1];
+        z[i] = v[2];
+    }
+}
+
+void MathSimd::NormalizeVectorsStrided(float* xyz, size_t strideBytes, size_t count)
+{
+    float x[s_blockSize], y[s_blockSize], z[s_blockSize];
+    uint8_t* base = reinterpret_cast<uint8_t*>(xyz);
+    for (size_t first = 0; first < count; first += s_blockSize)
+    {
+        size_t n = Math::Min(s_blockSize, count - first);
+        Deinterleave(reinterpret_cast<const float*>(base + first * strideBytes), strideBytes, n, x, y, z);
+        NormalizeVectors(x, y, z, n);
+        uint8_t* dst = base + first * strideBytes;
+        for (size_t i = 0; i < n; ++i, dst += strideBytes)
+        {
+            float* v = reinterpret_cast<float*>(dst);
+            v[0] = x[i];
+            v[1] = y[i];
+            v[2] = z[i];
+        }
+    }
+}
+
+void MathSimd::ComputeBoundsStrided(const float* xyz, size_t strideBytes, size_t count,
+    Vector3& outMin, Vector3& outMax)
+{
+    float x[s_blockSize], y[s_blockSize], z[s_blockSize];
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(xyz);
+    for (size_t first = 0; first < count; first += s_blockSize)
+    {
+        size_t n = Math::Min(s_blockSize, count - first);
+        Deinterleave(reinterpret_cast<const float*>(base + first * strideBytes), strideBytes, n, x, y, z);
+        Vector3 blockMin, blockMax;
+        ComputeBounds(x, y, z, n, blockMin, blockMax);
+        if (first == 0)
+        {
+            outMin = blockMin;
+            outMax = blockMax;
+        }
+        else
+        {
+            outMin.Set(Math::Min(outMin.x, blockMin.x), Math::Min(outMin.y, blockMin.y), Math::Min(outMin.z, blockMin.z));
+            outMax.Set(Math::Max(outMax.x, blockMax.x), Math::Max(outMax.y, blockMax.y), Math::Max(outMax.z, blockMax.z));
+        }
+    }
+}
@@ -0,0 +1,52 @@
+// engineMathSimd.h
+// Batch versions of the EngineMath transforms for whole vertex streams
+
+#pragma once
+
+#include "EngineMath.h"
+#include <cstddef>
+
+// Kernels over structure-of-arrays float streams (separate x, y and z arrays of count
+// values). The widest instruction set the CPU supports (AVX2, SSE or NEON) is picked
+// on first use. Every path does the same float operations in the same order, without
+// fused multiply-adds, so results are bit-identical whichever path runs.
+namespace MathSimd
+{
+	enum class Isa
+	{
+		Scalar,
+		SSE,
+		AVX2,
+		NEON,
+	};
+
+	Isa GetIsa();
+	const char* GetIsaName(Isa isa);
+	// Forces a path, for tests and benchmarks. Returns false (and keeps the current
+	// path) if the CPU doesn't support it.
+	bool SetIsa(Isa isa);
+
+	// out = Matrix4::Transform(in, mat, 1) for every point; out may alias in
+	void TransformPoints(const Matrix4& mat, const float* x, const float* y, const float* z,
+		float* outX, float* outY, float* outZ, size_t count);
+	// Same with w = 0, for directions
+	void TransformVectors(const Matrix4& mat, const float* x, const float* y, const float* z,
+		float* outX, float* outY, float* outZ, size_t count);
+	// out = Quaternion::Transform(in, q); out may alias in
+	void RotateVectors(const Quaternion& q, const float* x, const float* y, const float* z,
+		float* outX, float* outY, float* outZ, size_t count);
+	// Normalizes in place; zero vectors stay zero
+	void NormalizeVectors(float* x, float* y, float* z, size_t count);
+	// count must be at least 1
+	void ComputeBounds(const float* x, const float* y, const float* z, size_t count,
+		Vector3& outMin, Vector3& outMax);
+	// Scales weights[0][i] .. weights[slotCount - 1][i] in place so they sum to scale,
+	// for every i; sets summing to zero or less become zero
+	void NormalizeWeights(float* const* weights, size_t slotCount, size_t count, float scale);
+
+	// Array-of-structures helpers for float3 values strideBytes apart (such as the
+	// positions of a VertexData array): deinterleave blocks on the stack, run the kernel
+	void NormalizeVectorsStrided(float* xyz, size_t strideBytes, size_t count);
+	void ComputeBoundsStrided(const float* xyz, size_t strideBytes, size_t count,
+		Vector3& outMin, Vector3& outMax);
+}
@@ -1,28 +1,242 @@
 
 // FBX2ITP.cpp : Reads an .fbx file and writes vertex data to a JSON file.
-// Usage: FBX2ITP.exe input.fbx output.json
+// Usage: FBX2ITP.exe input.fbx [options]
+//        FBX2ITP.exe -batch list.txt|dir [options]
+// Run without arguments for the list of options (see PrintUsage).
 // Requires Autodesk FBX SDK installed and linked (libfbxsdk.lib).
 
 #include "VertexFormat.h"
+#include "AsyncFileWriter.h"
+#include "BuildCache.h"
 #include "FbxHelper.h"
+#include "ItpAnim.h"
 #include "ItpMesh.h"
+#include "MeshBounds.h"
+#include "MeshBuilder.h"
+#include "MeshCodec.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "Profiler.h"
+#include "TangentGenerator.h"
+#include "ThreadPool.h"
+#include "Triangulator.h"
+#include "VertexWelder.h"
 #include <array>
 #include <cmath>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <future>
 #include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <algorithm>
 
 static bool s_doBlendShapes = true;
 static bool s_doSkinning = true;
+static bool s_writeBinary = false;
+static unsigned s_jobCount = 1;
+static unsigned s_fileJobCount = 1;
+static std::string s_inputPath;
+static std::string s_batchPath;
+static std::mutex s_sdkMutex;
+static WeldTolerance s_weldTolerance;
+static bool s_optimizeVertexCache = true;
+static float s_overdrawThreshold = 0.0f;
+static int s_jsonPrecision = 0;
+static bool s_streamMode = false;
+static size_t s_streamMemoryCap = size_t(1024) << 20;
+static size_t s_ioQueueBytes = size_t(256) << 20;   // 0 = write on the converting threads
+static unsigned s_importAhead = 1;      // batch files imported ahead of the conversions
+static AsyncFileWriter* s_fileWriter = nullptr;
+static float s_blendShapeThreshold = 1e-5f;
+static float s_blendShapeDenseRatio = 0.5f;
+static bool s_generateTangents = false;
+static bool s_sdkTriangulate = false;
+static std::vector<float> s_lodRatios;    // triangle ratio of each LOD, 0 = as far as the error allows
+static std::vector<float> s_lodErrors;    // error limit of each LOD, relative to the mesh extent
+static bool s_buildMeshlets = false;
+static size_t s_meshletMaxVertices = 64;
+static size_t s_meshletMaxTriangles = 124;
+static bool s_buildBvh = false;
+static size_t s_bvhLeafTriangles = 4;
+static std::string s_cachePath;
+static std::string s_profilePath;
+static std::string s_tracePath;
+static ItpMesh::VertexFormat::NormalEncoding s_normalEncoding = ItpMesh::VertexFormat::NormalFloat3;
+static ItpMesh::VertexFormat::UVEncoding s_uvEncoding = ItpMesh::VertexFormat::UVFloat2;
+static ItpMesh::VertexFormat::PositionEncoding s_positionEncoding = ItpMesh::VertexFormat::PositionFloat3;
+static uint32_t s_streamCodec = ItpMesh::VertexFormat::CodecNone;
+static bool s_index32 = false;
+static bool s_split16 = false;
+static bool s_mergeMeshes = false;
+static uint32_t s_skinInfluences = 4;
+static bool s_weights16 = false;
+static bool s_bones16 = false;
+static uint32_t s_paletteBones = 0;     // 0 = vertices index the whole skeleton
+static bool s_exportAnimation = false;
+static float s_animFrameRate = 0.0f;    // 0 = the scene's frame rate
+static float s_animRotationError = Math::ToRadians(0.05f);
+static float s_animTranslationError = 0.01f;
+
+// Console output of one mesh conversion. Meshes may convert concurrently, so their
+// messages are buffered and printed in scene order once each mesh is done.
+struct ConvertLog
+{
+    std::ostringstream out;
+    std::ostringstream err;
+};
+
+// Output element counts and files of one converted mesh
+struct MeshCounts
+{
+    std::string name;
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    bool ok = true;                     // every output was written
+    bool restored = false;              // from the cache, so not to be stored again
+    std::vector<std::string> outputs;   // paths of the files written
+};
+
+// Totals of one input file, printed as the per-file summary in batch mode
+struct FileSummary
+{
+    std::string path;
+    bool ok = false;
+    size_t meshCount = 0;
+    size_t vertexCount = 0;
+    size_t triangleCount = 0;
+    double seconds = 0.0;
+};
+
+
+// One blendshape target found on a mesh, in deformer/channel/target order
+struct BlendTarget
+{
+    FbxShape* shape = nullptr;
+    std::string channelName;
+    int targetIndex = 0;
+    std::string name;
+};
+
+// Mesh with generated tangents (-tan): the tangent deltas of a target come from tangents
+// generated again on the target positions and normals
+static void GenerateBlendTargetTangents(const FbxVector4* shapeControlPoints, const FbxHelper::MeshCorners& corners,
+    const std::vector<uint32_t>& cornerVertices, const ItpMesh::Mesh* out, ItpMesh::BlendShape& bs)
+{
+    const size_t cornerCount = corners.controlPoint.size();
+    std::vector<Vector3> pos(cornerCount);
+    std::vector<Vector3> norm(cornerCount);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        const FbxVector4& p = shapeControlPoints[corners.controlPoint[c]];
+        pos[c] = Vector3(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
+        norm[c] = corners.norm[c];
+        if (bs.format.hasNormal)
+        {   // the normal the runtime ends up with at full weight
+            norm[c] += bs.deltas[cornerVertices[c]].norm;
+            if (norm[c].LengthSq() > 0.0f)
+                norm[c].Normalize();
+        }
+    }
+    std::vector<Vector3> tan(cornerCount);
+    std::vector<float> sign(cornerCount);
+    // targets already run in parallel, so one thread each
+    TangentGenerator::Generate(pos.data(), norm.data(), corners.uv.data(), cornerCount, tan.data(), sign.data(), 1);
+
+    // the first corner of each vertex decides its delta, as the base vertex took its tangent
+    // from one corner too
+    std::vector<bool> done(out->verts.size(), false);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        uint32_t v = cornerVertices[c];
+        if (done[v])
+            continue;
+        done[v] = true;
+        bs.deltas[v].tan = tan[c] - out->verts[v].tan;
+    }
+}
+
+// Computes the deltas of one target against the welded base vertices. Only reads the
+// shape and out, so targets can be extracted concurrently.
+static void ReadBlendTarget(const BlendTarget& target, const ItpMesh::Mesh* out, int baseCount,
+    const FbxHelper::MeshCorners& corners, const std::vector<uint32_t>& cornerVertices, ItpMesh::BlendShape& bs)
+{
+    FbxShape* shape = target.shape;
+    FbxVector4* shapeControlPoints = shape->GetControlPoints();
+    bs.name = target.name;
 
+    FbxHelper::Layer<Vector3> shapeNormals;
+    if (out->format.hasNormal)
+    {
+        bs.format.hasNormal = FbxHelper::CaptureNormals(shape, shapeNormals)
+            && (shapeNormals.mapping == FbxGeometryElement::eByControlPoint);
+    }
+    FbxHelper::Layer<Vector3> shapeTangents;
+    const bool generateTangents = out->format.hasTanSign;
+    if (out->format.hasTan && !generateTangents)
+    {
+        bs.format.hasTan = FbxHelper::CaptureTangents(shape, shapeTangents)
+            && (shapeTangents.mapping == FbxGeometryElement::eByControlPoint);
+    }
+
+    // target values per control point; the base value where the target has none
+    const ItpMesh::Mesh::VertexMap& vertexMap = out->vertexMap;
+    const size_t mappedCount = std::min(static_cast<size_t>(baseCount), vertexMap.GetControlPointCount());
+    std::vector<Vector3> positions(mappedCount);
+    std::vector<Vector3> normals(bs.format.hasNormal ? mappedCount : 0);
+    std::vector<Vector3> tangents(bs.format.hasTan ? mappedCount : 0);
+    for (size_t i = 0; i < mappedCount; ++i)
+    {
+        const FbxVector4& p = shapeControlPoints[i];
+        positions[i] = Vector3(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
+        if (vertexMap.IsEmpty(i))
+            continue;
+        const VertexData& baseVert = out->verts[*vertexMap.Begin(i)];
+        if (bs.format.hasNormal)
+        {
+            int idx = shapeNormals.Resolve(static_cast<int>(i), -1, -1);
+            normals[i] = idx >= 0 ? shapeNormals.values[static_cast<size_t>(idx)] : baseVert.norm;
+        }
+        if (bs.format.hasTan)
+        {
+            int idx = shapeTangents.Resolve(static_cast<int>(i), -1, -1);
+            tangents[i] = idx >= 0 ? shapeTangents.values[static_cast<size_t>(idx)] : baseVert.tan;
+        }
+    }
+    MeshBuilder::ComputeBlendDeltas(*out, positions.data(), normals.data(), tangents.data(), mappedCount, bs);
+
+    if (generateTangents)
+    {
+        bs.format.hasTan = true;
+        GenerateBlendTargetTangents(shapeControlPoints, corners, cornerVertices, out, bs);
+    }
+
+    bs.MakeSparse(s_blendShapeThreshold, s_blendShapeDenseRatio);
+}
 
 // Read blendshapes (blend shape deformers) from an FbxMesh.
 // For each blendshape channel + each target shape, compute per-control-point deltas
 // (targetPosition - basePosition) and also compute per-control-point normals and tangents
 // for the target by re-evaluating triangle normals/tangents using the target positions.
-static void ReadBlendShapes(FbxMesh* mesh, ItpMesh::Mesh* out)
+// Targets are listed first, then extracted on up to s_jobCount threads; out->blendShapes
+// keeps the deformer/channel/target order. corners and cornerVertices are the base mesh
+// corners and their welded vertices.
+static void ReadBlendShapes(FbxMesh* mesh, ItpMesh::Mesh* out, const FbxHelper::MeshCorners& corners,
+    const std::vector<uint32_t>& cornerVertices, ConvertLog& log)
 {
     if (!mesh || !out)
         return;
@@ -36,6 +250,7 @@ static void ReadBlendShapes(FbxMesh* mesh, ItpMesh::Mesh* out)
     if (baseCount == 0)
         return;
 
+    std::vector<BlendTarget> targets;
     // For each blendshape deformer
     for (int d = 0; d < deformerCount; ++d)
     {
@@ -56,98 +271,93 @@ static void ReadBlendShapes(FbxMesh* mesh, ItpMesh::Mesh* out)
                 FbxShape* shape = channel->GetTargetShape(t);
                 if (!shape) continue;
 
-                FbxVector4* shapeControlPoints = shape->GetControlPoints();
                 int shapeCount = shape->GetControlPointsCount();
-
                 if (shapeCount != baseCount)
                 {
-                    std::cerr << "Warning: blend target control point count (" << shapeCount
+                    log.err << "Warning: blend target control point count (" << shapeCount
                         << ") != base control point count (" << baseCount << ") for channel '"
                         << channel->GetName() << "' target " << t << ". Skipping target.\n";
                     continue;
                 }
 
-                ItpMesh::BlendShape bs;
-                bs.name = std::string(channel->GetName());
+                BlendTarget target;
+                target.shape = shape;
+                target.channelName = channel->GetName();
+                target.targetIndex = t;
+                target.name = target.channelName;
                 if (targetCount > 1)
-                    bs.name += "_target" + std::to_string(t);
-
-                fbxsdk::FbxGeometryElementNormal* elemNormal = shape->GetElementNormal(0);
-                if (out->format.hasNormal)
-                {
-                    bs.format.hasNormal = elemNormal
-                        && (elemNormal->GetMappingMode() == FbxGeometryElement::eByControlPoint);
-                }
-                fbxsdk::FbxGeometryElementTangent* elemTangent = shape->GetElementTangent(0);
-                if (out->format.hasTan)
-                {
-                    bs.format.hasTan = elemTangent
-                        && (elemTangent->GetMappingMode() == FbxGeometryElement::eByControlPoint);
-                }
-
-                bs.deltas.resize(static_cast<size_t>(out->verts.size()));
-                for (int i = 0; i < baseCount; ++i)
-                {
-                    uint32_t baseIndex = out->vertexMap[static_cast<uint32_t>(i)][0];
-                    VertexData& baseVert = out->verts[baseIndex];
-                    VertexData vert;
-                    float dx = static_cast<float>(shapeControlPoints[i][0]);
-                    float dy = static_cast<float>(shapeControlPoints[i][1]);
-                    float dz = static_cast<float>(shapeControlPoints[i][2]);
-                    vert.pos = Vector3(dx, dy, dz) - baseVert.pos;
-
-                    if (bs.format.hasNormal)
-                    {
-                        int idx = (elemNormal->GetReferenceMode() == FbxGeometryElement::eDirect) ?
-                            i : elemNormal->GetIndexArray().GetAt(i);
-                        FbxVector4 n = elemNormal->GetDirectArray().GetAt(idx);
-                        vert.norm = Vector3(static_cast<float>(n[0]), static_cast<float>(n[1]), static_cast<float>(n[2]));
-                        vert.norm -= baseVert.norm;
-                    }
-                    if (bs.format.hasTan)
-                    {
-                        int idx = (elemTangent->GetReferenceMode() == FbxGeometryElement::eDirect) ?
-                            i : elemTangent->GetIndexArray().GetAt(i);
-                        FbxVector4 n = elemTangent->GetDirectArray().GetAt(idx);
-                        vert.tan = Vector3(static_cast<float>(n[0]), static_cast<float>(n[1]), static_cast<float>(n[2]));
-                        vert.tan -= baseVert.tan;
-                    }
-
-                    for (uint32_t vi : out->vertexMap[static_cast<uint32_t>(i)])
-                    {
-                        // For each duplicated vertex, add the same delta
-                        bs.deltas[vi] = vert;
-                    }
-                }
-
-                out->blendShapes.push_back(std::move(bs));
-
-                std::cout << "Found blendshape channel '" << channel->GetName()
-                    << "' target " << t << " -> '" << out->blendShapes.back().name
-                    << "' (control points: " << baseCount << ")\n";
+                    target.name += "_target" + std::to_string(t);
+                targets.push_back(std::move(target));
             } // target
         } // channel
     } // deformer
+
+    size_t first = out->blendShapes.size();
+    out->blendShapes.resize(first + targets.size());
+    ThreadPool::ParallelFor(targets.size(), s_jobCount, [&](size_t i)
+    {
+        ReadBlendTarget(targets[i], out, baseCount, corners, cornerVertices, out->blendShapes[first + i]);
+    });
+
+    for (const BlendTarget& target : targets)
+    {
+        log.out << "Found blendshape channel '" << target.channelName
+            << "' target " << target.targetIndex << " -> '" << target.name
+            << "' (control points: " << baseCount << ")\n";
+    }
+}
+
+// Pose of a bone from its transform relative to its parent bone (or to the mesh, for a
+// root bone); bind poses and animation samples both go through here
+static ItpMesh::Bone::BindPose ToBonePose(const FbxAMatrix& local)
+{
+    ItpMesh::Bone::BindPose pose;
+    FbxVector4 t = local.GetT();
+    FbxVector4 r = local.GetR(); // Euler angles in degrees (X, Y, Z)
+
+    pose.trans = Vector3(static_cast<float>(t[0]), static_cast<float>(t[1]), static_cast<float>(t[2]));
+
+    auto ToRadians = [](double deg) { return static_cast<float>(deg * (3.14159265358979323846 / 180.0)); };
+    float pitch = ToRadians(r[0]); // X
+    float yaw = ToRadians(r[1]);   // Y
+    float roll = ToRadians(r[2]);  // Z
+
+    float cy = cosf(yaw * 0.5f);
+    float sy = sinf(yaw * 0.5f);
+    float cp = cosf(pitch * 0.5f);
+    float sp = sinf(pitch * 0.5f);
+    float cr = cosf(roll * 0.5f);
+    float sr = sinf(roll * 0.5f);
+
+    pose.rot.x = sr * cp * cy - cr * sp * sy;
+    pose.rot.y = cr * sp * cy + sr * cp * sy;
+    pose.rot.z = cr * cp * sy - sr * sp * cy;
+    pose.rot.w = cr * cp * cy + sr * sp * sy;
+    return pose;
 }
 
 // Read skinning info and also populate the mesh bones (names + bind poses + parent indices).
-// Returns true if any skinning data was found.
+// Returns true if any skinning data was found. Packs the influences to the skin layout of
+// format, switching it to 16 bit bone indices when there are more than 256 bones.
 static bool ReadSkin(FbxMesh* mesh,
-    std::vector<std::array<uint8_t, 4>>& ctrlBones,
-    std::vector<std::array<uint8_t, 4>>& ctrlWeights,
-    std::vector<ItpMesh::Bone>& outBones)
+    ItpMesh::VertexFormat& format,
+    std::vector<MeshBuilder::SkinSlots>& ctrlBones,
+    std::vector<MeshBuilder::SkinSlots>& ctrlWeights,
+    std::vector<ItpMesh::Bone>& outBones,
+    ConvertLog& log)
 {
     int skinDeformerCount = mesh->GetDeformerCount(FbxDeformer::eSkin);
     int controlPointCount = mesh->GetControlPointsCount();
 
-    // Per-control-point list of (boneIndex, weight)
-    std::vector<std::vector<std::pair<uint8_t, float>>> cpInfluences;
-    cpInfluences.resize(static_cast<size_t>(controlPointCount));
-
-    // Map bone (link) name -> small integer index (uint8_t)
-    std::unordered_map<std::string, uint8_t> boneNameToIndex;
+    // Map bone (link) node -> bone index
+    std::unordered_map<FbxNode*, uint16_t> boneNodeToIndex;
     uint32_t nextBoneIndex = 0;
 
+    // Clusters that contribute, with their bone index, for the fill pass
+    std::vector<std::pair<FbxCluster*, uint16_t>> boneClusters;
+    MeshBuilder::InfluenceTable influences;
+    influences.Reset(static_cast<size_t>(controlPointCount));
+
     // Keep arrays for node pointers and bind matrices indexed by boneIndex
     std::vector<FbxNode*> boneNodes;
     std::vector<FbxAMatrix> boneBindMatrices;
@@ -166,18 +376,17 @@ static bool ReadSkin(FbxMesh* mesh,
             FbxNode* linkNode = cluster->GetLink(); // bone node
             if (!linkNode) continue;
 
-            std::string boneName = linkNode->GetName();
-            uint8_t boneIndex = 0;
-            auto it = boneNameToIndex.find(boneName);
-            if (it == boneNameToIndex.end())
+            uint16_t boneIndex = 0;
+            auto it = boneNodeToIndex.find(linkNode);
+            if (it == boneNodeToIndex.end())
             {
-                if (nextBoneIndex > 255)
+                if (nextBoneIndex > 65535)
                 {
-                    std::cerr << "Warning: too many bones - bone '" << boneName << "' ignored\n";
+                    log.err << "Warning: too many bones - bone '" << linkNode->GetName() << "' ignored\n";
                     continue;
                 }
-                boneIndex = static_cast<uint8_t>(nextBoneIndex);
-                boneNameToIndex[boneName] = boneIndex;
+                boneIndex = static_cast<uint16_t>(nextBoneIndex);
+                boneNodeToIndex[linkNode] = boneIndex;
                 ++nextBoneIndex;
 
                 boneNodes.resize(nextBoneIndex);
@@ -214,70 +423,42 @@ static bool ReadSkin(FbxMesh* mesh,
                     boneBindMatrices[boneIndex] = localBind;
             }
 
+            // count pass: entries per control point
             int indexCount = cluster->GetControlPointIndicesCount();
             int* indices = cluster->GetControlPointIndices();
             double* weights = cluster->GetControlPointWeights();
-
             for (int k = 0; k < indexCount; ++k)
             {
                 int cpIndex = indices[k];
-                float w = static_cast<float>(weights[k]);
-                if (w <= 0.0f) 
-                    continue;
-                if (cpIndex < 0 || cpIndex >= controlPointCount) 
-                    continue;
-                cpInfluences[static_cast<size_t>(cpIndex)].emplace_back(boneIndex, w);
+                if (static_cast<float>(weights[k]) > 0.0f && cpIndex >= 0 && cpIndex < controlPointCount)
+                    influences.Count(static_cast<size_t>(cpIndex));
             }
+            boneClusters.emplace_back(cluster, boneIndex);
         }
     }
 
-    // Pack up to 4 strongest influences per control point (unchanged existing behavior)
-    ctrlBones.resize(static_cast<size_t>(controlPointCount));
-    ctrlWeights.resize(static_cast<size_t>(controlPointCount));
-
-    bool anySkin = false;
-    for (int i = 0; i < controlPointCount; ++i)
+    // fill pass, with the same filter as the count pass
+    influences.Allocate();
+    for (const std::pair<FbxCluster*, uint16_t>& boneCluster : boneClusters)
     {
-        auto& inf = cpInfluences[static_cast<size_t>(i)];
-        std::array<uint8_t, 4> b = { 0,0,0,0 };
-        std::array<uint8_t, 4> w = { 0,0,0,0 };
-
-        if (!inf.empty())
+        FbxCluster* cluster = boneCluster.first;
+        int indexCount = cluster->GetControlPointIndicesCount();
+        int* indices = cluster->GetControlPointIndices();
+        double* weights = cluster->GetControlPointWeights();
+        for (int k = 0; k < indexCount; ++k)
         {
-            std::sort(inf.begin(), inf.end(), [](const std::pair<uint8_t, float>& a, const std::pair<uint8_t, float>& b) {
-                return a.second > b.second;
-                });
-
-            float total = 0.0f;
-            size_t take = std::min<size_t>(4, inf.size());
-            for (size_t j = 0; j < take; ++j)
-                total += inf[j].second;
-
-            if (total > 0.0f)
-            {
-                int acc = 0;
-                for (size_t j = 0; j < take; ++j)
-                {
-                    b[j] = inf[j].first;
-                    float nf = inf[j].second / total;
-                    int byteVal = static_cast<int>(std::round(nf * 255.0f));
-                    if (j == take - 1)
-                    {
-                        byteVal = 255 - acc;
-                        if (byteVal < 0)
-                            byteVal = 0;
-                    }
-                    w[j] = static_cast<uint8_t>(byteVal);
-                    acc += byteVal;
-                }
-                anySkin = true;
-            }
+            int cpIndex = indices[k];
+            float w = static_cast<float>(weights[k]);
+            if (w > 0.0f && cpIndex >= 0 && cpIndex < controlPointCount)
+                influences.Add(static_cast<size_t>(cpIndex), boneCluster.second, w);
         }
-
-        ctrlBones[static_cast<size_t>(i)] = b;
-        ctrlWeights[static_cast<size_t>(i)] = w;
     }
 
+    // Pack the strongest influences per control point
+    if (nextBoneIndex > 256)
+        format.boneEncoding = ItpMesh::VertexFormat::BoneUint16;
+    bool anySkin = MeshBuilder::PackInfluences(influences, format, ctrlBones, ctrlWeights);
+
     // Build outBones entries (name, parentIndex, bindPose) using boneBindMatrices
     outBones.clear();
     outBones.resize(nextBoneIndex);
@@ -291,15 +472,15 @@ static bool ReadSkin(FbxMesh* mesh,
         if (node)
         {
             bone.name = node->GetName();
+            bone.node = node;
 
             // find parent in the same bone map
             FbxNode* parent = node->GetParent();
             int parentIndex = -1;
             while (parent)
             {
-                std::string parentName = parent->GetName();
-                auto pit = boneNameToIndex.find(parentName);
-                if (pit != boneNameToIndex.end())
+                auto pit = boneNodeToIndex.find(parent);
+                if (pit != boneNodeToIndex.end())
                 {
                     parentIndex = static_cast<int>(pit->second);
                     break;
@@ -324,27 +505,7 @@ static bool ReadSkin(FbxMesh* mesh,
                 localBind = boneGlobal;
             }
 
-            FbxVector4 t = localBind.GetT();
-            FbxVector4 r = localBind.GetR(); // Euler angles in degrees (X, Y, Z)
-
-            bone.bindPose.trans = Vector3(static_cast<float>(t[0]), static_cast<float>(t[1]), static_cast<float>(t[2]));
-
-            auto ToRadians = [](double deg) { return static_cast<float>(deg * (3.14159265358979323846 / 180.0)); };
-            float pitch = ToRadians(r[0]); // X
-            float yaw = ToRadians(r[1]);   // Y
-            float roll = ToRadians(r[2]);  // Z
-
-            float cy = cosf(yaw * 0.5f);
-            float sy = sinf(yaw * 0.5f);
-            float cp = cosf(pitch * 0.5f);
-            float sp = sinf(pitch * 0.5f);
-            float cr = cosf(roll * 0.5f);
-            float sr = sinf(roll * 0.5f);
-
-            bone.bindPose.rot.x = sr * cp * cy - cr * sp * sy;
-            bone.bindPose.rot.y = cr * sp * cy + sr * cp * sy;
-            bone.bindPose.rot.z = cr * cp * sy - sr * sp * cy;
-            bone.bindPose.rot.w = cr * cp * cy + sr * sp * sy;
+            bone.bindPose = ToBonePose(localBind);
         }
         else
         {
@@ -360,10 +521,10 @@ static bool ReadSkin(FbxMesh* mesh,
     return anySkin;
 }
 
-static void ProcessMeshToItp(FbxMesh* mesh, ItpMesh::Mesh* out, int index)
+// Name, vertex format and skin of a mesh: everything needed before its corners are welded
+static void ReadMeshHeader(FbxMesh* mesh, ItpMesh::Mesh* out, int index,
+    std::vector<MeshBuilder::SkinSlots>& ctrlBones, std::vector<MeshBuilder::SkinSlots>& ctrlWeights, ConvertLog& log)
 {
-    if (!mesh)
-        return;
     FbxNode* node = mesh->GetNode();
     out->name = node ? node->GetName() : "mesh_" + std::to_string(index);
 
@@ -373,240 +534,1820 @@ static void ProcessMeshToItp(FbxMesh* mesh, ItpMesh::Mesh* out, int index)
     out->format.hasNormal = (elemN != nullptr);
     out->format.hasUV = (elemUV != nullptr);
     out->format.hasTan = (elemT != nullptr);
+    out->format.normalEncoding = s_normalEncoding;
+    out->format.uvEncoding = s_uvEncoding;
+    out->format.positionEncoding = s_positionEncoding;
+    out->format.codec = s_streamCodec;
+    out->format.indexEncoding = s_index32 ? ItpMesh::VertexFormat::IndexUint32 : ItpMesh::VertexFormat::IndexAuto;
+    out->format.influenceCount = s_skinInfluences;
+    out->format.weightEncoding = s_weights16 ? ItpMesh::VertexFormat::WeightUnorm16 : ItpMesh::VertexFormat::WeightUnorm8;
+    out->format.boneEncoding = s_bones16 ? ItpMesh::VertexFormat::BoneUint16 : ItpMesh::VertexFormat::BoneUint8;
 
     // Read skinning data
-    std::vector<std::array<uint8_t, 4>> ctrlBones;
-    std::vector<std::array<uint8_t, 4>> ctrlWeights;
     if (s_doSkinning)
-        out->format.hasSkin = ReadSkin(mesh, ctrlBones, ctrlWeights, out->bones);
-
-    int polygonCount = mesh->GetPolygonCount();
-    out->indices.resize(polygonCount);
-    std::unordered_map<VertexData, size_t> vertexMap;
-    for (int p = 0; p < polygonCount; ++p)
     {
-        int polySize = mesh->GetPolygonSize(p);
-        for (int v = 0; v < polySize; ++v)
-        {
-            int ctrlPointIndex = mesh->GetPolygonVertex(p, v);
-
-            VertexData vert;
-            FbxVector4 pos = mesh->GetControlPointAt(ctrlPointIndex);
-
-            FbxVector4 normal; bool hasNormal = FbxHelper::GetNormalAt(mesh, p, v, normal);
-            FbxVector2 uv; bool hasUV = FbxHelper::GetUVAt(mesh, p, v, uv, nullptr);
-            FbxVector4 tangent; bool hasTangent = FbxHelper::GetTangentAt(mesh, p, v, tangent);
-
-            vert.pos = Vector3(static_cast<float>(pos[0]), static_cast<float>(pos[1]), static_cast<float>(pos[2]));
-            if (hasNormal)
-                vert.norm = Vector3(static_cast<float>(normal[0]), static_cast<float>(normal[1]), static_cast<float>(normal[2]));
-            else
-                vert.norm = Vector3(0.0f, 0.0f, 0.0f);
-            if (hasTangent)
-                vert.tan = Vector3(static_cast<float>(tangent[0]), static_cast<float>(tangent[1]), static_cast<float>(tangent[2]));
-            else
-                vert.tan = Vector3(0.0f, 0.0f, 0.0f);
-            if (hasUV)
-            {
-                uv[1] = 1.0 - uv[1]; // flip V
-                vert.uv = Vector2(static_cast<float>(uv[0]), static_cast<float>(uv[1]));
-            }
-            else
-                vert.uv = Vector2(0.0f, 0.0f);
-
-            // copy skin data for this control point (if present)
-            if (out->format.hasSkin && ctrlBones.size() > static_cast<size_t>(ctrlPointIndex))
-            {
-                auto cb = ctrlBones[static_cast<size_t>(ctrlPointIndex)];
-                auto cw = ctrlWeights[static_cast<size_t>(ctrlPointIndex)];
-                vert.bones[0] = cb[0];
-                vert.bones[1] = cb[1];
-                vert.bones[2] = cb[2];
-                vert.bones[3] = cb[3];
-                vert.weights[0] = cw[0]; 
-                vert.weights[1] = cw[1];
-                vert.weights[2] = cw[2]; 
-                vert.weights[3] = cw[3];
-            }
-            else
-            {
-                vert.bones[0] = vert.bones[1] = vert.bones[2] = vert.bones[3] = 0;
-                vert.weights[0] = vert.weights[1] = vert.weights[2] = vert.weights[3] = 0;
-            }
+        Profiler::Scope scope("ReadSkin", out->name);
+        out->format.hasSkin = ReadSkin(mesh, out->format, ctrlBones, ctrlWeights, out->bones, log);
+        scope.SetCounts(static_cast<uint64_t>(mesh->GetControlPointsCount()), out->bones.size());
+    }
+}
 
-            size_t index = 0;
-            auto inMap = vertexMap.find(vert);
-            if (inMap != vertexMap.end())
-            {
-                index = inMap->second;
-            }
-            else
-            {
-                index = vertexMap.size();
-                vertexMap[vert] = index;
-                out->verts.emplace_back(vert);
-                out->vertexMap[static_cast<uint32_t>(ctrlPointIndex)].push_back(static_cast<uint32_t>(index));
-            }
-            // reverse the winding order
-            out->indices[p].index[2 - v] = static_cast<uint32_t>(index);
-        }
+// The vertex of corner c, with the skin of its control point
+static VertexData BuildCornerVertex(const FbxHelper::MeshCorners& corners, size_t c, bool hasSkin,
+    const std::vector<MeshBuilder::SkinSlots>& ctrlBones, const std::vector<MeshBuilder::SkinSlots>& ctrlWeights)
+{
+    int ctrlPointIndex = corners.controlPoint[c];
+
+    VertexData vert;
+    vert.pos = corners.pos[c];
+    if (!corners.norm.empty())
+        vert.norm = corners.norm[c];
+    else
+        vert.norm = Vector3(0.0f, 0.0f, 0.0f);
+    if (!corners.tan.empty())
+        vert.tan = corners.tan[c];
+    else
+        vert.tan = Vector3(0.0f, 0.0f, 0.0f);
+    vert.tanSign = corners.tanSign.empty() ? 1.0f : corners.tanSign[c];
+    if (!corners.uv.empty())
+        vert.uv = Vector2(corners.uv[c].x, 1.0f - corners.uv[c].y); // flip V
+    else
+        vert.uv = Vector2(0.0f, 0.0f);
+
+    // copy skin data for this control point (if present)
+    if (hasSkin && ctrlBones.size() > static_cast<size_t>(ctrlPointIndex))
+    {
+        const MeshBuilder::SkinSlots& cb = ctrlBones[static_cast<size_t>(ctrlPointIndex)];
+        const MeshBuilder::SkinSlots& cw = ctrlWeights[static_cast<size_t>(ctrlPointIndex)];
+        memcpy(vert.bones, cb.data(), sizeof(vert.bones));
+        memcpy(vert.weights, cw.data(), sizeof(vert.weights));
     }
+    else
+    {
+        memset(vert.bones, 0, sizeof(vert.bones));
+        memset(vert.weights, 0, sizeof(vert.weights));
+    }
+    return vert;
+}
 
-    if (s_doBlendShapes)
-    {   // read blend shapes
-        ReadBlendShapes(mesh, out);
+// -tan: replaces the corner tangents with MikkTSpace ones. Needs normals, uvs and
+// triangulated corners; returns false, leaving the corners alone, otherwise.
+static bool GenerateCornerTangents(FbxHelper::MeshCorners& corners, unsigned threadCount)
+{
+    if (corners.norm.empty() || corners.uv.empty() || corners.polygonStart.empty()
+        || !Triangulator::IsTriangulated(corners.polygonStart.data(), corners.polygonStart.size() - 1))
+        return false;
+    const size_t cornerCount = corners.controlPoint.size();
+    corners.tan.resize(cornerCount);
+    corners.tanSign.resize(cornerCount);
+    TangentGenerator::Generate(corners.pos.data(), corners.norm.data(), corners.uv.data(), cornerCount,
+        corners.tan.data(), corners.tanSign.data(), threadCount);
+    return true;
+}
+
+// -lod/-loderror: simplifies the welded triangles once per LOD, each from the full mesh
+// so errors don't accumulate. LODs that don't drop triangles compared to the previous
+// one are left out.
+static void GenerateLods(ItpMesh::Mesh* out, ConvertLog& log)
+{
+    if (out->indices.empty())
+        return;
+    Profiler::Scope scope("GenerateLods", out->name);
+    const size_t lodCount = std::max(s_lodRatios.size(), s_lodErrors.size());
+    const uint32_t* indices = out->indices[0].index;
+    const size_t indexCount = out->indices.size() * 3;
+    std::vector<ItpMesh::Mesh::Lod> lods(lodCount);
+    ThreadPool::ParallelFor(lodCount, s_jobCount, [&](size_t l)
+    {
+        const float ratio = l < s_lodRatios.size() ? std::min(1.0f, s_lodRatios[l]) : 0.0f;
+        const float error = l < s_lodErrors.size() ? s_lodErrors[l] : FLT_MAX;
+        const size_t targetIndexCount = static_cast<size_t>(out->indices.size() * ratio) * 3;
+        std::vector<uint32_t> lodIndices;
+        lods[l].error = MeshSimplifier::Simplify(out->verts.data(), out->verts.size(), out->format, indices, indexCount,
+            targetIndexCount, error, lodIndices);
+        lods[l].indices.resize(lodIndices.size() / 3);
+        if (!lodIndices.empty())
+            memcpy(lods[l].indices.data(), lodIndices.data(), lodIndices.size() * sizeof(uint32_t));
+    });
+
+    size_t previous = out->indices.size();
+    for (size_t l = 0; l < lodCount; ++l)
+    {
+        if (lods[l].indices.empty() || lods[l].indices.size() >= previous)
+            continue;
+        previous = lods[l].indices.size();
+        log.out << "  LOD" << out->lods.size() + 1 << ": " << previous << " triangles (error " << lods[l].error << ")\n";
+        out->lods.push_back(std::move(lods[l]));
     }
+    scope.SetCounts(out->indices.size(), previous);
 }
 
-static void WriteMesh(FbxMesh* mesh, int index)
+static void ProcessMeshToItp(FbxMesh* mesh, ItpMesh::Mesh* out, int index, ConvertLog& log)
 {
-    ItpMesh::Mesh itpMesh;
-    ProcessMeshToItp(mesh, &itpMesh, index);
-    std::cout << itpMesh.name << "\n";
+    if (!mesh)
+        return;
 
-    {   // Open output file
-        std::string outputPath = itpMesh.name + ".itpmesh3";
-        std::ofstream ofs(outputPath, std::ofstream::out | std::ofstream::trunc);
-        if (!ofs.is_open())
-        {
-            std::cerr << "Failed to open output file: " << outputPath << "\n";
-        }
-        else
-        {
-            ofs << std::showpoint;
-            itpMesh.WriteToJson(ofs);
-            ofs.close();
-        }
+    std::vector<MeshBuilder::SkinSlots> ctrlBones;
+    std::vector<MeshBuilder::SkinSlots> ctrlWeights;
+    ReadMeshHeader(mesh, out, index, ctrlBones, ctrlWeights, log);
+
+    // Pull every corner attribute out of the SDK once, then assemble vertices from flat arrays
+    FbxHelper::MeshCorners corners;
+    {
+        Profiler::Scope scope("ExtractCorners", out->name);
+        FbxHelper::ExtractCorners(mesh, corners);
+        scope.SetCounts(static_cast<uint64_t>(mesh->GetPolygonCount()), corners.controlPoint.size());
+    }
+    {
+        Profiler::Scope scope("Triangulate", out->name);
+        size_t dropped = FbxHelper::TriangulateCorners(corners);
+        if (dropped > 0)
+            log.err << "Warning: dropped " << dropped << " polygon(s) of " << out->name << " with fewer than 3 corners\n";
+        scope.SetCounts(static_cast<uint64_t>(mesh->GetPolygonCount()), corners.polygonStart.size() - 1);
     }
 
-    if (s_doSkinning && itpMesh.format.hasSkin)
+    if (s_generateTangents)
     {
-        std::cout << "  Skinning:\n";
-        // Open output file
-        std::string outputPath = itpMesh.name + ".itpskel";
-        std::ofstream ofs(outputPath, std::ofstream::out | std::ofstream::trunc);
-        if (!ofs.is_open())
+        Profiler::Scope scope("GenerateTangents", out->name);
+        scope.SetCounts(corners.controlPoint.size(), corners.controlPoint.size());
+        if (GenerateCornerTangents(corners, s_jobCount))
         {
-            std::cerr << "Failed to open output file: " << outputPath << "\n";
+            out->format.hasTan = true;
+            out->format.hasTanSign = true;
+            log.out << "  Generated MikkTSpace tangents\n";
         }
         else
         {
-            ofs << std::showpoint;
-            itpMesh.WriteSkelToJson(ofs);
-            ofs.close();
+            log.err << "Warning: " << out->name << " needs normals and uvs to generate tangents\n";
         }
     }
 
-    if (s_doBlendShapes && !itpMesh.blendShapes.empty())
+    const size_t triangleCount = corners.controlPoint.size() / 3;
+    out->indices.resize(triangleCount);
+    std::vector<uint32_t> cornerVertices(corners.controlPoint.size());
     {
-        std::cout << "  BlendShapes:\n";
-        for (const auto& bs : itpMesh.blendShapes)
+        Profiler::Scope scope("Weld", out->name);
+        VertexWelder welder(out->format, corners.controlPoint.size(), s_weldTolerance);
+        for (size_t t = 0; t < triangleCount; ++t)
         {
-            std::cout << "    " << bs.name << " (deltas: " << bs.deltas.size() << ")\n";
-
-            // Open output file
-            std::string outputPath = bs.name + ".itpblend";
-            std::ofstream ofs(outputPath, std::ofstream::out | std::ofstream::trunc);
-            if (!ofs.is_open())
-            {
-                std::cerr << "Failed to open output file: " << outputPath << "\n";
-            }
-            else
+            for (size_t v = 0; v < 3; ++v)
             {
-                ofs << std::showpoint;
-                bs.WriteToJson(ofs);
-                ofs.close();
+                size_t c = 3 * t + v;
+                VertexData vert = BuildCornerVertex(corners, c, out->format.hasSkin, ctrlBones, ctrlWeights);
+
+                bool isNew = false;
+                uint32_t index = welder.Weld(vert, isNew);
+                if (isNew)
+                    out->verts.emplace_back(vert);
+                cornerVertices[c] = index;
+                // reverse the winding order
+                out->indices[t].index[2 - v] = index;
             }
         }
+
+        // a vertex can be shared by several control points (always possible, and
+        // common with tolerance welding), so the map keeps every control point that uses it
+        out->vertexMap.Build(static_cast<size_t>(mesh->GetControlPointsCount()), corners.controlPoint.data(),
+            cornerVertices.data(), cornerVertices.size());
+        scope.SetCounts(corners.controlPoint.size(), out->verts.size());
+    }
+
+    if (!s_weldTolerance.IsExact())
+    {
+        log.out << "  Welded " << corners.controlPoint.size() << " corners to " << out->verts.size()
+            << " vertices (tolerance " << s_weldTolerance.position << ", "
+            << Math::ToDegrees(s_weldTolerance.normalAngle) << " deg, " << s_weldTolerance.uv << ")\n";
     }
+
+    if (s_doBlendShapes)
+    {   // read blend shapes
+        Profiler::Scope scope("ReadBlendShapes", out->name);
+        ReadBlendShapes(mesh, out, corners, cornerVertices, log);
+        size_t deltaCount = 0;
+        for (const ItpMesh::BlendShape& bs : out->blendShapes)
+            deltaCount += bs.deltas.size();
+        scope.SetCounts(out->blendShapes.size(), deltaCount);
+    }
+
+    // a LOD draws across submeshes, so it can't use their bone palettes
+    const bool palettes = s_paletteBones > 0 && out->format.hasSkin;
+    if ((!s_lodRatios.empty() || !s_lodErrors.empty()) && palettes)
+        log.err << "Warning: LODs of " << out->name << " are not generated with bone palettes\n";
+    else if (!s_lodRatios.empty() || !s_lodErrors.empty())
+        GenerateLods(out, log);
 }
 
-static void WriteAllMesh(FbxNode* node, int& index)
+// Reorders triangles for the post-transform vertex cache, optionally sorts clusters of
+// them to reduce overdraw, then renumbers the vertices in first-use order so vertex
+// fetch walks memory forward.
+static void OptimizeMeshToItp(ItpMesh::Mesh* out, ConvertLog& log)
 {
-    if (!node)
+    if (out->indices.empty())
         return;
-    FbxMesh* mesh = node->GetMesh();
-    if (mesh)
+
+    Profiler::Scope scope("OptimizeMesh", out->name);
+    scope.SetCounts(out->indices.size(), out->verts.size());
+    uint32_t* indices = out->indices[0].index;
+    size_t indexCount = out->indices.size() * 3;
+    MeshOptimizer::CacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, indexCount, out->verts.size());
+
+    MeshOptimizer::OptimizeVertexCache(indices, indexCount, out->verts.size());
+    for (ItpMesh::Mesh::Lod& lod : out->lods)
     {
-        WriteMesh(mesh, index);
-        index++;
+        if (!lod.indices.empty())
+            MeshOptimizer::OptimizeVertexCache(lod.indices[0].index, lod.indices.size() * 3, out->verts.size());
     }
-    for (int i = 0; i < node->GetChildCount(); ++i)
+
+    if (s_overdrawThreshold > 0.0f)
     {
-        WriteAllMesh(node->GetChild(i), index);
+        const float* positions = &out->verts[0].pos.x;
+        float overdrawBefore = MeshOptimizer::AnalyzeOverdraw(indices, indexCount, positions, out->verts.size(), sizeof(VertexData));
+        MeshOptimizer::OptimizeOverdraw(indices, indexCount, positions, out->verts.size(), sizeof(VertexData), s_overdrawThreshold);
+        float overdrawAfter = MeshOptimizer::AnalyzeOverdraw(indices, indexCount, positions, out->verts.size(), sizeof(VertexData));
+        log.out << std::fixed << std::setprecision(3)
+            << "  Overdraw: " << overdrawBefore << " -> " << overdrawAfter << "\n" << std::defaultfloat;
     }
+
+    std::vector<uint32_t> remap;
+    MeshOptimizer::BuildFetchRemap(remap, indices, indexCount, out->verts.size());
+    out->RemapVertices(remap);
+
+    MeshOptimizer::CacheStats after = MeshOptimizer::AnalyzeVertexCache(indices, indexCount, out->verts.size());
+    log.out << std::fixed << std::setprecision(3)
+        << "  Vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << "\n" << std::defaultfloat;
 }
 
-void ReadOptions(int argc, char** argv)
+// -meshlets: clusters the final (optimized) triangle list for mesh shaders
+static void BuildMeshletsToItp(ItpMesh::Mesh* out, ConvertLog& log)
 {
-    s_doBlendShapes = false;
-    s_doSkinning = false;
-    // For simplicity, only check for flags in arguments
-    for (int i = 2; i < argc; ++i)
+    if (out->indices.empty())
+        return;
+    Profiler::Scope scope("BuildMeshlets", out->name);
+    // a little cone weight tightens the normal cones without costing many more meshlets
+    const float coneWeight = 0.25f;
+    MeshletBuilder::Build(out->indices[0].index, out->indices.size() * 3, &out->verts[0].pos.x, out->verts.size(),
+        sizeof(VertexData), s_meshletMaxVertices, s_meshletMaxTriangles, coneWeight,
+        out->meshlets, out->meshletVertices, out->meshletTriangles);
+    scope.SetCounts(out->indices.size(), out->meshlets.size());
+
+    size_t cullable = 0;
+    for (const ItpMesh::Meshlet& meshlet : out->meshlets)
+        cullable += meshlet.coneCutoff < 1.0f ? 1 : 0;
+    log.out << std::fixed << std::setprecision(1)
+        << "  Meshlets: " << out->meshlets.size() << ", " << static_cast<float>(out->meshletVertices.size()) / out->meshlets.size()
+        << " verts and " << static_cast<float>(out->indices.size()) / out->meshlets.size() << " tris on average, "
+        << cullable << " with a backface cone\n" << std::defaultfloat;
+}
+
+// Bounds of the final mesh, once its positions are quantized, and with -bvh its
+// triangle BVH
+static void BuildBoundsToItp(ItpMesh::Mesh* out, ConvertLog& log)
+{
+    Profiler::Scope scope("BuildBounds", out->name);
+    MeshBounds::Compute(*out);
+    if (out->format.hasSkin)
+        MeshBounds::ComputeBones(*out);
+    if (s_buildBvh && !out->indices.empty())
     {
-        std::string arg = argv[i];
-        if (arg == "-b")
+        // padded like the mesh bounds, so the nodes hold the positions as they decode
+        MeshBounds::BuildBvh(out->indices[0].index, out->indices.size() * 3, &out->verts[0].pos.x, sizeof(VertexData),
+            MeshBounds::GetDecodeError(out->format), s_bvhLeafTriangles, out->bvhNodes, out->bvhTriangles);
+        log.out << "  BVH: " << out->bvhNodes.size() << " nodes\n";
+    }
+    scope.SetCounts(out->verts.size(), out->bvhNodes.size());
+}
+
+// -split16 and -palette: 16 bit index windows and, for skinned meshes, bone palettes
+static void SplitMeshToItp(ItpMesh::Mesh* out, ConvertLog& log)
+{
+    Profiler::Scope scope("SplitSubmeshes", out->name);
+    const size_t vertexCount = out->verts.size();
+    const bool palettes = s_paletteBones > 0 && out->format.hasSkin;
+    const bool split16 = s_split16 && !s_index32;
+    out->SplitSubmeshes(split16 ? ItpMesh::Mesh::MaxShortIndexVertices : UINT32_MAX, palettes ? s_paletteBones : 0);
+    scope.SetCounts(vertexCount, out->verts.size());
+    log.out << "  Split into " << out->submeshes.size() << " submeshes" << (split16 ? " with 16 bit indices" : "")
+        << ", " << out->verts.size() - vertexCount << " verts duplicated\n";
+    if (!palettes)
+        return;
+
+    uint32_t largestPalette = 0;
+    for (const ItpMesh::Submesh& submesh : out->submeshes)
+        largestPalette = std::max(largestPalette, submesh.paletteBoneCount);
+    if (largestPalette > s_paletteBones)
+        log.err << "Warning: a triangle of " << out->name << " weights more than " << s_paletteBones << " bones, its palette has " << largestPalette << "\n";
+    // the vertices now index their palette, which may well fit in a byte
+    if (!s_bones16 && largestPalette <= 256)
+        out->format.boneEncoding = ItpMesh::VertexFormat::BoneUint8;
+    log.out << "  Bone palettes: " << out->submeshes.size() << ", up to " << largestPalette << " of " << out->bones.size() << " bones\n";
+}
+
+static void WriteSkeleton(const ItpMesh::Mesh& mesh, JsonWriter& json, MeshCounts& counts, ConvertLog& log)
+{
+    Profiler::Scope scope("WriteSkeleton", mesh.name);
+    scope.SetCounts(mesh.bones.size(), mesh.bones.size());
+    log.out << "  Skinning:\n";
+    std::string outputPath = mesh.name + ".itpskel";
+    json.Clear();
+    mesh.WriteSkelToJson(json);
+    s_fileWriter->Write(outputPath, json.Release());
+    counts.outputs.push_back(outputPath);
+}
+
+// Clip names come from the DCC ("Armature|Walk", "Take 001"); keep them file name safe
+static std::string ToFileName(const std::string& name)
+{
+    std::string fileName = name;
+    for (char& c : fileName)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_' && c != '.')
+            c = '_';
+    }
+    return fileName;
+}
+
+// -a: the tracks the meshes of a scene share, so the sub-meshes of one character don't
+// each sample and reduce the same bones. A track is a bone under its parent bone in the
+// space of a mesh node, and meshes whose nodes move alike share a space. Guarded by
+// s_sdkMutex; a track is read through its future once the mesh that claimed it is done.
+struct SceneAnimation
+{
+    struct TrackKey
+    {
+        int stack;
+        FbxNode* space;
+        FbxNode* bone;
+        FbxNode* parent;    // null for a root bone
+
+        bool operator<(const TrackKey& other) const
         {
-            s_doBlendShapes = true;
+            return std::tie(stack, space, bone, parent) < std::tie(other.stack, other.space, other.bone, other.parent);
         }
-        else if (arg == "-s")
+    };
+
+    // per stack, each space's first mesh node and its sampled global transforms
+    std::vector<std::vector<std::pair<FbxNode*, std::vector<FbxAMatrix>>>> spaces;
+    std::map<TrackKey, std::shared_future<ItpAnim::Track>> tracks;
+};
+
+// by scene, until ConvertImportedFile destroys it
+static std::map<FbxScene*, SceneAnimation> s_sceneAnimations;
+
+// -a: samples every animation stack of the scene on the skeleton of mesh and writes it
+// as mesh_stack.itpanim, a track per bone in skeleton order. Each bone is sampled on the
+// node ReadSkin read it from; only a bone without one is looked up by name, and a bone
+// that isn't in the scene keeps its bind pose. A track an earlier mesh of the scene made
+// is reused, and each node is sampled once for the tracks this mesh makes. The FBX
+// evaluator isn't thread-safe, so sampling runs under s_sdkMutex, a stack at a time;
+// the key reduction then runs on the worker pool, a track per job.
+static void WriteAnimations(FbxNode* meshNode, const ItpMesh::Mesh& mesh, MeshCounts& counts, ConvertLog& log)
+{
+    FbxScene* scene = meshNode ? meshNode->GetScene() : nullptr;
+    const int stackCount = scene ? scene->GetSrcObjectCount<FbxAnimStack>() : 0;
+    if (stackCount == 0 || mesh.bones.empty())
+        return;
+
+    Profiler::Scope scope("WriteAnimations", mesh.name);
+    log.out << "  Animations:\n";
+    const size_t boneCount = mesh.bones.size();
+    std::vector<FbxNode*> boneNodes(boneCount);
+    for (size_t b = 0; b < boneCount; ++b)
+    {
+        FbxNode* node = static_cast<FbxNode*>(mesh.bones[b].node);
+        boneNodes[b] = node ? node : scene->FindNodeByName(mesh.bones[b].name.c_str());
+    }
+    const double frameRate = s_animFrameRate > 0.0f ? s_animFrameRate : FbxTime::GetFrameRate(scene->GetGlobalSettings().GetTimeMode());
+    auto parentNode = [&](size_t b)
+    {
+        const int32_t parent = mesh.bones[b].parentIndex;
+        return parent >= 0 ? boneNodes[parent] : nullptr;
+    };
+
+    uint64_t sampleCount = 0;
+    uint64_t keyCount = 0;
+    for (int s = 0; s < stackCount; ++s)
+    {
+        FbxAnimStack* stack = scene->GetSrcObject<FbxAnimStack>(s);
+        ItpAnim::Clip clip;
+        clip.name = stack->GetName();
+        clip.frameRate = static_cast<float>(frameRate);
+
+        // the tracks this mesh claimed (and bones without a node, which aren't shared)
+        std::vector<std::shared_future<ItpAnim::Track>> tracks(boneCount);
+        std::vector<size_t> ownBones;
+        std::vector<std::promise<ItpAnim::Track>> promises;
+        // mesh-space globals of the nodes the own tracks need, node n's at [n * frameCount + frame]
+        std::unordered_map<FbxNode*, size_t> nodeSlots;
+        std::vector<FbxAMatrix> globals;
         {
-            s_doSkinning = true;
+            std::lock_guard<std::mutex> lock(s_sdkMutex);
+            scene->SetCurrentAnimationStack(stack);
+            const FbxTimeSpan span = stack->GetLocalTimeSpan();
+            uint64_t frameCount = static_cast<uint64_t>(std::max(0.0, std::floor(span.GetDuration().GetSecondDouble() * frameRate + 0.5))) + 1;
+            if (frameCount > ItpAnim::MaxFrames)
+            {
+                log.err << "Warning: clip " << clip.name << " of " << mesh.name << " cut to " << ItpAnim::MaxFrames << " frames\n";
+                frameCount = ItpAnim::MaxFrames;
+            }
+            clip.frameCount = static_cast<uint32_t>(frameCount);
+            auto frameTime = [&](uint32_t f)
+            {
+                FbxTime offset;
+                offset.SetSecondDouble(f / frameRate);
+                return span.GetStart() + offset;
+            };
+
+            std::vector<FbxAMatrix> meshGlobals(clip.frameCount);
+            for (uint32_t f = 0; f < clip.frameCount; ++f)
+                meshGlobals[f] = meshNode->EvaluateGlobalTransform(frameTime(f));
+            SceneAnimation& shared = s_sceneAnimations[scene];
+            shared.spaces.resize(stackCount);
+            auto& spaces = shared.spaces[s];
+            auto space = std::find_if(spaces.begin(), spaces.end(),
+                [&](const std::pair<FbxNode*, std::vector<FbxAMatrix>>& other) { return other.second == meshGlobals; });
+            if (space == spaces.end())
+                space = spaces.emplace(spaces.end(), meshNode, std::move(meshGlobals));
+
+            for (size_t b = 0; b < boneCount; ++b)
+            {
+                if (!boneNodes[b])
+                {
+                    promises.emplace_back();
+                    tracks[b] = promises.back().get_future().share();
+                    ownBones.push_back(b);
+                    continue;
+                }
+                const SceneAnimation::TrackKey key = { s, space->first, boneNodes[b], parentNode(b) };
+                auto it = shared.tracks.find(key);
+                if (it == shared.tracks.end())
+                {
+                    promises.emplace_back();
+                    it = shared.tracks.emplace(key, promises.back().get_future().share()).first;
+                    ownBones.push_back(b);
+                    for (FbxNode* node : { key.bone, key.parent })
+                    {
+                        if (node)
+                            nodeSlots.emplace(node, nodeSlots.size());
+                    }
+                }
+                tracks[b] = it->second;
+            }
+
+            // the same mesh-space globals as the bind poses, each node sampled once
+            std::vector<FbxNode*> nodes(nodeSlots.size());
+            for (const std::pair<FbxNode* const, size_t>& slot : nodeSlots)
+                nodes[slot.second] = slot.first;
+            globals.resize(nodes.size() * clip.frameCount);
+            for (uint32_t f = 0; f < clip.frameCount; ++f)
+            {
+                const FbxTime time = frameTime(f);
+                const FbxAMatrix meshInverse = space->second[f].Inverse();
+                for (size_t n = 0; n < nodes.size(); ++n)
+                    globals[n * clip.frameCount + f] = nodes[n]->EvaluateGlobalTransform(time) * meshInverse;
+            }
         }
+
+        const uint32_t frameCount = clip.frameCount;
+        ThreadPool::ParallelFor(ownBones.size(), s_jobCount, [&](size_t i)
+            {
+                const size_t b = ownBones[i];
+                std::vector<Quaternion> rotations(frameCount, mesh.bones[b].bindPose.rot);
+                std::vector<Vector3> translations(frameCount, mesh.bones[b].bindPose.trans);
+                if (boneNodes[b])
+                {   // parent-relative locals, like the bind poses
+                    const FbxAMatrix* bone = &globals[nodeSlots.at(boneNodes[b]) * frameCount];
+                    FbxNode* parent = parentNode(b);
+                    const FbxAMatrix* parentGlobals = parent ? &globals[nodeSlots.at(parent) * frameCount] : nullptr;
+                    for (uint32_t f = 0; f < frameCount; ++f)
+                    {
+                        const ItpMesh::Bone::BindPose pose = ToBonePose(parentGlobals ? parentGlobals[f].Inverse() * bone[f] : bone[f]);
+                        rotations[f] = pose.rot;
+                        translations[f] = pose.trans;
+                    }
+                }
+                ItpAnim::Track track;
+                track.SetSamples(rotations.data(), translations.data(), frameCount);
+                track.Reduce(s_animRotationError, s_animTranslationError);
+                promises[i].set_value(std::move(track));
+            });
+
+        clip.tracks.resize(boneCount);
+        for (size_t b = 0; b < boneCount; ++b)
+            clip.tracks[b] = tracks[b].get();
+        const size_t clipKeys = clip.GetKeyCount();
+        sampleCount += 2 * ownBones.size() * clip.frameCount;
+        keyCount += clipKeys;
+        log.out << "    " << clip.name << " (frames: " << clip.frameCount << ", keys: " << clipKeys << " of " << 2 * boneCount * clip.frameCount;
+        if (ownBones.size() < boneCount)
+            log.out << ", " << boneCount - ownBones.size() << " tracks shared";
+        log.out << ")\n";
+
+        std::string outputPath = mesh.name + "_" + ToFileName(clip.name) + ".itpanim";
+        std::vector<uint8_t> file;
+        clip.WriteToBinary(file);
+        s_fileWriter->Write(outputPath, std::move(file));
+        counts.outputs.push_back(outputPath);
     }
+    scope.SetCounts(sampleCount, keyCount);
 }
 
-int main(int argc, char** argv)
+// -stream: converts the mesh in windows of welded vertices and writes each window to the
+// binary output as soon as it is complete, so the working set stays near s_streamMemoryCap
+// however big the mesh is. Vertices are only welded and cache optimized within a window.
+static MeshCounts StreamMeshToItp(FbxMesh* mesh, int index, ConvertLog& log)
 {
-    if (argc < 2)
-    {
-        std::cerr << "Usage: " << (argc > 0 ? argv[0] : "FBX2ITP") << " input.fbx\n";
-        return 1;
+    MeshCounts counts;
+    if (!mesh)
+        return counts;
+
+    Profiler::Scope scope("StreamMesh");
+    // the current window; name, format and bones describe the whole mesh
+    ItpMesh::Mesh window;
+    std::vector<MeshBuilder::SkinSlots> ctrlBones;
+    std::vector<MeshBuilder::SkinSlots> ctrlWeights;
+    ReadMeshHeader(mesh, &window, index, ctrlBones, ctrlWeights, log);
+    scope.SetSubject(window.name);
+    log.out << window.name << "\n";
+    if (s_doBlendShapes && mesh->GetDeformerCount(FbxDeformer::eBlendShape) > 0)
+        log.err << "Warning: blendshapes of " << window.name << " are not exported in streaming mode\n";
+    if (s_generateTangents) // tangent groups can span windows
+        log.err << "Warning: tangents of " << window.name << " are not generated in streaming mode\n";
+    if (!s_lodRatios.empty() || !s_lodErrors.empty())
+        log.err << "Warning: LODs of " << window.name << " are not generated in streaming mode\n";
+    if (s_buildMeshlets)
+        log.err << "Warning: meshlets of " << window.name << " are not built in streaming mode\n";
+    if (s_buildBvh)
+        log.err << "Warning: the BVH of " << window.name << " is not built in streaming mode\n";
+    if (s_streamCodec != ItpMesh::VertexFormat::CodecNone)
+        log.err << "Warning: " << window.name << " is not compressed in streaming mode\n";
+    if (s_split16 || (s_paletteBones > 0 && window.format.hasSkin))
+        log.err << "Warning: " << window.name << " is not split into submeshes in streaming mode\n";
+
+    const FbxVector4* controlPoints = mesh->GetControlPoints();
+    const int controlPointCount = mesh->GetControlPointsCount();
+    if (window.format.positionEncoding == ItpMesh::VertexFormat::PositionUnorm16 && controlPointCount > 0)
+    {   // every corner position is a control point, so their bounds are the mesh bounds
+        auto toVector3 = [](const FbxVector4& v)
+        {
+            return Vector3(static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2]));
+        };
+        Vector3 boundsMin = toVector3(controlPoints[0]);
+        Vector3 boundsMax = boundsMin;
+        for (int i = 1; i < controlPointCount; ++i)
+        {
+            Vector3 p = toVector3(controlPoints[i]);
+            boundsMin = Vector3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z));
+            boundsMax = Vector3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+        }
+        window.format.FitPositionQuantization(boundsMin, boundsMax);
     }
-    const char* inputPath = argv[1];
-    ReadOptions(argc, argv);
 
-    // Initialize SDK manager
-    FbxManager* sdkManager = FbxManager::Create();
-    if (!sdkManager)
+    std::string outputPath = window.name + ".itpmesh3";
+    ItpMesh::BinaryStreamWriter writer(window.format, window.name);
+    if (!writer.Open(outputPath))
     {
-        std::cerr << "Failed to create FBX Manager\n";
-        return 1;
+        log.err << "Failed to open output file: " << outputPath << "\n";
+        return counts;
     }
 
-    // IO settings
-    FbxIOSettings* ios = FbxIOSettings::Create(sdkManager, IOSROOT);
-    sdkManager->SetIOSettings(ios);
+    // Rough working set per window vertex: the VertexData, its weld key and table slots,
+    // the optimizer's per-vertex state and about two triangles
+    const size_t bytesPerVertex = 256;
+    const size_t windowVertexLimit = std::max<size_t>(s_streamMemoryCap / bytesPerVertex, 1 << 16);
+    const int polygonsPerRange = 1 << 16;
+    const size_t welderCorners = std::min(windowVertexLimit * 2, static_cast<size_t>(mesh->GetPolygonVertexCount()));
 
-    // Create importer
-    FbxImporter* importer = FbxImporter::Create(sdkManager, "");
-    if (!importer->Initialize(inputPath, -1, sdkManager->GetIOSettings()))
+    size_t windowCount = 0;
+    std::unique_ptr<VertexWelder> welder;
+    auto flushWindow = [&]()
     {
-        std::cerr << "Failed to initialize importer for: " << inputPath << "\n";
-        std::cerr << "Error: " << importer->GetStatus().GetErrorString() << "\n";
-        importer->Destroy();
-        sdkManager->Destroy();
-        return 1;
+        if (window.verts.empty())
+            return;
+        if (s_optimizeVertexCache)
+        {
+            ConvertLog windowLog; // per window stats would only be noise
+            OptimizeMeshToItp(&window, windowLog);
+        }
+        writer.WriteTriangles(window.indices.data(), window.indices.size(), static_cast<uint32_t>(writer.GetVertexCount()));
+        writer.WriteVertices(window.verts.data(), window.verts.size());
+        window.verts.clear();
+        window.indices.clear();
+        welder.reset();
+        ++windowCount;
+    };
+
+    FbxHelper::MeshLayers layers;
+    FbxHelper::CaptureMeshLayers(mesh, layers);
+    FbxHelper::MeshCorners corners;
+    size_t droppedPolygons = 0;
+    const int polygonCount = mesh->GetPolygonCount();
+    for (int firstPolygon = 0; firstPolygon < polygonCount; firstPolygon += polygonsPerRange)
+    {
+        FbxHelper::ExtractCornerRange(mesh, layers, firstPolygon, polygonsPerRange, corners);
+        droppedPolygons += FbxHelper::TriangulateCorners(corners);
+        const size_t rangeTriangles = corners.controlPoint.size() / 3;
+        for (size_t t = 0; t < rangeTriangles; ++t)
+        {
+            if (!welder)
+                welder.reset(new VertexWelder(window.format, welderCorners, s_weldTolerance));
+
+            ItpMesh::Mesh::Triangle tri = {};
+            for (size_t v = 0; v < 3; ++v)
+            {
+                size_t c = 3 * t + v;
+                VertexData vert = BuildCornerVertex(corners, c, window.format.hasSkin, ctrlBones, ctrlWeights);
+                bool isNew = false;
+                uint32_t vertIndex = welder->Weld(vert, isNew);
+                if (isNew)
+                    window.verts.emplace_back(vert);
+                // reverse the winding order
+                tri.index[2 - v] = vertIndex;
+            }
+            window.indices.push_back(tri);
+
+            if (window.verts.size() >= windowVertexLimit)
+                flushWindow();
+        }
+    }
+    flushWindow();
+    if (droppedPolygons > 0)
+        log.err << "Warning: dropped " << droppedPolygons << " polygon(s) of " << window.name << " with fewer than 3 corners\n";
+
+    counts.name = window.name;
+    counts.vertexCount = static_cast<size_t>(writer.GetVertexCount());
+    counts.triangleCount = static_cast<size_t>(writer.GetTriangleCount());
+    scope.SetCounts(static_cast<uint64_t>(controlPointCount), counts.vertexCount);
+    if (!writer.Finish())
+    {
+        log.err << "Failed to write output file: " << outputPath << "\n";
+        counts.ok = false;
+    }
+    else
+    {
+        counts.outputs.push_back(outputPath);
     }
+    log.out << "  Streamed " << counts.vertexCount << " vertices, " << counts.triangleCount
+        << " triangles in " << windowCount << " window(s)\n";
 
-    // Create scene and import
-    FbxScene* scene = FbxScene::Create(sdkManager, "scene");
-    if (!importer->Import(scene))
+    if (s_doSkinning && window.format.hasSkin)
     {
-        std::cerr << "Failed to import scene\n";
-        importer->Destroy();
-        sdkManager->Destroy();
-        return 1;
+        JsonWriter json(s_jsonPrecision);
+        WriteSkeleton(window, json, counts, log);
+        if (s_exportAnimation)
+            WriteAnimations(mesh->GetNode(), window, counts, log);
     }
-    importer->Destroy();
+    return counts;
+}
 
-    FbxGeometryConverter converter(sdkManager);
-    converter.Triangulate(scene, true); // The 'true' parameter ensures original nodes are replaced.
+// Reads one mesh and runs every stage on it up to the output; the position quantization
+// is left to WriteMeshFiles so merged meshes fit it to their whole bounds
+static void ConvertMeshToItp(FbxMesh* mesh, ItpMesh::Mesh* out, int index, ConvertLog& log)
+{
+    ProcessMeshToItp(mesh, out, index, log);
+    log.out << out->name << "\n";
+    if (s_optimizeVertexCache)
+        OptimizeMeshToItp(out, log);
+    const bool palettes = s_paletteBones > 0 && out->format.hasSkin;
+    if (s_buildMeshlets && palettes)
+        log.err << "Warning: meshlets of " << out->name << " are not built with bone palettes\n";
+    else if (s_buildMeshlets)
+        BuildMeshletsToItp(out, log);
+    if (palettes || (s_split16 && !s_index32 && out->verts.size() > ItpMesh::Mesh::MaxShortIndexVertices))
+        SplitMeshToItp(out, log);
+}
 
-    int index = 0;
-    WriteAllMesh(scene->GetRootNode(), index);
+// Writes the .itpmesh3 of a converted mesh and its skeleton, blendshape and clip files;
+// the clips are sampled relative to meshNode. The files are handed to s_fileWriter, so
+// they may still be queued on return.
+static MeshCounts WriteMeshFiles(ItpMesh::Mesh& itpMesh, FbxNode* meshNode, ConvertLog& log)
+{
+    if (itpMesh.format.positionEncoding == ItpMesh::VertexFormat::PositionUnorm16)
+        itpMesh.FitPositionQuantization();
+    BuildBoundsToItp(&itpMesh, log);
+    // each document is released to the file writer, which keeps it until it is written
+    JsonWriter json(s_jsonPrecision);
+    MeshCounts counts;
 
-    // Cleanup
+    {
+        Profiler::Scope fileScope("WriteMeshFile", itpMesh.name);
+        std::string outputPath = itpMesh.name + ".itpmesh3";
+        size_t fileSize = 0;
+        if (s_writeBinary)
+        {
+            std::vector<uint8_t> file;
+            itpMesh.WriteToBinary(file);
+            fileSize = file.size();
+            s_fileWriter->Write(outputPath, std::move(file));
+        }
+        else
+        {
+            itpMesh.WriteToJson(json);
+            fileSize = json.GetSize();
+            s_fileWriter->Write(outputPath, json.Release());
+        }
+        fileScope.SetCounts(itpMesh.verts.size(), fileSize);
+        counts.outputs.push_back(outputPath);
+    }
+
+    if (s_doSkinning && itpMesh.format.hasSkin)
+        WriteSkeleton(itpMesh, json, counts, log);
+    if (s_exportAnimation && itpMesh.format.hasSkin)
+        WriteAnimations(meshNode, itpMesh, counts, log);
+
+    if (s_doBlendShapes && !itpMesh.blendShapes.empty())
+    {
+        Profiler::Scope blendScope("WriteBlendShapes", itpMesh.name);
+        blendScope.SetCounts(itpMesh.blendShapes.size(), itpMesh.blendShapes.size());
+        log.out << "  BlendShapes:\n";
+        for (const auto& bs : itpMesh.blendShapes)
+            log.out << "    " << bs.name << " (deltas: " << bs.deltas.size() << (bs.sparse ? ", sparse" : "") << ")\n";
+
+        // formatted by one JSON writer per job; the files are queued as each is done
+        ThreadPool::ParallelFor(itpMesh.blendShapes.size(), s_jobCount, [&](size_t i)
+        {
+            const ItpMesh::BlendShape& bs = itpMesh.blendShapes[i];
+            JsonWriter blendJson(s_jsonPrecision);
+            bs.WriteToJson(blendJson);
+            s_fileWriter->Write(bs.name + ".itpblend", blendJson.Release());
+        });
+        for (const ItpMesh::BlendShape& bs : itpMesh.blendShapes)
+            counts.outputs.push_back(bs.name + ".itpblend");
+    }
+
+    counts.name = itpMesh.name;
+    counts.vertexCount = itpMesh.verts.size();
+    counts.triangleCount = itpMesh.indices.size();
+    return counts;
+}
+
+static MeshCounts WriteMesh(FbxMesh* mesh, int index, ConvertLog& log)
+{
+    if (s_streamMode)
+        return StreamMeshToItp(mesh, index, log);
+
+    Profiler::Scope scope("WriteMesh");
+    ItpMesh::Mesh itpMesh;
+    ConvertMeshToItp(mesh, &itpMesh, index, log);
+    scope.SetSubject(itpMesh.name);
+    MeshCounts counts = WriteMeshFiles(itpMesh, mesh->GetNode(), log);
+    scope.SetCounts(static_cast<uint64_t>(mesh->GetControlPointsCount()), counts.vertexCount);
+    return counts;
+}
+
+// Everything that changes output bytes, for the cache keys. Job counts and the I/O
+// pipeline settings are left out as the output doesn't depend on them.
+static void AddOptionsToHash(ContentHash& hash)
+{
+    hash.AddValue(BuildCache::Version).AddValue(ItpMesh::BinaryVersion);
+    hash.AddValue(s_doBlendShapes).AddValue(s_doSkinning).AddValue(s_writeBinary);
+    hash.AddValue(s_streamMode).AddValue(static_cast<uint64_t>(s_streamMemoryCap));
+    hash.AddValue(s_weldTolerance.position).AddValue(s_weldTolerance.normalAngle).AddValue(s_weldTolerance.uv);
+    hash.AddValue(s_optimizeVertexCache).AddValue(s_overdrawThreshold).AddValue(s_jsonPrecision);
+    hash.AddValue(s_blendShapeThreshold).AddValue(s_blendShapeDenseRatio).AddValue(s_generateTangents);
+    hash.AddValue(s_sdkTriangulate);
+    hash.AddArray(s_lodRatios.data(), s_lodRatios.size()).AddArray(s_lodErrors.data(), s_lodErrors.size());
+    hash.AddValue(s_buildMeshlets).AddValue(s_meshletMaxVertices).AddValue(s_meshletMaxTriangles);
+    hash.AddValue(s_buildBvh).AddValue(s_bvhLeafTriangles);
+    hash.AddValue(s_normalEncoding).AddValue(s_uvEncoding).AddValue(s_positionEncoding).AddValue(s_streamCodec);
+    hash.AddValue(s_index32).AddValue(s_split16).AddValue(s_mergeMeshes);
+    hash.AddValue(s_skinInfluences).AddValue(s_weights16).AddValue(s_bones16).AddValue(s_paletteBones);
+    hash.AddValue(s_exportAnimation).AddValue(ItpAnim::BinaryVersion).AddValue(s_animFrameRate)
+        .AddValue(s_animRotationError).AddValue(s_animTranslationError);
+}
+
+template<typename T>
+static void AddLayerToHash(ContentHash& hash, const FbxHelper::Layer<T>& layer)
+{
+    hash.AddValue(static_cast<int>(layer.mapping));
+    hash.AddArray(layer.indices.data(), layer.indices.size());
+    hash.AddArray(layer.values.data(), layer.values.size());
+}
+
+static void AddMatrixToHash(ContentHash& hash, const FbxAMatrix& m)
+{
+    for (int r = 0; r < 4; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+            hash.AddValue(m.Get(r, c));
+    }
+}
+
+// -a: the stacks and whatever moves the mesh or its bones: the default local transform
+// and the curves of each of those nodes and their ancestors
+static void AddAnimationToHash(ContentHash& hash, FbxMesh* mesh)
+{
+    FbxScene* scene = mesh->GetScene();
+    if (!scene)
+        return;
+    std::vector<FbxNode*> nodes;
+    auto addWithAncestors = [&](FbxNode* node)
+    {
+        for (; node && std::find(nodes.begin(), nodes.end(), node) == nodes.end(); node = node->GetParent())
+            nodes.push_back(node);
+    };
+    addWithAncestors(mesh->GetNode());
+    for (int s = 0; s < mesh->GetDeformerCount(FbxDeformer::eSkin); ++s)
+    {
+        FbxSkin* skin = static_cast<FbxSkin*>(mesh->GetDeformer(s, FbxDeformer::eSkin));
+        for (int c = 0; skin && c < skin->GetClusterCount(); ++c)
+            addWithAncestors(skin->GetCluster(c) ? skin->GetCluster(c)->GetLink() : nullptr);
+    }
+
+    // evaluation fills the scene's evaluator cache
+    std::lock_guard<std::mutex> lock(s_sdkMutex);
+    for (FbxNode* node : nodes)
+    {
+        hash.AddString(node->GetName());
+        AddMatrixToHash(hash, node->EvaluateLocalTransform(FBXSDK_TIME_INFINITE));
+    }
+    for (int s = 0; s < scene->GetSrcObjectCount<FbxAnimStack>(); ++s)
+    {
+        FbxAnimStack* stack = scene->GetSrcObject<FbxAnimStack>(s);
+        const FbxTimeSpan span = stack->GetLocalTimeSpan();
+        hash.AddString(stack->GetName()).AddValue(span.GetStart().Get()).AddValue(span.GetStop().Get());
+        for (int l = 0; l < stack->GetMemberCount<FbxAnimLayer>(); ++l)
+        {
+            FbxAnimLayer* layer = stack->GetMember<FbxAnimLayer>(l);
+            for (FbxNode* node : nodes)
+            {
+                FbxPropertyT<FbxDouble3>* properties[3] = { &node->LclTranslation, &node->LclRotation, &node->LclScaling };
+                const char* channels[3] = { FBXSDK_CURVENODE_COMPONENT_X, FBXSDK_CURVENODE_COMPONENT_Y, FBXSDK_CURVENODE_COMPONENT_Z };
+                for (FbxPropertyT<FbxDouble3>* property : properties)
+                {
+                    for (const char* channel : channels)
+                    {
+                        FbxAnimCurve* curve = property->GetCurve(layer, channel);
+                        const int keyCount = curve ? curve->KeyGetCount() : 0;
+                        hash.AddValue(keyCount);
+                        for (int k = 0; k < keyCount; ++k)
+                        {
+                            hash.AddValue(curve->KeyGetTime(k).Get()).AddValue(curve->KeyGetValue(k))
+                                .AddValue(static_cast<int>(curve->KeyGetInterpolation(k)));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Cache key of one mesh: the options plus every part of the scene that ReadMeshHeader,
+// ReadSkin, ReadBlendShapes, the corner extraction and WriteAnimations read for it
+static std::string HashMeshSource(FbxMesh* mesh, int index)
+{
+    ContentHash hash;
+    AddOptionsToHash(hash);
+    FbxNode* node = mesh->GetNode();
+    hash.AddString(node ? node->GetName() : "mesh_" + std::to_string(index));
+
+    hash.AddArray(mesh->GetControlPoints(), static_cast<size_t>(mesh->GetControlPointsCount()));
+    const int polygonCount = mesh->GetPolygonCount();
+    hash.AddValue(polygonCount);
+    for (int p = 0; p < polygonCount; ++p)
+        hash.AddValue(mesh->GetPolygonSize(p));
+    hash.AddArray(mesh->GetPolygonVertices(), static_cast<size_t>(mesh->GetPolygonVertexCount()));
+
+    hash.AddValue(mesh->GetElementNormal(0) != nullptr).AddValue(mesh->GetElementTangent(0) != nullptr)
+        .AddValue(mesh->GetElementUV(0) != nullptr);
+    FbxHelper::MeshLayers layers;
+    FbxHelper::CaptureMeshLayers(mesh, layers);
+    AddLayerToHash(hash, layers.norm);
+    AddLayerToHash(hash, layers.tan);
+    AddLayerToHash(hash, layers.uv);
+
+    if (s_doSkinning)
+    {
+        for (int s = 0; s < mesh->GetDeformerCount(FbxDeformer::eSkin); ++s)
+        {
+            FbxSkin* skin = static_cast<FbxSkin*>(mesh->GetDeformer(s, FbxDeformer::eSkin));
+            for (int c = 0; skin && c < skin->GetClusterCount(); ++c)
+            {
+                FbxCluster* cluster = skin->GetCluster(c);
+                FbxNode* link = cluster ? cluster->GetLink() : nullptr;
+                hash.AddValue(link != nullptr);
+                if (!link)
+                    continue;
+                // the bone parents come from the names up the link's hierarchy
+                for (FbxNode* n = link; n; n = n->GetParent())
+                    hash.AddString(n->GetName());
+                FbxAMatrix linkBindMat, meshBindMat;
+                cluster->GetTransformLinkMatrix(linkBindMat);
+                cluster->GetTransformMatrix(meshBindMat);
+                AddMatrixToHash(hash, linkBindMat);
+                AddMatrixToHash(hash, meshBindMat);
+                const size_t influenceCount = static_cast<size_t>(cluster->GetControlPointIndicesCount());
+                hash.AddArray(cluster->GetControlPointIndices(), influenceCount);
+                hash.AddArray(cluster->GetControlPointWeights(), influenceCount);
+            }
+        }
+    }
+
+    if (s_exportAnimation)
+        AddAnimationToHash(hash, mesh);
+
+    if (s_doBlendShapes)
+    {
+        for (int d = 0; d < mesh->GetDeformerCount(FbxDeformer::eBlendShape); ++d)
+        {
+            FbxBlendShape* blendShape = static_cast<FbxBlendShape*>(mesh->GetDeformer(d, FbxDeformer::eBlendShape));
+            for (int c = 0; blendShape && c < blendShape->GetBlendShapeChannelCount(); ++c)
+            {
+                FbxBlendShapeChannel* channel = blendShape->GetBlendShapeChannel(c);
+                hash.AddValue(channel != nullptr);
+                if (!channel)
+                    continue;
+                hash.AddString(channel->GetName());
+                for (int t = 0; t < channel->GetTargetShapeCount(); ++t)
+                {
+                    FbxShape* shape = channel->GetTargetShape(t);
+                    hash.AddValue(shape != nullptr);
+                    if (!shape)
+                        continue;
+                    hash.AddArray(shape->GetControlPoints(), static_cast<size_t>(shape->GetControlPointsCount()));
+                    FbxHelper::Layer<Vector3> shapeLayer;
+                    FbxHelper::CaptureNormals(shape, shapeLayer);
+                    AddLayerToHash(hash, shapeLayer);
+                    shapeLayer = FbxHelper::Layer<Vector3>();
+                    FbxHelper::CaptureTangents(shape, shapeLayer);
+                    AddLayerToHash(hash, shapeLayer);
+                }
+            }
+        }
+    }
+    return hash.GetHex();
+}
+
+// WriteMesh through the cache (-cache): a mesh with the same source data and options as
+// an earlier conversion gets its files restored instead. meshKey is set either way; a
+// converted mesh is stored by StoreMeshesInCache once its files are written.
+static MeshCounts WriteMeshCached(FbxMesh* mesh, int index, const BuildCache* cache, std::string& meshKey, ConvertLog& log)
+{
+    if (!cache)
+        return WriteMesh(mesh, index, log);
+
+    meshKey = HashMeshSource(mesh, index);
+    BuildCache::MeshEntry entry;
+    size_t written = 0;
+    if (cache->LoadMesh(meshKey, entry) && cache->RestoreMesh(entry, written))
+    {
+        log.out << entry.name << "\n  Restored from cache (" << written << " of " << entry.files.size()
+            << " files rewritten)\n";
+        MeshCounts counts;
+        counts.name = entry.name;
+        counts.vertexCount = entry.vertexCount;
+        counts.triangleCount = entry.triangleCount;
+        counts.restored = true;
+        counts.outputs = entry.files;
+        return counts;
+    }
+    return WriteMesh(mesh, index, log);
+}
+
+// Waits for the queued outputs of the meshes and reports each one that failed.
+// Returns whether every mesh is still ok.
+static bool FlushMeshOutputs(std::vector<MeshCounts>& counts, std::ostream& err)
+{
+    Profiler::Scope scope("FlushOutputs");
+    s_fileWriter->Flush();
+    for (MeshCounts& c : counts)
+    {
+        if (c.restored)
+            continue;
+        for (const std::string& output : c.outputs)
+        {
+            if (s_fileWriter->Failed(output))
+            {
+                err << "Failed to write output file: " << output << "\n";
+                c.ok = false;
+            }
+        }
+    }
+    return std::all_of(counts.begin(), counts.end(), [](const MeshCounts& c) { return c.ok; });
+}
+
+// After FlushMeshOutputs: the cache copies the written files of every converted mesh;
+// meshKeys of the meshes that are not stored are cleared
+static void StoreMeshesInCache(const BuildCache& cache, const std::vector<MeshCounts>& counts, std::vector<std::string>& meshKeys,
+    std::ostream& err)
+{
+    std::vector<bool> stored(counts.size(), true);
+    ThreadPool::ParallelFor(counts.size(), s_jobCount, [&](size_t i)
+        {
+            const MeshCounts& c = counts[i];
+            if (c.restored || meshKeys[i].empty())
+                return;
+            BuildCache::MeshEntry entry;
+            entry.key = meshKeys[i];
+            entry.name = c.name;
+            entry.vertexCount = c.vertexCount;
+            entry.triangleCount = c.triangleCount;
+            entry.files = c.outputs;
+            stored[i] = c.ok && cache.StoreMesh(entry);
+        });
+    for (size_t i = 0; i < counts.size(); ++i)
+    {
+        if (stored[i])
+            continue;
+        if (counts[i].ok)
+            err << "Warning: could not store " << counts[i].name << " in the cache\n";
+        meshKeys[i].clear();
+    }
+}
+
+static void CollectMeshes(FbxNode* node, std::vector<FbxMesh*>& meshes)
+{
+    if (!node)
+        return;
+    FbxMesh* mesh = node->GetMesh();
+    if (mesh)
+        meshes.push_back(mesh);
+    for (int i = 0; i < node->GetChildCount(); ++i)
+    {
+        CollectMeshes(node->GetChild(i), meshes);
+    }
+}
+
+// -merge: converts every mesh (on the worker pool), then packs the meshes whose vertices
+// are laid out alike into one mesh each, in scene order, as long as their skeletons fit
+// together. The merged meshes are named after the file: name, name_1, ...
+// Returns whether every output was written.
+static bool MergeAllMesh(const std::vector<FbxMesh*>& meshes, const std::string& mergedName,
+    std::ostream& out, std::ostream& err, FileSummary& summary)
+{
+    std::vector<ItpMesh::Mesh> itpMeshes(meshes.size());
+    std::vector<ConvertLog> logs(meshes.size());
+    ThreadPool::ParallelFor(meshes.size(), s_jobCount, [&](size_t i)
+        {
+            Profiler::Scope scope("ConvertMesh");
+            ConvertMeshToItp(meshes[i], &itpMeshes[i], static_cast<int>(i), logs[i]);
+            scope.SetSubject(itpMeshes[i].name);
+            scope.SetCounts(static_cast<uint64_t>(meshes[i]->GetControlPointsCount()), itpMeshes[i].verts.size());
+        });
+    for (const ConvertLog& log : logs)
+    {
+        out << log.out.str();
+        err << log.err.str();
+    }
+
+    std::vector<ItpMesh::Mesh> merged;
+    std::vector<size_t> sourceCounts;
+    std::vector<FbxNode*> mergedNodes;  // of each merged mesh's first mesh, for its clips
+    {
+        Profiler::Scope scope("MergeMeshes", mergedName);
+        for (size_t i = 0; i < itpMeshes.size(); ++i)
+        {
+            ItpMesh::Mesh& itpMesh = itpMeshes[i];
+            size_t m = 0;
+            while (m < merged.size() && !merged[m].Merge(itpMesh))
+                ++m;
+            if (m == merged.size())
+            {   // a single mesh always fits
+                merged.emplace_back();
+                merged.back().name = m == 0 ? mergedName : mergedName + "_" + std::to_string(m);
+                merged.back().Merge(itpMesh);
+                sourceCounts.push_back(0);
+                mergedNodes.push_back(meshes[i]->GetNode());
+            }
+            ++sourceCounts[m];
+            itpMesh = ItpMesh::Mesh();
+        }
+        scope.SetCounts(meshes.size(), merged.size());
+    }
+
+    std::vector<MeshCounts> counts(merged.size());
+    for (size_t m = 0; m < merged.size(); ++m)
+    {
+        ConvertLog log;
+        log.out << merged[m].name << "\n  Merged " << sourceCounts[m] << " meshes into " << merged[m].submeshes.size()
+            << " submeshes, " << merged[m].bones.size() << " bones\n";
+        counts[m] = WriteMeshFiles(merged[m], mergedNodes[m], log);
+        // the written mesh is only needed by the queued files, which hold their own copy
+        merged[m] = ItpMesh::Mesh();
+        out << log.out.str();
+        err << log.err.str();
+        summary.vertexCount += counts[m].vertexCount;
+        summary.triangleCount += counts[m].triangleCount;
+    }
+    const bool ok = FlushMeshOutputs(counts, err);
+    summary.meshCount += meshes.size();
+    return ok;
+}
+
+// Converts every mesh under node. With s_jobCount > 1 the meshes are converted and
+// written on a worker pool; the scene is only read, and each mesh writes its own files,
+// so the output is identical to the serial path. Logs are printed in scene order. The
+// files go out on s_fileWriter while later meshes convert; this returns once they are
+// written. With a cache, meshKeys gets the cache key of each mesh (empty if it wasn't stored).
+// With -merge the merged meshes are named mergedName and are not cached.
+// Returns whether every mesh converted and every output was written.
+static bool WriteAllMesh(FbxNode* node, const std::string& mergedName, const BuildCache* cache, std::vector<std::string>& meshKeys,
+    std::ostream& out, std::ostream& err, FileSummary& summary)
+{
+    std::vector<FbxMesh*> meshes;
+    CollectMeshes(node, meshes);
+    meshKeys.assign(meshes.size(), std::string());
+    if (s_mergeMeshes && s_streamMode)
+        err << "Warning: meshes are not merged in streaming mode\n";
+    if (s_mergeMeshes && !s_streamMode)
+    {
+        return MergeAllMesh(meshes, mergedName, out, err, summary);
+    }
+
+    std::vector<ConvertLog> logs(meshes.size());
+    std::vector<MeshCounts> counts(meshes.size());
+    std::vector<bool> done(meshes.size(), false);
+    size_t nextToPrint = 0;
+    std::mutex printMutex;
+
+    ThreadPool::ParallelFor(meshes.size(), s_jobCount, [&](size_t i)
+        {
+            counts[i] = WriteMeshCached(meshes[i], static_cast<int>(i), cache, meshKeys[i], logs[i]);
+
+            std::lock_guard<std::mutex> lock(printMutex);
+            done[i] = true;
+            while (nextToPrint < meshes.size() && done[nextToPrint])
+            {
+                out << logs[nextToPrint].out.str();
+                err << logs[nextToPrint].err.str();
+                logs[nextToPrint] = ConvertLog();
+                ++nextToPrint;
+            }
+        });
+
+    const bool ok = FlushMeshOutputs(counts, err);
+    if (cache)
+        StoreMeshesInCache(*cache, counts, meshKeys, err);
+
+    summary.meshCount += meshes.size();
+    for (const MeshCounts& c : counts)
+    {
+        summary.vertexCount += c.vertexCount;
+        summary.triangleCount += c.triangleCount;
+    }
+    return ok;
+}
+
+// -cache: restores every mesh of a file entry, or nothing if any mesh entry is gone
+static bool RestoreFileFromCache(const BuildCache& cache, const std::string& fileKey, std::ostream& out, FileSummary& summary)
+{
+    std::vector<std::string> meshKeys;
+    if (!cache.LoadFile(fileKey, meshKeys))
+        return false;
+    std::vector<BuildCache::MeshEntry> entries(meshKeys.size());
+    for (size_t i = 0; i < meshKeys.size(); ++i)
+    {
+        if (!cache.LoadMesh(meshKeys[i], entries[i]))
+            return false;
+    }
+    for (const BuildCache::MeshEntry& entry : entries)
+    {
+        size_t written = 0;
+        if (!cache.RestoreMesh(entry, written))
+            return false;
+        out << entry.name << "\n  Restored from cache (" << written << " of " << entry.files.size()
+            << " files rewritten)\n";
+        summary.vertexCount += entry.vertexCount;
+        summary.triangleCount += entry.triangleCount;
+    }
+    summary.meshCount += entries.size();
+    return true;
+}
+
+// A file's cache lookup and import: everything before its meshes convert, which batch
+// mode runs ahead of the conversions
+struct ImportedFile
+{
+    FileSummary summary;
+    std::chrono::steady_clock::time_point start;
+    std::unique_ptr<BuildCache> cache;
+    std::string fileKey;
+    FbxScene* scene = nullptr;  // null once the file is restored from the cache, or failed
+};
+
+// Restores one .fbx file from the cache, or imports and triangulates it with an existing
+// manager. The FBX SDK manager is not thread-safe, so everything that creates or destroys
+// SDK objects runs under s_sdkMutex; conversion itself only reads the scene.
+static void ImportFile(FbxManager* sdkManager, const std::string& inputPath, ImportedFile& file, std::ostream& out, std::ostream& err)
+{
+    file.summary.path = inputPath;
+    file.start = std::chrono::steady_clock::now();
+
+    // a file whose bytes and options were converted before skips the import
+    if (!s_cachePath.empty())
+    {
+        Profiler::Scope cacheScope("CacheLookup", inputPath);
+        file.cache.reset(new BuildCache(s_cachePath));
+        ContentHash hash;
+        if (hash.AddFile(inputPath))
+        {
+            AddOptionsToHash(hash);
+            file.fileKey = hash.GetHex();
+            FileSummary restored = file.summary;
+            if (RestoreFileFromCache(*file.cache, file.fileKey, out, restored))
+            {
+                file.summary = restored;
+                file.summary.ok = true;
+                file.summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - file.start).count();
+                return;
+            }
+        }
+    }
+
+    FbxScene* scene = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(s_sdkMutex);
+
+        // Create importer
+        Profiler::Scope importScope("Import", inputPath);
+        FbxImporter* importer = FbxImporter::Create(sdkManager, "");
+        if (!importer->Initialize(inputPath.c_str(), -1, sdkManager->GetIOSettings()))
+        {
+            err << "Failed to initialize importer for: " << inputPath << "\n";
+            err << "Error: " << importer->GetStatus().GetErrorString() << "\n";
+            importer->Destroy();
+            return;
+        }
+
+        // Create scene and import
+        scene = FbxScene::Create(sdkManager, "scene");
+        if (!importer->Import(scene))
+        {
+            err << "Failed to import scene: " << inputPath << "\n";
+            importer->Destroy();
+            scene->Destroy();
+            return;
+        }
+        importer->Destroy();
+        importScope.SetCounts(0, static_cast<uint64_t>(scene->GetGeometryCount()));
+    }
+    if (s_sdkTriangulate)
+    {   // otherwise each mesh's polygons are split while reading its corners
+        std::lock_guard<std::mutex> lock(s_sdkMutex);
+        Profiler::Scope triangulateScope("Triangulate", inputPath);
+        FbxGeometryConverter converter(sdkManager);
+        converter.Triangulate(scene, true); // The 'true' parameter ensures original nodes are replaced.
+    }
+    file.scene = scene;
+}
+
+// Converts the meshes of an imported file and destroys its scene
+static FileSummary ConvertImportedFile(ImportedFile& file, std::ostream& out, std::ostream& err)
+{
+    FileSummary& summary = file.summary;
+    Profiler::Scope scope("ConvertFile", summary.path);
+    if (!file.scene)
+    {
+        scope.SetCounts(0, summary.meshCount);
+        return summary;
+    }
+
+    std::vector<std::string> meshKeys;
+    const bool ok = WriteAllMesh(file.scene->GetRootNode(), std::filesystem::path(summary.path).stem().string(),
+        file.cache.get(), meshKeys, out, err, summary);
+    if (!file.fileKey.empty() && std::find(meshKeys.begin(), meshKeys.end(), std::string()) == meshKeys.end())
+    {
+        if (!file.cache->StoreFile(file.fileKey, meshKeys))
+            err << "Warning: could not store " << summary.path << " in the cache\n";
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(s_sdkMutex);
+        s_sceneAnimations.erase(file.scene);
+        file.scene->Destroy();
+        file.scene = nullptr;
+    }
+
+    summary.ok = ok;
+    summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - file.start).count();
+    scope.SetCounts(0, summary.meshCount);
+    return summary;
+}
+
+// Imports, triangulates and converts one .fbx file with an existing manager
+static FileSummary ConvertFile(FbxManager* sdkManager, const std::string& inputPath, std::ostream& out, std::ostream& err)
+{
+    ImportedFile file;
+    ImportFile(sdkManager, inputPath, file, out, err);
+    return ConvertImportedFile(file, out, err);
+}
+
+static bool IsFbxFile(const std::filesystem::path& path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return ext == ".fbx";
+}
+
+// Expands the -batch argument: every .fbx under a directory (recursively), or
+// one path per line of a list file (blank lines and lines starting with '#' are skipped).
+static bool GatherBatchFiles(const std::string& batchPath, std::vector<std::string>& files)
+{
+    std::error_code ec;
+    if (std::filesystem::is_directory(batchPath, ec))
+    {
+        for (auto it = std::filesystem::recursive_directory_iterator(batchPath, ec);
+            !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+        {
+            if (it->is_regular_file(ec) && IsFbxFile(it->path()))
+                files.push_back(it->path().string());
+        }
+        std::sort(files.begin(), files.end());
+        return !ec;
+    }
+
+    std::ifstream list(batchPath);
+    if (!list.is_open())
+        return false;
+    std::string line;
+    while (std::getline(list, line))
+    {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        size_t last = line.find_last_not_of(" \t\r");
+        files.push_back(line.substr(first, last - first + 1));
+    }
+    return true;
+}
+
+// Converts every file of the batch with one shared manager and prints a per-file summary.
+// With s_importAhead > 0 an import thread reads the files in batch order, up to that many
+// past the last file a converter has started, so the next scene loads while the current
+// one converts. Returns the number of files that failed.
+static int ConvertBatch(FbxManager* sdkManager, const std::vector<std::string>& files)
+{
+    std::vector<FileSummary> summaries(files.size());
+    std::vector<ConvertLog> logs(files.size());
+    std::vector<bool> done(files.size(), false);
+    size_t nextToPrint = 0;
+    std::mutex printMutex;
+
+    std::vector<ImportedFile> imports(s_importAhead > 0 ? files.size() : 0);
+    size_t importedCount = 0;   // files 0 .. importedCount - 1 are ready
+    size_t startedCount = 0;    // files a converter has taken
+    std::mutex importMutex;
+    std::condition_variable importChanged;
+    std::thread importThread;
+    if (s_importAhead > 0)
+    {
+        importThread = std::thread([&]()
+        {
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(importMutex);
+                    importChanged.wait(lock, [&]() { return i < startedCount + s_importAhead; });
+                }
+                // the converter of file i only reads its log once the import is done
+                ImportFile(sdkManager, files[i], imports[i], logs[i].out, logs[i].err);
+                {
+                    std::lock_guard<std::mutex> lock(importMutex);
+                    importedCount = i + 1;
+                }
+                importChanged.notify_all();
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool::ParallelFor(files.size(), s_fileJobCount, [&](size_t i)
+        {
+            if (s_importAhead > 0)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(importMutex);
+                    startedCount = std::max(startedCount, i + 1);
+                    importChanged.notify_all();
+                    importChanged.wait(lock, [&]() { return importedCount > i; });
+                }
+                summaries[i] = ConvertImportedFile(imports[i], logs[i].out, logs[i].err);
+                imports[i] = ImportedFile();
+            }
+            else
+            {
+                summaries[i] = ConvertFile(sdkManager, files[i], logs[i].out, logs[i].err);
+            }
+
+            std::lock_guard<std::mutex> lock(printMutex);
+            done[i] = true;
+            while (nextToPrint < files.size() && done[nextToPrint])
+            {
+                const FileSummary& summary = summaries[nextToPrint];
+                std::cout << logs[nextToPrint].out.str();
+                std::cerr << logs[nextToPrint].err.str();
+                std::cout << "[" << (nextToPrint + 1) << "/" << files.size() << "] " << summary.path << ": ";
+                if (summary.ok)
+                {
+                    std::cout << summary.meshCount << " meshes, " << summary.vertexCount << " verts, "
+                        << summary.triangleCount << " tris, " << std::fixed << std::setprecision(3)
+                        << summary.seconds << "s\n" << std::defaultfloat;
+                }
+                else
+                {
+                    std::cout << "FAILED\n";
+                }
+                logs[nextToPrint] = ConvertLog();
+                ++nextToPrint;
+            }
+        });
+    if (importThread.joinable())
+        importThread.join();
+
+    int failed = 0;
+    FileSummary total;
+    for (const FileSummary& summary : summaries)
+    {
+        if (!summary.ok)
+            ++failed;
+        total.meshCount += summary.meshCount;
+        total.vertexCount += summary.vertexCount;
+        total.triangleCount += summary.triangleCount;
+    }
+    total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Batch: " << (files.size() - failed) << " of " << files.size() << " files converted, "
+        << total.meshCount << " meshes, " << total.vertexCount << " verts, " << total.triangleCount
+        << " tris, " << std::fixed << std::setprecision(3) << total.seconds << "s\n" << std::defaultfloat;
+    return failed;
+}
+
+static void PrintUsage(const char* exe)
+{
+    std::cerr << "Usage: " << exe << " input.fbx [options]\n"
+        << "       " << exe << " -batch list.txt|dir [-jf N] [options]\n"
+        << "Options:\n"
+        << "  -b            export blendshapes (.itpblend)\n"
+        << "  -s            export skinning and skeleton (.itpskel)\n"
+        << "  -a            also export every animation stack as a clip of each skinned mesh's skeleton\n"
+        << "                (mesh_stack.itpanim, binary; implies -s)\n"
+        << "  -animfps N    sample the clips at N frames per second (default: the scene's frame rate)\n"
+        << "  -animerror r,t  drop the clip keys that the others reproduce within r degrees and t units\n"
+        << "                (default 0.05,0.01); rotations are then stored in 48 bits, translations in 3 x 16\n"
+        << "  -bin          write .itpmesh3 as a memory-mappable binary file instead of JSON\n"
+        << "  -stream       write binary output while converting, one window of vertices at a time,\n"
+        << "                for meshes too big to convert in memory (no blendshapes; implies -bin)\n"
+        << "  -memcap MB    working set per streamed mesh (default 1024)\n"
+        << "  -ioqueue MB   output files waiting for the I/O thread before conversion stalls\n"
+        << "                (default 256; 0 = write on the converting threads)\n"
+        << "  -j N          convert up to N meshes, and the blendshape targets of each mesh,\n"
+        << "                in parallel (0 = one per hardware thread)\n"
+        << "  -weld p,n,uv  weld near-duplicate vertices: max position distance, max normal\n"
+        << "                angle in degrees and max uv difference (default: exact welding)\n"
+        << "  -nocache      keep the FBX triangle and vertex order (vertex cache optimization is on by default)\n"
+        << "  -overdraw T   after cache optimization, sort triangle clusters to reduce overdraw,\n"
+        << "                giving up at most a factor T of ACMR per cluster (e.g. 1.05)\n"
+        << "  -precision N  write JSON floats with N significant digits (default: shortest exact)\n"
+        << "  -bsthreshold T  drop blendshape deltas whose components are all within T (default 1e-5)\n"
+        << "  -bsdense R    keep a blendshape dense when more than a fraction R of its vertices\n"
+        << "                move (default 0.5; 1 = always sparse, 0 = always dense)\n"
+        << "  -tan          generate MikkTSpace tangents with a bitangent sign, replacing those in\n"
+        << "                the FBX (needs normals and uvs; also regenerates blendshape tangents)\n"
+        << "  -lod r1,r2..  generate simplified LODs keeping a fraction r of the triangles each, sharing\n"
+        << "                the mesh's vertices (e.g. 0.5,0.25,0.1; not in streaming mode)\n"
+        << "  -loderror e1,e2..  stop simplifying each LOD at an error e, relative to the mesh size\n"
+        << "                (default: no limit; LODs without a ratio go as far as the error allows)\n"
+        << "  -meshlets     also write meshlets for mesh shaders: clusters of the triangles with local\n"
+        << "                8 bit indices, a bounding sphere and a normal cone each (not in streaming mode)\n"
+        << "  -meshletsize v,t  vertex and triangle limit of a meshlet (default 64,124; v at most 256)\n"
+        << "  -bvh          also write a bounding volume hierarchy of the triangles (not in streaming mode)\n"
+        << "  -bvhleaf n    triangles per BVH leaf (default 4)\n"
+        << "  -sdktri       triangulate with the FBX SDK (slower; the converter splits polygons itself by default)\n"
+        << "  -qnorm 16|8   store normals and tangents octahedral-encoded in 2 x 16 or 2 x 8 bits\n"
+        << "  -quv          store texture coordinates as half floats\n"
+        << "  -qpos         store positions as 16 bit values normalized to the mesh bounds\n"
+        << "  -compress     encode the binary vertex and index streams (MeshCodec; implies -bin)\n"
+        << "  -zstd         also wrap each encoded stream in a zstd frame (implies -compress; needs\n"
+        << "                a build with ITP_HAVE_ZSTD)\n"
+        << "  -index32      always write 32 bit indices (by default meshes of up to 65536 verts get 16 bit ones)\n"
+        << "  -split16      split larger meshes into submeshes of up to 65536 verts so every index is\n"
+        << "                16 bit, relative to its submesh's base vertex (not in streaming mode)\n"
+        << "  -influences 4|8  bones per skinned vertex (default 4)\n"
+        << "  -weights16    store skin weights as 16 bit instead of 8 bit normalized values\n"
+        << "  -bones16      always store 16 bit bone indices (by default only past 256 bones)\n"
+        << "  -palette N    split skinned meshes into submeshes whose vertices weight at most N bones,\n"
+        << "                each with its own bone palette so only N matrices are bound per draw\n"
+        << "                (no LODs or meshlets for those meshes; not in streaming mode)\n"
+        << "  -merge        pack the meshes of a file into one mesh per vertex layout, named after the\n"
+        << "                file, with a submesh per mesh and one skeleton (not cached; not in streaming mode)\n"
+        << "  -cache dir    reuse the outputs of unchanged files and meshes from a cache directory\n"
+        << "  -profile path write per-stage time, allocations and element counts per file and mesh\n"
+        << "                (.csv: one row per stage run, otherwise JSON)\n"
+        << "  -trace path   write the stages as a Chrome trace (chrome://tracing, Perfetto)\n"
+        << "  -batch path   convert every file of a list file or every .fbx under a directory\n"
+        << "  -jf N         in batch mode, convert up to N files at once\n"
+        << "  -importahead N  in batch mode, import up to N files ahead of the conversions\n"
+        << "                (default 1; 0 = import each file when its conversion starts)\n";
+}
+
+void ReadOptions(int argc, char** argv)
+{
+    s_doBlendShapes = false;
+    s_doSkinning = false;
+    s_writeBinary = false;
+    s_jobCount = 1;
+    s_fileJobCount = 1;
+    s_weldTolerance = WeldTolerance();
+    s_optimizeVertexCache = true;
+    s_overdrawThreshold = 0.0f;
+    s_jsonPrecision = 0;
+    s_streamMode = false;
+    s_streamMemoryCap = size_t(1024) << 20;
+    s_ioQueueBytes = size_t(256) << 20;
+    s_importAhead = 1;
+    s_blendShapeThreshold = 1e-5f;
+    s_blendShapeDenseRatio = 0.5f;
+    s_generateTangents = false;
+    s_sdkTriangulate = false;
+    s_lodRatios.clear();
+    s_lodErrors.clear();
+    s_buildMeshlets = false;
+    s_meshletMaxVertices = 64;
+    s_meshletMaxTriangles = 124;
+    s_buildBvh = false;
+    s_bvhLeafTriangles = 4;
+    s_cachePath.clear();
+    s_profilePath.clear();
+    s_tracePath.clear();
+    s_normalEncoding = ItpMesh::VertexFormat::NormalFloat3;
+    s_uvEncoding = ItpMesh::VertexFormat::UVFloat2;
+    s_positionEncoding = ItpMesh::VertexFormat::PositionFloat3;
+    s_streamCodec = ItpMesh::VertexFormat::CodecNone;
+    s_index32 = false;
+    s_split16 = false;
+    s_mergeMeshes = false;
+    s_skinInfluences = 4;
+    s_weights16 = false;
+    s_bones16 = false;
+    s_paletteBones = 0;
+    s_exportAnimation = false;
+    s_animFrameRate = 0.0f;
+    s_animRotationError = Math::ToRadians(0.05f);
+    s_animTranslationError = 0.01f;
+    // For simplicity, only check for flags in arguments
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-b")
+        {
+            s_doBlendShapes = true;
+        }
+        else if (arg == "-s")
+        {
+            s_doSkinning = true;
+        }
+        else if (arg == "-a")
+        {
+            s_exportAnimation = true;
+            s_doSkinning = true;
+        }
+        else if (arg == "-animfps" && i + 1 < argc)
+        {
+            s_animFrameRate = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (arg == "-animerror" && i + 1 < argc)
+        {
+            // -animerror degrees,units
+            std::stringstream values(argv[++i]);
+            std::string value;
+            float errors[2] = { 0.05f, 0.01f };
+            for (int e = 0; e < 2 && std::getline(values, value, ','); ++e)
+                errors[e] = static_cast<float>(std::atof(value.c_str()));
+            s_animRotationError = Math::ToRadians(std::max(0.0f, errors[0]));
+            s_animTranslationError = std::max(0.0f, errors[1]);
+        }
+        else if (arg == "-bin")
+        {
+            s_writeBinary = true;
+        }
+        else if (arg == "-stream")
+        {
+            s_streamMode = true;
+            s_writeBinary = true;
+        }
+        else if (arg == "-memcap" && i + 1 < argc)
+        {
+            s_streamMemoryCap = static_cast<size_t>(std::max(1, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "-ioqueue" && i + 1 < argc)
+        {
+            s_ioQueueBytes = static_cast<size_t>(std::max(0, std::atoi(argv[++i]))) << 20;
+        }
+        else if (arg == "-j" && i + 1 < argc)
+        {
+            // 0 means one job per hardware thread
+            s_jobCount = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+            if (s_jobCount == 0)
+                s_jobCount = ThreadPool::HardwareThreads();
+        }
+        else if (arg == "-weld" && i + 1 < argc)
+        {
+            // -weld position,normalDegrees,uv
+            std::stringstream values(argv[++i]);
+            std::string value;
+            float tolerances[3] = { 0.0f, 0.0f, 0.0f };
+            for (int t = 0; t < 3 && std::getline(values, value, ','); ++t)
+                tolerances[t] = static_cast<float>(std::atof(value.c_str()));
+            s_weldTolerance.position = std::max(0.0f, tolerances[0]);
+            s_weldTolerance.normalAngle = Math::ToRadians(std::max(0.0f, tolerances[1]));
+            s_weldTolerance.uv = std::max(0.0f, tolerances[2]);
+        }
+        else if ((arg == "-lod" || arg == "-loderror") && i + 1 < argc)
+        {
+            // comma separated, one value per LOD
+            std::vector<float>& list = arg == "-lod" ? s_lodRatios : s_lodErrors;
+            std::stringstream values(argv[++i]);
+            std::string value;
+            list.clear();
+            while (std::getline(values, value, ','))
+                list.push_back(std::max(0.0f, static_cast<float>(std::atof(value.c_str()))));
+        }
+        else if (arg == "-meshlets")
+        {
+            s_buildMeshlets = true;
+        }
+        else if (arg == "-meshletsize" && i + 1 < argc)
+        {
+            // -meshletsize vertices,triangles
+            std::stringstream values(argv[++i]);
+            std::string value;
+            if (std::getline(values, value, ','))
+                s_meshletMaxVertices = static_cast<size_t>(std::max(3, std::min(256, std::atoi(value.c_str()))));
+            if (std::getline(values, value, ','))
+                s_meshletMaxTriangles = static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+        }
+        else if (arg == "-bvh")
+        {
+            s_buildBvh = true;
+        }
+        else if (arg == "-bvhleaf" && i + 1 < argc)
+        {
+            s_bvhLeafTriangles = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "-nocache")
+        {
+            s_optimizeVertexCache = false;
+        }
+        else if (arg == "-overdraw" && i + 1 < argc)
+        {
+            s_overdrawThreshold = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (arg == "-precision" && i + 1 < argc)
+        {
+            s_jsonPrecision = std::max(0, std::min(9, std::atoi(argv[++i])));
+        }
+        else if (arg == "-bsthreshold" && i + 1 < argc)
+        {
+            s_blendShapeThreshold = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (arg == "-bsdense" && i + 1 < argc)
+        {
+            s_blendShapeDenseRatio = std::max(0.0f, static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (arg == "-qnorm" && i + 1 < argc)
+        {
+            int bits = std::atoi(argv[++i]);
+            s_normalEncoding = bits == 8 ? ItpMesh::VertexFormat::NormalOct8 : ItpMesh::VertexFormat::NormalOct16;
+        }
+        else if (arg == "-tan")
+        {
+            s_generateTangents = true;
+        }
+        else if (arg == "-sdktri")
+        {
+            s_sdkTriangulate = true;
+        }
+        else if (arg == "-quv")
+        {
+            s_uvEncoding = ItpMesh::VertexFormat::UVHalf2;
+        }
+        else if (arg == "-qpos")
+        {
+            s_positionEncoding = ItpMesh::VertexFormat::PositionUnorm16;
+        }
+        else if (arg == "-compress" || arg == "-zstd")
+        {
+            s_writeBinary = true;
+            s_streamCodec |= ItpMesh::VertexFormat::CodecIndices | ItpMesh::VertexFormat::CodecVertices;
+            if (arg == "-zstd" && MeshCodec::HasZstd())
+                s_streamCodec |= ItpMesh::VertexFormat::CodecZstd;
+            else if (arg == "-zstd")
+                std::cerr << "Warning: built without zstd, -zstd only encodes the streams\n";
+        }
+        else if (arg == "-index32")
+        {
+            s_index32 = true;
+        }
+        else if (arg == "-split16")
+        {
+            s_split16 = true;
+        }
+        else if (arg == "-merge")
+        {
+            s_mergeMeshes = true;
+        }
+        else if (arg == "-influences" && i + 1 < argc)
+        {
+            s_skinInfluences = std::atoi(argv[++i]) > 4 ? 8 : 4;
+        }
+        else if (arg == "-weights16")
+        {
+            s_weights16 = true;
+        }
+        else if (arg == "-bones16")
+        {
+            s_bones16 = true;
+        }
+        else if (arg == "-palette" && i + 1 < argc)
+        {
+            s_paletteBones = static_cast<uint32_t>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg == "-profile" && i + 1 < argc)
+        {
+            s_profilePath = argv[++i];
+        }
+        else if (arg == "-trace" && i + 1 < argc)
+        {
+            s_tracePath = argv[++i];
+        }
+        else if (arg == "-cache" && i + 1 < argc)
+        {
+            s_cachePath = argv[++i];
+        }
+        else if (arg == "-batch" && i + 1 < argc)
+        {
+            s_batchPath = argv[++i];
+        }
+        else if (arg == "-jf" && i + 1 < argc)
+        {
+            s_fileJobCount = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+            if (s_fileJobCount == 0)
+                s_fileJobCount = ThreadPool::HardwareThreads();
+        }
+        else if (arg == "-importahead" && i + 1 < argc)
+        {
+            s_importAhead = static_cast<unsigned>(std::max(0, std::atoi(argv[++i])));
+        }
+        else if (arg[0] != '-' && s_inputPath.empty())
+        {
+            s_inputPath = arg;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ReadOptions(argc, argv);
+    if (s_inputPath.empty() && s_batchPath.empty())
+    {
+        PrintUsage(argc > 0 ? argv[0] : "FBX2ITP");
+        return 1;
+    }
+    if (!s_profilePath.empty() || !s_tracePath.empty())
+        Profiler::Enable();
+
+    std::vector<std::string> batchFiles;
+    if (!s_batchPath.empty() && !GatherBatchFiles(s_batchPath, batchFiles))
+    {
+        std::cerr << "Failed to read batch list: " << s_batchPath << "\n";
+        return 1;
+    }
+
+    // Initialize SDK manager
+    FbxManager* sdkManager = FbxManager::Create();
+    if (!sdkManager)
+    {
+        std::cerr << "Failed to create FBX Manager\n";
+        return 1;
+    }
+
+    // IO settings
+    FbxIOSettings* ios = FbxIOSettings::Create(sdkManager, IOSROOT);
+    sdkManager->SetIOSettings(ios);
+
+    int result = 0;
+    {
+        Profiler::Scope scope("Total");
+        AsyncFileWriter fileWriter(s_ioQueueBytes);
+        s_fileWriter = &fileWriter;
+        if (!s_batchPath.empty())
+        {
+            result = ConvertBatch(sdkManager, batchFiles) == 0 ? 0 : 1;
+        }
+        else
+        {
+            FileSummary summary = ConvertFile(sdkManager, s_inputPath, std::cout, std::cerr);
+            result = summary.ok ? 0 : 1;
+        }
+        s_fileWriter = nullptr;
+    }
+
+    if (!s_profilePath.empty() && !Profiler::WriteReport(s_profilePath))
+        std::cerr << "Failed to write profile: " << s_profilePath << "\n";
+    if (!s_tracePath.empty() && !Profiler::WriteTrace(s_tracePath))
+        std::cerr << "Failed to write trace: " << s_tracePath << "\n";
+
+    // Cleanup
     sdkManager->Destroy();
-    return 0;
-}
\ No newline at end of file
+    return result;
+}
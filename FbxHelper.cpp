@@ -1,4 +1,6 @@
 #include "FbxHelper.h"
+#include "Triangulator.h"
+#include <algorithm>
 
 // Helper to fetch normal for a polygon-vertex
 /*static*/ bool FbxHelper::GetNormalAt(FbxMesh* mesh, int polyIndex, int vertIndex, FbxVector4& outNormal)
@@ -87,3 +89,167 @@
 }
 
 
+
+template<typename TElement, typename T, typename Convert>
+static bool CaptureLayer(const TElement* elem, FbxHelper::Layer<T>& out, Convert convert)
+{
+    out = FbxHelper::Layer<T>();
+    if (!elem)
+        return false;
+
+    out.mapping = elem->GetMappingMode();
+    if (elem->GetReferenceMode() != FbxGeometryElement::eDirect)
+    {
+        const auto& indexArray = elem->GetIndexArray();
+        int count = indexArray.GetCount();
+        out.indices.resize(static_cast<size_t>(count));
+        for (int i = 0; i < count; ++i)
+            out.indices[static_cast<size_t>(i)] = indexArray.GetAt(i);
+    }
+
+    const auto& directArray = elem->GetDirectArray();
+    int count = directArray.GetCount();
+    out.values.resize(static_cast<size_t>(count));
+    for (int i = 0; i < count; ++i)
+        out.values[static_cast<size_t>(i)] = convert(directArray.GetAt(i));
+    return out.IsValid();
+}
+
+static Vector3 ToVector3(const FbxVector4& v)
+{
+    return Vector3(static_cast<float>(v[0]), static_cast<float>(v[1]), static_cast<float>(v[2]));
+}
+
+static Vector2 ToVector2(const FbxVector2& v)
+{
+    return Vector2(static_cast<float>(v[0]), static_cast<float>(v[1]));
+}
+
+/*static*/ bool FbxHelper::CaptureNormals(FbxGeometryBase* geom, Layer<Vector3>& out)
+{
+    return CaptureLayer(geom ? geom->GetElementNormal(0) : nullptr, out, ToVector3);
+}
+
+/*static*/ bool FbxHelper::CaptureTangents(FbxGeometryBase* geom, Layer<Vector3>& out)
+{
+    return CaptureLayer(geom ? geom->GetElementTangent(0) : nullptr, out, ToVector3);
+}
+
+/*static*/ bool FbxHelper::CaptureUVs(FbxGeometryBase* geom, Layer<Vector2>& out)
+{
+    return CaptureLayer(geom ? geom->GetElementUV(0) : nullptr, out, ToVector2);
+}
+
+template<typename T>
+static void GatherCorners(const FbxHelper::Layer<T>& layer, const FbxHelper::MeshCorners& corners, std::vector<T>& out)
+{
+    if (!layer.IsValid())
+    {
+        out.clear();
+        return;
+    }
+    out.assign(corners.controlPoint.size(), T());
+    int polygonCount = static_cast<int>(corners.polygonStart.size()) - 1;
+    for (int p = 0; p < polygonCount; ++p)
+    {
+        for (int c = corners.polygonStart[static_cast<size_t>(p)]; c < corners.polygonStart[static_cast<size_t>(p + 1)]; ++c)
+        {
+            int i = layer.Resolve(corners.controlPoint[static_cast<size_t>(c)], corners.firstCorner + c, corners.firstPolygon + p);
+            if (i >= 0)
+                out[static_cast<size_t>(c)] = layer.values[static_cast<size_t>(i)];
+        }
+    }
+}
+
+/*static*/ void FbxHelper::ExtractCorners(FbxMesh* mesh, MeshCorners& out)
+{
+    out = MeshCorners();
+    if (!mesh)
+        return;
+
+    MeshLayers layers;
+    CaptureMeshLayers(mesh, layers);
+    ExtractCornerRange(mesh, layers, 0, mesh->GetPolygonCount(), out);
+}
+
+/*static*/ void FbxHelper::CaptureMeshLayers(FbxMesh* mesh, MeshLayers& out)
+{
+    CaptureNormals(mesh, out.norm);
+    CaptureTangents(mesh, out.tan);
+    CaptureUVs(mesh, out.uv);
+}
+
+/*static*/ void FbxHelper::ExtractCornerRange(FbxMesh* mesh, const MeshLayers& layers, int firstPolygon, int polygonCount, MeshCorners& out)
+{
+    if (!mesh)
+    {
+        out = MeshCorners();
+        return;
+    }
+
+    int meshPolygonCount = mesh->GetPolygonCount();
+    int meshCornerCount = mesh->GetPolygonVertexCount();
+    firstPolygon = std::max(0, std::min(firstPolygon, meshPolygonCount));
+    polygonCount = std::max(0, std::min(polygonCount, meshPolygonCount - firstPolygon));
+    int endPolygon = firstPolygon + polygonCount;
+
+    // assign/resize keep the capacity, so a loop over ranges reuses the buffers
+    out.firstPolygon = firstPolygon;
+    out.firstCorner = firstPolygon < meshPolygonCount ? mesh->GetPolygonVertexIndex(firstPolygon) : meshCornerCount;
+    int endCorner = endPolygon < meshPolygonCount ? mesh->GetPolygonVertexIndex(endPolygon) : meshCornerCount;
+    int cornerCount = endCorner - out.firstCorner;
+    out.polygonStart.resize(static_cast<size_t>(polygonCount) + 1);
+    for (int p = 0; p < polygonCount; ++p)
+        out.polygonStart[static_cast<size_t>(p)] = mesh->GetPolygonVertexIndex(firstPolygon + p) - out.firstCorner;
+    out.polygonStart[static_cast<size_t>(polygonCount)] = cornerCount;
+
+    const int* polygonVertices = mesh->GetPolygonVertices() + out.firstCorner;
+    out.controlPoint.assign(polygonVertices, polygonVertices + cornerCount);
+
+    const FbxVector4* controlPoints = mesh->GetControlPoints();
+    int controlPointCount = mesh->GetControlPointsCount();
+    out.pos.assign(static_cast<size_t>(cornerCount), Vector3());
+    for (int c = 0; c < cornerCount; ++c)
+    {
+        int cp = out.controlPoint[static_cast<size_t>(c)];
+        if (cp >= 0 && cp < controlPointCount)
+            out.pos[static_cast<size_t>(c)] = ToVector3(controlPoints[cp]);
+    }
+
+    GatherCorners(layers.norm, out, out.norm);
+    GatherCorners(layers.tan, out, out.tan);
+    GatherCorners(layers.uv, out, out.uv);
+}
+
+template<typename T>
+static void PermuteCorners(std::vector<T>& values, const std::vector<uint32_t>& order)
+{
+    if (values.empty())
+        return;
+    std::vector<T> permuted(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        permuted[i] = values[order[i]];
+    values.swap(permuted);
+}
+
+/*static*/ size_t FbxHelper::TriangulateCorners(MeshCorners& corners)
+{
+    const size_t polygonCount = corners.polygonStart.empty() ? 0 : corners.polygonStart.size() - 1;
+    if (Triangulator::IsTriangulated(corners.polygonStart.data(), polygonCount))
+        return 0;
+
+    std::vector<uint32_t> order;
+    order.reserve(corners.controlPoint.size() * 2);
+    size_t dropped = Triangulator::Triangulate(corners.pos.data(), corners.polygonStart.data(), polygonCount, order);
+    PermuteCorners(corners.controlPoint, order);
+    PermuteCorners(corners.pos, order);
+    PermuteCorners(corners.norm, order);
+    PermuteCorners(corners.tan, order);
+    PermuteCorners(corners.tanSign, order);
+    PermuteCorners(corners.uv, order);
+    const size_t triangleCount = order.size() / 3;
+    corners.polygonStart.resize(triangleCount + 1);
+    for (size_t t = 0; t <= triangleCount; ++t)
+        corners.polygonStart[t] = static_cast<int>(3 * t);
+    return dropped;
+}
@@ -1,12 +1,87 @@
 #pragma once
 #include <fbxsdk.h>
+#include "EngineMath.h"
+#include <vector>
 
 class FbxHelper
 {
 public:
+    // One geometry layer element captured once per mesh or shape: the mapping mode plus
+    // copies of the index and direct arrays, so resolving a corner is plain array indexing.
+    template<typename T>
+    struct Layer
+    {
+        FbxLayerElement::EMappingMode mapping = FbxLayerElement::eNone;
+        std::vector<int> indices;   // empty for eDirect reference mode
+        std::vector<T> values;
+
+        bool IsValid() const { return !values.empty(); }
+
+        // Index into values for one polygon corner, or -1 if the element doesn't map it
+        int Resolve(int controlPoint, int corner, int polygon) const
+        {
+            int i = -1;
+            switch (mapping)
+            {
+            case FbxLayerElement::eByControlPoint: i = controlPoint; break;
+            case FbxLayerElement::eByPolygonVertex: i = corner; break;
+            case FbxLayerElement::eByPolygon: i = polygon; break;
+            case FbxLayerElement::eAllSame: i = 0; break;
+            default: return -1; // other mapping modes possible, not handled here
+            }
+            if (!indices.empty())
+            {
+                if (i < 0 || i >= static_cast<int>(indices.size()))
+                    return -1;
+                i = indices[static_cast<size_t>(i)];
+            }
+            return (i >= 0 && i < static_cast<int>(values.size())) ? i : -1;
+        }
+    };
+
+    // Flat per-corner (polygon-vertex) streams of a mesh. Attribute streams are empty
+    // when the mesh has no such element; corners the element doesn't map are zero.
+    struct MeshCorners
+    {
+        int firstPolygon = 0;           // mesh polygon index of polygon 0, see ExtractCornerRange
+        int firstCorner = 0;            // mesh corner index of corner 0
+        std::vector<int> polygonStart;  // first corner of each polygon, plus one past the end
+        std::vector<int> controlPoint;  // control point index of each corner
+        std::vector<Vector3> pos;
+        std::vector<Vector3> norm;
+        std::vector<Vector3> tan;
+        std::vector<float> tanSign;     // only for generated tangents, see TangentGenerator
+        std::vector<Vector2> uv;        // as stored in the FBX (V not flipped)
+    };
+
+    // The layer elements ExtractCornerRange reads, captured once per mesh
+    struct MeshLayers
+    {
+        Layer<Vector3> norm;
+        Layer<Vector3> tan;
+        Layer<Vector2> uv;
+    };
+
+    // Capture layer element 0 of a mesh or shape
+    static bool CaptureNormals(FbxGeometryBase* geom, Layer<Vector3>& out);
+    static bool CaptureTangents(FbxGeometryBase* geom, Layer<Vector3>& out);
+    static bool CaptureUVs(FbxGeometryBase* geom, Layer<Vector2>& out);
+
+    // Fill every corner stream of mesh in one pass per attribute
+    static void ExtractCorners(FbxMesh* mesh, MeshCorners& out);
+    // Same for polygons [firstPolygon, firstPolygon + polygonCount) only; corner and
+    // polygon indices in out are relative to the range. ExtractCorners on a huge mesh
+    // can be replaced by a loop over ranges to bound memory.
+    static void CaptureMeshLayers(FbxMesh* mesh, MeshLayers& out);
+    static void ExtractCornerRange(FbxMesh* mesh, const MeshLayers& layers, int firstPolygon, int polygonCount, MeshCorners& out);
+    // Rewrites corners as a triangle list (see Triangulator): triangle t is corners
+    // 3t..3t+2 of the result, copied from its polygon's corners, and an n-gon becomes
+    // 3 * (n - 2) corners. A no-op on triangles.
+    // Returns the number of dropped polygons with fewer than three corners.
+    static size_t TriangulateCorners(MeshCorners& corners);
+
     // Helper to fetch normal for a polygon-vertex
     static bool GetNormalAt(FbxMesh* mesh, int polyIndex, int vertIndex, FbxVector4& outNormal);
     static bool GetTangentAt(FbxMesh* mesh, int polyIndex, int vertIndex, FbxVector4& outTangent);
     static bool GetUVAt(FbxMesh* mesh, int polyIndex, int vertIndex, FbxVector2& outUV, const char* uvName = nullptr);
 };
-
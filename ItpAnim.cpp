@@ -0,0 +1,288 @@
+#include "ItpAnim.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const float s_rotationRange = 0.70710678f;   // 1 / sqrt(2), the most a non-largest component can be
+
+static uint32_t AlignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Greedy key reduction of one channel: from each kept key the next one is the furthest
+// key whose interpolation with it reproduces every key in between. The reach is found by
+// doubling then bisecting, so long smooth stretches don't cost a scan per candidate.
+template <typename T, typename LerpFn, typename WithinFn>
+static void ReduceKeys(std::vector<uint32_t>& frames, std::vector<T>& values, LerpFn lerp, WithinFn within)
+{
+    const size_t count = values.size();
+    if (count < 2)
+        return;
+
+    // constant within the error: a single key
+    bool constant = true;
+    for (size_t k = 1; k < count && constant; ++k)
+        constant = within(values[0], values[k]);
+    if (constant)
+    {
+        frames.resize(1);
+        values.resize(1);
+        return;
+    }
+
+    auto fits = [&](size_t a, size_t e)
+    {
+        const float span = static_cast<float>(frames[e] - frames[a]);
+        for (size_t k = a + 1; k < e; ++k)
+        {
+            float f = static_cast<float>(frames[k] - frames[a]) / span;
+            if (!within(lerp(values[a], values[e], f), values[k]))
+                return false;
+        }
+        return true;
+    };
+
+    size_t kept = 1;    // frames[0], values[0] stay
+    size_t a = 0;
+    while (a + 1 < count)
+    {
+        size_t good = a + 1;
+        size_t probe = a + 2;
+        while (probe < count && fits(a, probe))
+        {
+            good = probe;
+            probe = a + 2 * (probe - a);
+        }
+        size_t bad = std::min(probe, count);
+        while (bad - good > 1)
+        {
+            size_t mid = good + (bad - good) / 2;
+            if (fits(a, mid))
+                good = mid;
+            else
+                bad = mid;
+        }
+        // kept - 1 <= a and the search only reads from a on, so keys compact in place
+        frames[kept] = frames[good];
+        values[kept] = values[good];
+        ++kept;
+        a = good;
+    }
+    frames.resize(kept);
+    values.resize(kept);
+}
+
+template <typename T, typename LerpFn>
+static T EvaluateKeys(const std::vector<uint32_t>& frames, const std::vector<T>& values, uint32_t frame, LerpFn lerp)
+{
+    if (values.empty())
+        return T();
+    if (frame <= frames.front())
+        return values.front();
+    if (frame >= frames.back())
+        return values.back();
+    size_t e = static_cast<size_t>(std::upper_bound(frames.begin(), frames.end(), frame) - frames.begin());
+    size_t a = e - 1;
+    float f = static_cast<float>(frame - frames[a]) / static_cast<float>(frames[e] - frames[a]);
+    return lerp(values[a], values[e], f);
+}
+
+static Quaternion LerpRotation(const Quaternion& a, const Quaternion& b, float f)
+{
+    return Quaternion::Lerp(a, b, f);
+}
+
+static Vector3 LerpTranslation(const Vector3& a, const Vector3& b, float f)
+{
+    return a + (b - a) * f;
+}
+
+void ItpAnim::Track::SetSamples(const Quaternion* sampledRotations, const Vector3* sampledTranslations, size_t frameCount)
+{
+    rotationFrames.resize(frameCount);
+    rotations.resize(frameCount);
+    translationFrames.resize(frameCount);
+    translations.assign(sampledTranslations, sampledTranslations + frameCount);
+    for (size_t i = 0; i < frameCount; ++i)
+    {
+        rotationFrames[i] = translationFrames[i] = static_cast<uint32_t>(i);
+        Quaternion q = sampledRotations[i];
+        if (i > 0 && Quaternion::Dot(q, rotations[i - 1]) < 0.0f)
+            q = Quaternion(-q.x, -q.y, -q.z, -q.w);
+        rotations[i] = q;
+    }
+}
+
+void ItpAnim::Track::Reduce(float rotationError, float translationError)
+{
+    // unit quaternions in the same hemisphere an angle apart are 2 sin(angle / 4) apart,
+    // which unlike their dot product float resolves for small angles
+    const float maxChord = 2.0f * sinf(std::min(rotationError, 3.14159265f) * 0.25f);
+    const float maxChordSq = maxChord * maxChord;
+    ReduceKeys(rotationFrames, rotations, LerpRotation, [maxChordSq](const Quaternion& a, const Quaternion& b)
+    {
+        const float s = Quaternion::Dot(a, b) < 0.0f ? -1.0f : 1.0f;
+        const float dx = a.x - s * b.x, dy = a.y - s * b.y, dz = a.z - s * b.z, dw = a.w - s * b.w;
+        return dx * dx + dy * dy + dz * dz + dw * dw <= maxChordSq;
+    });
+    const float maxDistanceSq = translationError * translationError;
+    ReduceKeys(translationFrames, translations, LerpTranslation,
+        [maxDistanceSq](const Vector3& a, const Vector3& b) { return (a - b).LengthSq() <= maxDistanceSq; });
+}
+
+Quaternion ItpAnim::Track::EvaluateRotation(uint32_t frame) const
+{
+    return EvaluateKeys(rotationFrames, rotations, frame, LerpRotation);
+}
+
+Vector3 ItpAnim::Track::EvaluateTranslation(uint32_t frame) const
+{
+    return EvaluateKeys(translationFrames, translations, frame, LerpTranslation);
+}
+
+void ItpAnim::Clip::Reduce(float rotationError, float translationError, unsigned jobCount)
+{
+    ThreadPool::ParallelFor(tracks.size(), jobCount, [&](size_t i)
+    {
+        tracks[i].Reduce(rotationError, translationError);
+    });
+}
+
+size_t ItpAnim::Clip::GetKeyCount() const
+{
+    size_t count = 0;
+    for (const Track& track : tracks)
+        count += track.rotations.size() + track.translations.size();
+    return count;
+}
+
+/*static*/ ItpAnim::RotationKey ItpAnim::EncodeRotation(const Quaternion& q)
+{
+    const float c[4] = { q.x, q.y, q.z, q.w };
+    int largest = 0;
+    for (int i = 1; i < 4; ++i)
+    {
+        if (fabsf(c[i]) > fabsf(c[largest]))
+            largest = i;
+    }
+    const float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+    RotationKey key = {};
+    int slot = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        float unit = (c[i] * sign / s_rotationRange) * 0.5f + 0.5f;
+        float quantized = std::round(std::min(std::max(unit, 0.0f), 1.0f) * 32767.0f);
+        key.value[slot++] = static_cast<uint16_t>(quantized);
+    }
+    key.value[0] |= static_cast<uint16_t>((largest >> 1) << 15);
+    key.value[1] |= static_cast<uint16_t>((largest & 1) << 15);
+    return key;
+}
+
+/*static*/ Quaternion ItpAnim::DecodeRotation(const RotationKey& key)
+{
+    const int largest = ((key.value[0] >> 15) << 1) | (key.value[1] >> 15);
+    float c[4];
+    float sumSq = 0.0f;
+    int slot = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (i == largest)
+            continue;
+        float unit = static_cast<float>(key.value[slot++] & 0x7FFF) / 32767.0f;
+        c[i] = (unit * 2.0f - 1.0f) * s_rotationRange;
+        sumSq += c[i] * c[i];
+    }
+    c[largest] = sqrtf(std::max(0.0f, 1.0f - sumSq));
+    return Quaternion(c[0], c[1], c[2], c[3]);
+}
+
+void ItpAnim::Clip::WriteToBinary(std::ofstream& ofs) const
+{
+    std::vector<uint8_t> file;
+    WriteToBinary(file);
+    ofs.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+}
+
+void ItpAnim::Clip::WriteToBinary(std::vector<uint8_t>& file) const
+{
+    std::vector<BinaryTrack> trackTable(tracks.size());
+    uint32_t rotationKeyCount = 0;
+    uint32_t translationKeyCount = 0;
+    for (size_t t = 0; t < tracks.size(); ++t)
+    {
+        const Track& track = tracks[t];
+        BinaryTrack& entry = trackTable[t];
+        entry.firstRotationKey = rotationKeyCount;
+        entry.rotationKeyCount = static_cast<uint32_t>(track.rotations.size());
+        entry.firstTranslationKey = translationKeyCount;
+        entry.translationKeyCount = static_cast<uint32_t>(track.translations.size());
+        Vector3 boundsMin = track.translations.empty() ? Vector3::Zero : track.translations[0];
+        Vector3 boundsMax = boundsMin;
+        for (const Vector3& v : track.translations)
+        {
+            boundsMin = Vector3(std::min(boundsMin.x, v.x), std::min(boundsMin.y, v.y), std::min(boundsMin.z, v.z));
+            boundsMax = Vector3(std::max(boundsMax.x, v.x), std::max(boundsMax.y, v.y), std::max(boundsMax.z, v.z));
+        }
+        entry.translationMin[0] = boundsMin.x;
+        entry.translationMin[1] = boundsMin.y;
+        entry.translationMin[2] = boundsMin.z;
+        entry.translationScale[0] = boundsMax.x - boundsMin.x;
+        entry.translationScale[1] = boundsMax.y - boundsMin.y;
+        entry.translationScale[2] = boundsMax.z - boundsMin.z;
+        rotationKeyCount += entry.rotationKeyCount;
+        translationKeyCount += entry.translationKeyCount;
+    }
+
+    BinaryHeader header = {};
+    header.magic = BinaryMagic;
+    header.version = BinaryVersion;
+    header.trackCount = static_cast<uint32_t>(tracks.size());
+    header.frameCount = frameCount;
+    header.frameRate = frameRate;
+    header.rotationKeyCount = rotationKeyCount;
+    header.translationKeyCount = translationKeyCount;
+    header.nameOffset = static_cast<uint32_t>(sizeof(BinaryHeader) + sizeof(BinaryTrack) * trackTable.size());
+    header.rotationFramesOffset = AlignUp(header.nameOffset + static_cast<uint32_t>(name.size()) + 1, BinaryAlignment);
+    header.rotationKeysOffset = AlignUp(header.rotationFramesOffset + sizeof(uint16_t) * rotationKeyCount, BinaryAlignment);
+    header.translationFramesOffset = AlignUp(header.rotationKeysOffset + sizeof(RotationKey) * rotationKeyCount, BinaryAlignment);
+    header.translationKeysOffset = AlignUp(header.translationFramesOffset + sizeof(uint16_t) * translationKeyCount, BinaryAlignment);
+    const uint32_t fileSize = header.translationKeysOffset + sizeof(TranslationKey) * translationKeyCount;
+
+    // Assemble the whole file in memory so it goes out in a single write
+    file.assign(fileSize, 0);
+    memcpy(file.data(), &header, sizeof(header));
+    if (!trackTable.empty())
+        memcpy(file.data() + sizeof(header), trackTable.data(), sizeof(BinaryTrack) * trackTable.size());
+    memcpy(file.data() + header.nameOffset, name.c_str(), name.size() + 1);
+
+    uint16_t* rotationFrames = reinterpret_cast<uint16_t*>(file.data() + header.rotationFramesOffset);
+    RotationKey* rotationKeys = reinterpret_cast<RotationKey*>(file.data() + header.rotationKeysOffset);
+    uint16_t* translationFrames = reinterpret_cast<uint16_t*>(file.data() + header.translationFramesOffset);
+    TranslationKey* translationKeys = reinterpret_cast<TranslationKey*>(file.data() + header.translationKeysOffset);
+    for (size_t t = 0; t < tracks.size(); ++t)
+    {
+        const Track& track = tracks[t];
+        const BinaryTrack& entry = trackTable[t];
+        for (size_t k = 0; k < track.rotations.size(); ++k)
+        {
+            rotationFrames[entry.firstRotationKey + k] = static_cast<uint16_t>(track.rotationFrames[k]);
+            rotationKeys[entry.firstRotationKey + k] = EncodeRotation(track.rotations[k]);
+        }
+        for (size_t k = 0; k < track.translations.size(); ++k)
+        {
+            translationFrames[entry.firstTranslationKey + k] = static_cast<uint16_t>(track.translationFrames[k]);
+            const float v[3] = { track.translations[k].x, track.translations[k].y, track.translations[k].z };
+            TranslationKey& key = translationKeys[entry.firstTranslationKey + k];
+            for (int c = 0; c < 3; ++c)
+            {
+                float unit = entry.translationScale[c] > 0.0f ? (v[c] - entry.translationMin[c]) / entry.translationScale[c] : 0.0f;
+                key.value[c] = static_cast<uint16_t>(std::round(std::min(std::max(unit, 0.0f), 1.0f) * 65535.0f));
+            }
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "EngineMath.h"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ItpAnim
+{
+public:
+
+    // Binary .itpanim layout (little-endian):
+    //   BinaryHeader
+    //   BinaryTrack[trackCount]
+    //   clip name, utf-8, null terminated
+    //   rotation key frames, uint16_t, every track's back to back
+    //   rotation keys, RotationKey
+    //   translation key frames, uint16_t
+    //   translation keys, TranslationKey
+    // each array starting on a BinaryAlignment boundary. Track i animates bone i of the
+    // .itpskel the clip was exported with, in the same bone-local space as its bind pose.
+    // Between two keys the runtime interpolates linearly (rotations: normalized lerp);
+    // a track holds its first and last key before and after them.
+    static const uint32_t BinaryMagic = 0x41505449;    // "ITPA"
+    static const uint32_t BinaryVersion = 1;
+    static const uint32_t BinaryAlignment = 16;
+    static const uint32_t MaxFrames = 65536;
+
+    struct BinaryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t trackCount;
+        uint32_t frameCount;        // sampled frames; key frames are below this
+        float frameRate;            // frames per second
+        uint32_t rotationKeyCount;  // of all tracks
+        uint32_t translationKeyCount;
+        uint32_t nameOffset;        // from the start of the file
+        uint32_t rotationFramesOffset;
+        uint32_t rotationKeysOffset;
+        uint32_t translationFramesOffset;
+        uint32_t translationKeysOffset;
+    };
+
+    struct BinaryTrack
+    {
+        uint32_t firstRotationKey;
+        uint32_t rotationKeyCount;
+        uint32_t firstTranslationKey;
+        uint32_t translationKeyCount;
+        float translationMin[3];    // translation = key / 65535 * translationScale + translationMin
+        float translationScale[3];
+    };
+
+    // Smallest three: the largest component of the unit quaternion is dropped and the
+    // other three, in x y z w order, stored as 15 bits over [-1/sqrt(2), 1/sqrt(2)]. The
+    // top bits of value[0] and value[1] hold the index of the dropped component, which
+    // the quaternion is negated to make positive.
+    struct RotationKey
+    {
+        uint16_t value[3];
+    };
+
+    struct TranslationKey
+    {
+        uint16_t value[3];
+    };
+
+    // One bone's keys, ascending frames. The first key is on frame 0 and the last on the
+    // clip's last frame, unless a channel is constant and has a single key.
+    struct Track
+    {
+        std::vector<uint32_t> rotationFrames;
+        std::vector<Quaternion> rotations;
+        std::vector<uint32_t> translationFrames;
+        std::vector<Vector3> translations;
+
+        // A key on every one of frameCount samples; rotations are flipped into the
+        // hemisphere of the one before so neighbouring keys interpolate the short way
+        void SetSamples(const Quaternion* sampledRotations, const Vector3* sampledTranslations, size_t frameCount);
+        // Drops every key that interpolating the kept ones reproduces within rotationError
+        // radians and translationError units, checked at every current key (every frame,
+        // after SetSamples)
+        void Reduce(float rotationError, float translationError);
+
+        Quaternion EvaluateRotation(uint32_t frame) const;
+        Vector3 EvaluateTranslation(uint32_t frame) const;
+    };
+
+    struct Clip
+    {
+        std::string name;
+        float frameRate = 30.0f;
+        uint32_t frameCount = 0;
+        std::vector<Track> tracks;
+
+        // Track::Reduce on every track, on up to jobCount threads
+        void Reduce(float rotationError, float translationError, unsigned jobCount);
+        size_t GetKeyCount() const;
+
+        void WriteToBinary(std::ofstream& ofs) const;
+        // Assembles the .itpanim in memory, replacing the contents of file
+        void WriteToBinary(std::vector<uint8_t>& file) const;
+    };
+
+    static RotationKey EncodeRotation(const Quaternion& q);
+    static Quaternion DecodeRotation(const RotationKey& key);
+};
@@ -1,224 +1,1690 @@
 #include "ItpMesh.h"
+#include "EngineMathSimd.h"
+#include "MeshCodec.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 
-static std::string Indent(int indent)
+static_assert(sizeof(ItpMesh::BinaryHeader) == 64, "BinaryHeader layout is part of the file format");
+static_assert(sizeof(ItpMesh::BinaryStream) == 24, "BinaryStream layout is part of the file format");
+static_assert(sizeof(ItpMesh::VertexFormat::Attribute) == 16, "Attribute layout is part of the file format");
+static_assert(sizeof(ItpMesh::Mesh::Triangle) == 3 * sizeof(uint32_t), "Triangles are written as a raw index blob");
+static_assert(sizeof(ItpMesh::Bounds) == 64, "Bounds layout is part of the file format");
+static_assert(sizeof(ItpMesh::BvhNode) == 32, "BvhNode layout is part of the file format");
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// high ratio; meshes are written once and decoded on many clients
+static const int s_zstdLevel = 19;
+
+static std::string MaterialPath(const std::string& meshName)
+{
+    return "Assets/Materials/" + meshName + ".itpmat";
+}
+
+uint32_t ItpMesh::VertexFormat::GetFlags() const
+{
+    uint32_t flags = 0;
+    if (hasNormal)
+        flags |= FlagNormal;
+    if (hasTan)
+        flags |= FlagTangent;
+    if (hasTan && hasTanSign)
+        flags |= FlagTangentSign;
+    if (hasUV)
+        flags |= FlagUV;
+    if (hasSkin)
+        flags |= FlagSkin;
+    return flags;
+}
+
+bool ItpMesh::VertexFormat::HasSameLayout(const VertexFormat& other) const
 {
-    std::string indentStr = "";
-    for (int i = 0; i < indent; ++i)
+    return GetFlags() == other.GetFlags() && positionEncoding == other.positionEncoding
+        && normalEncoding == other.normalEncoding && uvEncoding == other.uvEncoding
+        && boneEncoding == other.boneEncoding && weightEncoding == other.weightEncoding
+        && influenceCount == other.influenceCount && indexEncoding == other.indexEncoding;
+}
+
+static uint32_t ComponentSize(uint32_t type)
+{
+    switch (type)
     {
-        indentStr += "\t";
+    case ItpMesh::VertexFormat::TypeFloat:
+        return 4;
+    case ItpMesh::VertexFormat::TypeHalf:
+    case ItpMesh::VertexFormat::TypeSnorm16:
+    case ItpMesh::VertexFormat::TypeUnorm16:
+    case ItpMesh::VertexFormat::TypeUint16:
+        return 2;
+    default:
+        return 1;
     }
-    return indentStr;
 }
 
-void ItpMesh::VertexFormat::WriteToJson(std::ofstream& ofs, int indent) const
+static const char* ComponentTypeName(uint32_t type)
+{
+    switch (type)
+    {
+    case ItpMesh::VertexFormat::TypeFloat:
+        return "float";
+    case ItpMesh::VertexFormat::TypeHalf:
+        return "half";
+    case ItpMesh::VertexFormat::TypeSnorm16:
+        return "snorm16";
+    case ItpMesh::VertexFormat::TypeSnorm8:
+        return "snorm8";
+    case ItpMesh::VertexFormat::TypeUnorm16:
+        return "unorm16";
+    case ItpMesh::VertexFormat::TypeUint16:
+        return "uint16";
+    default:
+        return "byte";
+    }
+}
+
+static uint32_t DirectionType(ItpMesh::VertexFormat::NormalEncoding encoding)
+{
+    if (encoding == ItpMesh::VertexFormat::NormalOct16)
+        return ItpMesh::VertexFormat::TypeSnorm16;
+    if (encoding == ItpMesh::VertexFormat::NormalOct8)
+        return ItpMesh::VertexFormat::TypeSnorm8;
+    return ItpMesh::VertexFormat::TypeFloat;
+}
+
+uint32_t ItpMesh::VertexFormat::GetAttributes(Attribute* attributes) const
 {
-    std::string in = Indent(indent);
-    ofs << in << "\"vertexformat\": [\n";
-    ofs << in << "\t{\n";
-    ofs << in << "\t\t\"name\": \"position\",\n";
-    ofs << in << "\t\t\"type\" : \"float\",\n";
-    ofs << in << "\t\t\"count\" : 3\n";
-    ofs << in << "\t}";
+    uint32_t count = 0;
+    uint32_t offset = 0;
+    auto add = [&](uint32_t semantic, uint32_t type, uint32_t components)
+    {
+        uint32_t size = ComponentSize(type);
+        offset = static_cast<uint32_t>(AlignUp(offset, size));
+        Attribute& attribute = attributes[count++];
+        attribute.semantic = semantic;
+        attribute.type = type;
+        attribute.count = components;
+        attribute.offset = offset;
+        offset += size * components;
+    };
+
+    if (positionEncoding == PositionUnorm16)
+        add(SemanticPosition, TypeUnorm16, 3);
+    else
+        add(SemanticPosition, TypeFloat, 3);
+    const uint32_t directionType = DirectionType(normalEncoding);
+    const uint32_t directionCount = directionType == TypeFloat ? 3 : 2;
     if (hasNormal)
+        add(SemanticNormal, directionType, directionCount);
+    if (hasTan)
+        add(SemanticTangent, directionType, directionCount + (hasTanSign ? 1 : 0));
+    if (hasSkin)
+    {
+        add(SemanticBones, boneEncoding == BoneUint16 ? TypeUint16 : TypeByte, influenceCount);
+        add(SemanticWeights, weightEncoding == WeightUnorm16 ? TypeUnorm16 : TypeByte, influenceCount);
+    }
+    if (hasUV)
+        add(SemanticTexcoord, uvEncoding == UVHalf2 ? TypeHalf : TypeFloat, 2);
+    return count;
+}
+
+uint32_t ItpMesh::VertexFormat::GetStride() const
+{
+    Attribute attributes[MaxAttributes];
+    uint32_t count = GetAttributes(attributes);
+    const Attribute& last = attributes[count - 1];
+    return static_cast<uint32_t>(AlignUp(last.offset + ComponentSize(last.type) * last.count, 4));
+}
+
+static void PackDirection(const Vector3& dir, uint32_t type, uint8_t* dst)
+{
+    if (type == ItpMesh::VertexFormat::TypeFloat)
+    {
+        memcpy(dst, &dir, sizeof(Vector3));
+        return;
+    }
+    int16_t oct[2];
+    ItpMesh::VertexFormat::OctEncode(dir, type == ItpMesh::VertexFormat::TypeSnorm16 ? 16 : 8, oct);
+    if (type == ItpMesh::VertexFormat::TypeSnorm16)
+    {
+        memcpy(dst, oct, sizeof(oct));
+    }
+    else
+    {
+        int8_t oct8[2] = { static_cast<int8_t>(oct[0]), static_cast<int8_t>(oct[1]) };
+        memcpy(dst, oct8, sizeof(oct8));
+    }
+}
+
+// the sign as one more component of the given type: +-1.0f, or the largest snorm value
+static void PackSign(float sign, uint32_t type, uint8_t* dst)
+{
+    if (type == ItpMesh::VertexFormat::TypeFloat)
+    {
+        float value = sign < 0.0f ? -1.0f : 1.0f;
+        memcpy(dst, &value, sizeof(value));
+    }
+    else if (type == ItpMesh::VertexFormat::TypeSnorm16)
+    {
+        int16_t value = sign < 0.0f ? -32767 : 32767;
+        memcpy(dst, &value, sizeof(value));
+    }
+    else
+    {
+        int8_t value = sign < 0.0f ? -127 : 127;
+        memcpy(dst, &value, sizeof(value));
+    }
+}
+
+void ItpMesh::VertexFormat::PackVertex(const VertexData& vert, uint8_t* dst) const
+{
+    Attribute attributes[MaxAttributes];
+    uint32_t count = GetAttributes(attributes);
+    memset(dst, 0, GetStride()); // padding
+    for (uint32_t a = 0; a < count; ++a)
+    {
+        const Attribute& attribute = attributes[a];
+        uint8_t* out = dst + attribute.offset;
+        switch (attribute.semantic)
+        {
+        case SemanticPosition:
+            if (attribute.type == TypeUnorm16)
+            {
+                uint16_t q[3];
+                QuantizePosition(vert.pos, q);
+                memcpy(out, q, sizeof(q));
+            }
+            else
+            {
+                memcpy(out, &vert.pos, sizeof(Vector3));
+            }
+            break;
+        case SemanticNormal:
+            PackDirection(vert.norm, attribute.type, out);
+            break;
+        case SemanticTangent:
+            PackDirection(vert.tan, attribute.type, out);
+            if (hasTanSign)
+                PackSign(vert.tanSign, attribute.type, out + ComponentSize(attribute.type) * (attribute.count - 1));
+            break;
+        case SemanticBones:
+        case SemanticWeights:
+        {
+            const uint16_t* values = attribute.semantic == SemanticBones ? vert.bones : vert.weights;
+            if (attribute.type == TypeByte)
+            {
+                for (uint32_t k = 0; k < attribute.count; ++k)
+                    out[k] = static_cast<uint8_t>(values[k]);
+            }
+            else
+            {
+                memcpy(out, values, sizeof(uint16_t) * attribute.count);
+            }
+            break;
+        }
+        case SemanticTexcoord:
+            if (attribute.type == TypeHalf)
+            {
+                uint16_t h[2] = { FloatToHalf(vert.uv.x), FloatToHalf(vert.uv.y) };
+                memcpy(out, h, sizeof(h));
+            }
+            else
+            {
+                memcpy(out, &vert.uv, sizeof(Vector2));
+            }
+            break;
+        }
+    }
+}
+
+void ItpMesh::VertexFormat::FitPositionQuantization(const Vector3& boundsMin, const Vector3& boundsMax)
+{
+    positionOffset = boundsMin;
+    positionScale = boundsMax - boundsMin;
+}
+
+void ItpMesh::VertexFormat::QuantizePosition(const Vector3& pos, uint16_t out[3]) const
+{
+    const float p[3] = { pos.x - positionOffset.x, pos.y - positionOffset.y, pos.z - positionOffset.z };
+    const float scale[3] = { positionScale.x, positionScale.y, positionScale.z };
+    for (int i = 0; i < 3; ++i)
     {
-        ofs << ",\n";
-        ofs << in << "\t{\n";
-        ofs << in << "\t\t\"name\": \"normal\",\n";
-        ofs << in << "\t\t\"type\": \"float\",\n";
-        ofs << in << "\t\t\"count\": 3\n";
-        ofs << in << "\t}";
+        // a flat axis quantizes to 0 and decodes to the offset
+        float t = scale[i] > 0.0f ? p[i] / scale[i] : 0.0f;
+        out[i] = static_cast<uint16_t>(lrintf(Math::Clamp(t, 0.0f, 1.0f) * 65535.0f));
+    }
+}
+
+/*static*/ void ItpMesh::VertexFormat::OctEncode(const Vector3& dir, int bits, int16_t out[2])
+{
+    // project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the diagonals
+    float u = 0.0f;
+    float v = 0.0f;
+    float l1 = fabsf(dir.x) + fabsf(dir.y) + fabsf(dir.z);
+    if (l1 > 0.0f)
+    {
+        u = dir.x / l1;
+        v = dir.y / l1;
+        if (dir.z < 0.0f)
+        {
+            float foldU = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float foldV = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = foldU;
+            v = foldV;
+        }
+    }
+    const float maxValue = static_cast<float>((1 << (bits - 1)) - 1);
+    out[0] = static_cast<int16_t>(lrintf(Math::Clamp(u, -1.0f, 1.0f) * maxValue));
+    out[1] = static_cast<int16_t>(lrintf(Math::Clamp(v, -1.0f, 1.0f) * maxValue));
+}
+
+/*static*/ Vector3 ItpMesh::VertexFormat::OctDecode(float u, float v)
+{
+    Vector3 dir(u, v, 1.0f - fabsf(u) - fabsf(v));
+    if (dir.z < 0.0f)
+    {
+        dir.x = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        dir.y = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+    }
+    dir.Normalize();
+    return dir;
+}
+
+/*static*/ uint16_t ItpMesh::VertexFormat::FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t absBits = bits & 0x7FFFFFFF;
+
+    if (absBits >= 0x7F800000) // inf or nan
+        return sign | 0x7C00 | (absBits > 0x7F800000 ? 0x200 : 0);
+    if (absBits >= 0x477FF000) // rounds past 65504
+        return sign | 0x7C00;
+    if (absBits < 0x33000000) // below half the smallest half subnormal
+        return sign;
+
+    uint32_t half;
+    uint32_t rest;
+    uint32_t halfway;
+    if (absBits < 0x38800000)
+    {   // subnormal half: shift the mantissa (with its implicit bit) into place
+        uint32_t shift = 126 - (absBits >> 23);
+        uint32_t mantissa = (absBits & 0x7FFFFF) | 0x800000;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {   // rebias the exponent from 127 to 15
+        half = (absBits - 0x38000000) >> 13;
+        rest = absBits & 0x1FFF;
+        halfway = 0x1000;
+    }
+    // round to nearest even; a carry into the exponent is still the right value
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    return static_cast<uint16_t>(sign | half);
+}
+
+/*static*/ float ItpMesh::VertexFormat::HalfToFloat(uint16_t value)
+{
+    const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        float result = static_cast<float>(mantissa) * (1.0f / 16777216.0f); // 2^-24
+        return sign ? -result : result;
+    }
+    if (exponent == 31)
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+void ItpMesh::VertexFormat::WriteToJson(JsonWriter& json, int indent) const
+{
+    const char* directionType = ComponentTypeName(DirectionType(normalEncoding));
+    const int directionCount = normalEncoding == NormalFloat3 ? 3 : 2;
+    auto beginAttribute = [&](const char* name, const char* type, const char* typeSeparator)
+    {
+        json.Indent(indent + 1).Raw("{\n");
+        json.Indent(indent + 2).Raw("\"name\": \"").Raw(name).Raw("\",\n");
+        json.Indent(indent + 2).Raw("\"type\"").Raw(typeSeparator).Raw("\"").Raw(type).Raw("\",\n");
+    };
+    auto endAttribute = [&](const char* countSeparator, int count)
+    {
+        json.Indent(indent + 2).Raw("\"count\"").Raw(countSeparator).Int(count).Char('\n');
+        json.Indent(indent + 1).Raw("}");
+    };
+
+    json.Indent(indent).Raw("\"vertexformat\": [\n");
+    if (positionEncoding == PositionUnorm16)
+    {   // position = value / 65535 * scale + offset
+        beginAttribute("position", "unorm16", " : ");
+        json.Indent(indent + 2).Raw("\"count\" : 3,\n");
+        json.Indent(indent + 2).Raw("\"scale\": [ ").Float(positionScale.x).Raw(", ")
+            .Float(positionScale.y).Raw(", ").Float(positionScale.z).Raw(" ],\n");
+        json.Indent(indent + 2).Raw("\"offset\": [ ").Float(positionOffset.x).Raw(", ")
+            .Float(positionOffset.y).Raw(", ").Float(positionOffset.z).Raw(" ]\n");
+        json.Indent(indent + 1).Raw("}");
+    }
+    else
+    {
+        beginAttribute("position", "float", " : ");
+        endAttribute(" : ", 3);
+    }
+    if (hasNormal)
+    {
+        json.Raw(",\n");
+        beginAttribute("normal", directionType, ": ");
+        if (normalEncoding != NormalFloat3)
+            json.Indent(indent + 2).Raw("\"encoding\": \"octahedral\",\n");
+        endAttribute(": ", directionCount);
     }
     if (hasTan)
     {
-        ofs << ",\n";
-        ofs << in << "\t{\n";
-        ofs << in << "\t\t\"name\": \"tangent\",\n";
-        ofs << in << "\t\t\"type\": \"float\",\n";
-        ofs << in << "\t\t\"count\": 3\n";
-        ofs << in << "\t}";
+        json.Raw(",\n");
+        beginAttribute("tangent", directionType, ": ");
+        if (normalEncoding != NormalFloat3)
+            json.Indent(indent + 2).Raw("\"encoding\": \"octahedral\",\n");
+        if (hasTanSign) // last component: bitangent = cross(normal, tangent) * sign
+            json.Indent(indent + 2).Raw("\"sign\": true,\n");
+        endAttribute(": ", directionCount + (hasTanSign ? 1 : 0));
     }
     if (hasSkin)
     {
-        ofs << ",\n";
-        ofs << in << "\t{\n";
-        ofs << in << "\t\t\"name\": \"bones\",\n";
-        ofs << in << "\t\t\"type\": \"byte\",\n";
-        ofs << in << "\t\t\"count\": 4\n";
-        ofs << in << "\t},\n";
-        ofs << in << "\t{\n";
-        ofs << in << "\t\t\"name\": \"weights\",\n";
-        ofs << in << "\t\t\"type\": \"byte\",\n";
-        ofs << in << "\t\t\"count\": 4\n";
-        ofs << in << "\t}";
+        json.Raw(",\n");
+        beginAttribute("bones", boneEncoding == BoneUint16 ? "uint16" : "byte", ": ");
+        endAttribute(": ", static_cast<int>(influenceCount));
+        json.Raw(",\n");
+        beginAttribute("weights", weightEncoding == WeightUnorm16 ? "unorm16" : "byte", ": ");
+        endAttribute(": ", static_cast<int>(influenceCount));
     }
     if (hasUV)
     {
-        ofs << ",\n";
-        ofs << in << "\t{\n";
-        ofs << in << "\t\t\"name\": \"texcoord\",\n";
-        ofs << in << "\t\t\"type\": \"float\",\n";
-        ofs << in << "\t\t\"count\": 2\n";
-        ofs << in << "\t}";
+        json.Raw(",\n");
+        beginAttribute("texcoord", uvEncoding == UVHalf2 ? "half" : "float", ": ");
+        endAttribute(": ", 2);
+    }
+    json.Char('\n').Indent(indent).Raw("], \n");
+}
+
+static bool IsDeltaWithin(const Vector3& delta, float threshold)
+{
+    return fabsf(delta.x) <= threshold && fabsf(delta.y) <= threshold && fabsf(delta.z) <= threshold;
+}
+
+void ItpMesh::BlendShape::MakeSparse(float threshold, float denseRatio)
+{
+    std::vector<uint32_t> kept;
+    for (size_t i = 0; i < deltas.size(); ++i)
+    {
+        const VertexData& delta = deltas[i];
+        if (!IsDeltaWithin(delta.pos, threshold)
+            || (format.hasNormal && !IsDeltaWithin(delta.norm, threshold))
+            || (format.hasTan && !IsDeltaWithin(delta.tan, threshold)))
+        {
+            kept.push_back(static_cast<uint32_t>(i));
+        }
     }
-    ofs << "\n" << in << "], \n";
+    if (denseRatio <= 0.0f || static_cast<float>(kept.size()) > denseRatio * static_cast<float>(deltas.size()))
+        return;
+
+    std::vector<VertexData> keptDeltas;
+    keptDeltas.reserve(kept.size());
+    for (uint32_t i : kept)
+        keptDeltas.push_back(deltas[i]);
+    deltas.swap(keptDeltas);
+    indices.swap(kept);
+    sparse = true;
 }
 
-void ItpMesh::BlendShape::WriteDeltaToJson(const VertexData& vert, std::ofstream& ofs) const
+static void WriteFloat3(JsonWriter& json, const Vector3& v)
 {
-    ofs << "\t\t[ ";
-    ofs << vert.pos.x << ", " << vert.pos.y << ", " << vert.pos.z;
+    json.Float(v.x).Raw(", ").Float(v.y).Raw(", ").Float(v.z);
+}
+
+void ItpMesh::BlendShape::WriteDeltaToJson(const VertexData& vert, JsonWriter& json) const
+{
+    json.Raw("\t\t[ ");
+    WriteFloat3(json, vert.pos);
     if (format.hasNormal)
     {
-        ofs << ", " << vert.norm.x << ", " << vert.norm.y << ", " << vert.norm.z;
+        json.Raw(", ");
+        WriteFloat3(json, vert.norm);
     }
     if (format.hasTan)
     {
-        ofs << ", " << vert.tan.x << ", " << vert.tan.y << ", " << vert.tan.z;
+        json.Raw(", ");
+        WriteFloat3(json, vert.tan);
     }
 
-    ofs << " ]";
+    json.Raw(" ]");
 }
 
-void ItpMesh::BlendShape::WriteDeltasToJson(std::ofstream& ofs) const
+void ItpMesh::BlendShape::WriteDeltasToJson(JsonWriter& json) const
 {
-    ofs << "\t\"deltas\": [\n";
+    if (sparse)
+    {
+        json.Raw("\t\"indices\": [ ");
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (i > 0)
+                json.Raw(", ");
+            json.UInt(indices[i]);
+        }
+        json.Raw(" ],\n");
+    }
+    json.Raw("\t\"deltas\": [\n");
     if (!deltas.empty())
     {
-        WriteDeltaToJson(deltas[0], ofs);
+        WriteDeltaToJson(deltas[0], json);
         for (size_t i = 1; i < deltas.size(); ++i)
         {
-            ofs << ",\n";
-            WriteDeltaToJson(deltas[i], ofs);
+            json.Raw(",\n");
+            WriteDeltaToJson(deltas[i], json);
         }
     }
-    ofs << "\n\t]";
+    json.Raw("\n\t]");
 }
 
-void ItpMesh::BlendShape::WriteToJson(std::ofstream& ofs) const
+void ItpMesh::BlendShape::WriteToJson(JsonWriter& json) const
 {
-    ofs << "{\n";
-    ofs << "\t\"metadata\": {\n";
-    ofs << "\t\t\"type\": \"itpblend\",\n";
-    ofs << "\t\t\"version\" : 1\n";
-    ofs << "\t},\n";
+    // about 3 to 9 floats per delta
+    json.Reserve(json.GetSize() + 256 + deltas.size() * 128 + indices.size() * 8);
+    json.Raw("{\n");
+    json.Raw("\t\"metadata\": {\n");
+    json.Raw("\t\t\"type\": \"itpblend\",\n");
+    json.Raw("\t\t\"version\" : 2\n");
+    json.Raw("\t},\n");
 
-    ofs << "\t\"name\": \"" << name << "\",\n";
-    format.WriteToJson(ofs, 1);
+    json.Raw("\t\"name\": ").String(name).Raw(",\n");
+    json.Raw("\t\"sparse\": ").Raw(sparse ? "true" : "false").Raw(",\n");
+    format.WriteToJson(json, 1);
     // deltas
-    WriteDeltasToJson(ofs);
+    WriteDeltasToJson(json);
 
-    ofs << "\n}\n";
+    json.Raw("\n}\n");
 }
 
-void ItpMesh::Bone::WriteToJson(std::ofstream& ofs) const
+void ItpMesh::Bone::WriteToJson(JsonWriter& json) const
 {
-    ofs << "\t\t{\n";
-    ofs << "\t\t\t\"name\": \"" << name << "\",\n";
-    ofs << "\t\t\t\"parentIndex\": " << parentIndex << ",\n";
-    ofs << "\t\t\t\"bindPose\": {\n";
-    ofs << "\t\t\t\t\"rot\": [ " << bindPose.rot.x << ", "
-        << bindPose.rot.y << ", " << bindPose.rot.z << ", "
-        << bindPose.rot.w << " ],\n";
-    ofs << "\t\t\t\t\"trans\": [ " << bindPose.trans.x << ", "
-        << bindPose.trans.y << ", " << bindPose.trans.z << " ]\n";
-    ofs << "\t\t\t}\n";
-    ofs << "\t\t}";
+    json.Raw("\t\t{\n");
+    json.Raw("\t\t\t\"name\": ").String(name).Raw(",\n");
+    json.Raw("\t\t\t\"parentIndex\": ").Int(parentIndex).Raw(",\n");
+    json.Raw("\t\t\t\"bindPose\": {\n");
+    json.Raw("\t\t\t\t\"rot\": [ ").Float(bindPose.rot.x).Raw(", ")
+        .Float(bindPose.rot.y).Raw(", ").Float(bindPose.rot.z).Raw(", ")
+        .Float(bindPose.rot.w).Raw(" ],\n");
+    json.Raw("\t\t\t\t\"trans\": [ ");
+    WriteFloat3(json, bindPose.trans);
+    json.Raw(" ]\n");
+    json.Raw("\t\t\t}\n");
+    json.Raw("\t\t}");
 }
 
-void ItpMesh::Mesh::Triangle::WriteToJson(std::ofstream& ofs) const
+void ItpMesh::Mesh::Triangle::WriteToJson(JsonWriter& json) const
 {
-    ofs << "\t\t[ " << index[0] << ", " << index[1] << ", "
-        << index[2] << " ]";
+    json.Raw("\t\t[ ").UInt(index[0]).Raw(", ").UInt(index[1]).Raw(", ")
+        .UInt(index[2]).Raw(" ]");
 }
 
-void ItpMesh::Mesh::WriteToJson(std::ofstream& ofs) const
+void ItpMesh::Mesh::WriteToJson(JsonWriter& json) const
 {
-    ofs << "{\n";
-    ofs << "\t\"metadata\": {\n";
-    ofs << "\t\t\"type\": \"itpmesh\",\n";
-    ofs << "\t\t\"version\" : 3\n";
-    ofs << "\t},\n";
-    ofs << "\t\"material\" : \"Assets/Materials/" << name << ".itpmat\",\n";
-    format.WriteToJson(ofs, 1);
-    WriteVertsToJson(ofs);
-    WriteIndicesToJson(ofs);
+    // a vertex is at most ~25 numbers, a triangle 3
+    json.Reserve(json.GetSize() + 1024 + verts.size() * 256 + indices.size() * 40);
+    json.Raw("{\n");
+    json.Raw("\t\"metadata\": {\n");
+    json.Raw("\t\t\"type\": \"itpmesh\",\n");
+    // version 4: "indices" are relative to their submesh's baseVertex, so a version 3
+    // reader mustn't load the file; meshes without submeshes stay version 3
+    json.Raw(submeshes.empty() ? "\t\t\"version\" : 3\n" : "\t\t\"version\" : 4\n");
+    json.Raw("\t},\n");
+    json.Raw("\t\"material\" : ").String(MaterialPath(name)).Raw(",\n");
+    json.Raw(GetIndexSize() == sizeof(uint16_t) ? "\t\"indexType\": \"uint16\",\n" : "\t\"indexType\": \"uint32\",\n");
+    format.WriteToJson(json, 1);
+    WriteVertsToJson(json);
+    WriteIndicesToJson(json);
+    WriteSubmeshesToJson(json);
+    WriteLodsToJson(json);
+    WriteMeshletsToJson(json);
+    WriteBoundsToJson(json);
 
-    ofs << "\n}\n";
+    json.Raw("\n}\n");
 }
 
-void ItpMesh::Mesh::WriteVertToJson(const VertexData& vert, std::ofstream& ofs) const
+void ItpMesh::Mesh::VertexMap::Build(size_t controlPointCount, const int* cornerControlPoints, const uint32_t* cornerVertices, size_t cornerCount)
 {
-    ofs << "\t\t[ ";
-    ofs << vert.pos.x << ", " << vert.pos.y << ", " << vert.pos.z;
+    // counting sort of the corners by control point
+    offsets.assign(controlPointCount + 1, 0);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        size_t cp = static_cast<size_t>(cornerControlPoints[c]);
+        if (cp < controlPointCount)
+            ++offsets[cp + 1];
+    }
+    for (size_t cp = 0; cp < controlPointCount; ++cp)
+        offsets[cp + 1] += offsets[cp];
+    indices.resize(offsets[controlPointCount]);
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        size_t cp = static_cast<size_t>(cornerControlPoints[c]);
+        if (cp < controlPointCount)
+            indices[cursor[cp]++] = cornerVertices[c];
+    }
+
+    // a control point's corners mostly weld to one vertex; keep each vertex once
+    uint32_t write = 0;
+    for (size_t cp = 0; cp < controlPointCount; ++cp)
+    {
+        uint32_t begin = offsets[cp];
+        uint32_t end = offsets[cp + 1];
+        offsets[cp] = write;
+        std::sort(indices.begin() + begin, indices.begin() + end);
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            if (i == begin || indices[i] != indices[i - 1])
+                indices[write++] = indices[i];
+        }
+    }
+    offsets[controlPointCount] = write;
+    indices.resize(write);
+    indices.shrink_to_fit();
+}
+
+uint32_t ItpMesh::Mesh::GetIndexSize() const
+{
+    if (format.indexEncoding == VertexFormat::IndexUint32)
+        return sizeof(uint32_t);
+    if (submeshes.empty())
+        return verts.size() <= MaxShortIndexVertices ? sizeof(uint16_t) : sizeof(uint32_t);
+    for (const Submesh& submesh : submeshes)
+    {
+        if (submesh.vertexCount > MaxShortIndexVertices)
+            return sizeof(uint32_t);
+    }
+    return sizeof(uint16_t);
+}
+
+void ItpMesh::Mesh::SplitSubmeshes(uint32_t maxVertices, uint32_t maxPaletteBones)
+{
+    const uint32_t noVertex = ~0u;
+    submeshes.clear();
+    submeshMaterials.clear();
+    bonePalettes.clear();
+    if (indices.empty())
+        return;
+
+    // walk the triangles in order, giving each submesh its own copies of the vertices
+    const bool palettes = maxPaletteBones > 0 && format.hasSkin;
+    std::vector<uint32_t> source;                       // new vertex -> old vertex
+    std::vector<VertexData> newVerts;
+    std::vector<uint32_t> current(verts.size(), noVertex);  // old vertex -> its copy in the open submesh
+    std::vector<uint32_t> firstCopy(verts.size(), noVertex);
+    std::vector<uint32_t> paletteSlot(palettes ? format.GetMaxBones() : 0, noVertex); // bone -> entry of the open palette
+    Submesh submesh = {};
+    for (size_t t = 0; t < indices.size(); ++t)
+    {
+        Triangle& tri = indices[t];
+        uint32_t newVertices = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (current[tri.index[k]] == noVertex && (k < 1 || tri.index[k] != tri.index[0]) && (k < 2 || tri.index[k] != tri.index[1]))
+                ++newVertices;
+        }
+        uint16_t newBones[3 * VertexData::MaxInfluences];
+        uint32_t newBoneCount = 0;
+        for (int k = 0; k < 3 && palettes; ++k)
+        {
+            const VertexData& vert = verts[tri.index[k]];
+            for (uint32_t i = 0; i < format.influenceCount; ++i)
+            {
+                if (vert.weights[i] > 0 && paletteSlot[vert.bones[i]] == noVertex
+                    && std::find(newBones, newBones + newBoneCount, vert.bones[i]) == newBones + newBoneCount)
+                    newBones[newBoneCount++] = vert.bones[i];
+            }
+        }
+        // a triangle always goes in, even when it alone weights more bones than allowed
+        if ((submesh.vertexCount + newVertices > maxVertices || (palettes && submesh.paletteBoneCount + newBoneCount > maxPaletteBones))
+            && t * 3 > submesh.firstIndex)
+        {
+            submesh.indexCount = static_cast<uint32_t>(t * 3) - submesh.firstIndex;
+            submeshes.push_back(submesh);
+            for (uint32_t v = submesh.baseVertex; v < submesh.baseVertex + submesh.vertexCount; ++v)
+                current[source[v]] = noVertex;
+            for (uint32_t b = submesh.firstPaletteBone; b < submesh.firstPaletteBone + submesh.paletteBoneCount; ++b)
+                paletteSlot[bonePalettes[b]] = noVertex;
+            submesh = Submesh();
+            submesh.firstIndex = static_cast<uint32_t>(t * 3);
+            submesh.baseVertex = static_cast<uint32_t>(source.size());
+            submesh.firstPaletteBone = static_cast<uint32_t>(bonePalettes.size());
+            newBoneCount = 0;
+            for (int k = 0; k < 3 && palettes; ++k)
+            {
+                const VertexData& vert = verts[tri.index[k]];
+                for (uint32_t i = 0; i < format.influenceCount; ++i)
+                {
+                    if (vert.weights[i] > 0 && std::find(newBones, newBones + newBoneCount, vert.bones[i]) == newBones + newBoneCount)
+                        newBones[newBoneCount++] = vert.bones[i];
+                }
+            }
+        }
+        for (uint32_t b = 0; b < newBoneCount; ++b)
+        {
+            paletteSlot[newBones[b]] = submesh.paletteBoneCount++;
+            bonePalettes.push_back(newBones[b]);
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = tri.index[k];
+            if (current[v] == noVertex)
+            {
+                current[v] = static_cast<uint32_t>(source.size());
+                if (firstCopy[v] == noVertex)
+                    firstCopy[v] = current[v];
+                source.push_back(v);
+                newVerts.push_back(verts[v]);
+                if (palettes)
+                {
+                    VertexData& copy = newVerts.back();
+                    for (int i = 0; i < VertexData::MaxInfluences; ++i)
+                        copy.bones[i] = copy.weights[i] > 0 ? static_cast<uint16_t>(paletteSlot[copy.bones[i]]) : 0;
+                }
+                ++submesh.vertexCount;
+            }
+            tri.index[k] = current[v];
+        }
+    }
+    submesh.indexCount = static_cast<uint32_t>(indices.size() * 3) - submesh.firstIndex;
+    submeshes.push_back(submesh);
+
+    // LODs and meshlets only use vertices of the full mesh, so every one has a copy
+    for (Lod& lod : lods)
+    {
+        for (Triangle& tri : lod.indices)
+        {
+            tri.index[0] = firstCopy[tri.index[0]];
+            tri.index[1] = firstCopy[tri.index[1]];
+            tri.index[2] = firstCopy[tri.index[2]];
+        }
+    }
+    for (uint32_t& v : meshletVertices)
+        v = firstCopy[v];
+
+    for (BlendShape& bs : blendShapes)
+    {
+        if (!bs.sparse)
+        {
+            std::vector<VertexData> newDeltas(source.size());
+            for (size_t i = 0; i < source.size(); ++i)
+                newDeltas[i] = bs.deltas[source[i]];
+            bs.deltas.swap(newDeltas);
+            continue;
+        }
+        std::vector<uint32_t> deltaOf(verts.size(), noVertex);
+        for (size_t i = 0; i < bs.indices.size(); ++i)
+            deltaOf[bs.indices[i]] = static_cast<uint32_t>(i);
+        std::vector<uint32_t> newIndices;
+        std::vector<VertexData> newDeltas;
+        for (size_t i = 0; i < source.size(); ++i)
+        {
+            if (deltaOf[source[i]] == noVertex)
+                continue;
+            newIndices.push_back(static_cast<uint32_t>(i));
+            newDeltas.push_back(bs.deltas[deltaOf[source[i]]]);
+        }
+        bs.indices.swap(newIndices);
+        bs.deltas.swap(newDeltas);
+    }
+
+    if (!vertexMap.offsets.empty())
+    {   // old vertex -> all of its copies, ascending
+        std::vector<uint32_t> copyOffsets(verts.size() + 1, 0);
+        for (uint32_t v : source)
+            ++copyOffsets[v + 1];
+        for (size_t v = 0; v < verts.size(); ++v)
+            copyOffsets[v + 1] += copyOffsets[v];
+        std::vector<uint32_t> copies(source.size());
+        std::vector<uint32_t> cursor(copyOffsets.begin(), copyOffsets.end() - 1);
+        for (size_t i = 0; i < source.size(); ++i)
+            copies[cursor[source[i]]++] = static_cast<uint32_t>(i);
+
+        VertexMap newMap;
+        const size_t controlPointCount = vertexMap.GetControlPointCount();
+        newMap.offsets.resize(controlPointCount + 1);
+        for (size_t cp = 0; cp < controlPointCount; ++cp)
+        {
+            newMap.offsets[cp] = static_cast<uint32_t>(newMap.indices.size());
+            size_t begin = newMap.indices.size();
+            for (const uint32_t* v = vertexMap.Begin(cp); v != vertexMap.End(cp); ++v)
+                newMap.indices.insert(newMap.indices.end(), copies.begin() + copyOffsets[*v], copies.begin() + copyOffsets[*v + 1]);
+            std::sort(newMap.indices.begin() + begin, newMap.indices.end());
+        }
+        newMap.offsets[controlPointCount] = static_cast<uint32_t>(newMap.indices.size());
+        vertexMap = std::move(newMap);
+    }
+
+    verts.swap(newVerts);
+}
+
+bool ItpMesh::Mesh::Merge(const Mesh& other)
+{
+    const bool first = verts.empty() && indices.empty();
+    if (!first && (!format.HasSameLayout(other.format) || bonePalettes.empty() != other.bonePalettes.empty()))
+        return false;
+
+    // other's bones in the unified list, by name
+    std::vector<uint32_t> boneRemap(other.bones.size());
+    std::vector<Bone> newBones;
+    for (size_t i = 0; i < other.bones.size(); ++i)
+    {
+        size_t j = 0;
+        while (j < bones.size() && bones[j].name != other.bones[i].name)
+            ++j;
+        if (j == bones.size())
+        {
+            j = 0;
+            while (j < newBones.size() && newBones[j].name != other.bones[i].name)
+                ++j;
+            if (j == newBones.size())
+                newBones.push_back(other.bones[i]);
+            j += bones.size();
+        }
+        boneRemap[i] = static_cast<uint32_t>(j);
+    }
+    // palette entries are 16 bit, the vertices index the palettes
+    const size_t maxBones = other.bonePalettes.empty() ? other.format.GetMaxBones() : 65536;
+    if (bones.size() + newBones.size() > maxBones)
+        return false;
+
+    if (first)
+        format = other.format;
+    if (other.lods.size() > lods.size())
+    {   // the meshes merged so far fill the new levels with their coarsest one (their full
+        // list when they had none), which is what lods.back() or indices already hold
+        const Lod coarsest = lods.empty() ? Lod{ 0.0f, indices } : lods.back();
+        lods.resize(other.lods.size(), coarsest);
+    }
+    const uint32_t vertexOffset = static_cast<uint32_t>(verts.size());
+    const uint32_t indexOffset = static_cast<uint32_t>(indices.size() * 3);
+
+    for (Bone& bone : newBones)
+        bone.parentIndex = bone.parentIndex < 0 ? -1 : static_cast<int32_t>(boneRemap[bone.parentIndex]);
+    for (size_t i = 0; i < other.bones.size(); ++i)
+    {   // a bone that was a root in another mesh may have its parent in this one
+        Bone& bone = boneRemap[i] < bones.size() ? bones[boneRemap[i]] : newBones[boneRemap[i] - bones.size()];
+        if (bone.parentIndex < 0 && other.bones[i].parentIndex >= 0)
+            bone.parentIndex = static_cast<int32_t>(boneRemap[other.bones[i].parentIndex]);
+        if (!bone.node)
+            bone.node = other.bones[i].node;
+    }
+    bones.insert(bones.end(), newBones.begin(), newBones.end());
+
+    verts.insert(verts.end(), other.verts.begin(), other.verts.end());
+    if (format.hasSkin && !other.bones.empty() && other.bonePalettes.empty())
+    {
+        for (size_t i = vertexOffset; i < verts.size(); ++i)
+        {
+            for (int k = 0; k < VertexData::MaxInfluences; ++k)
+                verts[i].bones[k] = static_cast<uint16_t>(boneRemap[verts[i].bones[k]]);
+        }
+    }
+    const uint32_t paletteOffset = static_cast<uint32_t>(bonePalettes.size());
+    for (uint16_t bone : other.bonePalettes)
+        bonePalettes.push_back(static_cast<uint16_t>(boneRemap[bone]));
+    indices.reserve(indices.size() + other.indices.size());
+    for (const Triangle& tri : other.indices)
+        indices.push_back({ { tri.index[0] + vertexOffset, tri.index[1] + vertexOffset, tri.index[2] + vertexOffset } });
+
+    const size_t firstSubmesh = submeshes.size();
+    submeshMaterials.resize(firstSubmesh, MaterialPath(name));
+    if (other.submeshes.empty())
+    {
+        Submesh submesh = { indexOffset, static_cast<uint32_t>(other.indices.size() * 3), vertexOffset, static_cast<uint32_t>(other.verts.size()), 0, 0 };
+        submeshes.push_back(submesh);
+    }
+    for (Submesh submesh : other.submeshes)
+    {
+        submesh.firstIndex += indexOffset;
+        submesh.baseVertex += vertexOffset;
+        submesh.firstPaletteBone += paletteOffset;
+        submeshes.push_back(submesh);
+    }
+    for (size_t i = firstSubmesh; i < submeshes.size(); ++i)
+        submeshMaterials.push_back(other.submeshMaterials.empty() ? MaterialPath(other.name) : other.submeshMaterials[i - firstSubmesh]);
+
+    for (size_t i = 0; i < lods.size(); ++i)
+    {
+        const std::vector<Triangle>& lodIndices = other.lods.empty() ? other.indices : other.lods[std::min(i, other.lods.size() - 1)].indices;
+        for (const Triangle& tri : lodIndices)
+            lods[i].indices.push_back({ { tri.index[0] + vertexOffset, tri.index[1] + vertexOffset, tri.index[2] + vertexOffset } });
+        if (!other.lods.empty())
+            lods[i].error = std::max(lods[i].error, other.lods[std::min(i, other.lods.size() - 1)].error);
+    }
+
+    const uint32_t meshletVertexOffset = static_cast<uint32_t>(meshletVertices.size());
+    const uint32_t meshletTriangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+    for (Meshlet meshlet : other.meshlets)
+    {
+        meshlet.vertexOffset += meshletVertexOffset;
+        meshlet.triangleOffset += meshletTriangleOffset;
+        meshlets.push_back(meshlet);
+    }
+    for (uint32_t v : other.meshletVertices)
+        meshletVertices.push_back(v + vertexOffset);
+    meshletTriangles.insert(meshletTriangles.end(), other.meshletTriangles.begin(), other.meshletTriangles.end());
+
+    // dense deltas would have to cover every merged vertex
+    for (const BlendShape& bs : other.blendShapes)
+    {
+        BlendShape merged;
+        merged.name = bs.name;
+        merged.format = bs.format;
+        merged.sparse = true;
+        merged.deltas = bs.deltas;
+        merged.indices.resize(bs.deltas.size());
+        for (size_t i = 0; i < bs.deltas.size(); ++i)
+            merged.indices[i] = (bs.sparse ? bs.indices[i] : static_cast<uint32_t>(i)) + vertexOffset;
+        blendShapes.push_back(std::move(merged));
+    }
+
+    if (!other.vertexMap.offsets.empty())
+    {   // the control points of other follow the ones merged so far
+        if (vertexMap.offsets.empty())
+            vertexMap.offsets.push_back(0);
+        const uint32_t mapOffset = static_cast<uint32_t>(vertexMap.indices.size());
+        for (size_t cp = 1; cp < other.vertexMap.offsets.size(); ++cp)
+            vertexMap.offsets.push_back(other.vertexMap.offsets[cp] + mapOffset);
+        for (uint32_t v : other.vertexMap.indices)
+            vertexMap.indices.push_back(v + vertexOffset);
+    }
+    return true;
+}
+
+void ItpMesh::Mesh::FitPositionQuantization()
+{
+    if (verts.empty())
+        return;
+    Vector3 boundsMin, boundsMax;
+    MathSimd::ComputeBoundsStrided(&verts[0].pos.x, sizeof(VertexData), verts.size(), boundsMin, boundsMax);
+    format.FitPositionQuantization(boundsMin, boundsMax);
+}
+
+void ItpMesh::Mesh::RemapVertices(const std::vector<uint32_t>& remap)
+{
+    std::vector<VertexData> newVerts(verts.size());
+    for (size_t i = 0; i < verts.size(); ++i)
+        newVerts[remap[i]] = verts[i];
+    verts.swap(newVerts);
+
+    auto remapTriangles = [&](std::vector<Triangle>& tris)
+    {
+        for (Triangle& tri : tris)
+        {
+            tri.index[0] = remap[tri.index[0]];
+            tri.index[1] = remap[tri.index[1]];
+            tri.index[2] = remap[tri.index[2]];
+        }
+    };
+    remapTriangles(indices);
+    for (Lod& lod : lods)
+        remapTriangles(lod.indices);
+
+    for (BlendShape& bs : blendShapes)
+    {
+        if (bs.sparse)
+        {   // renumber, then restore ascending index order
+            std::vector<std::pair<uint32_t, uint32_t>> order(bs.indices.size());
+            for (size_t i = 0; i < bs.indices.size(); ++i)
+                order[i] = std::make_pair(remap[bs.indices[i]], static_cast<uint32_t>(i));
+            std::sort(order.begin(), order.end());
+            std::vector<VertexData> newDeltas(bs.deltas.size());
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                bs.indices[i] = order[i].first;
+                newDeltas[i] = bs.deltas[order[i].second];
+            }
+            bs.deltas.swap(newDeltas);
+            continue;
+        }
+        std::vector<VertexData> newDeltas(bs.deltas.size());
+        for (size_t i = 0; i < bs.deltas.size(); ++i)
+            newDeltas[remap[i]] = bs.deltas[i];
+        bs.deltas.swap(newDeltas);
+    }
+
+    for (uint32_t& v : meshletVertices)
+        v = remap[v];
+    for (uint32_t& v : vertexMap.indices)
+        v = remap[v];
+}
+
+// Writes indices as indexSize (2 or 4) byte values
+static void PackIndices(const uint32_t* indices, size_t indexCount, uint32_t indexSize, uint8_t* dst)
+{
+    if (indexSize == sizeof(uint32_t))
+    {
+        if (indexCount > 0)
+            memcpy(dst, indices, indexCount * sizeof(uint32_t));
+        return;
+    }
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint16_t index = static_cast<uint16_t>(indices[i]);
+        memcpy(dst + i * sizeof(uint16_t), &index, sizeof(uint16_t));
+    }
+}
+
+// Lays the streams out back to back after the header and stream table
+static void AssignStreamOffsets(const ItpMesh::BinaryHeader& header, std::vector<ItpMesh::BinaryStream>& streams)
+{
+    uint64_t offset = header.headerSize;
+    for (ItpMesh::BinaryStream& stream : streams)
+    {
+        stream.offset = AlignUp(offset, ItpMesh::BinaryAlignment);
+        offset = stream.offset + stream.size;
+    }
+}
+
+// Fills the header and stream table of a binary file and lays the streams out after them:
+// the four streams every file has, then extraStreams (type, stride and size set)
+static void BuildBinaryLayout(const ItpMesh::VertexFormat& format, uint64_t vertexCount, uint64_t triangleCount,
+    uint32_t indexSize, size_t materialSize, uint32_t attributeCount, const std::vector<ItpMesh::BinaryStream>& extraStreams,
+    ItpMesh::BinaryHeader& header, std::vector<ItpMesh::BinaryStream>& streams)
+{
+    const uint32_t stride = format.GetStride();
+
+    streams.assign(4, ItpMesh::BinaryStream());
+    streams[0].type = ItpMesh::StreamVertices;
+    streams[0].stride = stride;
+    streams[0].size = stride * vertexCount;
+    streams[1].type = ItpMesh::StreamIndices;
+    streams[1].stride = indexSize;
+    streams[1].size = indexSize * 3 * triangleCount;
+    streams[2].type = ItpMesh::StreamMaterial;
+    streams[2].stride = 0;
+    streams[2].size = materialSize;
+    streams[3].type = ItpMesh::StreamVertexLayout;
+    streams[3].stride = sizeof(ItpMesh::VertexFormat::Attribute);
+    streams[3].size = sizeof(ItpMesh::VertexFormat::Attribute) * attributeCount;
+    streams.insert(streams.end(), extraStreams.begin(), extraStreams.end());
+
+    header = ItpMesh::BinaryHeader();
+    header.magic = ItpMesh::BinaryMagic;
+    header.version = ItpMesh::BinaryVersion;
+    header.headerSize = static_cast<uint32_t>(sizeof(ItpMesh::BinaryHeader) + sizeof(ItpMesh::BinaryStream) * streams.size());
+    header.formatFlags = format.GetFlags();
+    header.vertexStride = stride;
+    header.vertexCount = static_cast<uint32_t>(vertexCount);
+    header.indexCount = static_cast<uint32_t>(triangleCount * 3);
+    header.streamCount = static_cast<uint32_t>(streams.size());
+    if (format.positionEncoding == ItpMesh::VertexFormat::PositionUnorm16)
+    {
+        header.positionScale[0] = format.positionScale.x;
+        header.positionScale[1] = format.positionScale.y;
+        header.positionScale[2] = format.positionScale.z;
+        header.positionOffset[0] = format.positionOffset.x;
+        header.positionOffset[1] = format.positionOffset.y;
+        header.positionOffset[2] = format.positionOffset.z;
+    }
+    else
+    {
+        header.positionScale[0] = header.positionScale[1] = header.positionScale[2] = 1.0f;
+    }
+
+    header.codec = format.codec;
+    header.indexSize = indexSize;
+    AssignStreamOffsets(header, streams);
+}
+
+void ItpMesh::Mesh::WriteToBinary(std::ofstream& ofs) const
+{
+    std::vector<uint8_t> file;
+    WriteToBinary(file);
+    ofs.write(reinterpret_cast<const char*>(file.data()), static_cast<std::streamsize>(file.size()));
+}
+
+void ItpMesh::Mesh::WriteToBinary(std::vector<uint8_t>& file) const
+{
+    const uint32_t stride = format.GetStride();
+    const std::string material = MaterialPath(name);
+
+    VertexFormat::Attribute attributes[VertexFormat::MaxAttributes];
+    const uint32_t attributeCount = format.GetAttributes(attributes);
+
+    // the index streams as written: relative to their submesh and narrowed where possible
+    const uint32_t indexSize = GetIndexSize();
+    std::vector<uint32_t> localIndices;
+    if (!indices.empty())
+        localIndices.assign(indices[0].index, indices[0].index + indices.size() * 3);
+    for (const Submesh& submesh : submeshes)
+    {
+        for (uint32_t i = submesh.firstIndex; i < submesh.firstIndex + submesh.indexCount; ++i)
+            localIndices[i] -= submesh.baseVertex;
+    }
+    const uint32_t lodIndexSize = format.indexEncoding == VertexFormat::IndexAuto && verts.size() <= MaxShortIndexVertices ? 2 : 4;
+
+    std::vector<BinaryStream> extraStreams;
+    std::vector<BinaryLod> lodTable(lods.size());
+    if (!lods.empty())
+    {
+        uint32_t firstIndex = 0;
+        for (size_t i = 0; i < lods.size(); ++i)
+        {
+            lodTable[i].firstIndex = firstIndex;
+            lodTable[i].indexCount = static_cast<uint32_t>(lods[i].indices.size() * 3);
+            lodTable[i].error = lods[i].error;
+            lodTable[i].reserved = 0;
+            firstIndex += lodTable[i].indexCount;
+        }
+        BinaryStream stream = {};
+        stream.type = StreamLods;
+        stream.stride = sizeof(BinaryLod);
+        stream.size = sizeof(BinaryLod) * lodTable.size();
+        extraStreams.push_back(stream);
+        stream.type = StreamLodIndices;
+        stream.stride = lodIndexSize;
+        stream.size = lodIndexSize * static_cast<uint64_t>(firstIndex);
+        extraStreams.push_back(stream);
+    }
+    std::string submeshMaterialBlob;
+    for (const std::string& submeshMaterial : submeshMaterials)
+        submeshMaterialBlob.append(submeshMaterial.c_str(), submeshMaterial.size() + 1);
+    if (!submeshes.empty())
+    {
+        BinaryStream stream = {};
+        stream.type = StreamSubmeshes;
+        stream.stride = sizeof(Submesh);
+        stream.size = sizeof(Submesh) * submeshes.size();
+        extraStreams.push_back(stream);
+    }
+    if (!submeshMaterialBlob.empty())
+    {
+        BinaryStream stream = {};
+        stream.type = StreamSubmeshMaterials;
+        stream.size = submeshMaterialBlob.size();
+        extraStreams.push_back(stream);
+    }
+    if (!bonePalettes.empty())
+    {
+        BinaryStream stream = {};
+        stream.type = StreamBonePalettes;
+        stream.stride = sizeof(uint16_t);
+        stream.size = sizeof(uint16_t) * bonePalettes.size();
+        extraStreams.push_back(stream);
+    }
+    if (hasBounds)
+    {
+        BinaryStream stream = {};
+        stream.type = StreamBounds;
+        stream.stride = sizeof(Bounds);
+        stream.size = sizeof(Bounds);
+        extraStreams.push_back(stream);
+    }
+    if (!bvhNodes.empty())
+    {
+        BinaryStream stream = {};
+        stream.type = StreamBvhNodes;
+        stream.stride = sizeof(BvhNode);
+        stream.size = sizeof(BvhNode) * bvhNodes.size();
+        extraStreams.push_back(stream);
+        stream.type = StreamBvhTriangles;
+        stream.stride = sizeof(uint32_t);
+        stream.size = sizeof(uint32_t) * bvhTriangles.size();
+        extraStreams.push_back(stream);
+    }
+    if (!meshlets.empty())
+    {
+        BinaryStream stream = {};
+        stream.type = StreamMeshlets;
+        stream.stride = sizeof(Meshlet);
+        stream.size = sizeof(Meshlet) * meshlets.size();
+        extraStreams.push_back(stream);
+        stream.type = StreamMeshletVertices;
+        stream.stride = sizeof(uint32_t);
+        stream.size = sizeof(uint32_t) * meshletVertices.size();
+        extraStreams.push_back(stream);
+        stream.type = StreamMeshletTriangles;
+        stream.stride = sizeof(uint8_t);
+        stream.size = meshletTriangles.size();
+        extraStreams.push_back(stream);
+    }
+
+    BinaryHeader header;
+    std::vector<BinaryStream> streams;
+    BuildBinaryLayout(format, verts.size(), indices.size(), indexSize, material.size(), attributeCount, extraStreams, header, streams);
+
+    // encoded streams are produced up front since their sizes drive the layout
+    std::vector<uint8_t> encodedVertices;
+    std::vector<uint8_t> encodedIndices;
+    if (format.codec & VertexFormat::CodecVertices)
+    {
+        std::vector<uint8_t> packed(stride * verts.size());
+        for (size_t i = 0; i < verts.size(); ++i)
+            format.PackVertex(verts[i], packed.data() + stride * i);
+        MeshCodec::EncodeVertices(packed.data(), verts.size(), stride, encodedVertices);
+        if (format.codec & VertexFormat::CodecZstd)
+            MeshCodec::Compress(encodedVertices, s_zstdLevel);
+        streams[0].size = encodedVertices.size();
+    }
+    if (format.codec & VertexFormat::CodecIndices)
+    {
+        MeshCodec::EncodeIndices(localIndices.data(), localIndices.size(), encodedIndices);
+        if (format.codec & VertexFormat::CodecZstd)
+            MeshCodec::Compress(encodedIndices, s_zstdLevel);
+        streams[1].size = encodedIndices.size();
+    }
+    if (format.codec != VertexFormat::CodecNone)
+        AssignStreamOffsets(header, streams);
+    const uint64_t fileSize = streams.back().offset + streams.back().size;
+
+    // Assemble the whole file in memory so it goes out in a single write
+    file.assign(static_cast<size_t>(fileSize), 0);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), streams.data(), sizeof(BinaryStream) * streams.size());
+
+    if (format.codec & VertexFormat::CodecVertices)
+    {
+        memcpy(file.data() + streams[0].offset, encodedVertices.data(), encodedVertices.size());
+    }
+    else
+    {
+        uint8_t* dst = file.data() + streams[0].offset;
+        for (const VertexData& vert : verts)
+        {
+            format.PackVertex(vert, dst);
+            dst += stride;
+        }
+    }
+    if (format.codec & VertexFormat::CodecIndices)
+        memcpy(file.data() + streams[1].offset, encodedIndices.data(), encodedIndices.size());
+    else
+        PackIndices(localIndices.data(), localIndices.size(), indexSize, file.data() + streams[1].offset);
+    if (!material.empty())
+        memcpy(file.data() + streams[2].offset, material.data(), material.size());
+    memcpy(file.data() + streams[3].offset, attributes, static_cast<size_t>(streams[3].size));
+    for (size_t i = 4; i < streams.size(); ++i)
+    {
+        uint8_t* blob = file.data() + streams[i].offset;
+        if (streams[i].type == StreamLods)
+        {
+            memcpy(blob, lodTable.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamLodIndices)
+        {
+            for (const Lod& lod : lods)
+            {
+                if (lod.indices.empty())
+                    continue;
+                PackIndices(lod.indices[0].index, lod.indices.size() * 3, lodIndexSize, blob);
+                blob += lodIndexSize * 3 * lod.indices.size();
+            }
+        }
+        else if (streams[i].type == StreamSubmeshes)
+        {
+            memcpy(blob, submeshes.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamSubmeshMaterials)
+        {
+            memcpy(blob, submeshMaterialBlob.data(), submeshMaterialBlob.size());
+        }
+        else if (streams[i].type == StreamBonePalettes)
+        {
+            memcpy(blob, bonePalettes.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamMeshlets)
+        {
+            memcpy(blob, meshlets.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamMeshletVertices && !meshletVertices.empty())
+        {
+            memcpy(blob, meshletVertices.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamMeshletTriangles && !meshletTriangles.empty())
+        {
+            memcpy(blob, meshletTriangles.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamBounds)
+        {
+            memcpy(blob, &bounds, sizeof(Bounds));
+        }
+        else if (streams[i].type == StreamBvhNodes)
+        {
+            memcpy(blob, bvhNodes.data(), static_cast<size_t>(streams[i].size));
+        }
+        else if (streams[i].type == StreamBvhTriangles && !bvhTriangles.empty())
+        {
+            memcpy(blob, bvhTriangles.data(), static_cast<size_t>(streams[i].size));
+        }
+    }
+}
+
+ItpMesh::BinaryStreamWriter::BinaryStreamWriter(const VertexFormat& format, const std::string& meshName, size_t chunkBytes)
+    : format(format)
+    , material(MaterialPath(meshName))
+    , stride(format.GetStride())
+{
+    // streamed vertices go out chunk by chunk, unencoded
+    this->format.codec = VertexFormat::CodecNone;
+    vertexChunk.reserve(std::max<size_t>(chunkBytes / stride, 1) * stride);
+    indexChunk.reserve(std::max<size_t>(chunkBytes / sizeof(uint32_t), 3));
+}
+
+ItpMesh::BinaryStreamWriter::~BinaryStreamWriter()
+{
+    if (indexFile.is_open())
+        indexFile.close();
+    if (!indexPath.empty())
+        std::remove(indexPath.c_str());
+}
+
+bool ItpMesh::BinaryStreamWriter::Open(const std::string& path)
+{
+    ofs.open(path, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    indexPath = path + ".indices.tmp";
+    indexFile.open(indexPath, std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    if (!ofs.is_open() || !indexFile.is_open())
+        return false;
+
+    // the header and stream table are rewritten by Finish; the vertex stream starts
+    // at a fixed offset since the table has a fixed size
+    BinaryHeader header;
+    std::vector<BinaryStream> streams;
+    BuildBinaryLayout(format, 0, 0, sizeof(uint32_t), 0, 0, std::vector<BinaryStream>(), header, streams);
+    std::vector<char> zeros(static_cast<size_t>(streams[0].offset), 0);
+    ofs.write(zeros.data(), static_cast<std::streamsize>(zeros.size()));
+    return static_cast<bool>(ofs);
+}
+
+void ItpMesh::BinaryStreamWriter::WriteVertices(const VertexData* verts, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (vertexChunk.size() + stride > vertexChunk.capacity())
+            FlushVertices();
+        size_t at = vertexChunk.size();
+        vertexChunk.resize(at + stride);
+        format.PackVertex(verts[i], vertexChunk.data() + at);
+    }
+    vertexCount += count;
+}
+
+void ItpMesh::BinaryStreamWriter::WriteTriangles(const Mesh::Triangle* tris, size_t count, uint32_t baseVertex)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (indexChunk.size() + 3 > indexChunk.capacity())
+            FlushIndices();
+        indexChunk.push_back(tris[i].index[0] + baseVertex);
+        indexChunk.push_back(tris[i].index[1] + baseVertex);
+        indexChunk.push_back(tris[i].index[2] + baseVertex);
+    }
+    triangleCount += count;
+}
+
+void ItpMesh::BinaryStreamWriter::FlushVertices()
+{
+    ofs.write(reinterpret_cast<const char*>(vertexChunk.data()), static_cast<std::streamsize>(vertexChunk.size()));
+    vertexChunk.clear();
+}
+
+void ItpMesh::BinaryStreamWriter::FlushIndices()
+{
+    indexFile.write(reinterpret_cast<const char*>(indexChunk.data()), static_cast<std::streamsize>(indexChunk.size() * sizeof(uint32_t)));
+    indexChunk.clear();
+}
+
+bool ItpMesh::BinaryStreamWriter::Finish()
+{
+    FlushVertices();
+    FlushIndices();
+
+    VertexFormat::Attribute attributes[VertexFormat::MaxAttributes];
+    const uint32_t attributeCount = format.GetAttributes(attributes);
+    BinaryHeader header;
+    std::vector<BinaryStream> streams;
+    // the vertex count is only known now; the spooled 32 bit indices are narrowed on the way
+    const uint32_t indexSize = format.indexEncoding == VertexFormat::IndexAuto && vertexCount <= Mesh::MaxShortIndexVertices ? 2 : 4;
+    BuildBinaryLayout(format, vertexCount, triangleCount, indexSize, material.size(), attributeCount, std::vector<BinaryStream>(), header, streams);
+
+    auto padTo = [&](uint64_t offset)
+    {
+        static const char zeros[BinaryAlignment] = {};
+        std::streamoff at = ofs.tellp();
+        if (at >= 0 && static_cast<uint64_t>(at) < offset)
+            ofs.write(zeros, static_cast<std::streamsize>(offset - static_cast<uint64_t>(at)));
+    };
+
+    // append the spooled indices, reusing the vertex chunk as the copy buffer
+    padTo(streams[1].offset);
+    indexFile.flush();
+    indexFile.seekg(0);
+    std::vector<uint8_t>& buffer = vertexChunk;
+    buffer.resize(std::max<size_t>(buffer.capacity() / sizeof(uint32_t), 1) * sizeof(uint32_t));
+    uint64_t remaining = triangleCount * sizeof(Mesh::Triangle);
+    while (remaining > 0 && indexFile)
+    {
+        std::streamsize count = static_cast<std::streamsize>(std::min<uint64_t>(remaining, buffer.size()));
+        indexFile.read(reinterpret_cast<char*>(buffer.data()), count);
+        const size_t readCount = static_cast<size_t>(indexFile.gcount()) / sizeof(uint32_t);
+        if (indexSize == sizeof(uint16_t))
+        {   // in place: index i moves from byte 4i down to byte 2i
+            for (size_t i = 0; i < readCount; ++i)
+            {
+                uint32_t index;
+                memcpy(&index, buffer.data() + i * sizeof(uint32_t), sizeof(index));
+                uint16_t shortIndex = static_cast<uint16_t>(index);
+                memcpy(buffer.data() + i * sizeof(uint16_t), &shortIndex, sizeof(shortIndex));
+            }
+        }
+        ofs.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(readCount * indexSize));
+        remaining -= static_cast<uint64_t>(indexFile.gcount());
+    }
+    buffer.clear();
+
+    padTo(streams[2].offset);
+    ofs.write(material.data(), static_cast<std::streamsize>(material.size()));
+    padTo(streams[3].offset);
+    ofs.write(reinterpret_cast<const char*>(attributes), static_cast<std::streamsize>(streams[3].size));
+
+    // now that the counts are known, patch the header
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(streams.data()), static_cast<std::streamsize>(sizeof(BinaryStream) * streams.size()));
+    ofs.close();
+
+    indexFile.close();
+    std::remove(indexPath.c_str());
+    indexPath.clear();
+    return remaining == 0 && !ofs.fail();
+}
+
+static void WriteDirectionToJson(const Vector3& dir, ItpMesh::VertexFormat::NormalEncoding encoding, JsonWriter& json)
+{
+    json.Raw(", ");
+    if (encoding == ItpMesh::VertexFormat::NormalFloat3)
+    {
+        WriteFloat3(json, dir);
+        return;
+    }
+    int16_t oct[2];
+    ItpMesh::VertexFormat::OctEncode(dir, encoding == ItpMesh::VertexFormat::NormalOct16 ? 16 : 8, oct);
+    json.Int(oct[0]).Raw(", ").Int(oct[1]);
+}
+
+void ItpMesh::Mesh::WriteVertToJson(const VertexData& vert, JsonWriter& json) const
+{
+    json.Raw("\t\t[ ");
+    if (format.positionEncoding == VertexFormat::PositionUnorm16)
+    {
+        uint16_t q[3];
+        format.QuantizePosition(vert.pos, q);
+        json.UInt(q[0]).Raw(", ").UInt(q[1]).Raw(", ").UInt(q[2]);
+    }
+    else
+    {
+        WriteFloat3(json, vert.pos);
+    }
     if (format.hasNormal)
     {
-        ofs << ", " << vert.norm.x << ", " << vert.norm.y << ", " << vert.norm.z;
+        WriteDirectionToJson(vert.norm, format.normalEncoding, json);
     }
     if (format.hasTan)
     {
-        ofs << ", " << vert.tan.x << ", " << vert.tan.y << ", " << vert.tan.z;
+        WriteDirectionToJson(vert.tan, format.normalEncoding, json);
+        if (format.hasTanSign)
+        {
+            if (format.normalEncoding == VertexFormat::NormalFloat3)
+                json.Raw(vert.tanSign < 0.0f ? ", -1.0" : ", 1.0");
+            else if (format.normalEncoding == VertexFormat::NormalOct16)
+                json.Raw(vert.tanSign < 0.0f ? ", -32767" : ", 32767");
+            else
+                json.Raw(vert.tanSign < 0.0f ? ", -127" : ", 127");
+        }
     }
     if (format.hasSkin)
     {
-        ofs << ", " << static_cast<uint32_t>(vert.bones[0]) << ", "
-            << static_cast<uint32_t>(vert.bones[1]) << ", "
-            << static_cast<uint32_t>(vert.bones[2]) << ", "
-            << static_cast<uint32_t>(vert.bones[3]) << ", "
-            << static_cast<uint32_t>(vert.weights[0]) << ", "
-            << static_cast<uint32_t>(vert.weights[1]) << ", "
-            << static_cast<uint32_t>(vert.weights[2]) << ", "
-            << static_cast<uint32_t>(vert.weights[3]);
+        for (uint32_t k = 0; k < format.influenceCount; ++k)
+            json.Raw(", ").UInt(vert.bones[k]);
+        for (uint32_t k = 0; k < format.influenceCount; ++k)
+            json.Raw(", ").UInt(vert.weights[k]);
     }
     if (format.hasUV)
     {
-        ofs << ", " << vert.uv.x << ", " << vert.uv.y;
+        if (format.uvEncoding == VertexFormat::UVHalf2)
+        {   // write the value the half holds, so the loader converts it back exactly
+            json.Raw(", ").Float(VertexFormat::HalfToFloat(VertexFormat::FloatToHalf(vert.uv.x)))
+                .Raw(", ").Float(VertexFormat::HalfToFloat(VertexFormat::FloatToHalf(vert.uv.y)));
+        }
+        else
+        {
+            json.Raw(", ").Float(vert.uv.x).Raw(", ").Float(vert.uv.y);
+        }
+    }
+
+    json.Raw(" ]");
+}
+
+void ItpMesh::Mesh::WriteVertsToJson(JsonWriter& json) const
+{
+    json.Raw("\t\"vertices\": [\n");
+    for (size_t i = 0; i < verts.size(); ++i)
+    {
+        if (i > 0)
+            json.Raw(",\n");
+        WriteVertToJson(verts[i], json);
+    }
+    json.Raw("\n\t],\n");
+}
+
+// Like the binary stream, the indices of a split or merged mesh are relative to their
+// submesh; WriteToJson marks such files version 4
+void ItpMesh::Mesh::WriteIndicesToJson(JsonWriter& json) const
+{
+    json.Raw("\t\"indices\": [\n");
+    if (submeshes.empty())
+    {
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            if (i > 0)
+                json.Raw(",\n");
+            indices[i].WriteToJson(json);
+        }
+    }
+    else
+    {
+        for (const Submesh& submesh : submeshes)
+        {
+            for (uint32_t t = submesh.firstIndex / 3; t < (submesh.firstIndex + submesh.indexCount) / 3; ++t)
+            {
+                Triangle local = indices[t];
+                local.index[0] -= submesh.baseVertex;
+                local.index[1] -= submesh.baseVertex;
+                local.index[2] -= submesh.baseVertex;
+                if (t > 0)
+                    json.Raw(",\n");
+                local.WriteToJson(json);
+            }
+        }
+    }
+    json.Raw("\n\t]");
+}
+
+// "submeshes": [ { "firstIndex": i, "indexCount": n, "baseVertex": b, "vertexCount": v[, "material": path][, "palette": [ bones ]] }, ... ],
+// only for split and merged meshes
+void ItpMesh::Mesh::WriteSubmeshesToJson(JsonWriter& json) const
+{
+    if (submeshes.empty())
+        return;
+    json.Raw(",\n\t\"submeshes\": [\n");
+    for (size_t i = 0; i < submeshes.size(); ++i)
+    {
+        const Submesh& submesh = submeshes[i];
+        json.Raw("\t\t{ \"firstIndex\": ").UInt(submesh.firstIndex)
+            .Raw(", \"indexCount\": ").UInt(submesh.indexCount)
+            .Raw(", \"baseVertex\": ").UInt(submesh.baseVertex)
+            .Raw(", \"vertexCount\": ").UInt(submesh.vertexCount);
+        if (i < submeshMaterials.size())
+            json.Raw(", \"material\": ").String(submeshMaterials[i]);
+        if (submesh.paletteBoneCount > 0)
+        {
+            json.Raw(", \"palette\": [ ");
+            for (uint32_t b = 0; b < submesh.paletteBoneCount; ++b)
+                json.Raw(b > 0 ? ", " : "").UInt(bonePalettes[submesh.firstPaletteBone + b]);
+            json.Raw(" ]");
+        }
+        json.Raw(i + 1 < submeshes.size() ? " },\n" : " }\n");
     }
+    json.Raw("\t]");
+}
 
-    ofs << " ]";
+// "lods": [ { "error": e, "indices": [ ... ] }, ... ], only when there are any
+void ItpMesh::Mesh::WriteLodsToJson(JsonWriter& json) const
+{
+    if (lods.empty())
+        return;
+    json.Raw(",\n\t\"lods\": [\n");
+    for (size_t l = 0; l < lods.size(); ++l)
+    {
+        const Lod& lod = lods[l];
+        json.Raw("\t{\n\t\t\"error\": ").Float(lod.error).Raw(",\n\t\t\"indices\": [\n");
+        for (size_t i = 0; i < lod.indices.size(); ++i)
+        {
+            if (i > 0)
+                json.Raw(",\n");
+            json.Char('\t');
+            lod.indices[i].WriteToJson(json);
+        }
+        json.Raw(l + 1 < lods.size() ? "\n\t\t]\n\t},\n" : "\n\t\t]\n\t}\n");
+    }
+    json.Raw("\t]");
 }
 
-void ItpMesh::Mesh::WriteVertsToJson(std::ofstream& ofs) const
+// "meshlets": [ { bounds, "vertices": [ ... ], "triangles": [ ... ] }, ... ], only when
+// there are any. The triangles are the local vertex triples without the alignment padding.
+void ItpMesh::Mesh::WriteMeshletsToJson(JsonWriter& json) const
 {
-    ofs << "\t\"vertices\": [\n";
-    WriteVertToJson(verts[0], ofs);
-    for (size_t i = 1; i < verts.size(); ++i)
+    if (meshlets.empty())
+        return;
+    json.Raw(",\n\t\"meshlets\": [\n");
+    for (size_t m = 0; m < meshlets.size(); ++m)
     {
-        ofs << ",\n";
-        WriteVertToJson(verts[i], ofs);
+        const Meshlet& meshlet = meshlets[m];
+        json.Raw("\t\t{ \"center\": [ ").Float(meshlet.center[0]).Raw(", ").Float(meshlet.center[1]).Raw(", ").Float(meshlet.center[2])
+            .Raw(" ], \"radius\": ").Float(meshlet.radius)
+            .Raw(", \"coneApex\": [ ").Float(meshlet.coneApex[0]).Raw(", ").Float(meshlet.coneApex[1]).Raw(", ").Float(meshlet.coneApex[2])
+            .Raw(" ], \"coneAxis\": [ ").Float(meshlet.coneAxis[0]).Raw(", ").Float(meshlet.coneAxis[1]).Raw(", ").Float(meshlet.coneAxis[2])
+            .Raw(" ], \"coneCutoff\": ").Float(meshlet.coneCutoff)
+            .Raw(",\n\t\t  \"vertices\": [ ");
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            if (i > 0)
+                json.Raw(", ");
+            json.UInt(meshletVertices[meshlet.vertexOffset + i]);
+        }
+        json.Raw(" ],\n\t\t  \"triangles\": [ ");
+        for (uint32_t i = 0; i < meshlet.triangleCount * 3; ++i)
+        {
+            if (i > 0)
+                json.Raw(", ");
+            json.UInt(meshletTriangles[meshlet.triangleOffset + i]);
+        }
+        json.Raw(m + 1 < meshlets.size() ? " ] },\n" : " ] }\n");
     }
-    ofs << "\n\t],\n";
+    json.Raw("\t]");
 }
 
-void ItpMesh::Mesh::WriteIndicesToJson(std::ofstream& ofs) const
+// "bounds": { aabb, sphere, blend extent } and "bvh": { "nodes": [ ... ], "triangles": [ ... ] },
+// each only when there is one
+void ItpMesh::Mesh::WriteBoundsToJson(JsonWriter& json) const
 {
-    ofs << "\t\"indices\": [\n";
-    indices[0].WriteToJson(ofs);
-    for (size_t i = 1; i < indices.size(); ++i)
+    if (hasBounds)
+    {
+        json.Raw(",\n\t\"bounds\": {\n");
+        json.Raw("\t\t\"min\": [ ").Float(bounds.aabbMin[0]).Raw(", ").Float(bounds.aabbMin[1]).Raw(", ").Float(bounds.aabbMin[2]).Raw(" ],\n");
+        json.Raw("\t\t\"max\": [ ").Float(bounds.aabbMax[0]).Raw(", ").Float(bounds.aabbMax[1]).Raw(", ").Float(bounds.aabbMax[2]).Raw(" ],\n");
+        json.Raw("\t\t\"center\": [ ").Float(bounds.sphereCenter[0]).Raw(", ").Float(bounds.sphereCenter[1]).Raw(", ").Float(bounds.sphereCenter[2]).Raw(" ],\n");
+        json.Raw("\t\t\"radius\": ").Float(bounds.sphereRadius).Raw(",\n");
+        json.Raw("\t\t\"blendMin\": [ ").Float(bounds.blendMin[0]).Raw(", ").Float(bounds.blendMin[1]).Raw(", ").Float(bounds.blendMin[2]).Raw(" ],\n");
+        json.Raw("\t\t\"blendMax\": [ ").Float(bounds.blendMax[0]).Raw(", ").Float(bounds.blendMax[1]).Raw(", ").Float(bounds.blendMax[2]).Raw(" ]\n");
+        json.Raw("\t}");
+    }
+    if (bvhNodes.empty())
+        return;
+    json.Raw(",\n\t\"bvh\": {\n\t\t\"nodes\": [\n");
+    for (size_t n = 0; n < bvhNodes.size(); ++n)
     {
-        ofs << ",\n";
-        indices[i].WriteToJson(ofs);
+        const BvhNode& node = bvhNodes[n];
+        json.Raw("\t\t{ \"min\": [ ").Float(node.boundsMin[0]).Raw(", ").Float(node.boundsMin[1]).Raw(", ").Float(node.boundsMin[2])
+            .Raw(" ], \"max\": [ ").Float(node.boundsMax[0]).Raw(", ").Float(node.boundsMax[1]).Raw(", ").Float(node.boundsMax[2])
+            .Raw(" ], \"rightOrFirst\": ").UInt(node.rightOrFirst)
+            .Raw(", \"triangleCount\": ").UInt(node.triangleCount);
+        json.Raw(n + 1 < bvhNodes.size() ? " },\n" : " }\n");
     }
-    ofs << "\n\t]";
+    json.Raw("\t\t],\n\t\t\"triangles\": [ ");
+    for (size_t i = 0; i < bvhTriangles.size(); ++i)
+    {
+        if (i > 0)
+            json.Raw(", ");
+        json.UInt(bvhTriangles[i]);
+    }
+    json.Raw(" ]\n\t}");
 }
 
-void ItpMesh::Mesh::WriteSkelToJson(std::ofstream& ofs) const
+void ItpMesh::Mesh::WriteSkelToJson(JsonWriter& json) const
 {
-    ofs << "{\n";
-    ofs << "\t\"metadata\": {\n";
-    ofs << "\t\t\"type\": \"itpskel\",\n";
-    ofs << "\t\t\"version\": 1\n";
-    ofs << "\t},\n";
-    ofs << "\t\"bonecount\": " << bones.size() << ",\n";
-    ofs << "\t\"bones\": [\n";
+    json.Raw("{\n");
+    json.Raw("\t\"metadata\": {\n");
+    json.Raw("\t\t\"type\": \"itpskel\",\n");
+    json.Raw("\t\t\"version\": 2\n");
+    json.Raw("\t},\n");
+    json.Raw("\t\"bonecount\": ").UInt(bones.size()).Raw(",\n");
+    // how the mesh's vertices reference these bones
+    json.Raw("\t\"boneIndexType\": ").Raw(format.boneEncoding == VertexFormat::BoneUint16 ? "\"uint16\"" : "\"byte\"").Raw(",\n");
+    json.Raw("\t\"weightType\": ").Raw(format.weightEncoding == VertexFormat::WeightUnorm16 ? "\"unorm16\"" : "\"byte\"").Raw(",\n");
+    json.Raw("\t\"influences\": ").UInt(format.influenceCount).Raw(",\n");
+    json.Raw("\t\"palettes\": ").Raw(bonePalettes.empty() ? "false" : "true").Raw(",\n");
+    // bone space bounds of the vertices each bone weights, parallel to "bones"; a bone that
+    // weights no vertex has { "empty": true } instead, which a runtime skips when culling
+    if (boneBounds.size() == bones.size() && !bones.empty())
+    {
+        json.Raw("\t\"boneBounds\": [\n");
+        for (size_t i = 0; i < boneBounds.size(); ++i)
+        {
+            const BoneBounds& boneBound = boneBounds[i];
+            if (boneBound.IsEmpty())
+            {
+                json.Raw(i + 1 < boneBounds.size() ? "\t\t{ \"empty\": true },\n" : "\t\t{ \"empty\": true }\n");
+                continue;
+            }
+            json.Raw("\t\t{ \"min\": [ ").Float(boneBound.min[0]).Raw(", ").Float(boneBound.min[1]).Raw(", ").Float(boneBound.min[2])
+                .Raw(" ], \"max\": [ ").Float(boneBound.max[0]).Raw(", ").Float(boneBound.max[1]).Raw(", ").Float(boneBound.max[2]);
+            json.Raw(i + 1 < boneBounds.size() ? " ] },\n" : " ] }\n");
+        }
+        json.Raw("\t],\n");
+    }
+    json.Raw("\t\"bones\": [\n");
     if (!bones.empty())
     {
-        bones[0].WriteToJson(ofs);
+        bones[0].WriteToJson(json);
         for (size_t i = 1; i < bones.size(); ++i)
         {
-            ofs << ",\n";
-            bones[i].WriteToJson(ofs);
+            json.Raw(",\n");
+            bones[i].WriteToJson(json);
         }
     }
-    ofs << "\n\t]\n";
-    ofs << "}\n";
+    json.Raw("\n\t]\n");
+    json.Raw("}\n");
 }
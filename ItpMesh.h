@@ -1,34 +1,299 @@
 #pragma once
+#include "JsonWriter.h"
 #include "VertexFormat.h"
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 class ItpMesh
 {
 public:
 
+    // Binary .itpmesh3 layout (little-endian):
+    //   BinaryHeader
+    //   BinaryStream[streamCount]
+    //   stream blobs, each starting on a BinaryAlignment boundary
+    // The runtime can mmap the file and hand the vertex/index blobs straight to the GPU,
+    // unless the header's codec says they are encoded; MeshCodec then decodes them.
+    // Readers should skip stream types they don't know; the optional streams only
+    // appear when the mesh has the data.
+    static const uint32_t BinaryMagic = 0x4D505449;    // "ITPM"
+    static const uint32_t BinaryVersion = 5;
+    static const uint32_t BinaryAlignment = 16;
+
+    enum StreamType : uint32_t
+    {
+        StreamVertices = 0,     // packed vertices, VertexFormat::GetStride() bytes each
+        StreamIndices = 1,      // triangle list of BinaryHeader::indexSize byte indices
+        StreamMaterial = 2,     // material path, utf-8, not null terminated
+        StreamVertexLayout = 3, // VertexFormat::Attribute[], one per packed attribute
+        StreamLods = 4,         // optional BinaryLod[], simplified levels, finest first
+        StreamLodIndices = 5,   // triangle lists of every BinaryLod, back to back; 16 bit when
+                                // the mesh has at most 65536 vertices (stream stride 2), else 32
+        StreamMeshlets = 6,     // optional Meshlet[], clusters of the triangle list for mesh shaders
+        StreamMeshletVertices = 7,  // uint32_t mesh vertex indices of every Meshlet, back to back
+        StreamMeshletTriangles = 8, // uint8_t local vertex triples of every Meshlet, each run 4 byte aligned
+        StreamSubmeshes = 9,    // optional Submesh[]; StreamIndices is then relative to each baseVertex
+        StreamSubmeshMaterials = 10,// merged meshes: material path of each Submesh, utf-8, each null terminated
+        StreamBonePalettes = 11,// uint16_t skeleton bone of every Submesh palette entry, back to back
+        StreamBounds = 12,      // one Bounds of the whole mesh
+        StreamBvhNodes = 13,    // optional BvhNode[], the triangle BVH, root first
+        StreamBvhTriangles = 14,// uint32_t triangle (index of its first index / 3) of every BVH leaf slot
+    };
+
+    struct BinaryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t headerSize;    // header + stream table, in bytes
+        uint32_t formatFlags;   // VertexFormat::Flags
+        uint32_t vertexStride;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t streamCount;
+        float positionScale[3]; // position = quantized / 65535 * scale + offset when
+        float positionOffset[3];// positions are unorm16, otherwise scale 1 and offset 0
+        uint32_t codec;         // VertexFormat::Codec flags of the vertex and index streams
+        uint32_t indexSize;     // bytes per index of StreamIndices, 2 or 4
+    };
+
+    struct BinaryStream
+    {
+        uint32_t type;          // StreamType
+        uint32_t stride;        // size of one element, 0 for untyped blobs
+        uint64_t offset;        // from the start of the file
+        uint64_t size;          // in bytes
+    };
+
+    // One simplified level of detail; it uses the mesh's vertex stream
+    struct BinaryLod
+    {
+        uint32_t firstIndex;    // into the StreamLodIndices stream
+        uint32_t indexCount;
+        float error;            // geometric error, relative to the largest side of the mesh bounds
+        uint32_t reserved;
+    };
+
+    // A cluster of at most a few hundred triangles, also the element of the binary
+    // StreamMeshlets. Its triangles index its own vertex list, which indexes the mesh's
+    // vertices. The cluster faces away from a camera at p, and can be skipped, when
+    // dot(normalize(coneApex - p), coneAxis) >= coneCutoff; coneCutoff is 1 when the
+    // triangles face too many ways for that to ever hold.
+    struct Meshlet
+    {
+        uint32_t vertexOffset;      // into the meshlet vertices
+        uint32_t triangleOffset;    // into the meshlet triangles, in bytes
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+        float center[3];            // bounding sphere
+        float radius;
+        float coneApex[3];
+        float coneCutoff;
+        float coneAxis[3];          // unit average normal
+        uint32_t reserved;
+    };
+
+    // A range of the triangle list drawn with its own vertex window, so meshes with more
+    // than 65536 vertices can still use 16 bit indices, or one of the meshes packed into
+    // a merged mesh. With a bone palette the submesh's vertex bone indices select entries
+    // of its palette rather than skeleton bones, so only the palette's matrices need to be
+    // bound to draw it. Also the element of the binary StreamSubmeshes.
+    struct Submesh
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t baseVertex;    // added to the submesh's indices in the binary stream
+        uint32_t vertexCount;
+        uint32_t firstPaletteBone;  // into the bone palettes
+        uint32_t paletteBoneCount;  // 0 when the vertices index the skeleton
+    };
+
+    // Conservative bounds of a mesh, also the element of the binary StreamBounds. The
+    // blendshape extent holds the mesh with any mix of its targets at weights 0 to 1; it
+    // is the AABB itself when there are no blendshapes.
+    struct Bounds
+    {
+        float aabbMin[3];
+        float aabbMax[3];
+        float sphereCenter[3];
+        float sphereRadius;
+        float blendMin[3];
+        float blendMax[3];
+    };
+
+    // Bounds of the bind pose vertices a bone weights, in the bone's space (the inverse
+    // of its chained bind poses), so a skinned mesh's bounds follow its posed bones.
+    // min is above max for a bone that weights no vertex, which the .itpskel writes as
+    // { "empty": true }.
+    struct BoneBounds
+    {
+        float min[3];
+        float max[3];
+
+        bool IsEmpty() const { return min[0] > max[0]; }
+    };
+
+    // A node of a flattened, depth first bounding volume hierarchy over a triangle list,
+    // also the element of the binary StreamBvhNodes. An inner node's first child is the
+    // next node and its second child is node rightOrFirst; a leaf (triangleCount > 0) holds
+    // the BVH triangles rightOrFirst .. rightOrFirst + triangleCount - 1.
+    struct BvhNode
+    {
+        float boundsMin[3];
+        uint32_t rightOrFirst;
+        float boundsMax[3];
+        uint32_t triangleCount;
+    };
+
     struct VertexFormat
     {
+        enum Flags : uint32_t
+        {
+            FlagNormal = 1 << 0,
+            FlagTangent = 1 << 1,
+            FlagUV = 1 << 2,
+            FlagSkin = 1 << 3,
+            FlagTangentSign = 1 << 4,
+        };
+
+        // Storage of the attributes. VertexData always holds floats; the encodings
+        // only apply when vertices are packed or written out.
+        enum PositionEncoding : uint32_t
+        {
+            PositionFloat3 = 0,
+            PositionUnorm16 = 1,    // 3 x uint16 normalized to the mesh AABB (positionScale/positionOffset)
+        };
+        enum NormalEncoding : uint32_t
+        {
+            NormalFloat3 = 0,
+            NormalOct16 = 1,        // octahedral, 2 x snorm16
+            NormalOct8 = 2,         // octahedral, 2 x snorm8
+        };
+        enum UVEncoding : uint32_t
+        {
+            UVFloat2 = 0,
+            UVHalf2 = 1,            // 2 x IEEE half
+        };
+
+        // How the binary writer stores the vertex and index streams (MeshCodec). Stream
+        // sizes are then the encoded sizes; the header counts still give the decoded ones.
+        enum Codec : uint32_t
+        {
+            CodecNone = 0,
+            CodecIndices = 1 << 0,  // StreamIndices is MeshCodec::EncodeIndices output
+            CodecVertices = 1 << 1, // StreamVertices is MeshCodec::EncodeVertices output
+            CodecZstd = 1 << 2,     // each encoded stream is wrapped in a zstd frame
+        };
+
+        // Skin layout: influenceCount (4 or 8) bone indices and weights per vertex
+        enum BoneEncoding : uint32_t
+        {
+            BoneUint8 = 0,          // up to 256 bones (or palette entries)
+            BoneUint16 = 1,
+        };
+        enum WeightEncoding : uint32_t
+        {
+            WeightUnorm8 = 0,       // weights sum to 255
+            WeightUnorm16 = 1,      // weights sum to 65535
+        };
+
+        enum IndexEncoding : uint32_t
+        {
+            IndexAuto = 0,          // 16 bit when the vertex count (or every submesh's) allows
+            IndexUint32 = 1,
+        };
+
+        enum Semantic : uint32_t
+        {
+            SemanticPosition = 0,
+            SemanticNormal = 1,
+            SemanticTangent = 2,
+            SemanticBones = 3,
+            SemanticWeights = 4,
+            SemanticTexcoord = 5,
+        };
+        enum ComponentType : uint32_t
+        {
+            TypeFloat = 0,
+            TypeByte = 1,           // uint8
+            TypeHalf = 2,
+            TypeSnorm16 = 3,
+            TypeSnorm8 = 4,
+            TypeUnorm16 = 5,
+            TypeUint16 = 6,
+        };
+
+        // One packed attribute, also the element of the binary StreamVertexLayout
+        struct Attribute
+        {
+            uint32_t semantic;      // Semantic
+            uint32_t type;          // ComponentType
+            uint32_t count;         // components
+            uint32_t offset;        // from the start of the packed vertex, aligned to the component size
+        };
+        static const uint32_t MaxAttributes = 6;
+
         bool hasNormal = false;
         bool hasTan = false;
+        bool hasTanSign = false;    // the tangent gets one more component, VertexData::tanSign
         bool hasUV = false;
         bool hasSkin = false;
 
-        void WriteToJson(std::ofstream& ofs, int indent = 1) const;
+        PositionEncoding positionEncoding = PositionFloat3;
+        NormalEncoding normalEncoding = NormalFloat3;   // normals and tangents
+        UVEncoding uvEncoding = UVFloat2;
+        BoneEncoding boneEncoding = BoneUint8;
+        WeightEncoding weightEncoding = WeightUnorm8;
+        uint32_t influenceCount = 4;
+        Vector3 positionScale = Vector3(1.0f, 1.0f, 1.0f);
+        Vector3 positionOffset = Vector3(0.0f, 0.0f, 0.0f);
+        uint32_t codec = CodecNone;         // Codec flags, binary output only
+        IndexEncoding indexEncoding = IndexAuto;
+
+        uint32_t GetFlags() const;
+        // true when vertices of both formats pack the same way (the codec aside)
+        bool HasSameLayout(const VertexFormat& other) const;
+        // bones the bone encoding can index, and the sum of a vertex's weights
+        uint32_t GetMaxBones() const { return boneEncoding == BoneUint16 ? 65536 : 256; }
+        uint32_t GetWeightScale() const { return weightEncoding == WeightUnorm16 ? 65535 : 255; }
+        // fills attributes with the active attributes in packing order and returns their count
+        uint32_t GetAttributes(Attribute* attributes) const;
+        // size in bytes of one packed vertex (only the active attributes, padded to 4 bytes)
+        uint32_t GetStride() const;
+        // writes the active attributes of vert to dst, in the same order as WriteToJson declares them
+        void PackVertex(const VertexData& vert, uint8_t* dst) const;
+        // sets positionScale/positionOffset so the given AABB maps to [0, 65535]
+        void FitPositionQuantization(const Vector3& boundsMin, const Vector3& boundsMax);
+        void QuantizePosition(const Vector3& pos, uint16_t out[3]) const;
+
+        // octahedral encoding of a direction, each component a snorm of the given bit count
+        static void OctEncode(const Vector3& dir, int bits, int16_t out[2]);
+        static Vector3 OctDecode(float u, float v);
+        static uint16_t FloatToHalf(float value);
+        static float HalfToFloat(uint16_t value);
+
+        void WriteToJson(JsonWriter& json, int indent = 1) const;
     };
 
     struct BlendShape
     {
         std::string name;
         VertexFormat format;
-        std::vector<VertexData> deltas;
+        std::vector<VertexData> deltas;         // one per vertex, or one per entry of indices when sparse
+        bool sparse = false;
+        std::vector<uint32_t> indices;          // sparse only: vertex index of each delta, ascending
+
+        // Drops the deltas whose position, normal and tangent components are all within
+        // threshold, keeping (index, delta) pairs, unless more than denseRatio of the
+        // vertices would remain, in which case the target stays dense. Only valid on a
+        // dense target.
+        void MakeSparse(float threshold, float denseRatio);
 
-        void WriteDeltaToJson(const VertexData& vert, std::ofstream& ofs) const;
-        void WriteDeltasToJson(std::ofstream& ofs) const;
-        void WriteToJson(std::ofstream& ofs) const;
+        void WriteDeltaToJson(const VertexData& vert, JsonWriter& json) const;
+        void WriteDeltasToJson(JsonWriter& json) const;
+        void WriteToJson(JsonWriter& json) const;
     };
 
     struct Bone
@@ -41,8 +306,10 @@ public:
         std::string name;
         int32_t parentIndex = -1;
         BindPose bindPose;
+        // the converter's handle of the scene node the bone was read from, not written
+        void* node = nullptr;
 
-        void WriteToJson(std::ofstream& ofs) const;
+        void WriteToJson(JsonWriter& json) const;
     };
 
     struct Mesh
@@ -50,23 +317,144 @@ public:
         struct Triangle {
             uint32_t index[3];
 
-            void WriteToJson(std::ofstream& ofs) const;
+            void WriteToJson(JsonWriter& json) const;
         };
         std::string name;
         VertexFormat format;
         std::vector<VertexData> verts;
-        std::vector<Triangle> indices;          // assuming triangles
+        std::vector<Triangle> indices;          // assuming triangles, always numbered across the whole mesh
+
+        // Simplified levels of detail sharing verts, coarser ones later. Vertices are only
+        // ever dropped, never moved or added, so blendshape deltas apply unchanged.
+        struct Lod
+        {
+            float error = 0.0f;                 // relative to the largest side of the mesh bounds
+            std::vector<Triangle> indices;
+        };
+        std::vector<Lod> lods;
+
+        // Set by SplitSubmeshes and Merge: consecutive triangle ranges with contiguous vertex
+        // windows. Merged meshes also name each submesh's material.
+        std::vector<Submesh> submeshes;
+        std::vector<std::string> submeshMaterials;
+        std::vector<uint16_t> bonePalettes;     // bones of every submesh's palette, see Submesh
+        static const uint32_t MaxShortIndexVertices = 65536;
+
+        // Optional clusters of indices for mesh shaders, see Meshlet
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> meshletVertices;
+        std::vector<uint8_t> meshletTriangles;
 
         std::vector<Bone> bones;                // skeleton bones
         std::vector<BlendShape> blendShapes;    // blendshape targets
 
-        std::unordered_map<uint32_t, std::vector<uint32_t>> vertexMap; // original index to new indices
+        // Set by MeshBounds once the mesh is final; no other operation updates them
+        bool hasBounds = false;
+        Bounds bounds = {};
+        std::vector<BoneBounds> boneBounds;     // one per bone, skinned meshes only
+        std::vector<BvhNode> bvhNodes;          // optional BVH over indices
+        std::vector<uint32_t> bvhTriangles;
+
+        // Control point -> welded vertices, as flat offset + index arrays (CSR): the
+        // vertices of control point cp are indices[offsets[cp]] .. indices[offsets[cp + 1] - 1].
+        struct VertexMap
+        {
+            std::vector<uint32_t> offsets;  // control point count + 1
+            std::vector<uint32_t> indices;
+
+            // cornerControlPoints/cornerVertices: control point and welded vertex of each
+            // corner. Duplicate pairs are dropped; unreferenced control points map to nothing.
+            void Build(size_t controlPointCount, const int* cornerControlPoints, const uint32_t* cornerVertices, size_t cornerCount);
+
+            size_t GetControlPointCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+            const uint32_t* Begin(size_t controlPoint) const { return indices.data() + offsets[controlPoint]; }
+            const uint32_t* End(size_t controlPoint) const { return indices.data() + offsets[controlPoint + 1]; }
+            bool IsEmpty(size_t controlPoint) const { return offsets[controlPoint] == offsets[controlPoint + 1]; }
+        };
+        VertexMap vertexMap;
+
+        // 2 or 4: the size of the binary StreamIndices indices
+        uint32_t GetIndexSize() const;
+
+        // Partitions the triangles, in order, into submeshes of at most maxVertices vertices
+        // each, duplicating the vertices submeshes share so every submesh's vertices are one
+        // contiguous window numbered in first use order. Updates lods and meshlets (to a
+        // vertex's first copy), blendshape deltas and vertexMap; vertices no triangle uses
+        // are dropped. RemapVertices must not be called afterwards, and meshes are split
+        // before they are merged.
+        // With maxPaletteBones, a submesh also ends before its vertices would weight more
+        // than that many bones, and gets them as its palette; its vertex bone indices are
+        // renumbered into the palette. LODs and meshlets, which cross submeshes, then only
+        // see the first copy's palette indices.
+        void SplitSubmeshes(uint32_t maxVertices, uint32_t maxPaletteBones = 0);
+
+        // Appends other's vertices and triangles as new submeshes (its own submeshes, or one
+        // for the whole mesh) using its material, and unifies the skeletons by bone name,
+        // renumbering other's vertex bone indices (a unified bone keeps the first node it
+        // was read from). The result has as many LODs as the mesh
+        // with the most, and LOD i holds LOD i of every mesh (its coarsest one when it has
+        // fewer, its full triangle list when it has none); meshlets, blendshapes (made sparse)
+        // and vertexMap are appended too. Appending to an empty mesh takes other's format.
+        // Returns false, leaving the mesh unchanged, when the layouts differ, only one of the
+        // meshes has bone palettes, or (without palettes) the bones would not fit the bone
+        // encoding.
+        bool Merge(const Mesh& other);
 
-        void WriteToJson(std::ofstream& ofs) const;
-        void WriteVertToJson(const VertexData& vert, std::ofstream& ofs) const;
-        void WriteVertsToJson(std::ofstream& ofs) const;
-        void WriteIndicesToJson(std::ofstream& ofs) const;
-        void WriteSkelToJson(std::ofstream& ofs) const;
+        // Computes the AABB of verts and fits format.positionScale/positionOffset to it
+        void FitPositionQuantization();
+
+        // Renumbers the vertices: vertex i moves to remap[i]. remap must be a permutation.
+        // Updates verts, indices, lods, meshlets, blendshape deltas and vertexMap together.
+        void RemapVertices(const std::vector<uint32_t>& remap);
+
+        void WriteToJson(JsonWriter& json) const;
+        void WriteToBinary(std::ofstream& ofs) const;
+        // Assembles the binary file in memory, replacing the contents of file
+        void WriteToBinary(std::vector<uint8_t>& file) const;
+        void WriteVertToJson(const VertexData& vert, JsonWriter& json) const;
+        void WriteVertsToJson(JsonWriter& json) const;
+        void WriteIndicesToJson(JsonWriter& json) const;
+        void WriteLodsToJson(JsonWriter& json) const;
+        void WriteSubmeshesToJson(JsonWriter& json) const;
+        void WriteMeshletsToJson(JsonWriter& json) const;
+        void WriteBoundsToJson(JsonWriter& json) const;
+        void WriteSkelToJson(JsonWriter& json) const;
+    };
+
+    // Writes a binary .itpmesh3 incrementally for meshes too big to hold in memory:
+    // vertices are packed to the file in chunks as they arrive, indices are spooled to
+    // a temporary file next to the output and appended by Finish, which then patches
+    // the header and stream table with the final counts. The format must be final
+    // (including the position quantization) before the first vertex.
+    class BinaryStreamWriter
+    {
+    public:
+        BinaryStreamWriter(const VertexFormat& format, const std::string& meshName, size_t chunkBytes = 4 << 20);
+        ~BinaryStreamWriter();
+
+        bool Open(const std::string& path);
+        void WriteVertices(const VertexData* verts, size_t count);
+        // baseVertex is added to every index, for triangles numbered within a vertex window
+        void WriteTriangles(const Mesh::Triangle* tris, size_t count, uint32_t baseVertex);
+        bool Finish();
+
+        uint64_t GetVertexCount() const { return vertexCount; }
+        uint64_t GetTriangleCount() const { return triangleCount; }
+
+    private:
+        void FlushVertices();
+        void FlushIndices();
+
+        VertexFormat format;
+        std::string material;
+        uint32_t stride;
+        std::ofstream ofs;
+        std::fstream indexFile;
+        std::string indexPath;
+        std::vector<uint8_t> vertexChunk;
+        std::vector<uint32_t> indexChunk;
+        uint64_t vertexCount = 0;
+        uint64_t triangleCount = 0;
     };
 };
 
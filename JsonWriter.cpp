@@ -0,0 +1,119 @@
+#include "JsonWriter.h"
+#include <charconv>
+#include <cstring>
+
+JsonWriter::JsonWriter(int precision)
+    : precision(precision)
+{
+}
+
+JsonWriter& JsonWriter::Raw(const char* text)
+{
+    buffer.append(text, strlen(text));
+    return *this;
+}
+
+JsonWriter& JsonWriter::Indent(int depth)
+{
+    static const char tabs[] = "\t\t\t\t\t\t\t\t";
+    while (depth > 0)
+    {
+        int count = depth < 8 ? depth : 8;
+        buffer.append(tabs, static_cast<size_t>(count));
+        depth -= count;
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::String(const std::string& text)
+{
+    buffer.push_back('"');
+    buffer.append(text);
+    buffer.push_back('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::EscapedString(const std::string& text)
+{
+    static const char digits[] = "0123456789abcdef";
+    buffer.push_back('"');
+    for (char c : text)
+    {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\')
+        {
+            buffer.push_back('\\');
+            buffer.push_back(c);
+        }
+        else if (u < 0x20)
+        {
+            buffer.append("\\u00");
+            buffer.push_back(digits[u >> 4]);
+            buffer.push_back(digits[u & 0xF]);
+        }
+        else
+        {
+            buffer.push_back(c);
+        }
+    }
+    buffer.push_back('"');
+    return *this;
+}
+
+JsonWriter& JsonWriter::Float(float value)
+{
+    char text[32];
+    std::to_chars_result result = precision > 0
+        ? std::to_chars(text, text + sizeof(text), value, std::chars_format::general, precision)
+        : std::to_chars(text, text + sizeof(text), value);
+    char* end = result.ptr;
+
+    // "1" -> "1.0", "1e+20" -> "1.0e+20"; leave inf/nan alone
+    char* exponent = end;
+    bool isNumber = true;
+    for (char* c = text; c < end; ++c)
+    {
+        if (*c == '.')
+        {
+            exponent = nullptr;
+            break;
+        }
+        if (*c == 'e')
+            exponent = c;
+        else if (*c == 'i' || *c == 'n')
+            isNumber = false;
+    }
+    if (exponent && isNumber)
+    {
+        buffer.append(text, static_cast<size_t>(exponent - text));
+        buffer.append(".0", 2);
+        buffer.append(exponent, static_cast<size_t>(end - exponent));
+    }
+    else
+    {
+        buffer.append(text, static_cast<size_t>(end - text));
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::Int(int64_t value)
+{
+    char text[24];
+    char* end = std::to_chars(text, text + sizeof(text), value).ptr;
+    buffer.append(text, static_cast<size_t>(end - text));
+    return *this;
+}
+
+JsonWriter& JsonWriter::UInt(uint64_t value)
+{
+    char text[24];
+    char* end = std::to_chars(text, text + sizeof(text), value).ptr;
+    buffer.append(text, static_cast<size_t>(end - text));
+    return *this;
+}
+
+bool JsonWriter::WriteTo(std::ostream& ofs) const
+{
+    ofs.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    return static_cast<bool>(ofs);
+}
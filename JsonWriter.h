@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Append-only text buffer for the JSON exporters. Numbers are formatted with
+// std::to_chars (no locale, no iostream state) and the whole document is written
+// with a single call once it is complete. Clear() keeps the capacity, so one writer
+// can be reused for a sequence of files without reallocating.
+class JsonWriter
+{
+public:
+    // precision: significant digits for floats, 0 for the shortest text that reads
+    // back to the same float
+    explicit JsonWriter(int precision = 0);
+
+    void Reserve(size_t bytes) { buffer.reserve(bytes); }
+    void Clear() { buffer.clear(); }
+    size_t GetSize() const { return buffer.size(); }
+
+    JsonWriter& Raw(const char* text);
+    JsonWriter& Raw(const std::string& text) { buffer.append(text); return *this; }
+    JsonWriter& Char(char c) { buffer.push_back(c); return *this; }
+    JsonWriter& Indent(int depth);
+    // "text", without escaping
+    JsonWriter& String(const std::string& text);
+    // "text" with quotes, backslashes and control characters escaped
+    JsonWriter& EscapedString(const std::string& text);
+    // always contains a '.' or an exponent so the value reads back as a float
+    JsonWriter& Float(float value);
+    JsonWriter& Int(int64_t value);
+    JsonWriter& UInt(uint64_t value);
+
+    // Writes the buffer to ofs in one call; returns false if the stream failed
+    bool WriteTo(std::ostream& ofs) const;
+    // Hands the document over without a copy; the writer is left empty, capacity and all
+    std::string Release() { std::string document; document.swap(buffer); return document; }
+
+private:
+    int precision;
+    std::string buffer;
+};
@@ -0,0 +1,398 @@
+#include "MeshBounds.h"
+#include "EngineMath.h"
+#include "EngineMathSimd.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const uint32_t s_noIndex = ~0u;
+static const int s_binCount = 16;
+
+static Vector3 GetPosition(const float* positions, size_t positionStride, uint32_t vertex)
+{
+    const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + positionStride * vertex);
+    return Vector3(p[0], p[1], p[2]);
+}
+
+static Vector3 Min(const Vector3& a, const Vector3& b)
+{
+    return Vector3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+static Vector3 Max(const Vector3& a, const Vector3& b)
+{
+    return Vector3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+static float GetComponent(const Vector3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static void StoreFloat3(const Vector3& v, float out[3])
+{
+    out[0] = v.x;
+    out[1] = v.y;
+    out[2] = v.z;
+}
+
+// Half the surface area of an AABB, the SAH cost of hitting it
+static float GetHalfArea(const Vector3& boundsMin, const Vector3& boundsMax)
+{
+    Vector3 d = boundsMax - boundsMin;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+/*static*/ Vector3 MeshBounds::GetDecodeError(const ItpMesh::VertexFormat& format)
+{
+    if (format.positionEncoding != ItpMesh::VertexFormat::PositionUnorm16)
+        return Vector3::Zero;
+    const float halfStep = 0.5f / 65535.0f;
+    return Vector3(fabsf(format.positionScale.x) * halfStep, fabsf(format.positionScale.y) * halfStep,
+        fabsf(format.positionScale.z) * halfStep);
+}
+
+/*static*/ void MeshBounds::Compute(ItpMesh::Mesh& mesh)
+{
+    mesh.hasBounds = !mesh.verts.empty();
+    mesh.bounds = {};
+    if (!mesh.hasBounds)
+        return;
+    const size_t vertexCount = mesh.verts.size();
+    auto position = [&](size_t i) { return mesh.verts[i].pos; };
+    const Vector3 error = GetDecodeError(mesh.format);
+
+    Vector3 boundsMin, boundsMax;
+    MathSimd::ComputeBoundsStrided(&mesh.verts[0].pos.x, sizeof(VertexData), vertexCount, boundsMin, boundsMax);
+    StoreFloat3(boundsMin - error, mesh.bounds.aabbMin);
+    StoreFloat3(boundsMax + error, mesh.bounds.aabbMax);
+
+    // Ritter's sphere: start from the most distant pair of axis extremes, then grow the
+    // sphere to take in every point outside it
+    Vector3 minPoint[3];
+    Vector3 maxPoint[3];
+    minPoint[0] = minPoint[1] = minPoint[2] = maxPoint[0] = maxPoint[1] = maxPoint[2] = position(0);
+    for (size_t i = 1; i < vertexCount; ++i)
+    {
+        Vector3 p = position(i);
+        if (p.x < minPoint[0].x) minPoint[0] = p;
+        if (p.y < minPoint[1].y) minPoint[1] = p;
+        if (p.z < minPoint[2].z) minPoint[2] = p;
+        if (p.x > maxPoint[0].x) maxPoint[0] = p;
+        if (p.y > maxPoint[1].y) maxPoint[1] = p;
+        if (p.z > maxPoint[2].z) maxPoint[2] = p;
+    }
+    int spanAxis = 0;
+    float spanSq = -1.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float lengthSq = (maxPoint[axis] - minPoint[axis]).LengthSq();
+        if (lengthSq > spanSq)
+        {
+            spanSq = lengthSq;
+            spanAxis = axis;
+        }
+    }
+    Vector3 center = (minPoint[spanAxis] + maxPoint[spanAxis]) * 0.5f;
+    float radius = sqrtf(spanSq) * 0.5f;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        Vector3 offset = position(i) - center;
+        float distance = offset.Length();
+        if (distance > radius)
+        {
+            float grownRadius = (radius + distance) * 0.5f;
+            center += offset * ((grownRadius - radius) / distance);
+            radius = grownRadius;
+        }
+    }
+    // the growth steps round, so the radius is the furthest vertex measured in double,
+    // rounded up
+    double maxDistanceSq = 0.0;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        Vector3 p = position(i);
+        double dx = static_cast<double>(p.x) - center.x;
+        double dy = static_cast<double>(p.y) - center.y;
+        double dz = static_cast<double>(p.z) - center.z;
+        maxDistanceSq = std::max(maxDistanceSq, dx * dx + dy * dy + dz * dz);
+    }
+    StoreFloat3(center, mesh.bounds.sphereCenter);
+    mesh.bounds.sphereRadius = nextafterf(static_cast<float>(sqrt(maxDistanceSq)) + error.Length(), FLT_MAX);
+
+    // Every target moves a vertex by weight * delta, so weights in 0..1 keep it between
+    // the vertex plus its negative deltas and the vertex plus its positive ones
+    boundsMin = Vector3(mesh.bounds.aabbMin[0], mesh.bounds.aabbMin[1], mesh.bounds.aabbMin[2]);
+    boundsMax = Vector3(mesh.bounds.aabbMax[0], mesh.bounds.aabbMax[1], mesh.bounds.aabbMax[2]);
+    if (!mesh.blendShapes.empty())
+    {
+        std::vector<Vector3> lower(vertexCount, Vector3::Zero);
+        std::vector<Vector3> upper(vertexCount, Vector3::Zero);
+        auto add = [&](size_t i, const Vector3& delta)
+        {
+            lower[i] += Min(delta, Vector3::Zero);
+            upper[i] += Max(delta, Vector3::Zero);
+        };
+        for (const ItpMesh::BlendShape& bs : mesh.blendShapes)
+        {
+            if (bs.sparse)
+            {
+                for (size_t k = 0; k < bs.indices.size() && k < bs.deltas.size(); ++k)
+                {
+                    if (bs.indices[k] < vertexCount)
+                        add(bs.indices[k], bs.deltas[k].pos);
+                }
+            }
+            else
+            {
+                for (size_t i = 0; i < bs.deltas.size() && i < vertexCount; ++i)
+                    add(i, bs.deltas[i].pos);
+            }
+        }
+        for (size_t i = 0; i < vertexCount; ++i)
+        {
+            boundsMin = Min(boundsMin, position(i) + lower[i] - error);
+            boundsMax = Max(boundsMax, position(i) + upper[i] + error);
+        }
+    }
+    StoreFloat3(boundsMin, mesh.bounds.blendMin);
+    StoreFloat3(boundsMax, mesh.bounds.blendMax);
+}
+
+/*static*/ void MeshBounds::ComputeBones(ItpMesh::Mesh& mesh)
+{
+    const size_t boneCount = mesh.bones.size();
+    mesh.boneBounds.assign(boneCount, ItpMesh::BoneBounds{ { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } });
+    if (boneCount == 0 || !mesh.format.hasSkin)
+        return;
+
+    // Bind poses are relative to the parent bone; chain them into mesh space, parents
+    // first. A parent index out of range or a loop makes the bone a root.
+    std::vector<ItpMesh::Bone::BindPose> globals(boneCount);
+    std::vector<uint8_t> resolved(boneCount, 0);
+    std::vector<uint32_t> chain;
+    for (size_t b = 0; b < boneCount; ++b)
+    {
+        chain.clear();
+        for (size_t bone = b; !resolved[bone] && chain.size() < boneCount; )
+        {
+            chain.push_back(static_cast<uint32_t>(bone));
+            const int32_t parent = mesh.bones[bone].parentIndex;
+            if (parent < 0 || static_cast<size_t>(parent) >= boneCount)
+                break;
+            bone = static_cast<size_t>(parent);
+        }
+        for (size_t c = chain.size(); c-- > 0; )
+        {
+            const uint32_t bone = chain[c];
+            if (resolved[bone])
+                continue;
+            const ItpMesh::Bone::BindPose& local = mesh.bones[bone].bindPose;
+            const int32_t parent = mesh.bones[bone].parentIndex;
+            if (parent >= 0 && static_cast<size_t>(parent) < boneCount && resolved[parent])
+            {
+                const ItpMesh::Bone::BindPose& parentGlobal = globals[parent];
+                globals[bone].rot = Quaternion::Concatenate(local.rot, parentGlobal.rot);
+                globals[bone].trans = parentGlobal.trans + Quaternion::Transform(local.trans, parentGlobal.rot);
+            }
+            else
+            {
+                globals[bone] = local;
+            }
+            resolved[bone] = 1;
+        }
+    }
+    // the rotations undo the bind, mesh space to bone space
+    for (ItpMesh::Bone::BindPose& global : globals)
+        global.rot.Conjugate();
+
+    const float error = GetDecodeError(mesh.format).Length();
+    const int influenceCount = std::min<int>(mesh.format.influenceCount, VertexData::MaxInfluences);
+    auto addVertices = [&](uint32_t firstVertex, uint32_t vertexCount, const uint16_t* palette, uint32_t paletteCount)
+    {
+        for (uint32_t v = firstVertex; v < firstVertex + vertexCount && v < mesh.verts.size(); ++v)
+        {
+            const VertexData& vert = mesh.verts[v];
+            for (int k = 0; k < influenceCount; ++k)
+            {
+                if (vert.weights[k] == 0)
+                    continue;
+                uint32_t bone = vert.bones[k];
+                if (palette)
+                    bone = bone < paletteCount ? palette[bone] : s_noIndex;
+                if (bone >= boneCount)
+                    continue;
+                const Vector3 p = Quaternion::Transform(vert.pos - globals[bone].trans, globals[bone].rot);
+                ItpMesh::BoneBounds& bounds = mesh.boneBounds[bone];
+                StoreFloat3(Min(Vector3(bounds.min[0], bounds.min[1], bounds.min[2]), p - Vector3(error, error, error)), bounds.min);
+                StoreFloat3(Max(Vector3(bounds.max[0], bounds.max[1], bounds.max[2]), p + Vector3(error, error, error)), bounds.max);
+            }
+        }
+    };
+    if (mesh.bonePalettes.empty())
+    {
+        addVertices(0, static_cast<uint32_t>(mesh.verts.size()), nullptr, 0);
+    }
+    else
+    {
+        for (const ItpMesh::Submesh& submesh : mesh.submeshes)
+        {
+            const bool hasPalette = submesh.paletteBoneCount > 0
+                && submesh.firstPaletteBone + submesh.paletteBoneCount <= mesh.bonePalettes.size();
+            addVertices(submesh.baseVertex, submesh.vertexCount,
+                hasPalette ? mesh.bonePalettes.data() + submesh.firstPaletteBone : nullptr, hasPalette ? submesh.paletteBoneCount : 0);
+        }
+    }
+}
+
+/*static*/ void MeshBounds::BuildBvh(const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride,
+    const Vector3& padding, size_t maxLeafTriangles, std::vector<ItpMesh::BvhNode>& nodes, std::vector<uint32_t>& triangles)
+{
+    nodes.clear();
+    triangles.clear();
+    maxLeafTriangles = std::max<size_t>(1, maxLeafTriangles);
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<Vector3> triangleMin(triangleCount);
+    std::vector<Vector3> triangleMax(triangleCount);
+    std::vector<Vector3> centroids(triangleCount);
+    triangles.resize(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        Vector3 a = GetPosition(positions, positionStride, indices[3 * t + 0]);
+        Vector3 b = GetPosition(positions, positionStride, indices[3 * t + 1]);
+        Vector3 c = GetPosition(positions, positionStride, indices[3 * t + 2]);
+        triangleMin[t] = Min(Min(a, b), c);
+        triangleMax[t] = Max(Max(a, b), c);
+        centroids[t] = (triangleMin[t] + triangleMax[t]) * 0.5f;
+        triangles[t] = static_cast<uint32_t>(t);
+    }
+
+    // Depth first with an explicit stack: the left child is pushed last so it is built
+    // right after its parent, and the right child patches its index into the parent
+    struct Task
+    {
+        uint32_t parent;    // node whose rightOrFirst is this node, s_noIndex for a left child or the root
+        uint32_t begin;
+        uint32_t end;
+    };
+    std::vector<Task> stack;
+    stack.push_back(Task{ s_noIndex, 0, static_cast<uint32_t>(triangleCount) });
+    nodes.reserve(2 * triangleCount / maxLeafTriangles + 1);
+    while (!stack.empty())
+    {
+        const Task task = stack.back();
+        stack.pop_back();
+        const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+        if (task.parent != s_noIndex)
+            nodes[task.parent].rightOrFirst = nodeIndex;
+
+        Vector3 boundsMin = triangleMin[triangles[task.begin]];
+        Vector3 boundsMax = triangleMax[triangles[task.begin]];
+        Vector3 centroidMin = centroids[triangles[task.begin]];
+        Vector3 centroidMax = centroidMin;
+        for (uint32_t i = task.begin + 1; i < task.end; ++i)
+        {
+            const uint32_t t = triangles[i];
+            boundsMin = Min(boundsMin, triangleMin[t]);
+            boundsMax = Max(boundsMax, triangleMax[t]);
+            centroidMin = Min(centroidMin, centroids[t]);
+            centroidMax = Max(centroidMax, centroids[t]);
+        }
+        ItpMesh::BvhNode node = {};
+        StoreFloat3(boundsMin - padding, node.boundsMin);
+        StoreFloat3(boundsMax + padding, node.boundsMax);
+        const uint32_t count = task.end - task.begin;
+        if (count <= maxLeafTriangles)
+        {
+            node.rightOrFirst = task.begin;
+            node.triangleCount = count;
+            nodes.push_back(node);
+            continue;
+        }
+        nodes.push_back(node);
+
+        // The cheapest plane between centroid bins of any axis: the area of each side
+        // weighted by its triangle count
+        int bestAxis = -1;
+        int bestBin = 0;
+        float bestCost = FLT_MAX;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const float axisMin = GetComponent(centroidMin, axis);
+            const float extent = GetComponent(centroidMax, axis) - axisMin;
+            if (!(extent > 0.0f))
+                continue;
+            const float binScale = s_binCount / extent;
+            uint32_t binCounts[s_binCount] = {};
+            Vector3 binMin[s_binCount];
+            Vector3 binMax[s_binCount];
+            for (uint32_t i = task.begin; i < task.end; ++i)
+            {
+                const uint32_t t = triangles[i];
+                const int bin = std::min(s_binCount - 1, static_cast<int>((GetComponent(centroids[t], axis) - axisMin) * binScale));
+                binMin[bin] = binCounts[bin] ? Min(binMin[bin], triangleMin[t]) : triangleMin[t];
+                binMax[bin] = binCounts[bin] ? Max(binMax[bin], triangleMax[t]) : triangleMax[t];
+                ++binCounts[bin];
+            }
+            // sweep from the right for each right side's area, then from the left
+            float rightArea[s_binCount];
+            uint32_t rightCount[s_binCount];
+            Vector3 sideMin, sideMax;
+            uint32_t sideCount = 0;
+            for (int bin = s_binCount - 1; bin > 0; --bin)
+            {
+                if (binCounts[bin])
+                {
+                    sideMin = sideCount ? Min(sideMin, binMin[bin]) : binMin[bin];
+                    sideMax = sideCount ? Max(sideMax, binMax[bin]) : binMax[bin];
+                    sideCount += binCounts[bin];
+                }
+                rightCount[bin] = sideCount;
+                rightArea[bin] = sideCount ? GetHalfArea(sideMin, sideMax) : 0.0f;
+            }
+            sideCount = 0;
+            for (int bin = 0; bin < s_binCount - 1; ++bin)
+            {
+                if (binCounts[bin])
+                {
+                    sideMin = sideCount ? Min(sideMin, binMin[bin]) : binMin[bin];
+                    sideMax = sideCount ? Max(sideMax, binMax[bin]) : binMax[bin];
+                    sideCount += binCounts[bin];
+                }
+                if (sideCount == 0 || rightCount[bin + 1] == 0)
+                    continue;
+                const float cost = GetHalfArea(sideMin, sideMax) * sideCount + rightArea[bin + 1] * rightCount[bin + 1];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        uint32_t* first = triangles.data() + task.begin;
+        uint32_t* last = triangles.data() + task.end;
+        uint32_t* middle;
+        if (bestAxis >= 0)
+        {
+            const float axisMin = GetComponent(centroidMin, bestAxis);
+            const float binScale = s_binCount / (GetComponent(centroidMax, bestAxis) - axisMin);
+            middle = std::partition(first, last, [&](uint32_t t)
+            {
+                return std::min(s_binCount - 1, static_cast<int>((GetComponent(centroids[t], bestAxis) - axisMin) * binScale)) <= bestBin;
+            });
+        }
+        else
+        {
+            // every centroid in one spot: halve the list as it is
+            middle = first + count / 2;
+        }
+        const uint32_t split = static_cast<uint32_t>(middle - triangles.data());
+        stack.push_back(Task{ nodeIndex, split, task.end });
+        stack.push_back(Task{ s_noIndex, task.begin, split });
+    }
+}
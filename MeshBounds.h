@@ -0,0 +1,33 @@
+#pragma once
+#include "ItpMesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Culling and collision data of a finished mesh: conservative bounds, per-bone bounds
+// for skinned meshes and a triangle BVH for picking and ray queries.
+class MeshBounds
+{
+public:
+    // Sets mesh.bounds (and hasBounds) from the vertex positions, as the runtime decodes
+    // them: the AABB, a bounding sphere and the extent under any blend of the mesh's
+    // targets. The sphere is Ritter's, grown to its furthest vertex.
+    static void Compute(ItpMesh::Mesh& mesh);
+
+    // Sets mesh.boneBounds: each bone's bounds in its bind space over the vertices it
+    // weights, following the submesh palettes when there are any; a bone that weights no
+    // vertex is left empty (BoneBounds::IsEmpty)
+    static void ComputeBones(ItpMesh::Mesh& mesh);
+
+    // How far a position the runtime decodes in format can be from its float: half a
+    // quantization step per axis for PositionUnorm16, else zero
+    static Vector3 GetDecodeError(const ItpMesh::VertexFormat& format);
+
+    // Binned SAH BVH over the triangle list: a node holding more than maxLeafTriangles
+    // is split at the centroid bin plane of least surface area cost. positions are float3
+    // values positionStride bytes apart, and node bounds are their bounds grown by padding
+    // on each axis (GetDecodeError for quantized positions). Nodes are depth first with the
+    // root at 0; triangles lists each leaf's triangles back to back.
+    static void BuildBvh(const uint32_t* indices, size_t indexCount, const float* positions, size_t positionStride,
+        const Vector3& padding, size_t maxLeafTriangles, std::vector<ItpMesh::BvhNode>& nodes, std::vector<uint32_t>& triangles);
+};
@@ -0,0 +1,130 @@
+#include "MeshBuilder.h"
+#include "EngineMathSimd.h"
+#include <algorithm>
+#include <cmath>
+
+void MeshBuilder::InfluenceTable::Reset(size_t controlPointCount)
+{
+    offsets.assign(controlPointCount + 1, 0);
+    bones.clear();
+    weights.clear();
+}
+
+void MeshBuilder::InfluenceTable::Allocate()
+{
+    // exclusive prefix sum shifted up one slot, so offsets[i + 1] starts as the first
+    // entry of control point i and Add leaves it at the last one + 1
+    uint32_t total = 0;
+    for (size_t i = 1; i < offsets.size(); ++i)
+    {
+        uint32_t count = offsets[i];
+        offsets[i] = total;
+        total += count;
+    }
+    bones.resize(total);
+    weights.resize(total);
+}
+
+/*static*/ bool MeshBuilder::PackInfluences(const InfluenceTable& influences, const ItpMesh::VertexFormat& format,
+    std::vector<SkinSlots>& outBones, std::vector<SkinSlots>& outWeights)
+{
+    const size_t controlPointCount = influences.GetControlPointCount();
+    outBones.resize(controlPointCount);
+    outWeights.resize(controlPointCount);
+    const size_t slotCount = std::min<size_t>(std::max(1u, format.influenceCount), VertexData::MaxInfluences);
+    const int scale = static_cast<int>(format.GetWeightScale());
+
+    // blocks of control points, their selected weights one slot row at a time so the
+    // normalization runs across control points
+    const size_t BlockSize = 512;
+    float blockWeights[VertexData::MaxInfluences][BlockSize];
+    float* rows[VertexData::MaxInfluences];
+    uint8_t takes[BlockSize];
+    for (size_t k = 0; k < VertexData::MaxInfluences; ++k)
+        rows[k] = blockWeights[k];
+
+    bool anySkin = false;
+    for (size_t start = 0; start < controlPointCount; start += BlockSize)
+    {
+        const size_t n = std::min(BlockSize, controlPointCount - start);
+        for (size_t j = 0; j < n; ++j)
+        {
+            // top slotCount by weight, kept sorted by insertion
+            SkinSlots& b = outBones[start + j];
+            float w[VertexData::MaxInfluences];
+            size_t take = 0;
+            const uint32_t end = influences.offsets[start + j + 1];
+            for (uint32_t e = influences.offsets[start + j]; e < end; ++e)
+            {
+                const float weight = influences.weights[e];
+                if (take == slotCount && !(weight > w[slotCount - 1]))
+                    continue;
+                size_t k = take < slotCount ? take++ : slotCount - 1;
+                for (; k > 0 && w[k - 1] < weight; --k)
+                {
+                    w[k] = w[k - 1];
+                    b[k] = b[k - 1];
+                }
+                w[k] = weight;
+                b[k] = influences.bones[e];
+            }
+            for (size_t k = 0; k < slotCount; ++k)
+                blockWeights[k][j] = k < take ? w[k] : 0.0f;
+            for (size_t k = take; k < VertexData::MaxInfluences; ++k)
+                b[k] = 0;
+            takes[j] = static_cast<uint8_t>(take);
+        }
+
+        MathSimd::NormalizeWeights(rows, slotCount, n, static_cast<float>(scale));
+
+        for (size_t j = 0; j < n; ++j)
+        {
+            SkinSlots& b = outBones[start + j];
+            SkinSlots& w = outWeights[start + j];
+            w = {};
+            const size_t take = takes[j];
+            // the strongest weight is positive exactly when the total was
+            if (take == 0 || !(blockWeights[0][j] > 0.0f))
+            {
+                b = {};
+                continue;
+            }
+            int acc = 0;
+            for (size_t k = 0; k + 1 < take; ++k)
+            {
+                int value = static_cast<int>(std::round(blockWeights[k][j]));
+                w[k] = static_cast<uint16_t>(value);
+                acc += value;
+            }
+            w[take - 1] = static_cast<uint16_t>(std::max(0, scale - acc));
+            anySkin = true;
+        }
+    }
+    return anySkin;
+}
+
+/*static*/ void MeshBuilder::ComputeBlendDeltas(const ItpMesh::Mesh& base, const Vector3* positions, const Vector3* normals,
+    const Vector3* tangents, size_t controlPointCount, ItpMesh::BlendShape& bs)
+{
+    bs.deltas.assign(base.verts.size(), VertexData());
+    const ItpMesh::Mesh::VertexMap& vertexMap = base.vertexMap;
+    const size_t mappedCount = std::min(controlPointCount, vertexMap.GetControlPointCount());
+    for (size_t i = 0; i < mappedCount; ++i)
+    {
+        if (vertexMap.IsEmpty(i))
+            continue; // control point not used by any polygon
+        const VertexData& baseVert = base.verts[*vertexMap.Begin(i)];
+        VertexData vert = VertexData();
+        vert.pos = positions[i] - baseVert.pos;
+        if (bs.format.hasNormal)
+            vert.norm = normals[i] - baseVert.norm;
+        if (bs.format.hasTan)
+            vert.tan = tangents[i] - baseVert.tan;
+
+        for (const uint32_t* vi = vertexMap.Begin(i); vi != vertexMap.End(i); ++vi)
+        {
+            // For each duplicated vertex, add the same delta
+            bs.deltas[*vi] = vert;
+        }
+    }
+}
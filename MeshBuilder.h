@@ -0,0 +1,51 @@
+#pragma once
+#include "ItpMesh.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The conversion steps that work on data already copied out of the FBX scene. They
+// don't use the FBX SDK, so the benchmark runs them on synthetic meshes.
+class MeshBuilder
+{
+public:
+    // (bone index, weight) pairs of every control point in flat arrays: control point i
+    // owns entries [offsets[i], offsets[i + 1]), in any order. Fill it in two passes:
+    // Reset, Count once per entry, Allocate, then Add once per counted entry.
+    struct InfluenceTable
+    {
+        std::vector<uint32_t> offsets;
+        std::vector<uint16_t> bones;
+        std::vector<float> weights;
+
+        void Reset(size_t controlPointCount);
+        void Count(size_t controlPoint) { ++offsets[controlPoint + 1]; }
+        void Allocate();
+        // Until every counted entry is added offsets[i + 1] is control point i's write cursor
+        void Add(size_t controlPoint, uint16_t bone, float weight)
+        {
+            uint32_t entry = offsets[controlPoint + 1]++;
+            bones[entry] = bone;
+            weights[entry] = weight;
+        }
+
+        size_t GetControlPointCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+        size_t GetEntryCount() const { return bones.size(); }
+    };
+    // The bones or weights of one control point, laid out as in VertexData
+    typedef std::array<uint16_t, VertexData::MaxInfluences> SkinSlots;
+
+    // Keeps the format.influenceCount strongest influences of each control point, with
+    // weights normalized to integers that sum to format.GetWeightScale(). Equal weights
+    // keep their table order. Returns true if any control point has a positive weight.
+    static bool PackInfluences(const InfluenceTable& influences, const ItpMesh::VertexFormat& format,
+        std::vector<SkinSlots>& outBones, std::vector<SkinSlots>& outWeights);
+
+    // Fills bs.deltas with one delta per welded vertex of base, through base.vertexMap.
+    // positions, normals and tangents hold the target value of each of controlPointCount
+    // control points; normals and tangents are only read when bs.format has them, and a
+    // control point the target doesn't cover should hold the base value so its delta is 0.
+    static void ComputeBlendDeltas(const ItpMesh::Mesh& base, const Vector3* positions, const Vector3* normals,
+        const Vector3* tangents, size_t controlPointCount, ItpMesh::BlendShape& bs);
+};
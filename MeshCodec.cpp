@@ -0,0 +1,441 @@
+#include "MeshCodec.h"
+#include <algorithm>
+#include <cstring>
+#if defined(ITP_HAVE_ZSTD)
+#include <zstd.h>
+#endif
+
+const uint8_t MeshCodec::IndexCodecVersion;
+const uint8_t MeshCodec::VertexCodecVersion;
+
+static const unsigned s_fifoSize = 16;
+static const unsigned s_edgeHits = 15;     // edge codes 0..14, 15 = no shared edge
+static const unsigned s_vertexHits = 14;   // vertex tokens 1..14 refer to the vertex FIFO
+static const uint8_t s_tokenNext = 0;
+static const uint8_t s_tokenExplicit = 15;
+static const uint32_t s_noVertex = ~0u;
+
+static const size_t s_blockVertices = 256;
+static const size_t s_groupSize = 16;
+
+// Coder state shared by the index encoder and decoder, which must update it identically
+struct IndexFifo
+{
+    uint32_t edges[s_fifoSize][2];
+    uint32_t vertices[s_fifoSize];
+    unsigned edgeHead = 0;
+    unsigned vertexHead = 0;
+    uint32_t next = 0;      // lowest vertex not seen yet, in a fetch optimized buffer
+    uint32_t last = 0;      // last explicitly coded vertex
+
+    IndexFifo()
+    {
+        memset(edges, 0xff, sizeof(edges));
+        memset(vertices, 0xff, sizeof(vertices));
+    }
+
+    void PushEdge(uint32_t a, uint32_t b)
+    {
+        edges[edgeHead][0] = a;
+        edges[edgeHead][1] = b;
+        edgeHead = (edgeHead + 1) % s_fifoSize;
+    }
+
+    void PushVertex(uint32_t v)
+    {
+        vertices[vertexHead] = v;
+        vertexHead = (vertexHead + 1) % s_fifoSize;
+    }
+
+    // i = 0 is the most recent entry
+    const uint32_t* GetEdge(unsigned i) const { return edges[(edgeHead + s_fifoSize - 1 - i) % s_fifoSize]; }
+    uint32_t GetVertex(unsigned i) const { return vertices[(vertexHead + s_fifoSize - 1 - i) % s_fifoSize]; }
+};
+
+static void WriteVarint(std::vector<uint8_t>& out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static bool ReadVarint(const uint8_t*& data, const uint8_t* end, uint32_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (data == end)
+            return false;
+        uint8_t byte = *data++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (byte < 0x80)
+            return true;
+    }
+    return false;
+}
+
+static uint32_t ZigZag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t UnZigZag(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// Picks the token for v and updates the FIFO; s_tokenExplicit needs a varint after the code bytes
+static uint8_t EncodeVertexToken(IndexFifo& fifo, uint32_t v)
+{
+    if (v == fifo.next)
+    {
+        ++fifo.next;
+        fifo.PushVertex(v);
+        return s_tokenNext;
+    }
+    for (unsigned i = 0; i < s_vertexHits; ++i)
+    {
+        if (fifo.GetVertex(i) == v)
+            return static_cast<uint8_t>(i + 1);
+    }
+    fifo.PushVertex(v);
+    return s_tokenExplicit;
+}
+
+static void WriteExplicit(std::vector<uint8_t>& out, IndexFifo& fifo, uint32_t v)
+{
+    WriteVarint(out, ZigZag(static_cast<int32_t>(v - fifo.last)));
+    fifo.last = v;
+}
+
+static bool DecodeVertexToken(IndexFifo& fifo, uint8_t token, const uint8_t*& data, const uint8_t* end, uint32_t& v)
+{
+    if (token == s_tokenNext)
+    {
+        v = fifo.next++;
+        fifo.PushVertex(v);
+        return true;
+    }
+    if (token != s_tokenExplicit)
+    {
+        v = fifo.GetVertex(token - 1u);
+        return v != s_noVertex;
+    }
+    uint32_t delta;
+    if (!ReadVarint(data, end, delta))
+        return false;
+    v = fifo.last + static_cast<uint32_t>(UnZigZag(delta));
+    fifo.last = v;
+    fifo.PushVertex(v);
+    return true;
+}
+
+/*static*/ void MeshCodec::EncodeIndices(const uint32_t* indices, size_t indexCount, std::vector<uint8_t>& out)
+{
+    out.reserve(out.size() + 1 + indexCount / 2);
+    out.push_back(IndexCodecVersion);
+    IndexFifo fifo;
+    for (size_t t = 0; t + 2 < indexCount; t += 3)
+    {
+        const uint32_t* tri = indices + t;
+        unsigned edgeHit = s_edgeHits;
+        unsigned rotation = 0;
+        for (unsigned i = 0; i < s_edgeHits && edgeHit == s_edgeHits; ++i)
+        {
+            const uint32_t* edge = fifo.GetEdge(i);
+            for (unsigned r = 0; r < 3; ++r)
+            {
+                if (edge[0] == tri[r] && edge[1] == tri[(r + 1) % 3])
+                {
+                    edgeHit = i;
+                    rotation = r;
+                    break;
+                }
+            }
+        }
+
+        if (edgeHit < s_edgeHits)
+        {
+            uint32_t a = tri[rotation];
+            uint32_t b = tri[(rotation + 1) % 3];
+            uint32_t c = tri[(rotation + 2) % 3];
+            uint8_t token = EncodeVertexToken(fifo, c);
+            out.push_back(static_cast<uint8_t>(edgeHit << 4 | token));
+            if (token == s_tokenExplicit)
+                WriteExplicit(out, fifo, c);
+            // the shared edge is used up; the other two are seen reversed by neighbours
+            fifo.PushEdge(c, b);
+            fifo.PushEdge(a, c);
+        }
+        else
+        {
+            uint32_t a = tri[0], b = tri[1], c = tri[2];
+            uint8_t tokens[3];
+            tokens[0] = EncodeVertexToken(fifo, a);
+            tokens[1] = EncodeVertexToken(fifo, b);
+            tokens[2] = EncodeVertexToken(fifo, c);
+            out.push_back(static_cast<uint8_t>(s_edgeHits << 4 | tokens[0]));
+            out.push_back(static_cast<uint8_t>(tokens[1] << 4 | tokens[2]));
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tokens[k] == s_tokenExplicit)
+                    WriteExplicit(out, fifo, tri[k]);
+            }
+            fifo.PushEdge(b, a);
+            fifo.PushEdge(c, b);
+            fifo.PushEdge(a, c);
+        }
+    }
+}
+
+template <typename Index>
+static bool DecodeIndexStream(Index* indices, size_t indexCount, const uint8_t* data, size_t size)
+{
+    const uint8_t* end = data + size;
+    if (size < 1 || *data++ != MeshCodec::IndexCodecVersion || indexCount % 3 != 0)
+        return false;
+    IndexFifo fifo;
+    for (size_t t = 0; t < indexCount; t += 3)
+    {
+        if (data == end)
+            return false;
+        uint8_t code = *data++;
+        unsigned edgeHit = code >> 4;
+        Index* tri = indices + t;
+        if (edgeHit < s_edgeHits)
+        {
+            const uint32_t* edge = fifo.GetEdge(edgeHit);
+            uint32_t a = edge[0], b = edge[1], c;
+            if (a == s_noVertex || !DecodeVertexToken(fifo, code & 15, data, end, c))
+                return false;
+            tri[0] = static_cast<Index>(a);
+            tri[1] = static_cast<Index>(b);
+            tri[2] = static_cast<Index>(c);
+            fifo.PushEdge(c, b);
+            fifo.PushEdge(a, c);
+        }
+        else
+        {
+            if (data == end)
+                return false;
+            uint8_t tokens = *data++;
+            // tokens and the vertex FIFO are resolved in order, as the encoder did;
+            // explicit deltas only follow both code bytes
+            uint8_t token[3] = { static_cast<uint8_t>(code & 15), static_cast<uint8_t>(tokens >> 4), static_cast<uint8_t>(tokens & 15) };
+            uint32_t v[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                if (!DecodeVertexToken(fifo, token[k], data, end, v[k]))
+                    return false;
+                tri[k] = static_cast<Index>(v[k]);
+            }
+            fifo.PushEdge(v[1], v[0]);
+            fifo.PushEdge(v[2], v[1]);
+            fifo.PushEdge(v[0], v[2]);
+        }
+    }
+    return true;
+}
+
+/*static*/ bool MeshCodec::DecodeIndices(uint32_t* indices, size_t indexCount, const uint8_t* data, size_t size)
+{
+    return DecodeIndexStream(indices, indexCount, data, size);
+}
+
+/*static*/ bool MeshCodec::DecodeIndices(uint16_t* indices, size_t indexCount, const uint8_t* data, size_t size)
+{
+    return DecodeIndexStream(indices, indexCount, data, size);
+}
+
+// width code -> bits per value
+static const unsigned s_groupBits[4] = { 0, 2, 4, 8 };
+
+static unsigned GetGroupWidth(const uint8_t* values)
+{
+    uint8_t combined = 0;
+    for (size_t i = 0; i < s_groupSize; ++i)
+        combined |= values[i];
+    if (combined == 0)
+        return 0;
+    if (combined < 4)
+        return 1;
+    if (combined < 16)
+        return 2;
+    return 3;
+}
+
+/*static*/ void MeshCodec::EncodeVertices(const uint8_t* vertices, size_t vertexCount, size_t stride, std::vector<uint8_t>& out)
+{
+    out.reserve(out.size() + 1 + vertexCount * stride);
+    out.push_back(VertexCodecVersion);
+    std::vector<uint8_t> previous(stride, 0);
+    uint8_t deltas[s_blockVertices];
+    for (size_t first = 0; first < vertexCount; first += s_blockVertices)
+    {
+        const size_t count = std::min(s_blockVertices, vertexCount - first);
+        const size_t groupCount = (count + s_groupSize - 1) / s_groupSize;
+        for (size_t k = 0; k < stride; ++k)
+        {
+            // zigzag the byte differences so small moves either way are small values
+            uint8_t last = previous[k];
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint8_t value = vertices[(first + i) * stride + k];
+                uint8_t delta = static_cast<uint8_t>(value - last);
+                deltas[i] = static_cast<uint8_t>((delta << 1) ^ (static_cast<int8_t>(delta) >> 7));
+                last = value;
+            }
+            memset(deltas + count, 0, groupCount * s_groupSize - count);
+            previous[k] = last;
+
+            // 2 bit width of every group, four to a byte, then the packed groups
+            size_t header = out.size();
+            out.resize(header + (groupCount + 3) / 4, 0);
+            for (size_t g = 0; g < groupCount; ++g)
+            {
+                const uint8_t* group = deltas + g * s_groupSize;
+                unsigned width = GetGroupWidth(group);
+                out[header + g / 4] |= static_cast<uint8_t>(width << (g % 4 * 2));
+                const unsigned bits = s_groupBits[width];
+                if (bits == 8)
+                {
+                    out.insert(out.end(), group, group + s_groupSize);
+                }
+                else if (bits > 0)
+                {
+                    const unsigned perByte = 8 / bits;
+                    for (size_t i = 0; i < s_groupSize; i += perByte)
+                    {
+                        uint8_t byte = 0;
+                        for (unsigned j = 0; j < perByte; ++j)
+                            byte |= static_cast<uint8_t>(group[i + j] << (j * bits));
+                        out.push_back(byte);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*static*/ bool MeshCodec::DecodeVertices(uint8_t* vertices, size_t vertexCount, size_t stride, const uint8_t* data, size_t size)
+{
+    const uint8_t* end = data + size;
+    if (size < 1 || *data++ != VertexCodecVersion)
+        return false;
+    std::vector<uint8_t> previous(stride, 0);
+    uint8_t deltas[s_blockVertices];
+    for (size_t first = 0; first < vertexCount; first += s_blockVertices)
+    {
+        const size_t count = std::min(s_blockVertices, vertexCount - first);
+        const size_t groupCount = (count + s_groupSize - 1) / s_groupSize;
+        for (size_t k = 0; k < stride; ++k)
+        {
+            const uint8_t* header = data;
+            data += (groupCount + 3) / 4;
+            if (data > end)
+                return false;
+            for (size_t g = 0; g < groupCount; ++g)
+            {
+                uint8_t* group = deltas + g * s_groupSize;
+                const unsigned bits = s_groupBits[(header[g / 4] >> (g % 4 * 2)) & 3];
+                const size_t bytes = s_groupSize * bits / 8;
+                if (static_cast<size_t>(end - data) < bytes)
+                    return false;
+                if (bits == 0)
+                {
+                    memset(group, 0, s_groupSize);
+                }
+                else if (bits == 8)
+                {
+                    memcpy(group, data, s_groupSize);
+                }
+                else if (bits == 4)
+                {
+                    for (size_t i = 0; i < s_groupSize / 2; ++i)
+                    {
+                        group[2 * i + 0] = data[i] & 15;
+                        group[2 * i + 1] = data[i] >> 4;
+                    }
+                }
+                else
+                {
+                    for (size_t i = 0; i < s_groupSize / 4; ++i)
+                    {
+                        group[4 * i + 0] = data[i] & 3;
+                        group[4 * i + 1] = (data[i] >> 2) & 3;
+                        group[4 * i + 2] = (data[i] >> 4) & 3;
+                        group[4 * i + 3] = data[i] >> 6;
+                    }
+                }
+                data += bytes;
+            }
+
+            uint8_t* dst = vertices + first * stride + k;
+            for (size_t i = 0; i < count; ++i)
+                dst[i * stride] = deltas[i];
+        }
+
+        // undo the deltas a vertex at a time, adding the previous vertex; this runs along
+        // memory and vectorizes, unlike a sum down each byte plane
+        uint8_t* row = vertices + first * stride;
+        const uint8_t* last = previous.data();
+        for (size_t i = 0; i < count; ++i)
+        {
+            for (size_t k = 0; k < stride; ++k)
+            {
+                uint8_t zigzag = row[k];
+                row[k] = static_cast<uint8_t>(last[k] + ((zigzag >> 1) ^ -(zigzag & 1)));
+            }
+            last = row;
+            row += stride;
+        }
+        memcpy(previous.data(), last, stride);
+    }
+    return true;
+}
+
+/*static*/ bool MeshCodec::HasZstd()
+{
+#if defined(ITP_HAVE_ZSTD)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*static*/ bool MeshCodec::Compress(std::vector<uint8_t>& data, int level)
+{
+#if defined(ITP_HAVE_ZSTD)
+    std::vector<uint8_t> frame(ZSTD_compressBound(data.size()));
+    size_t size = ZSTD_compress(frame.data(), frame.size(), data.data(), data.size(), level);
+    if (ZSTD_isError(size))
+        return false;
+    frame.resize(size);
+    data.swap(frame);
+    return true;
+#else
+    (void)data;
+    (void)level;
+    return false;
+#endif
+}
+
+/*static*/ bool MeshCodec::Decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out)
+{
+#if defined(ITP_HAVE_ZSTD)
+    unsigned long long contentSize = ZSTD_getFrameContentSize(data, size);
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR || contentSize == ZSTD_CONTENTSIZE_UNKNOWN)
+        return false;
+    out.resize(static_cast<size_t>(contentSize));
+    size_t result = ZSTD_decompress(out.data(), out.size(), data, size);
+    return !ZSTD_isError(result) && result == out.size();
+#else
+    (void)data;
+    (void)size;
+    (void)out;
+    return false;
+#endif
+}
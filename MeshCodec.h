@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless codecs for the binary index and vertex streams. They shrink the data on
+// their own and, more so, make it compress well with a general purpose compressor.
+// The decoders only depend on this file and MeshCodec.cpp, so the runtime can link
+// them directly. Build with ITP_HAVE_ZSTD defined (and libzstd linked) for the zstd
+// framing; without it Compress fails and Decompress only accepts unframed data.
+//
+// Index stream: one code byte per triangle, rotated (winding kept, triangle order
+// kept) so that an edge it shares with one of the last 15 triangles comes first. The
+// remaining vertex is then usually the next vertex not seen before, which is all a
+// fetch optimized buffer needs, or one of the last 14 new vertices; anything else is
+// stored as a varint delta.
+// Vertex stream: blocks of 256 packed vertices stored one byte plane at a time, each
+// byte as the zigzagged difference to the same byte of the previous vertex, in groups
+// of 16 bit packed to 0, 2, 4 or 8 bits.
+class MeshCodec
+{
+public:
+    static const uint8_t IndexCodecVersion = 1;
+    static const uint8_t VertexCodecVersion = 1;
+
+    // Appends the encoded triangle list to out
+    static void EncodeIndices(const uint32_t* indices, size_t indexCount, std::vector<uint8_t>& out);
+    // Decodes exactly indexCount indices; false if data is malformed or truncated. The
+    // 16 bit version is for streams whose indices fit (BinaryHeader::indexSize 2).
+    static bool DecodeIndices(uint32_t* indices, size_t indexCount, const uint8_t* data, size_t size);
+    static bool DecodeIndices(uint16_t* indices, size_t indexCount, const uint8_t* data, size_t size);
+
+    // Appends the encoded vertices (vertexCount packed vertices of stride bytes) to out
+    static void EncodeVertices(const uint8_t* vertices, size_t vertexCount, size_t stride, std::vector<uint8_t>& out);
+    static bool DecodeVertices(uint8_t* vertices, size_t vertexCount, size_t stride, const uint8_t* data, size_t size);
+
+    static bool HasZstd();
+    // Replaces data with a zstd frame of it; false (data untouched) without zstd support
+    static bool Compress(std::vector<uint8_t>& data, int level);
+    // Expands a zstd frame into out; false if it isn't one or is corrupt
+    static bool Decompress(const uint8_t* data, size_t size, std::vector<uint8_t>& out);
+};
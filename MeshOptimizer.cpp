@@ -0,0 +1,433 @@
+#include "MeshOptimizer.h"
+#include "EngineMath.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Tuning constants from Tom Forsyth, "Linear-Speed Vertex Cache Optimisation" (2006)
+static const int s_cacheSize = 32;
+static const float s_cacheDecayPower = 1.5f;
+static const float s_lastTriScore = 0.75f;
+static const float s_valenceBoostScale = 2.0f;
+static const float s_valenceBoostPower = 0.5f;
+static const uint32_t s_maxValenceScore = 64;
+
+struct ForsythScores
+{
+    float cache[s_cacheSize];
+    float valence[s_maxValenceScore];
+
+    ForsythScores()
+    {
+        for (int i = 0; i < s_cacheSize; ++i)
+        {
+            if (i < 3)
+            {
+                // the three vertices of the last triangle get a fixed score so the next
+                // triangle doesn't depend on the order they were submitted in
+                cache[i] = s_lastTriScore;
+            }
+            else
+            {
+                const float scaler = 1.0f / (s_cacheSize - 3);
+                cache[i] = powf(1.0f - (i - 3) * scaler, s_cacheDecayPower);
+            }
+        }
+        valence[0] = 0.0f;
+        for (uint32_t i = 1; i < s_maxValenceScore; ++i)
+            valence[i] = s_valenceBoostScale * powf(static_cast<float>(i), -s_valenceBoostPower);
+    }
+
+    float Get(int cachePosition, uint32_t remainingValence) const
+    {
+        if (remainingValence == 0)
+            return -1.0f; // no triangles left, the vertex doesn't matter any more
+        float score = cachePosition >= 0 ? cache[cachePosition] : 0.0f;
+        if (remainingValence < s_maxValenceScore)
+            score += valence[remainingValence];
+        return score;
+    }
+};
+
+/*static*/ MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    CacheStats stats;
+    size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0)
+        return stats;
+
+    // FIFO emulation: a vertex is a hit if it was transformed within the last cacheSize misses
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < triCount * 3; ++i)
+    {
+        uint32_t v = indices[i];
+        if (timestamps[v] == 0)
+            ++used;
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            ++misses;
+        }
+    }
+
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(triCount);
+    stats.atvr = used > 0 ? static_cast<float>(misses) / static_cast<float>(used) : 0.0f;
+    return stats;
+}
+
+/*static*/ void MeshOptimizer::OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+    static const ForsythScores scores;
+
+    size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0)
+        return;
+
+    // Triangles adjacent to each vertex (CSR)
+    std::vector<uint32_t> valence(vertexCount, 0);
+    for (size_t i = 0; i < triCount * 3; ++i)
+        ++valence[indices[i]];
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyStart[v + 1] = adjacencyStart[v] + valence[v];
+    std::vector<uint32_t> adjacency(triCount * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        for (size_t i = 0; i < triCount * 3; ++i)
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScore[v] = scores.Get(-1, valence[v]);
+
+    std::vector<float> triScore(triCount);
+    std::vector<bool> emitted(triCount, false);
+    size_t best = 0;
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        const uint32_t* tri = indices + t * 3;
+        triScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+        if (triScore[t] > triScore[best])
+            best = t;
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(triCount * 3);
+    uint32_t cache[s_cacheSize + 3];
+    uint32_t newCache[s_cacheSize + 3];
+    int cacheCount = 0;
+    size_t scanCursor = 0;
+    const size_t none = static_cast<size_t>(-1);
+
+    for (size_t emittedCount = 0; emittedCount < triCount; ++emittedCount)
+    {
+        if (best == none)
+        {
+            // Nothing in the cache has triangles left: continue with the next unused triangle
+            while (emitted[scanCursor])
+                ++scanCursor;
+            best = scanCursor;
+        }
+
+        const uint32_t* tri = indices + best * 3;
+        result.insert(result.end(), tri, tri + 3);
+        emitted[best] = true;
+        for (int k = 0; k < 3; ++k)
+            --valence[tri[k]];
+
+        // The triangle's vertices move to the front of the LRU cache
+        int newCount = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            bool duplicate = false;
+            for (int j = 0; j < newCount; ++j)
+                duplicate |= (newCache[j] == tri[k]);
+            if (!duplicate)
+                newCache[newCount++] = tri[k];
+        }
+        for (int i = 0; i < cacheCount; ++i)
+        {
+            uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCount++] = v;
+        }
+
+        // Rescore every vertex that is or was in the cache
+        for (int i = 0; i < newCount; ++i)
+        {
+            uint32_t v = newCache[i];
+            cachePosition[v] = i < s_cacheSize ? i : -1;
+            vertexScore[v] = scores.Get(cachePosition[v], valence[v]);
+        }
+
+        // Pick the best remaining triangle touching the cache
+        best = none;
+        float bestScore = -1.0f;
+        for (int i = 0; i < newCount; ++i)
+        {
+            uint32_t v = newCache[i];
+            for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; ++a)
+            {
+                uint32_t t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                const uint32_t* other = indices + static_cast<size_t>(t) * 3;
+                triScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+                if (triScore[t] > bestScore)
+                {
+                    bestScore = triScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = newCount < s_cacheSize ? newCount : s_cacheSize;
+        for (int i = 0; i < cacheCount; ++i)
+            cache[i] = newCache[i];
+    }
+
+    for (size_t i = 0; i < result.size(); ++i)
+        indices[i] = result[i];
+}
+
+/*static*/ size_t MeshOptimizer::BuildFetchRemap(std::vector<uint32_t>& remap, const uint32_t* indices, size_t indexCount, size_t vertexCount)
+{
+    const uint32_t unused = 0xFFFFFFFF;
+    remap.assign(vertexCount, unused);
+
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t v = indices[i];
+        if (remap[v] == unused)
+            remap[v] = next++;
+    }
+    size_t referenced = next;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        if (remap[v] == unused)
+            remap[v] = next++;
+    }
+    return referenced;
+}
+
+static Vector3 GetPosition(const float* positions, size_t positionStride, uint32_t v)
+{
+    const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + v * positionStride);
+    return Vector3(p[0], p[1], p[2]);
+}
+
+// Cache misses a triangle causes in a FIFO cache of the given size, updating the cache state
+static int SimulateTriangle(const uint32_t* tri, std::vector<uint32_t>& timestamps, uint32_t& time, uint32_t cacheSize)
+{
+    int misses = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        uint32_t v = tri[k];
+        if (time - timestamps[v] > cacheSize)
+        {
+            timestamps[v] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+/*static*/ void MeshOptimizer::OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride, float threshold)
+{
+    const uint32_t cacheSize = 16;
+    size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0)
+        return;
+
+    // Hard boundaries: triangles where all three vertices miss, i.e. the cache effectively
+    // restarts, so cutting there costs nothing (Sander et al., "Fast Triangle Reordering
+    // for Vertex Locality and Reduced Overdraw", 2007)
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    std::vector<size_t> hardClusters;
+    for (size_t t = 0; t < triCount; ++t)
+    {
+        if (SimulateTriangle(indices + t * 3, timestamps, time, cacheSize) == 3)
+            hardClusters.push_back(t);
+    }
+    if (hardClusters.empty() || hardClusters[0] != 0)
+        hardClusters.insert(hardClusters.begin(), 0);
+
+    // Soft boundaries: split each hard cluster further wherever the ACMR of the piece so
+    // far, simulated from a cold cache, stays within threshold of the whole cluster's ACMR
+    std::vector<size_t> clusters;
+    for (size_t h = 0; h < hardClusters.size(); ++h)
+    {
+        size_t start = hardClusters[h];
+        size_t end = h + 1 < hardClusters.size() ? hardClusters[h + 1] : triCount;
+
+        time += cacheSize + 1;
+        size_t clusterMisses = 0;
+        for (size_t t = start; t < end; ++t)
+            clusterMisses += SimulateTriangle(indices + t * 3, timestamps, time, cacheSize);
+        float limit = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+        clusters.push_back(start);
+        time += cacheSize + 1;
+        size_t misses = 0;
+        for (size_t t = start; t < end; ++t)
+        {
+            misses += SimulateTriangle(indices + t * 3, timestamps, time, cacheSize);
+            size_t count = t + 1 - clusters.back();
+            if (t + 1 < end && static_cast<float>(misses) / static_cast<float>(count) <= limit)
+            {
+                clusters.push_back(t + 1);
+                time += cacheSize + 1;
+                misses = 0;
+            }
+        }
+    }
+
+    // Sort key per cluster: how much its area-weighted normal faces away from the mesh center
+    Vector3 meshCenter;
+    float meshArea = 0.0f;
+    std::vector<Vector3> clusterCenters(clusters.size());
+    std::vector<Vector3> clusterNormals(clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triCount;
+        Vector3 center;
+        Vector3 normal;
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < end; ++t)
+        {
+            const uint32_t* tri = indices + t * 3;
+            Vector3 a = GetPosition(positions, positionStride, tri[0]);
+            Vector3 b = GetPosition(positions, positionStride, tri[1]);
+            Vector3 p = GetPosition(positions, positionStride, tri[2]);
+            Vector3 n = Vector3::Cross(p - a, b - a);
+            float triArea = n.Length();
+            center += (a + b + p) * (triArea / 3.0f);
+            normal += n;
+            area += triArea;
+        }
+        meshCenter += center;
+        meshArea += area;
+        clusterCenters[c] = area > 0.0f ? center * (1.0f / area) : center;
+        clusterNormals[c] = normal;
+    }
+    if (meshArea > 0.0f)
+        meshCenter *= 1.0f / meshArea;
+
+    std::vector<float> sortKey(clusters.size());
+    std::vector<size_t> order(clusters.size());
+    for (size_t c = 0; c < clusters.size(); ++c)
+    {
+        float length = clusterNormals[c].Length();
+        Vector3 n = length > 0.0f ? clusterNormals[c] * (1.0f / length) : clusterNormals[c];
+        sortKey[c] = Vector3::Dot(clusterCenters[c] - meshCenter, n);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(triCount * 3);
+    for (size_t c : order)
+    {
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triCount;
+        result.insert(result.end(), indices + clusters[c] * 3, indices + end * 3);
+    }
+    for (size_t i = 0; i < result.size(); ++i)
+        indices[i] = result[i];
+}
+
+/*static*/ float MeshOptimizer::AnalyzeOverdraw(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride)
+{
+    const int resolution = 256;
+    size_t triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0)
+        return 0.0f;
+
+    Vector3 minPos = GetPosition(positions, positionStride, indices[0]);
+    Vector3 maxPos = minPos;
+    for (size_t i = 0; i < triCount * 3; ++i)
+    {
+        Vector3 p = GetPosition(positions, positionStride, indices[i]);
+        minPos.Set(Math::Min(minPos.x, p.x), Math::Min(minPos.y, p.y), Math::Min(minPos.z, p.z));
+        maxPos.Set(Math::Max(maxPos.x, p.x), Math::Max(maxPos.y, p.y), Math::Max(maxPos.z, p.z));
+    }
+    Vector3 extent = maxPos - minPos;
+    float scale = Math::Max(extent.x, Math::Max(extent.y, extent.z));
+    if (scale <= 0.0f)
+        return 0.0f;
+    scale = (resolution - 1) / scale;
+
+    std::vector<float> depth(resolution * resolution);
+    size_t shaded = 0;
+    size_t covered = 0;
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int dir = 0; dir < 2; ++dir)
+        {
+            // view along +/- axis; u, v are the two other axes, w is the distance from the viewer
+            int ua = (axis + 1) % 3;
+            int va = (axis + 2) % 3;
+            float sign = dir == 0 ? 1.0f : -1.0f;
+            std::fill(depth.begin(), depth.end(), FLT_MAX);
+
+            for (size_t t = 0; t < triCount; ++t)
+            {
+                float sx[3], sy[3], sz[3];
+                for (int k = 0; k < 3; ++k)
+                {
+                    Vector3 p = (GetPosition(positions, positionStride, indices[t * 3 + k]) - minPos) * scale;
+                    const float* c = &p.x;
+                    sx[k] = c[ua];
+                    sy[k] = c[va];
+                    sz[k] = c[axis] * sign;
+                }
+
+                // The outward normal's component along the axis is -area, and the viewer
+                // looks down sign * axis, so the triangle faces the viewer when sign * area > 0
+                float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+                if (sign * area <= 0.0f)
+                    continue;
+
+                int x0 = static_cast<int>(Math::Max(0.0f, floorf(Math::Min(sx[0], Math::Min(sx[1], sx[2])))));
+                int x1 = static_cast<int>(Math::Min(resolution - 1.0f, ceilf(Math::Max(sx[0], Math::Max(sx[1], sx[2])))));
+                int y0 = static_cast<int>(Math::Max(0.0f, floorf(Math::Min(sy[0], Math::Min(sy[1], sy[2])))));
+                int y1 = static_cast<int>(Math::Min(resolution - 1.0f, ceilf(Math::Max(sy[0], Math::Max(sy[1], sy[2])))));
+                float invArea = 1.0f / area;
+
+                for (int y = y0; y <= y1; ++y)
+                {
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        float px = x + 0.5f;
+                        float py = y + 0.5f;
+                        float w0 = ((sx[1] - px) * (sy[2] - py) - (sx[2] - px) * (sy[1] - py)) * invArea;
+                        float w1 = ((sx[2] - px) * (sy[0] - py) - (sx[0] - px) * (sy[2] - py)) * invArea;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                            continue;
+                        float z = w0 * sz[0] + w1 * sz[1] + w2 * sz[2];
+                        float& d = depth[y * resolution + x];
+                        if (z < d)
+                        {
+                            if (d == FLT_MAX)
+                                ++covered;
+                            d = z;
+                            ++shaded;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return covered > 0 ? static_cast<float>(shaded) / static_cast<float>(covered) : 0.0f;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index buffer optimization passes. All of them work on plain triangle lists
+// (three uint32_t per triangle) so they can be used for any index stream.
+class MeshOptimizer
+{
+public:
+    // Post-transform cache efficiency of a triangle list, simulated with a FIFO cache
+    struct CacheStats
+    {
+        float acmr = 0.0f;  // average cache misses per triangle (0.5 is ideal on a regular grid, 3 is worst)
+        float atvr = 0.0f;  // average transformed vertices per used vertex (1 is ideal)
+    };
+
+    static CacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+
+    // Reorders the triangles in place for post-transform cache locality using
+    // Tom Forsyth's linear-speed vertex cache optimization (LRU cache model).
+    static void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+    // Splits the (already cache optimized) triangle list into clusters and sorts them
+    // so clusters facing outwards from the mesh center draw first, which reduces
+    // overdraw. threshold bounds how much ACMR each cluster may lose through the
+    // extra cluster boundaries (1.05 allows 5%). positions are vertexCount float3 values
+    // positionStride bytes apart. Triangles use the converter's winding (reversed from
+    // FBX), so the outward normal of (a, b, c) is cross(c - a, b - a).
+    static void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+        size_t positionStride, float threshold);
+
+    // Estimated overdraw: pixels shaded / pixels covered, summed over orthographic views
+    // along the six axis directions, rasterizing front faces only in index buffer order.
+    static float AnalyzeOverdraw(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+        size_t positionStride);
+
+    // Fills remap (old index -> new index) so vertices are numbered in the order the
+    // index buffer first references them, for pre-transform fetch locality. Vertices
+    // that are never referenced go last, in their original order. Returns the number
+    // of referenced vertices.
+    static size_t BuildFetchRemap(std::vector<uint32_t>& remap, const uint32_t* indices, size_t indexCount, size_t vertexCount);
+};
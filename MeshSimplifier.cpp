@@ -0,0 +1,486 @@
+#include "MeshSimplifier.h"
+#include "EngineMath.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// Attribute penalties, in squared distance (relative to the mesh extent) per squared
+// attribute difference: a unit normal difference costs as much as moving 1% of the
+// extent, a uv difference of 0.1 or a full skin weight 2%.
+static const float s_normalWeight = 1e-4f;
+static const float s_uvWeight = 4e-2f;
+static const float s_skinWeight = 4e-4f;
+// Edge quadrics keep borders and seams from drifting sideways
+static const float s_borderWeight = 10.0f;
+static const float s_seamWeight = 1.0f;
+
+static const uint32_t s_noVertex = ~0u;
+
+enum VertexKind : uint8_t
+{
+    KindManifold,   // one vertex at this position, no open edges
+    KindBorder,     // one vertex, on a single open border loop
+    KindSeam,       // two vertices at this position, joined along a single seam
+    KindLocked,     // anything else
+    KindCount,
+};
+
+// [from][to]: can a vertex of kind from collapse onto one of kind to
+static const bool s_canCollapse[KindCount][KindCount] = {
+    { true, true, true, true },
+    { false, true, false, true },
+    { false, false, true, true },
+    { false, false, false, false },
+};
+// [k0][k1]: whether the edge also exists in the opposite direction, so it is seen twice
+static const bool s_hasOpposite[KindCount][KindCount] = {
+    { true, true, true, true },
+    { true, false, true, false },
+    { true, true, true, true },
+    { true, false, true, false },
+};
+
+struct Quadric
+{
+    float a00 = 0, a11 = 0, a22 = 0, a10 = 0, a20 = 0, a21 = 0;
+    float b0 = 0, b1 = 0, b2 = 0, c = 0;
+    float w = 0;
+
+    // weight * squared distance to the plane dot(n, p) + d = 0 (n unit length)
+    static Quadric FromPlane(const Vector3& n, float d, float weight)
+    {
+        Quadric q;
+        q.a00 = n.x * n.x * weight;
+        q.a11 = n.y * n.y * weight;
+        q.a22 = n.z * n.z * weight;
+        q.a10 = n.y * n.x * weight;
+        q.a20 = n.z * n.x * weight;
+        q.a21 = n.z * n.y * weight;
+        q.b0 = n.x * d * weight;
+        q.b1 = n.y * d * weight;
+        q.b2 = n.z * d * weight;
+        q.c = d * d * weight;
+        q.w = weight;
+        return q;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a00 += q.a00; a11 += q.a11; a22 += q.a22;
+        a10 += q.a10; a20 += q.a20; a21 += q.a21;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        w += q.w;
+    }
+
+    // weighted mean squared distance of p to the planes
+    float Error(const Vector3& p) const
+    {
+        float rx = a00 * p.x + a10 * p.y + a20 * p.z + b0;
+        float ry = a10 * p.x + a11 * p.y + a21 * p.z + b1;
+        float rz = a20 * p.x + a21 * p.y + a22 * p.z + b2;
+        float r = rx * p.x + ry * p.y + rz * p.z + b0 * p.x + b1 * p.y + b2 * p.z + c;
+        return w > 0.0f ? std::fabs(r) / w : 0.0f;
+    }
+};
+
+struct Collapse
+{
+    uint32_t v0;    // collapses onto v1
+    uint32_t v1;
+    float cost;
+};
+
+// Sorted edge list for "does a -> b exist" queries
+class EdgeSet
+{
+public:
+    void Build(const uint32_t* indices, size_t indexCount, size_t vertexCount)
+    {
+        offsets.assign(vertexCount + 1, 0);
+        for (size_t i = 0; i < indexCount; ++i)
+            ++offsets[indices[i] + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        targets.resize(indexCount);
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t t = 0; t < indexCount; t += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t a = indices[t + k];
+                uint32_t b = indices[t + (k + 1) % 3];
+                targets[cursor[a]++] = b;
+            }
+        }
+    }
+
+    bool Has(uint32_t a, uint32_t b) const
+    {
+        for (uint32_t i = offsets[a]; i < offsets[a + 1]; ++i)
+        {
+            if (targets[i] == b)
+                return true;
+        }
+        return false;
+    }
+
+private:
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> targets;
+};
+
+static bool IsSingle(uint32_t loop, uint32_t v)
+{
+    return loop != s_noVertex && loop != v;
+}
+
+// remap: first vertex with the same position; wedge: the next vertex with the same
+// position, as a circular list
+static void BuildPositionRemap(const VertexData* verts, size_t vertexCount, std::vector<uint32_t>& remap,
+    std::vector<uint32_t>& wedge)
+{
+    std::vector<uint32_t> order(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        order[i] = static_cast<uint32_t>(i);
+    auto less = [&](uint32_t a, uint32_t b)
+    {
+        int c = memcmp(&verts[a].pos, &verts[b].pos, sizeof(Vector3));
+        return c != 0 ? c < 0 : a < b;
+    };
+    std::sort(order.begin(), order.end(), less);
+
+    remap.resize(vertexCount);
+    wedge.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount;)
+    {
+        size_t end = i + 1;
+        while (end < vertexCount && memcmp(&verts[order[i]].pos, &verts[order[end]].pos, sizeof(Vector3)) == 0)
+            ++end;
+        for (size_t j = i; j < end; ++j)
+        {
+            remap[order[j]] = order[i];
+            wedge[order[j]] = order[j + 1 < end ? j + 1 : i];
+        }
+        i = end;
+    }
+}
+
+static float GetAttributeCost(const VertexData& a, const VertexData& b, const ItpMesh::VertexFormat& format)
+{
+    float cost = 0.0f;
+    if (format.hasNormal)
+        cost += s_normalWeight * (a.norm - b.norm).LengthSq();
+    if (format.hasUV)
+        cost += s_uvWeight * (a.uv - b.uv).LengthSq();
+    if (format.hasSkin)
+    {
+        float weightsA[2 * VertexData::MaxInfluences] = {}, weightsB[2 * VertexData::MaxInfluences] = {};
+        uint16_t bones[2 * VertexData::MaxInfluences];
+        int count = 0;
+        auto slot = [&](uint16_t bone)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (bones[i] == bone)
+                    return i;
+            }
+            bones[count] = bone;
+            return count++;
+        };
+        const float weightScale = 1.0f / static_cast<float>(format.GetWeightScale());
+        for (uint32_t k = 0; k < format.influenceCount; ++k)
+        {
+            if (a.weights[k])
+                weightsA[slot(a.bones[k])] += a.weights[k] * weightScale;
+            if (b.weights[k])
+                weightsB[slot(b.bones[k])] += b.weights[k] * weightScale;
+        }
+        float d = 0.0f;
+        for (int i = 0; i < count; ++i)
+            d += (weightsA[i] - weightsB[i]) * (weightsA[i] - weightsB[i]);
+        cost += s_skinWeight * d;
+    }
+    return cost;
+}
+
+static Vector3 GetTriangleNormal(const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    return Vector3::Cross(b - a, c - a);
+}
+
+// After collapsing a vertex the open edge loops that ran through it have to skip it
+static void RemapEdgeLoops(std::vector<uint32_t>& loop, const std::vector<uint32_t>& collapseRemap)
+{
+    for (size_t i = 0; i < loop.size(); ++i)
+    {
+        if (loop[i] == s_noVertex)
+            continue;
+        uint32_t l = loop[i];
+        uint32_t r = collapseRemap[l];
+        // i == r when the edge was collapsed against the loop direction
+        if (r == i)
+            loop[i] = loop[l] != s_noVertex ? collapseRemap[loop[l]] : s_noVertex;
+        else
+            loop[i] = r;
+    }
+}
+
+/*static*/ float MeshSimplifier::Simplify(const VertexData* verts, size_t vertexCount, const ItpMesh::VertexFormat& format,
+    const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float targetError,
+    std::vector<uint32_t>& outIndices)
+{
+    outIndices.assign(indices, indices + indexCount - indexCount % 3);
+    if (outIndices.empty() || vertexCount == 0)
+        return 0.0f;
+
+    // work in the unit cube so errors are relative to the mesh extent
+    Vector3 boundsMin = verts[0].pos, boundsMax = verts[0].pos;
+    for (size_t i = 1; i < vertexCount; ++i)
+    {
+        const Vector3& p = verts[i].pos;
+        boundsMin = Vector3(std::min(boundsMin.x, p.x), std::min(boundsMin.y, p.y), std::min(boundsMin.z, p.z));
+        boundsMax = Vector3(std::max(boundsMax.x, p.x), std::max(boundsMax.y, p.y), std::max(boundsMax.z, p.z));
+    }
+    const Vector3 extent = boundsMax - boundsMin;
+    const float scale = std::max(extent.x, std::max(extent.y, extent.z));
+    const float invScale = scale > 0.0f ? 1.0f / scale : 0.0f;
+    std::vector<Vector3> positions(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        positions[i] = (verts[i].pos - boundsMin) * invScale;
+
+    std::vector<uint32_t> remap, wedge;
+    BuildPositionRemap(verts, vertexCount, remap, wedge);
+
+    // open edges: a -> b without b -> a between the same vertices. loop/loopback hold
+    // the single open edge leaving/entering a vertex, the vertex itself if there are
+    // several and s_noVertex if there is none.
+    std::vector<uint32_t> loop(vertexCount, s_noVertex), loopback(vertexCount, s_noVertex);
+    {
+        EdgeSet edges;
+        edges.Build(outIndices.data(), outIndices.size(), vertexCount);
+        for (size_t t = 0; t < outIndices.size(); t += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t a = outIndices[t + k];
+                uint32_t b = outIndices[t + (k + 1) % 3];
+                if (edges.Has(b, a))
+                    continue;
+                loop[a] = loop[a] == s_noVertex ? b : a;
+                loopback[b] = loopback[b] == s_noVertex ? a : b;
+            }
+        }
+    }
+
+    std::vector<uint8_t> kinds(vertexCount, KindLocked);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        if (remap[i] != i)
+            continue;
+        const uint32_t v = static_cast<uint32_t>(i);
+        VertexKind kind = KindLocked;
+        if (wedge[v] == v)
+        {
+            if (loop[v] == s_noVertex && loopback[v] == s_noVertex)
+                kind = KindManifold;
+            else if (IsSingle(loop[v], v) && IsSingle(loopback[v], v))
+                kind = KindBorder;
+        }
+        else if (wedge[wedge[v]] == v)
+        {
+            // the two sides of the seam run in opposite directions
+            const uint32_t w = wedge[v];
+            if (IsSingle(loop[v], v) && IsSingle(loopback[v], v) && IsSingle(loop[w], w) && IsSingle(loopback[w], w)
+                && remap[loop[v]] == remap[loopback[w]] && remap[loopback[v]] == remap[loop[w]])
+                kind = KindSeam;
+        }
+        kinds[v] = kind;
+    }
+    for (size_t i = 0; i < vertexCount; ++i)
+        kinds[i] = kinds[remap[i]];
+
+    // per position: area weighted triangle planes, plus edge planes along borders and seams
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t < outIndices.size(); t += 3)
+    {
+        const uint32_t* tri = &outIndices[t];
+        const Vector3& p0 = positions[tri[0]];
+        Vector3 normal = GetTriangleNormal(p0, positions[tri[1]], positions[tri[2]]);
+        const float length = normal.Length();
+        if (length <= 0.0f)
+            continue;
+        normal = normal * (1.0f / length);
+        const Quadric q = Quadric::FromPlane(normal, -Vector3::Dot(normal, p0), length * 0.5f);
+        for (int k = 0; k < 3; ++k)
+            quadrics[remap[tri[k]]].Add(q);
+
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t a = tri[k], b = tri[(k + 1) % 3];
+            if (loop[a] != b || (kinds[a] != KindBorder && kinds[a] != KindSeam))
+                continue;
+            const Vector3 edge = positions[b] - positions[a];
+            const float edgeLengthSq = edge.LengthSq();
+            Vector3 edgeNormal = Vector3::Cross(edge, normal);
+            const float edgeNormalLength = edgeNormal.Length();
+            if (edgeNormalLength <= 0.0f)
+                continue;
+            edgeNormal = edgeNormal * (1.0f / edgeNormalLength);
+            const float weight = edgeLengthSq * (kinds[a] == KindBorder ? s_borderWeight : s_seamWeight);
+            const Quadric eq = Quadric::FromPlane(edgeNormal, -Vector3::Dot(edgeNormal, positions[a]), weight);
+            quadrics[remap[a]].Add(eq);
+            quadrics[remap[b]].Add(eq);
+        }
+    }
+
+    // the partner of seam vertex v0 when v0 collapses onto v1
+    auto seamTarget = [&](uint32_t v0, uint32_t v1)
+    {
+        const uint32_t s0 = wedge[v0];
+        return loop[v0] == v1 ? loopback[s0] : loop[s0];
+    };
+    auto collapseCost = [&](uint32_t v0, uint32_t v1)
+    {
+        float cost = quadrics[remap[v0]].Error(positions[v1]) + GetAttributeCost(verts[v0], verts[v1], format);
+        if (kinds[v0] == KindSeam)
+        {
+            const uint32_t s0 = wedge[v0];
+            const uint32_t s1 = seamTarget(v0, v1);
+            if (s1 < vertexCount)
+                cost += GetAttributeCost(verts[s0], verts[s1], format);
+        }
+        return cost;
+    };
+
+    const float errorLimit = targetError * targetError;
+    float maxCost = 0.0f;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> collapseRemap(vertexCount);
+    std::vector<uint8_t> locked(vertexCount);
+    std::vector<uint32_t> triOffsets, triList;
+    while (outIndices.size() > targetIndexCount)
+    {
+        // candidate edges, each in its cheaper allowed direction
+        collapses.clear();
+        for (size_t t = 0; t < outIndices.size(); t += 3)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t a = outIndices[t + k], b = outIndices[t + (k + 1) % 3];
+                const uint32_t ra = remap[a], rb = remap[b];
+                if (ra == rb)
+                    continue;
+                const uint8_t ka = kinds[a], kb = kinds[b];
+                if (!s_canCollapse[ka][kb] && !s_canCollapse[kb][ka])
+                    continue;
+                if (s_hasOpposite[ka][kb] && rb > ra)
+                    continue;
+                // two border or seam vertices must be joined by their loop, not across it
+                if (ka == kb && (ka == KindBorder || ka == KindSeam) && loop[a] != b && loopback[a] != b)
+                    continue;
+                const float costAB = s_canCollapse[ka][kb] ? collapseCost(a, b) : FLT_MAX;
+                const float costBA = s_canCollapse[kb][ka] ? collapseCost(b, a) : FLT_MAX;
+                Collapse c;
+                c.v0 = costAB <= costBA ? a : b;
+                c.v1 = costAB <= costBA ? b : a;
+                c.cost = std::min(costAB, costBA);
+                if (c.cost <= errorLimit)
+                    collapses.push_back(c);
+            }
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+        {
+            return a.cost < b.cost;
+        });
+
+        // triangles around each position, for the flip test
+        triOffsets.assign(vertexCount + 1, 0);
+        for (uint32_t v : outIndices)
+            ++triOffsets[remap[v] + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            triOffsets[v + 1] += triOffsets[v];
+        triList.resize(outIndices.size());
+        {
+            std::vector<uint32_t> cursor(triOffsets.begin(), triOffsets.end() - 1);
+            for (size_t i = 0; i < outIndices.size(); ++i)
+                triList[cursor[remap[outIndices[i]]]++] = static_cast<uint32_t>(i / 3);
+        }
+        auto hasFlips = [&](uint32_t r0, uint32_t r1, const Vector3& target)
+        {
+            for (uint32_t i = triOffsets[r0]; i < triOffsets[r0 + 1]; ++i)
+            {
+                const uint32_t* tri = &outIndices[triList[i] * 3];
+                Vector3 before[3], after[3];
+                bool removed = false;
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t r = remap[tri[k]];
+                    removed |= r == r1;
+                    before[k] = positions[tri[k]];
+                    after[k] = r == r0 ? target : before[k];
+                }
+                if (removed)
+                    continue;
+                const Vector3 n0 = GetTriangleNormal(before[0], before[1], before[2]);
+                const Vector3 n1 = GetTriangleNormal(after[0], after[1], after[2]);
+                if (Vector3::Dot(n0, n1) < 0.0f)
+                    return true;
+            }
+            return false;
+        };
+
+        // each collapse removes about two triangles; leave the rest to later passes so
+        // costs are recomputed on the updated mesh
+        const size_t goal = (outIndices.size() - targetIndexCount) / 6 + 1;
+        for (size_t i = 0; i < vertexCount; ++i)
+            collapseRemap[i] = static_cast<uint32_t>(i);
+        std::fill(locked.begin(), locked.end(), 0);
+        size_t performed = 0;
+        for (const Collapse& c : collapses)
+        {
+            if (performed >= goal)
+                break;
+            const uint32_t r0 = remap[c.v0], r1 = remap[c.v1];
+            if (locked[r0] || locked[r1])
+                continue;
+            if (hasFlips(r0, r1, positions[c.v1]))
+                continue;
+
+            collapseRemap[c.v0] = c.v1;
+            if (kinds[c.v0] == KindSeam)
+            {
+                const uint32_t s1 = seamTarget(c.v0, c.v1);
+                if (s1 < vertexCount)
+                    collapseRemap[wedge[c.v0]] = s1;
+            }
+            quadrics[r1].Add(quadrics[r0]);
+            locked[r0] = locked[r1] = 1;
+            maxCost = std::max(maxCost, c.cost);
+            ++performed;
+        }
+        if (performed == 0)
+            break;
+
+        RemapEdgeLoops(loop, collapseRemap);
+        RemapEdgeLoops(loopback, collapseRemap);
+
+        size_t write = 0;
+        for (size_t t = 0; t < outIndices.size(); t += 3)
+        {
+            const uint32_t a = collapseRemap[outIndices[t]];
+            const uint32_t b = collapseRemap[outIndices[t + 1]];
+            const uint32_t c = collapseRemap[outIndices[t + 2]];
+            if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a])
+                continue;
+            outIndices[write++] = a;
+            outIndices[write++] = b;
+            outIndices[write++] = c;
+        }
+        outIndices.resize(write);
+    }
+    return std::sqrt(maxCost);
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "ItpMesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert) by edge collapse. A vertex
+// only ever collapses onto another existing vertex, so the simplified triangle list
+// indexes the original vertex buffer and blendshape deltas stay valid for it.
+//  - vertices sharing a position but differing in other attributes (uv seams, hard
+//    normals) only collapse along the seam, together with their partner on the other side
+//  - open borders only collapse along the border; vertices where several seams or
+//    borders meet never move
+//  - the cost of a collapse is the quadric distance error plus a penalty for the normal,
+//    uv and skin weight difference between the two vertices
+//  - collapses that would flip a triangle are rejected
+class MeshSimplifier
+{
+public:
+    // Simplifies a triangle list towards targetIndexCount indices, stopping early once
+    // the next collapse would exceed targetError, a distance relative to the largest side
+    // of the mesh bounds. Only the attributes format marks present are considered.
+    // Writes the simplified triangles to outIndices and returns the error reached.
+    static float Simplify(const VertexData* verts, size_t vertexCount, const ItpMesh::VertexFormat& format,
+        const uint32_t* indices, size_t indexCount, size_t targetIndexCount, float targetError,
+        std::vector<uint32_t>& outIndices);
+};
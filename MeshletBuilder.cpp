@@ -0,0 +1,279 @@
+#include "MeshletBuilder.h"
+#include "EngineMath.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+static const uint32_t s_noIndex = ~0u;
+
+static Vector3 GetPosition(const float* positions, size_t positionStride, uint32_t vertex)
+{
+    const float* p = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + positionStride * vertex);
+    return Vector3(p[0], p[1], p[2]);
+}
+
+// Unit normal of a triangle in the converter's winding, zero when it is degenerate
+static Vector3 GetTriangleNormal(const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    Vector3 n = Vector3::Cross(c - a, b - a);
+    float length = n.Length();
+    return length > 0.0f ? n / length : Vector3::Zero;
+}
+
+/*static*/ void MeshletBuilder::Build(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+    size_t positionStride, size_t maxVertices, size_t maxTriangles, float coneWeight,
+    std::vector<ItpMesh::Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices,
+    std::vector<uint8_t>& meshletTriangles)
+{
+    meshlets.clear();
+    meshletVertices.clear();
+    meshletTriangles.clear();
+    maxVertices = std::max<size_t>(3, std::min<size_t>(maxVertices, 256));
+    maxTriangles = std::max<size_t>(1, maxTriangles);
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return;
+
+    std::vector<Vector3> centroids(triangleCount);
+    std::vector<Vector3> normals(triangleCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        Vector3 a = GetPosition(positions, positionStride, indices[3 * t + 0]);
+        Vector3 b = GetPosition(positions, positionStride, indices[3 * t + 1]);
+        Vector3 c = GetPosition(positions, positionStride, indices[3 * t + 2]);
+        centroids[t] = (a + b + c) / 3.0f;
+        normals[t] = GetTriangleNormal(a, b, c);
+    }
+
+    // vertex -> triangles not yet in a meshlet: each vertex's slice of adjacency starts at
+    // adjacencyOffsets[v] and holds liveCounts[v] triangles, emitted ones are swapped out
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; ++i)
+        ++adjacencyOffsets[indices[i] + 1];
+    for (size_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<uint32_t> liveCounts(vertexCount, 0);
+    std::vector<uint32_t> adjacency(indexCount);
+    for (size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t v = indices[i];
+        adjacency[adjacencyOffsets[v] + liveCounts[v]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> localIndex(vertexCount, s_noIndex);
+    size_t emittedCount = 0;
+    size_t seedCursor = 0;
+
+    ItpMesh::Meshlet meshlet = {};
+    Vector3 centroidSum = Vector3::Zero;
+    Vector3 normalSum = Vector3::Zero;
+
+    auto countNewVertices = [&](size_t t)
+    {
+        const uint32_t* tri = indices + 3 * t;
+        uint32_t count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (localIndex[tri[k]] == s_noIndex && (k < 1 || tri[k] != tri[0]) && (k < 2 || tri[k] != tri[1]))
+                ++count;
+        }
+        return count;
+    };
+
+    auto finishMeshlet = [&]()
+    {
+        if (meshlet.triangleCount == 0)
+            return;
+        while (meshletTriangles.size() % 4 != 0)
+            meshletTriangles.push_back(0);
+        ComputeBounds(meshlet, meshletVertices.data(), meshletTriangles.data(), positions, positionStride);
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+            localIndex[meshletVertices[meshlet.vertexOffset + i]] = s_noIndex;
+        meshlets.push_back(meshlet);
+        meshlet = ItpMesh::Meshlet();
+        meshlet.vertexOffset = static_cast<uint32_t>(meshletVertices.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(meshletTriangles.size());
+        centroidSum = Vector3::Zero;
+        normalSum = Vector3::Zero;
+    };
+
+    auto addTriangle = [&](size_t t)
+    {
+        const uint32_t* tri = indices + 3 * t;
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t v = tri[k];
+            if (localIndex[v] == s_noIndex)
+            {
+                localIndex[v] = meshlet.vertexCount++;
+                meshletVertices.push_back(v);
+            }
+            meshletTriangles.push_back(static_cast<uint8_t>(localIndex[v]));
+
+            // swap the triangle out of the vertex's live triangles
+            uint32_t* live = adjacency.data() + adjacencyOffsets[v];
+            for (uint32_t i = 0; i < liveCounts[v]; ++i)
+            {
+                if (live[i] == t)
+                {
+                    live[i] = live[--liveCounts[v]];
+                    break;
+                }
+            }
+        }
+        ++meshlet.triangleCount;
+        centroidSum += centroids[t];
+        normalSum += normals[t];
+        emitted[t] = true;
+        ++emittedCount;
+    };
+
+    while (emittedCount < triangleCount)
+    {
+        // the live triangle next to the meshlet that adds the fewest vertices, ties going
+        // to the closest one, with distance stretched for triangles facing another way
+        size_t best = s_noIndex;
+        uint32_t bestNewVertices = 4;
+        float bestScore = FLT_MAX;
+        if (meshlet.triangleCount > 0)
+        {
+            const Vector3 center = centroidSum / static_cast<float>(meshlet.triangleCount);
+            const float axisLength = normalSum.Length();
+            const Vector3 axis = axisLength > 0.0f ? normalSum / axisLength : Vector3::Zero;
+            for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+            {
+                uint32_t v = meshletVertices[meshlet.vertexOffset + i];
+                const uint32_t* live = adjacency.data() + adjacencyOffsets[v];
+                for (uint32_t j = 0; j < liveCounts[v]; ++j)
+                {
+                    uint32_t t = live[j];
+                    uint32_t newVertices = countNewVertices(t);
+                    if (newVertices > bestNewVertices)
+                        continue;
+                    float spread = 1.0f - Vector3::Dot(normals[t], axis);
+                    float score = (centroids[t] - center).Length() * (1.0f + coneWeight * spread);
+                    if (newVertices < bestNewVertices || score < bestScore)
+                    {
+                        best = t;
+                        bestNewVertices = newVertices;
+                        bestScore = score;
+                    }
+                }
+            }
+        }
+
+        // nothing adjacent is left: continue with the next unused triangle in input order
+        if (best == s_noIndex)
+        {
+            while (emitted[seedCursor])
+                ++seedCursor;
+            best = seedCursor;
+            bestNewVertices = countNewVertices(best);
+        }
+
+        if (meshlet.vertexCount + bestNewVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles)
+            finishMeshlet();
+        addTriangle(best);
+    }
+    finishMeshlet();
+}
+
+/*static*/ void MeshletBuilder::ComputeBounds(ItpMesh::Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+    const float* positions, size_t positionStride)
+{
+    const uint32_t* vertices = meshletVertices + meshlet.vertexOffset;
+    const uint8_t* triangles = meshletTriangles + meshlet.triangleOffset;
+    auto position = [&](uint32_t local) { return GetPosition(positions, positionStride, vertices[local]); };
+
+    // Ritter's sphere: start from the most distant pair of axis extremes, then grow the
+    // sphere to take in every point outside it
+    Vector3 minPoint[3];
+    Vector3 maxPoint[3];
+    minPoint[0] = minPoint[1] = minPoint[2] = maxPoint[0] = maxPoint[1] = maxPoint[2] = position(0);
+    for (uint32_t i = 1; i < meshlet.vertexCount; ++i)
+    {
+        Vector3 p = position(i);
+        if (p.x < minPoint[0].x) minPoint[0] = p;
+        if (p.y < minPoint[1].y) minPoint[1] = p;
+        if (p.z < minPoint[2].z) minPoint[2] = p;
+        if (p.x > maxPoint[0].x) maxPoint[0] = p;
+        if (p.y > maxPoint[1].y) maxPoint[1] = p;
+        if (p.z > maxPoint[2].z) maxPoint[2] = p;
+    }
+    int spanAxis = 0;
+    float spanSq = -1.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float lengthSq = (maxPoint[axis] - minPoint[axis]).LengthSq();
+        if (lengthSq > spanSq)
+        {
+            spanSq = lengthSq;
+            spanAxis = axis;
+        }
+    }
+    Vector3 center = (minPoint[spanAxis] + maxPoint[spanAxis]) * 0.5f;
+    float radius = sqrtf(spanSq) * 0.5f;
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        Vector3 offset = position(i) - center;
+        float distance = offset.Length();
+        if (distance > radius)
+        {
+            float grownRadius = (radius + distance) * 0.5f;
+            center += offset * ((grownRadius - radius) / distance);
+            radius = grownRadius;
+        }
+    }
+
+    // normal cone: the average normal, widened to the normal furthest from it
+    Vector3 normalSum = Vector3::Zero;
+    for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+    {
+        const uint8_t* tri = triangles + 3 * t;
+        normalSum += GetTriangleNormal(position(tri[0]), position(tri[1]), position(tri[2]));
+    }
+    const float axisLength = normalSum.Length();
+    const Vector3 axis = axisLength > 0.0f ? normalSum / axisLength : Vector3::Zero;
+    float minDot = 1.0f;
+    for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+    {
+        const uint8_t* tri = triangles + 3 * t;
+        Vector3 normal = GetTriangleNormal(position(tri[0]), position(tri[1]), position(tri[2]));
+        if (normal.LengthSq() > 0.0f)
+            minDot = std::min(minDot, Vector3::Dot(normal, axis));
+    }
+
+    // The apex sits far enough back along the axis to lie behind every triangle's plane,
+    // so a camera inside the (widened) cone behind it sees only back faces
+    Vector3 apex = center;
+    float cutoff = 1.0f;
+    if (minDot > 0.0f && axisLength > 0.0f)
+    {
+        float maxT = 0.0f;
+        for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+        {
+            const uint8_t* tri = triangles + 3 * t;
+            Vector3 p0 = position(tri[0]);
+            Vector3 normal = GetTriangleNormal(p0, position(tri[1]), position(tri[2]));
+            float dn = Vector3::Dot(axis, normal);
+            if (dn > 0.0f)
+                maxT = std::max(maxT, Vector3::Dot(center - p0, normal) / dn);
+        }
+        apex = center - axis * maxT;
+        cutoff = sqrtf(std::max(0.0f, 1.0f - minDot * minDot));
+    }
+
+    meshlet.center[0] = center.x;
+    meshlet.center[1] = center.y;
+    meshlet.center[2] = center.z;
+    meshlet.radius = radius;
+    meshlet.coneApex[0] = apex.x;
+    meshlet.coneApex[1] = apex.y;
+    meshlet.coneApex[2] = apex.z;
+    meshlet.coneCutoff = cutoff;
+    meshlet.coneAxis[0] = axis.x;
+    meshlet.coneAxis[1] = axis.y;
+    meshlet.coneAxis[2] = axis.z;
+    meshlet.reserved = 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "ItpMesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits a triangle list into meshlets for mesh shader and GPU-driven renderers: small
+// clusters with their own vertex list and 8-bit local triangles, each with a bounding
+// sphere and a normal cone for frustum and backface culling of the whole cluster.
+class MeshletBuilder
+{
+public:
+    // Greedily grows each meshlet from a seed triangle, taking the adjacent triangle
+    // that adds the fewest new vertices, then the one closest to the meshlet; coneWeight
+    // (0..1) also favours triangles facing the way the meshlet does, for tighter cones.
+    // The triangle order is kept where it doesn't cost vertices, so cache optimized input
+    // gives meshlets that are also spatially coherent. maxVertices is at most 256.
+    // positions are vertexCount float3 values positionStride bytes apart.
+    // Each meshlet's local triangles start on a 4 byte boundary of meshletTriangles.
+    static void Build(const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount,
+        size_t positionStride, size_t maxVertices, size_t maxTriangles, float coneWeight,
+        std::vector<ItpMesh::Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices,
+        std::vector<uint8_t>& meshletTriangles);
+
+    // Fills the bounding sphere and normal cone of a meshlet whose vertex and triangle
+    // ranges are set. Triangles use the converter's winding, so the outward normal of
+    // (a, b, c) is cross(c - a, b - a).
+    static void ComputeBounds(ItpMesh::Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles,
+        const float* positions, size_t positionStride);
+};
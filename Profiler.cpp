@@ -0,0 +1,366 @@
+#include "Profiler.h"
+#include "JsonWriter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#if defined(_WIN32)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+struct ProfileEvent
+{
+    const char* stage;
+    std::string subject;
+    uint32_t thread;
+    uint64_t startMicros;
+    uint64_t durationMicros;
+    uint64_t allocatedBytes;
+    int64_t peakBytes;
+    uint64_t inputCount;
+    uint64_t outputCount;
+};
+
+static std::atomic<bool> s_enabled(false);
+static std::atomic<int64_t> s_liveBytes(0);
+static std::atomic<int64_t> s_peakBytes(0);
+static std::atomic<uint32_t> s_nextThread(0);
+static std::mutex s_eventMutex;
+static std::vector<ProfileEvent> s_events;
+static const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+
+// per thread, so nested scopes on parallel jobs don't see each other's allocations
+static thread_local int64_t t_liveBytes = 0;
+static thread_local int64_t t_peakBytes = 0;
+static thread_local uint64_t t_allocatedBytes = 0;
+
+static uint32_t GetThreadIndex()
+{
+    static thread_local uint32_t index = s_nextThread.fetch_add(1);
+    return index;
+}
+
+static uint64_t GetMicros()
+{
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - s_epoch).count());
+}
+
+// Allocation sizes come from the heap rather than a header, so blocks allocated before
+// Enable() can still be freed normally
+static size_t GetBlockSize(void* p)
+{
+#if defined(_WIN32)
+    return _msize(p);
+#elif defined(__APPLE__)
+    return malloc_size(p);
+#else
+    return malloc_usable_size(p);
+#endif
+}
+
+static void TrackAllocation(void* p)
+{
+    int64_t size = static_cast<int64_t>(GetBlockSize(p));
+    t_allocatedBytes += static_cast<uint64_t>(size);
+    t_liveBytes += size;
+    t_peakBytes = std::max(t_peakBytes, t_liveBytes);
+    int64_t live = s_liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+    int64_t peak = s_peakBytes.load(std::memory_order_relaxed);
+    while (live > peak && !s_peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+static void TrackFree(void* p)
+{
+    int64_t size = static_cast<int64_t>(GetBlockSize(p));
+    t_liveBytes -= size;
+    s_liveBytes.fetch_sub(size, std::memory_order_relaxed);
+}
+
+static void* Allocate(size_t size)
+{
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (p && s_enabled.load(std::memory_order_relaxed))
+        TrackAllocation(p);
+    return p;
+}
+
+static void Free(void* p)
+{
+    if (!p)
+        return;
+    if (s_enabled.load(std::memory_order_relaxed))
+        TrackFree(p);
+    std::free(p);
+}
+
+void* operator new(size_t size)
+{
+    void* p = Allocate(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    void* p = Allocate(size);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return Allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return Allocate(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    Free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    Free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    Free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    Free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    Free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    Free(p);
+}
+
+/*static*/ void Profiler::Enable()
+{
+    s_enabled = true;
+}
+
+/*static*/ bool Profiler::IsEnabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+/*static*/ int64_t Profiler::GetPeakBytes()
+{
+    return s_peakBytes.load();
+}
+
+Profiler::Scope::Scope(const char* stage, const std::string& subject)
+    : active(IsEnabled())
+    , stage(stage)
+{
+    if (!active)
+        return;
+    this->subject = subject;
+    thread = GetThreadIndex();
+    startLiveBytes = t_liveBytes;
+    outerPeakBytes = t_peakBytes;
+    t_peakBytes = t_liveBytes;
+    startAllocatedBytes = t_allocatedBytes;
+    startMicros = GetMicros();
+}
+
+Profiler::Scope::~Scope()
+{
+    if (!active)
+        return;
+    ProfileEvent event;
+    event.durationMicros = GetMicros() - startMicros;
+    event.allocatedBytes = t_allocatedBytes - startAllocatedBytes;
+    event.peakBytes = std::max<int64_t>(0, t_peakBytes - startLiveBytes);
+    t_peakBytes = std::max(outerPeakBytes, t_peakBytes);
+    event.stage = stage;
+    event.subject.swap(subject);
+    event.thread = thread;
+    event.startMicros = startMicros;
+    event.inputCount = inputCount;
+    event.outputCount = outputCount;
+
+    std::lock_guard<std::mutex> lock(s_eventMutex);
+    s_events.push_back(std::move(event));
+}
+
+void Profiler::Scope::SetSubject(const std::string& subject)
+{
+    if (active)
+        this->subject = subject;
+}
+
+void Profiler::Scope::SetCounts(uint64_t inputCount, uint64_t outputCount)
+{
+    this->inputCount = inputCount;
+    this->outputCount = outputCount;
+}
+
+// The events ordered by start time, then longest first so parents precede children
+static std::vector<ProfileEvent> GetSortedEvents()
+{
+    std::vector<ProfileEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(s_eventMutex);
+        events = s_events;
+    }
+    std::stable_sort(events.begin(), events.end(), [](const ProfileEvent& a, const ProfileEvent& b)
+    {
+        if (a.startMicros != b.startMicros)
+            return a.startMicros < b.startMicros;
+        return a.durationMicros > b.durationMicros;
+    });
+    return events;
+}
+
+static void WriteCsvField(std::ofstream& ofs, const std::string& text)
+{
+    ofs << '"';
+    for (char c : text)
+    {
+        if (c == '"')
+            ofs << '"';
+        ofs << c;
+    }
+    ofs << '"';
+}
+
+/*static*/ bool Profiler::WriteReport(const std::string& path)
+{
+    std::vector<ProfileEvent> events = GetSortedEvents();
+    std::ofstream ofs(path, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    if (!ofs.is_open())
+        return false;
+
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0)
+    {
+        ofs << "stage,subject,thread,start_us,duration_us,allocated_bytes,peak_bytes,input_count,output_count\n";
+        for (const ProfileEvent& e : events)
+        {
+            ofs << e.stage << ',';
+            WriteCsvField(ofs, e.subject);
+            ofs << ',' << e.thread << ',' << e.startMicros << ',' << e.durationMicros << ',' << e.allocatedBytes
+                << ',' << e.peakBytes << ',' << e.inputCount << ',' << e.outputCount << '\n';
+        }
+        return !ofs.fail();
+    }
+
+    struct StageTotals
+    {
+        const char* stage;
+        uint64_t calls = 0;
+        uint64_t totalMicros = 0;
+        uint64_t maxMicros = 0;
+        uint64_t allocatedBytes = 0;
+        int64_t peakBytes = 0;
+        uint64_t inputCount = 0;
+        uint64_t outputCount = 0;
+    };
+    std::vector<StageTotals> stages;
+    std::unordered_map<std::string, size_t> stageIndex;
+    for (const ProfileEvent& e : events)
+    {
+        auto it = stageIndex.emplace(e.stage, stages.size()).first;
+        if (it->second == stages.size())
+        {
+            stages.emplace_back();
+            stages.back().stage = e.stage;
+        }
+        StageTotals& totals = stages[it->second];
+        ++totals.calls;
+        totals.totalMicros += e.durationMicros;
+        totals.maxMicros = std::max(totals.maxMicros, e.durationMicros);
+        totals.allocatedBytes += e.allocatedBytes;
+        totals.peakBytes = std::max(totals.peakBytes, e.peakBytes);
+        totals.inputCount += e.inputCount;
+        totals.outputCount += e.outputCount;
+    }
+
+    JsonWriter json;
+    json.Raw("{\n\t\"peakBytes\": ").Int(GetPeakBytes()).Raw(",\n\t\"stages\": [\n");
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        const StageTotals& t = stages[i];
+        json.Raw("\t\t{ \"stage\": ").EscapedString(t.stage)
+            .Raw(", \"calls\": ").UInt(t.calls)
+            .Raw(", \"totalMicros\": ").UInt(t.totalMicros)
+            .Raw(", \"maxMicros\": ").UInt(t.maxMicros)
+            .Raw(", \"allocatedBytes\": ").UInt(t.allocatedBytes)
+            .Raw(", \"peakBytes\": ").Int(t.peakBytes)
+            .Raw(", \"inputCount\": ").UInt(t.inputCount)
+            .Raw(", \"outputCount\": ").UInt(t.outputCount)
+            .Raw(i + 1 < stages.size() ? " },\n" : " }\n");
+    }
+    json.Raw("\t],\n\t\"events\": [\n");
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const ProfileEvent& e = events[i];
+        json.Raw("\t\t{ \"stage\": ").EscapedString(e.stage)
+            .Raw(", \"subject\": ").EscapedString(e.subject)
+            .Raw(", \"thread\": ").UInt(e.thread)
+            .Raw(", \"startMicros\": ").UInt(e.startMicros)
+            .Raw(", \"durationMicros\": ").UInt(e.durationMicros)
+            .Raw(", \"allocatedBytes\": ").UInt(e.allocatedBytes)
+            .Raw(", \"peakBytes\": ").Int(e.peakBytes)
+            .Raw(", \"inputCount\": ").UInt(e.inputCount)
+            .Raw(", \"outputCount\": ").UInt(e.outputCount)
+            .Raw(i + 1 < events.size() ? " },\n" : " }\n");
+    }
+    json.Raw("\t]\n}\n");
+    return json.WriteTo(ofs);
+}
+
+/*static*/ bool Profiler::WriteTrace(const std::string& path)
+{
+    std::vector<ProfileEvent> events = GetSortedEvents();
+    std::ofstream ofs(path, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    if (!ofs.is_open())
+        return false;
+
+    // complete ("X") events; args show up in the viewer's selection panel
+    JsonWriter json;
+    json.Raw("{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < events.size(); ++i)
+    {
+        const ProfileEvent& e = events[i];
+        json.Raw("{ \"name\": ").EscapedString(e.subject.empty() ? std::string(e.stage) : std::string(e.stage) + " " + e.subject)
+            .Raw(", \"cat\": ").EscapedString(e.stage)
+            .Raw(", \"ph\": \"X\", \"pid\": 1, \"tid\": ").UInt(e.thread)
+            .Raw(", \"ts\": ").UInt(e.startMicros)
+            .Raw(", \"dur\": ").UInt(e.durationMicros)
+            .Raw(", \"args\": { \"allocatedBytes\": ").UInt(e.allocatedBytes)
+            .Raw(", \"peakBytes\": ").Int(e.peakBytes)
+            .Raw(", \"inputCount\": ").UInt(e.inputCount)
+            .Raw(", \"outputCount\": ").UInt(e.outputCount)
+            .Raw(i + 1 < events.size() ? " } },\n" : " } }\n");
+    }
+    json.Raw("] }\n");
+    return json.WriteTo(ofs);
+}
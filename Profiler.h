@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Scoped stage instrumentation for -profile and -trace. While disabled a Scope costs a
+// branch. Enabled, every Scope records wall time, the bytes operator new handed out on
+// its thread, the peak of the thread's live bytes above the level at entry, and optional
+// input/output element counts. Profiler.cpp replaces the global operator new/delete to
+// count bytes; memory is only tracked once Enable() has been called, and allocations of
+// worker threads count towards the scopes on those threads.
+class Profiler
+{
+public:
+    static void Enable();
+    static bool IsEnabled();
+
+    class Scope
+    {
+    public:
+        // stage must be a string literal; subject is typically a file or mesh name
+        explicit Scope(const char* stage, const std::string& subject = std::string());
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        void SetSubject(const std::string& subject);
+        void SetCounts(uint64_t inputCount, uint64_t outputCount);
+
+    private:
+        bool active;
+        const char* stage;
+        std::string subject;
+        uint32_t thread = 0;
+        uint64_t startMicros = 0;
+        int64_t startLiveBytes = 0;
+        int64_t outerPeakBytes = 0;
+        uint64_t startAllocatedBytes = 0;
+        uint64_t inputCount = 0;
+        uint64_t outputCount = 0;
+    };
+
+    // Highest number of live bytes from operator new since Enable(), over all threads
+    static int64_t GetPeakBytes();
+
+    // Stage totals plus every recorded scope. A path ending in .csv gets one CSV row per
+    // scope, anything else a JSON document.
+    static bool WriteReport(const std::string& path);
+    // Chrome trace event format, for chrome://tracing or Perfetto
+    static bool WriteTrace(const std::string& path);
+};
@@ -0,0 +1,337 @@
+#include "TangentGenerator.h"
+#include "EngineMathSimd.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+static const size_t s_trianglesPerJob = 4096;
+static const uint32_t s_noCorner = 0xFFFFFFFFu;
+
+enum TriangleFlags : uint8_t
+{
+    TriangleOrientPreserving = 1 << 0,  // positive uv area
+    TriangleNoArea = 1 << 1,            // zero uv area: orientation comes from a neighbour
+    TriangleDegenerate = 1 << 2,        // two corners are the same vertex
+    TriangleOriented = 1 << 3,          // TriangleOrientPreserving is final
+};
+
+static bool NotZero(float f)
+{
+    return fabsf(f) > FLT_MIN;
+}
+
+static bool NotZero(const Vector3& v)
+{
+    return NotZero(v.x) || NotZero(v.y) || NotZero(v.z);
+}
+
+// v minus its component along n, normalized unless it vanishes
+static Vector3 ProjectNormalized(const Vector3& v, const Vector3& n)
+{
+    Vector3 p = v - n * Vector3::Dot(n, v);
+    if (NotZero(p))
+        p = p * (1.0f / p.Length());
+    return p;
+}
+
+// MikkTSpace's vertex identity: bitwise equal position, normal and uv
+static uint32_t AssignVertexIds(const Vector3* pos, const Vector3* norm, const Vector2* uv, size_t cornerCount,
+    std::vector<uint32_t>& ids)
+{
+    struct CornerKey
+    {
+        float v[8];
+        uint32_t corner;
+    };
+    std::vector<CornerKey> keys(cornerCount);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        CornerKey& key = keys[c];
+        key.v[0] = pos[c].x; key.v[1] = pos[c].y; key.v[2] = pos[c].z;
+        key.v[3] = norm[c].x; key.v[4] = norm[c].y; key.v[5] = norm[c].z;
+        key.v[6] = uv[c].x; key.v[7] = uv[c].y;
+        key.corner = static_cast<uint32_t>(c);
+    }
+    auto less = [](const CornerKey& a, const CornerKey& b)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            if (a.v[i] != b.v[i])
+                return a.v[i] < b.v[i];
+        }
+        return a.corner < b.corner;
+    };
+    std::sort(keys.begin(), keys.end(), less);
+
+    ids.resize(cornerCount);
+    uint32_t idCount = 0;
+    for (size_t i = 0; i < cornerCount; ++i)
+    {
+        if (i > 0 && !std::equal(keys[i].v, keys[i].v + 8, keys[i - 1].v))
+            ++idCount;
+        ids[keys[i].corner] = idCount;
+    }
+    return cornerCount > 0 ? idCount + 1 : 0;
+}
+
+static uint32_t FindRoot(std::vector<uint32_t>& parent, uint32_t c)
+{
+    while (parent[c] != c)
+    {
+        parent[c] = parent[parent[c]];
+        c = parent[c];
+    }
+    return c;
+}
+
+static void Unite(std::vector<uint32_t>& parent, uint32_t a, uint32_t b)
+{
+    a = FindRoot(parent, a);
+    b = FindRoot(parent, b);
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+/*static*/ void TangentGenerator::Generate(const Vector3* pos, const Vector3* norm, const Vector2* uv, size_t cornerCount,
+    Vector3* outTangent, float* outSign, unsigned threadCount)
+{
+    const size_t triangleCount = cornerCount / 3;
+    cornerCount = triangleCount * 3;
+    if (triangleCount == 0)
+        return;
+    const size_t triangleJobs = (triangleCount + s_trianglesPerJob - 1) / s_trianglesPerJob;
+
+    std::vector<uint32_t> ids;
+    const uint32_t idCount = AssignVertexIds(pos, norm, uv, cornerCount, ids);
+
+    // Unit tangent of each triangle (pointing along +u, flipped for mirrored triangles)
+    std::vector<Vector3> faceTangents(triangleCount, Vector3(0.0f, 0.0f, 0.0f));
+    std::vector<uint8_t> flags(triangleCount, 0);
+    ThreadPool::ParallelFor(triangleJobs, threadCount, [&](size_t job)
+    {
+        const size_t end = std::min(triangleCount, (job + 1) * s_trianglesPerJob);
+        for (size_t t = job * s_trianglesPerJob; t < end; ++t)
+        {
+            const size_t c = 3 * t;
+            if (ids[c] == ids[c + 1] || ids[c] == ids[c + 2] || ids[c + 1] == ids[c + 2])
+            {
+                flags[t] = TriangleDegenerate;
+                continue;
+            }
+            const Vector3 d1 = pos[c + 1] - pos[c];
+            const Vector3 d2 = pos[c + 2] - pos[c];
+            const float t21x = uv[c + 1].x - uv[c].x;
+            const float t21y = uv[c + 1].y - uv[c].y;
+            const float t31x = uv[c + 2].x - uv[c].x;
+            const float t31y = uv[c + 2].y - uv[c].y;
+            const float signedArea = t21x * t31y - t21y * t31x;
+
+            uint8_t flag = signedArea > 0.0f ? TriangleOrientPreserving : 0;
+            if (NotZero(signedArea))
+            {
+                flag |= TriangleOriented;
+                Vector3 os = d1 * t31y - d2 * t21y;
+                float length = os.Length();
+                if (NotZero(length))
+                    faceTangents[t] = os * ((flag & TriangleOrientPreserving ? 1.0f : -1.0f) / length);
+            }
+            else
+            {
+                flag |= TriangleNoArea;
+            }
+            flags[t] = flag;
+        }
+    });
+
+    // Edges between vertices, sorted so triangles sharing an edge are adjacent
+    struct Edge
+    {
+        uint32_t lo, hi;                // vertex ids, lo < hi
+        uint32_t cornerLo, cornerHi;    // the triangle's corners at lo and hi
+    };
+    std::vector<Edge> edges;
+    edges.reserve(cornerCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        if (flags[t] & TriangleDegenerate)
+            continue;
+        for (size_t k = 0; k < 3; ++k)
+        {
+            uint32_t a = static_cast<uint32_t>(3 * t + k);
+            uint32_t b = static_cast<uint32_t>(3 * t + (k + 1) % 3);
+            if (ids[a] > ids[b])
+                std::swap(a, b);
+            edges.push_back({ ids[a], ids[b], a, b });
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b)
+    {
+        if (a.lo != b.lo)
+            return a.lo < b.lo;
+        if (a.hi != b.hi)
+            return a.hi < b.hi;
+        return a.cornerLo < b.cornerLo;
+    });
+    std::vector<size_t> runStarts;
+    for (size_t i = 0; i < edges.size(); ++i)
+    {
+        if (i == 0 || edges[i].lo != edges[i - 1].lo || edges[i].hi != edges[i - 1].hi)
+            runStarts.push_back(i);
+    }
+    runStarts.push_back(edges.size());
+
+    // Triangles without uv area join the orientation of a neighbour, spreading across
+    // chains of them until nothing changes
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (size_t r = 0; r + 1 < runStarts.size(); ++r)
+        {
+            uint8_t orientation = 0xFF;
+            for (size_t i = runStarts[r]; i < runStarts[r + 1] && orientation == 0xFF; ++i)
+            {
+                uint8_t flag = flags[edges[i].cornerLo / 3];
+                if (flag & TriangleOriented)
+                    orientation = flag & TriangleOrientPreserving;
+            }
+            if (orientation == 0xFF)
+                continue;
+            for (size_t i = runStarts[r]; i < runStarts[r + 1]; ++i)
+            {
+                uint8_t& flag = flags[edges[i].cornerLo / 3];
+                if (!(flag & TriangleOriented))
+                {
+                    flag = static_cast<uint8_t>(flag | TriangleOriented | orientation);
+                    changed = true;
+                }
+            }
+        }
+    }
+    for (uint8_t& flag : flags)
+    {
+        if (!(flag & (TriangleOriented | TriangleDegenerate)))
+            flag |= TriangleOriented | TriangleOrientPreserving; // isolated, nothing to follow
+    }
+
+    // Groups: corners of a vertex whose triangles share an edge and agree in orientation
+    std::vector<uint32_t> parent(cornerCount);
+    for (size_t c = 0; c < cornerCount; ++c)
+        parent[c] = static_cast<uint32_t>(c);
+    for (size_t r = 0; r + 1 < runStarts.size(); ++r)
+    {
+        for (size_t i = runStarts[r]; i < runStarts[r + 1]; ++i)
+        {
+            for (size_t j = i + 1; j < runStarts[r + 1]; ++j)
+            {
+                const Edge& a = edges[i];
+                const Edge& b = edges[j];
+                if ((flags[a.cornerLo / 3] & TriangleOrientPreserving) != (flags[b.cornerLo / 3] & TriangleOrientPreserving))
+                    continue;
+                Unite(parent, a.cornerLo, b.cornerLo);
+                Unite(parent, a.cornerHi, b.cornerHi);
+            }
+        }
+    }
+
+    // Group members as flat offset + corner arrays, corners ascending within a group
+    std::vector<uint32_t> groupOf(cornerCount, s_noCorner);
+    uint32_t groupCount = 0;
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        if (!(flags[c / 3] & TriangleDegenerate) && parent[c] == c)
+            groupOf[c] = groupCount++;
+    }
+    std::vector<uint32_t> groupOffsets(groupCount + 1, 0);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        if (flags[c / 3] & TriangleDegenerate)
+            continue;
+        groupOf[c] = groupOf[FindRoot(parent, static_cast<uint32_t>(c))];
+        ++groupOffsets[groupOf[c] + 1];
+    }
+    for (uint32_t g = 0; g < groupCount; ++g)
+        groupOffsets[g + 1] += groupOffsets[g];
+    std::vector<uint32_t> groupCorners(groupOffsets[groupCount]);
+    {
+        std::vector<uint32_t> fill(groupOffsets.begin(), groupOffsets.end() - 1);
+        for (size_t c = 0; c < cornerCount; ++c)
+        {
+            if (groupOf[c] != s_noCorner)
+                groupCorners[fill[groupOf[c]]++] = static_cast<uint32_t>(c);
+        }
+    }
+
+    // Each corner's share: the triangle tangent in the plane of the corner normal, times
+    // the triangle's angle at the corner in that plane
+    std::vector<Vector3> contributions(cornerCount, Vector3(0.0f, 0.0f, 0.0f));
+    ThreadPool::ParallelFor(triangleJobs, threadCount, [&](size_t job)
+    {
+        const size_t end = std::min(triangleCount, (job + 1) * s_trianglesPerJob);
+        for (size_t t = job * s_trianglesPerJob; t < end; ++t)
+        {
+            if (flags[t] & (TriangleDegenerate | TriangleNoArea))
+                continue;
+            for (size_t k = 0; k < 3; ++k)
+            {
+                const size_t c = 3 * t + k;
+                const size_t next = 3 * t + (k + 1) % 3;
+                const size_t prev = 3 * t + (k + 2) % 3;
+                const Vector3& n = norm[c];
+                Vector3 os = ProjectNormalized(faceTangents[t], n);
+                Vector3 v1 = ProjectNormalized(pos[next] - pos[c], n);
+                Vector3 v2 = ProjectNormalized(pos[prev] - pos[c], n);
+                float cosAngle = std::max(-1.0f, std::min(1.0f, Vector3::Dot(v1, v2)));
+                contributions[c] = os * acosf(cosAngle);
+            }
+        }
+    });
+
+    // Sum each group in corner order, so the result doesn't depend on the job split
+    std::vector<float> gx(groupCount), gy(groupCount), gz(groupCount);
+    const size_t groupJobs = (groupCount + s_trianglesPerJob - 1) / s_trianglesPerJob;
+    ThreadPool::ParallelFor(groupJobs, threadCount, [&](size_t job)
+    {
+        const size_t begin = job * s_trianglesPerJob;
+        const size_t end = std::min(static_cast<size_t>(groupCount), begin + s_trianglesPerJob);
+        for (size_t g = begin; g < end; ++g)
+        {
+            Vector3 sum(0.0f, 0.0f, 0.0f);
+            for (uint32_t i = groupOffsets[g]; i < groupOffsets[g + 1]; ++i)
+                sum += contributions[groupCorners[i]];
+            gx[g] = sum.x;
+            gy[g] = sum.y;
+            gz[g] = sum.z;
+        }
+        MathSimd::NormalizeVectors(&gx[begin], &gy[begin], &gz[begin], end - begin);
+        for (size_t g = begin; g < end; ++g)
+        {
+            for (uint32_t i = groupOffsets[g]; i < groupOffsets[g + 1]; ++i)
+            {
+                uint32_t c = groupCorners[i];
+                outTangent[c] = Vector3(gx[g], gy[g], gz[g]);
+                outSign[c] = (flags[c / 3] & TriangleOrientPreserving) ? 1.0f : -1.0f;
+            }
+        }
+    });
+
+    // Corners of degenerate triangles copy another corner of their vertex
+    std::vector<uint32_t> representative(idCount, s_noCorner);
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        if (groupOf[c] != s_noCorner && representative[ids[c]] == s_noCorner)
+            representative[ids[c]] = static_cast<uint32_t>(c);
+    }
+    for (size_t c = 0; c < cornerCount; ++c)
+    {
+        if (groupOf[c] != s_noCorner)
+            continue;
+        uint32_t r = representative[ids[c]];
+        outTangent[c] = r != s_noCorner ? outTangent[r] : Vector3(0.0f, 0.0f, 0.0f);
+        outSign[c] = r != s_noCorner ? outSign[r] : 1.0f;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "EngineMath.h"
+#include <cstddef>
+
+// Per-corner tangents following MikkTSpace (genTangSpaceDefault), so normal maps baked
+// by MikkTSpace tools shade correctly:
+//  - corners with bitwise equal position, normal and uv are one vertex
+//  - each vertex splits into groups of triangles that reach each other across shared
+//    edges and have the same uv orientation (the sign of their uv area)
+//  - a corner's tangent is the sum over its group of each triangle's tangent, projected
+//    onto the corner normal and weighted by the triangle's angle at the vertex
+//  - the sign is +1 for triangles that preserve the uv orientation, -1 for mirrored ones
+// Triangles with no uv area take their orientation from a neighbour and add nothing;
+// triangles with two identical vertices copy the tangent of another corner of the vertex.
+class TangentGenerator
+{
+public:
+    // Triangle list as corners: corner 3 * t + k is vertex k of triangle t. The winding
+    // and uv convention must be the ones the maps were baked with (the FBX ones: source
+    // winding, V not flipped). The bitangent is cross(normal, tangent) * sign. Zero
+    // tangents are left where a group has no uv gradient at all. Triangle and group
+    // ranges run on up to threadCount threads; results don't depend on the thread count.
+    static void Generate(const Vector3* pos, const Vector3* norm, const Vector2* uv, size_t cornerCount,
+        Vector3* outTangent, float* outSign, unsigned threadCount);
+};
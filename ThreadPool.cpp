@@ -0,0 +1,157 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // One ParallelFor call: its items are handed out to the calling thread and to up to
+    // maxHelpers pool workers
+    struct Task
+    {
+        const std::function<void(size_t)>* job = nullptr;
+        size_t count = 0;
+        std::atomic<size_t> next{ 0 };
+        unsigned maxHelpers = 0;
+        unsigned helpers = 0;       // workers that joined, under the pool mutex
+        unsigned activeHelpers = 0; // of those, the ones still running items
+        std::exception_ptr firstError;
+        std::mutex errorMutex;
+
+        void RunItems()
+        {
+            for (;;)
+            {
+                size_t i = next.fetch_add(1);
+                if (i >= count)
+                    break;
+                try
+                {
+                    (*job)(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!firstError)
+                        firstError = std::current_exception();
+                    next = count; // stop handing out work
+                }
+            }
+        }
+    };
+
+    // Persistent workers shared by every ParallelFor, grown to the largest thread count
+    // asked for. An idle worker helps the oldest open task, so nested calls run on the
+    // workers that are free instead of starting threads of their own.
+    class Pool
+    {
+    public:
+        ~Pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (std::thread& thread : threads)
+                thread.join();
+        }
+
+        void Run(Task& task, unsigned threadCount)
+        {
+            task.maxHelpers = threadCount - 1;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                while (threads.size() < task.maxHelpers)
+                    threads.emplace_back(&Pool::Work, this);
+                tasks.push_back(&task);
+            }
+            wake.notify_all();
+
+            task.RunItems();
+
+            // no worker joins once the task is closed; wait for the ones that did
+            std::unique_lock<std::mutex> lock(mutex);
+            tasks.erase(std::find(tasks.begin(), tasks.end(), &task));
+            finished.wait(lock, [&]() { return task.activeHelpers == 0; });
+        }
+
+    private:
+        Task* FindOpenTask() const
+        {
+            for (Task* task : tasks)
+            {
+                if (task->helpers < task->maxHelpers && task->next.load() < task->count)
+                    return task;
+            }
+            return nullptr;
+        }
+
+        void Work()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                Task* task = nullptr;
+                wake.wait(lock, [&]() { return stopping || (task = FindOpenTask()) != nullptr; });
+                if (!task)
+                    return;
+                ++task->helpers;
+                ++task->activeHelpers;
+                lock.unlock();
+                task->RunItems();
+                lock.lock();
+                if (--task->activeHelpers == 0)
+                    finished.notify_all();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        std::vector<Task*> tasks;   // open tasks, oldest first
+        std::vector<std::thread> threads;
+        bool stopping = false;
+    };
+
+    Pool& GetPool()
+    {
+        static Pool pool;
+        return pool;
+    }
+}
+
+/*static*/ void ThreadPool::ParallelFor(size_t count, unsigned threadCount, const std::function<void(size_t)>& job)
+{
+    if (count == 0)
+        return;
+    if (threadCount == 0)
+        threadCount = HardwareThreads();
+    if (threadCount > count)
+        threadCount = static_cast<unsigned>(count);
+
+    if (threadCount <= 1)
+    {
+        for (size_t i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+
+    Task task;
+    task.job = &job;
+    task.count = count;
+    GetPool().Run(task, threadCount);
+
+    if (task.firstError)
+        std::rethrow_exception(task.firstError);
+}
+
+/*static*/ unsigned ThreadPool::HardwareThreads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+class ThreadPool
+{
+public:
+    // Runs job(i) for every i in [0, count) on up to threadCount threads, the calling
+    // thread included. Items are handed out in increasing order. Returns once every
+    // item has finished; the first exception thrown by a job is rethrown here.
+    // The other threads are persistent workers shared by every call, so a job may call
+    // ParallelFor itself: the nested items run on the calling thread and on whichever
+    // workers are idle, never on more threads than the largest threadCount asked for.
+    static void ParallelFor(size_t count, unsigned threadCount, const std::function<void(size_t)>& job);
+
+    // Number of hardware threads (at least 1)
+    static unsigned HardwareThreads();
+};
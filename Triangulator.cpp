@@ -0,0 +1,175 @@
+#include "Triangulator.h"
+#include <algorithm>
+#include <cmath>
+
+// Newell's method: robust for concave and slightly non-planar polygons
+static Vector3 GetPolygonNormal(const Vector3* pos, uint32_t first, uint32_t size)
+{
+    Vector3 n(0.0f, 0.0f, 0.0f);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        const Vector3& a = pos[first + i];
+        const Vector3& b = pos[first + (i + 1) % size];
+        n.x += (a.y - b.y) * (a.z + b.z);
+        n.y += (a.z - b.z) * (a.x + b.x);
+        n.z += (a.x - b.x) * (a.y + b.y);
+    }
+    return n;
+}
+
+static float GetTriangleFacing(const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& normal)
+{
+    return Vector3::Dot(Vector3::Cross(b - a, c - a), normal);
+}
+
+static void EmitTriangle(std::vector<uint32_t>& out, uint32_t a, uint32_t b, uint32_t c)
+{
+    out.push_back(a);
+    out.push_back(b);
+    out.push_back(c);
+}
+
+static void TriangulateQuad(const Vector3* pos, uint32_t first, const Vector3& normal, std::vector<uint32_t>& out)
+{
+    const Vector3& p0 = pos[first];
+    const Vector3& p1 = pos[first + 1];
+    const Vector3& p2 = pos[first + 2];
+    const Vector3& p3 = pos[first + 3];
+    const bool valid02 = GetTriangleFacing(p0, p1, p2, normal) > 0.0f && GetTriangleFacing(p0, p2, p3, normal) > 0.0f;
+    const bool valid13 = GetTriangleFacing(p1, p2, p3, normal) > 0.0f && GetTriangleFacing(p1, p3, p0, normal) > 0.0f;
+    bool use02 = (p2 - p0).LengthSq() <= (p3 - p1).LengthSq();
+    if (valid02 != valid13)
+        use02 = valid02;
+    if (use02)
+    {
+        EmitTriangle(out, first, first + 1, first + 2);
+        EmitTriangle(out, first, first + 2, first + 3);
+    }
+    else
+    {
+        EmitTriangle(out, first + 1, first + 2, first + 3);
+        EmitTriangle(out, first + 1, first + 3, first);
+    }
+}
+
+struct Point2
+{
+    float x, y;
+};
+
+// Twice the signed area of abc; positive when counterclockwise
+static float Cross2(const Point2& a, const Point2& b, const Point2& c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+static bool IsInTriangle(const Point2& p, const Point2& a, const Point2& b, const Point2& c)
+{
+    return Cross2(a, b, p) >= 0.0f && Cross2(b, c, p) >= 0.0f && Cross2(c, a, p) >= 0.0f;
+}
+
+static void TriangulatePolygon(const Vector3* pos, uint32_t first, uint32_t size, const Vector3& normal,
+    std::vector<Point2>& points, std::vector<uint32_t>& prev, std::vector<uint32_t>& next, std::vector<uint32_t>& out)
+{
+    // project along the dominant normal axis, mirrored so the polygon runs counterclockwise
+    const float ax = std::fabs(normal.x), ay = std::fabs(normal.y), az = std::fabs(normal.z);
+    points.resize(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        const Vector3& p = pos[first + i];
+        if (az >= ax && az >= ay)
+            points[i] = { normal.z >= 0.0f ? p.x : -p.x, p.y };
+        else if (ax >= ay)
+            points[i] = { normal.x >= 0.0f ? p.y : -p.y, p.z };
+        else
+            points[i] = { normal.y >= 0.0f ? p.z : -p.z, p.x };
+    }
+
+    bool convex = true;
+    for (uint32_t i = 0; i < size && convex; ++i)
+        convex = Cross2(points[(i + size - 1) % size], points[i], points[(i + 1) % size]) >= 0.0f;
+    if (convex)
+    {
+        for (uint32_t i = 1; i + 1 < size; ++i)
+            EmitTriangle(out, first, first + i, first + i + 1);
+        return;
+    }
+
+    prev.resize(size);
+    next.resize(size);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        prev[i] = (i + size - 1) % size;
+        next[i] = (i + 1) % size;
+    }
+
+    uint32_t remaining = size;
+    uint32_t i = 0;
+    uint32_t misses = 0;
+    while (remaining > 3)
+    {
+        const uint32_t a = prev[i], c = next[i];
+        bool isEar = Cross2(points[a], points[i], points[c]) > 0.0f;
+        for (uint32_t j = next[c]; isEar && j != a; j = next[j])
+        {
+            // only reflex vertices can lie inside an ear
+            if (Cross2(points[prev[j]], points[j], points[next[j]]) <= 0.0f)
+                isEar = !IsInTriangle(points[j], points[a], points[i], points[c]);
+        }
+        // a self-intersecting or degenerate remainder may have no ear left: clip anyway
+        if (isEar || misses > remaining)
+        {
+            EmitTriangle(out, first + a, first + i, first + c);
+            next[a] = c;
+            prev[c] = a;
+            --remaining;
+            misses = 0;
+            i = a;
+        }
+        else
+        {
+            ++misses;
+            i = c;
+        }
+    }
+    EmitTriangle(out, first + prev[i], first + i, first + next[i]);
+}
+
+/*static*/ size_t Triangulator::Triangulate(const Vector3* pos, const int* polygonStart, size_t polygonCount,
+    std::vector<uint32_t>& outCorners)
+{
+    std::vector<Point2> points;
+    std::vector<uint32_t> prev, next;
+    size_t dropped = 0;
+    for (size_t p = 0; p < polygonCount; ++p)
+    {
+        const uint32_t first = static_cast<uint32_t>(polygonStart[p]);
+        const uint32_t size = static_cast<uint32_t>(polygonStart[p + 1] - polygonStart[p]);
+        if (size < 3)
+        {
+            ++dropped;
+            continue;
+        }
+        if (size == 3)
+        {
+            EmitTriangle(outCorners, first, first + 1, first + 2);
+            continue;
+        }
+        const Vector3 normal = GetPolygonNormal(pos, first, size);
+        if (size == 4)
+            TriangulateQuad(pos, first, normal, outCorners);
+        else
+            TriangulatePolygon(pos, first, size, normal, points, prev, next, outCorners);
+    }
+    return dropped;
+}
+
+/*static*/ bool Triangulator::IsTriangulated(const int* polygonStart, size_t polygonCount)
+{
+    for (size_t p = 0; p <= polygonCount; ++p)
+    {
+        if (polygonStart[p] != static_cast<int>(3 * p))
+            return false;
+    }
+    return true;
+}
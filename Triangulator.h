@@ -0,0 +1,24 @@
+#pragma once
+#include "EngineMath.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits polygons into triangles without the FBX SDK. Triangles pass through, quads are
+// cut along the diagonal that keeps both halves facing the polygon's way (the shorter
+// one when both do), other convex polygons become a fan and concave ones are ear
+// clipped in the plane of their Newell normal. Every triangle keeps the winding of its
+// polygon.
+class Triangulator
+{
+public:
+    // polygonStart: first corner of each of polygonCount polygons plus one past the end;
+    // pos: the position of every corner. Appends three corner indices per triangle to
+    // outCorners and returns the number of polygons with fewer than three corners, which
+    // are dropped.
+    static size_t Triangulate(const Vector3* pos, const int* polygonStart, size_t polygonCount,
+        std::vector<uint32_t>& outCorners);
+
+    // True if every polygon already is a triangle
+    static bool IsTriangulated(const int* polygonStart, size_t polygonCount);
+};
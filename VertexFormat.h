@@ -1,6 +1,8 @@
 #pragma once
 #include "EngineMath.h"
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional> // for std::hash
 
 // The vertex data structure holds data for every possible optional attribute.
@@ -9,8 +11,12 @@ struct VertexData
     Vector3 pos;
     Vector3 norm;
     Vector3 tan;
-    uint8_t bones[4];
-    uint8_t weights[4];
+    float tanSign;      // bitangent = cross(norm, tan) * tanSign; only used with generated tangents
+    // The first VertexFormat::influenceCount slots are used; weights are normalized to the
+    // format's weight encoding (summing to 255 or 65535), unused slots are zero
+    static const int MaxInfluences = 8;
+    uint16_t bones[MaxInfluences];
+    uint16_t weights[MaxInfluences];
     Vector2 uv;
 };
 
@@ -19,11 +25,9 @@ inline bool operator==(const VertexData& a, const VertexData& b) noexcept
 {
     return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z
         && a.norm.x == b.norm.x && a.norm.y == b.norm.y && a.norm.z == b.norm.z
-        && a.tan.x == b.tan.x && a.tan.y == b.tan.y && a.tan.z == b.tan.z
-        && a.bones[0] == b.bones[0] && a.bones[1] == b.bones[1]
-        && a.bones[2] == b.bones[2] && a.bones[3] == b.bones[3]
-        && a.weights[0] == b.weights[0] && a.weights[1] == b.weights[1]
-        && a.weights[2] == b.weights[2] && a.weights[3] == b.weights[3]
+        && a.tan.x == b.tan.x && a.tan.y == b.tan.y && a.tan.z == b.tan.z && a.tanSign == b.tanSign
+        && memcmp(a.bones, b.bones, sizeof(a.bones)) == 0
+        && memcmp(a.weights, b.weights, sizeof(a.weights)) == 0
         && a.uv.x == b.uv.x && a.uv.y == b.uv.y;
 }
 
@@ -47,19 +51,15 @@ namespace std
             h ^= hf(v.tan.x) + 0x9e3779b9 + (h << 6) + (h >> 2);
             h ^= hf(v.tan.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
             h ^= hf(v.tan.z) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            h ^= hf(v.tanSign) + 0x9e3779b9 + (h << 6) + (h >> 2);
 
-            // include bone indices (bytes) in the hash
-            auto hb = std::hash<uint8_t>{};
-            h ^= hb(v.bones[0]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            h ^= hb(v.bones[1]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            h ^= hb(v.bones[2]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            h ^= hb(v.bones[3]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-
-            // include bone weights (bytes) in the hash
-            h ^= hb(v.weights[0]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            h ^= hb(v.weights[1]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            h ^= hb(v.weights[2]) + 0x9e3779b9 + (h << 6) + (h >> 2);
-            h ^= hb(v.weights[3]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            // include bone indices and weights in the hash
+            auto hb = std::hash<uint16_t>{};
+            for (int k = 0; k < VertexData::MaxInfluences; ++k)
+            {
+                h ^= hb(v.bones[k]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+                h ^= hb(v.weights[k]) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            }
 
             h ^= hf(v.uv.x) + 0x9e3779b9 + (h << 6) + (h >> 2);
             h ^= hf(v.uv.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
@@ -0,0 +1,281 @@
+#include "VertexWelder.h"
+#include <cmath>
+#include <cstring>
+
+static size_t NextPowerOfTwo(size_t n)
+{
+    size_t p = 16;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+// Adding +0.0f turns -0.0f into +0.0f, so keys match operator== for signed zeros.
+// Returns false when a value is NaN, which operator== never matches.
+static bool AppendFloats(uint8_t*& dst, const float* src, size_t count)
+{
+    bool comparable = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        float f = src[i] + 0.0f;
+        comparable &= f == f;
+        memcpy(dst, &f, sizeof(float));
+        dst += sizeof(float);
+    }
+    return comparable;
+}
+
+VertexWelder::VertexWelder(const ItpMesh::VertexFormat& format, size_t expectedCorners, const WeldTolerance& tolerance)
+    : format(format)
+    , tolerance(tolerance)
+    , exact(tolerance.IsExact())
+{
+    size_t size = 3 * sizeof(float);
+    if (format.hasNormal)
+        size += 3 * sizeof(float);
+    if (format.hasTan)
+        size += 3 * sizeof(float);
+    if (format.hasTanSign)
+        size += sizeof(float);
+    if (format.hasSkin)
+        size += 2 * sizeof(uint16_t) * format.influenceCount;
+    if (format.hasUV)
+        size += 2 * sizeof(float);
+    keySize = (size + 7) & ~static_cast<size_t>(7);
+
+    // Every corner could be unique; size the slots so the load factor stays at or below
+    // 3/4 even then. Typical meshes weld to well under half their corners.
+    slots.assign(NextPowerOfTwo(expectedCorners + expectedCorners / 3 + 1), EmptySlot);
+    hashes.reserve(expectedCorners / 2);
+    if (exact)
+    {
+        keys.reserve(expectedCorners / 2 * keySize);
+    }
+    else
+    {
+        // without a position tolerance the "cell" is the exact position
+        invCellSize = tolerance.position > 0.0f ? 1.0f / tolerance.position : 0.0f;
+        minNormalDot = cosf(tolerance.normalAngle);
+        verts.reserve(expectedCorners / 2);
+        cells.reserve(expectedCorners / 2);
+        next.reserve(expectedCorners / 2);
+    }
+}
+
+bool VertexWelder::BuildKey(const VertexData& vert, uint8_t* key) const
+{
+    memset(key, 0, keySize);
+    uint8_t* dst = key;
+    bool comparable = AppendFloats(dst, &vert.pos.x, 3);
+    if (format.hasNormal)
+        comparable &= AppendFloats(dst, &vert.norm.x, 3);
+    if (format.hasTan)
+        comparable &= AppendFloats(dst, &vert.tan.x, 3);
+    if (format.hasTanSign)
+        comparable &= AppendFloats(dst, &vert.tanSign, 1);
+    if (format.hasSkin)
+    {
+        memcpy(dst, vert.bones, sizeof(uint16_t) * format.influenceCount);
+        dst += sizeof(uint16_t) * format.influenceCount;
+        memcpy(dst, vert.weights, sizeof(uint16_t) * format.influenceCount);
+        dst += sizeof(uint16_t) * format.influenceCount;
+    }
+    if (format.hasUV)
+        comparable &= AppendFloats(dst, &vert.uv.x, 2);
+    return comparable;
+}
+
+/*static*/ uint64_t VertexWelder::HashKey(const uint8_t* key, size_t size)
+{
+    // 64-bit multiply-xorshift over the key, 8 bytes at a time
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+    for (size_t i = 0; i < size; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, key + i, sizeof(w));
+        h ^= w;
+        h *= 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 29;
+    return h;
+}
+
+void VertexWelder::Grow()
+{
+    std::vector<uint32_t> newSlots(slots.size() * 2, EmptySlot);
+    size_t mask = newSlots.size() - 1;
+    for (uint32_t v : slots)
+    {
+        if (v == EmptySlot)
+            continue;
+        size_t slot = hashes[v] & mask;
+        while (newSlots[slot] != EmptySlot)
+            slot = (slot + 1) & mask;
+        newSlots[slot] = v;
+    }
+    slots.swap(newSlots);
+}
+
+uint32_t VertexWelder::Weld(const VertexData& vert, bool& isNew)
+{
+    return exact ? WeldExact(vert, isNew) : WeldTolerant(vert, isNew);
+}
+
+uint32_t VertexWelder::WeldExact(const VertexData& vert, bool& isNew)
+{
+    uint8_t key[MaxKeySize];
+    const bool comparable = BuildKey(vert, key);
+    uint32_t hash = static_cast<uint32_t>(HashKey(key, keySize));
+    if (!comparable)
+    {   // a NaN vertex stays unwelded, as with operator==; it gets no slot
+        uint32_t index = static_cast<uint32_t>(hashes.size());
+        hashes.push_back(hash);
+        keys.insert(keys.end(), key, key + keySize);
+        isNew = true;
+        return index;
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] != EmptySlot)
+    {
+        uint32_t v = slots[slot];
+        if (hashes[v] == hash && memcmp(&keys[v * keySize], key, keySize) == 0)
+        {
+            isNew = false;
+            return v;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    uint32_t index = static_cast<uint32_t>(hashes.size());
+    slots[slot] = index;
+    hashes.push_back(hash);
+    keys.insert(keys.end(), key, key + keySize);
+    isNew = true;
+
+    if (++usedSlots * 4 > slots.size() * 3)
+        Grow();
+    return index;
+}
+
+// NaN goes to cell 0; its vertex welds to nothing anyway
+static int32_t CellCoord(float value, float invCellSize)
+{
+    double c = floor(static_cast<double>(value) * invCellSize);
+    if (std::isnan(c))
+        return 0;
+    c = Math::Clamp(c, -2147483648.0, 2147483647.0);
+    return static_cast<int32_t>(c);
+}
+
+VertexWelder::Cell VertexWelder::GetCell(const Vector3& pos) const
+{
+    Cell cell;
+    if (invCellSize == 0.0f)
+    {
+        float p[3] = { pos.x + 0.0f, pos.y + 0.0f, pos.z + 0.0f };
+        memcpy(&cell, p, sizeof(cell));
+        return cell;
+    }
+    cell.x = CellCoord(pos.x, invCellSize);
+    cell.y = CellCoord(pos.y, invCellSize);
+    cell.z = CellCoord(pos.z, invCellSize);
+    return cell;
+}
+
+/*static*/ uint32_t VertexWelder::HashCell(const Cell& cell)
+{
+    uint8_t key[16] = {};
+    memcpy(key, &cell, sizeof(cell));
+    return static_cast<uint32_t>(HashKey(key, sizeof(key)));
+}
+
+size_t VertexWelder::FindCellSlot(const Cell& cell, uint32_t hash) const
+{
+    size_t mask = slots.size() - 1;
+    size_t slot = hash & mask;
+    while (slots[slot] != EmptySlot)
+    {
+        const Cell& other = cells[slots[slot]];
+        if (other.x == cell.x && other.y == cell.y && other.z == cell.z)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static bool IsAngleWithin(const Vector3& a, const Vector3& b, float minDot)
+{
+    float lenSq = a.LengthSq() * b.LengthSq();
+    if (lenSq == 0.0f)
+        return a.LengthSq() == b.LengthSq(); // both missing, or exact match needed
+    return Vector3::Dot(a, b) >= minDot * sqrtf(lenSq);
+}
+
+// Written so that a NaN component is never within tolerance, like operator==
+bool VertexWelder::IsWithinTolerance(const VertexData& a, const VertexData& b) const
+{
+    if (!((a.pos - b.pos).LengthSq() <= tolerance.position * tolerance.position))
+        return false;
+    if (format.hasNormal && !IsAngleWithin(a.norm, b.norm, minNormalDot))
+        return false;
+    if (format.hasTan && !IsAngleWithin(a.tan, b.tan, minNormalDot))
+        return false;
+    if (format.hasTanSign && a.tanSign != b.tanSign)
+        return false;
+    if (format.hasSkin && (memcmp(a.bones, b.bones, sizeof(a.bones)) != 0 || memcmp(a.weights, b.weights, sizeof(a.weights)) != 0))
+        return false;
+    if (format.hasUV && !(fabsf(a.uv.x - b.uv.x) <= tolerance.uv && fabsf(a.uv.y - b.uv.y) <= tolerance.uv))
+        return false;
+    return true;
+}
+
+uint32_t VertexWelder::WeldTolerant(const VertexData& vert, bool& isNew)
+{
+    Cell cell = GetCell(vert.pos);
+    const int range = invCellSize == 0.0f ? 0 : 1;
+    for (int dz = -range; dz <= range; ++dz)
+    {
+        for (int dy = -range; dy <= range; ++dy)
+        {
+            for (int dx = -range; dx <= range; ++dx)
+            {
+                // cells at the clamped edge of the grid have no neighbour beyond it
+                const int64_t x = static_cast<int64_t>(cell.x) + dx;
+                const int64_t y = static_cast<int64_t>(cell.y) + dy;
+                const int64_t z = static_cast<int64_t>(cell.z) + dz;
+                if (x < INT32_MIN || x > INT32_MAX || y < INT32_MIN || y > INT32_MAX || z < INT32_MIN || z > INT32_MAX)
+                    continue;
+                Cell neighbour = { static_cast<int32_t>(x), static_cast<int32_t>(y), static_cast<int32_t>(z) };
+                size_t slot = FindCellSlot(neighbour, HashCell(neighbour));
+                for (uint32_t v = slots[slot]; v != EmptySlot; v = next[v])
+                {
+                    if (IsWithinTolerance(vert, verts[v]))
+                    {
+                        isNew = false;
+                        return v;
+                    }
+                }
+            }
+        }
+    }
+
+    // New vertex becomes the head of its cell's chain
+    uint32_t hash = HashCell(cell);
+    size_t slot = FindCellSlot(cell, hash);
+    uint32_t index = static_cast<uint32_t>(hashes.size());
+    bool newCell = slots[slot] == EmptySlot;
+    next.push_back(slots[slot]);
+    slots[slot] = index;
+    hashes.push_back(hash);
+    cells.push_back(cell);
+    verts.push_back(vert);
+    isNew = true;
+
+    if (newCell && ++usedSlots * 4 > slots.size() * 3)
+        Grow();
+    return index;
+}
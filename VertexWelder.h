@@ -0,0 +1,72 @@
+#pragma once
+#include "ItpMesh.h"
+#include <cstdint>
+#include <vector>
+
+// Per-attribute limits for tolerance welding; all zero means exact welding
+struct WeldTolerance
+{
+    float position = 0.0f;      // max distance between positions
+    float normalAngle = 0.0f;   // max angle between normals (and tangents), in radians
+    float uv = 0.0f;            // max difference per texture coordinate
+
+    bool IsExact() const { return position <= 0.0f && normalAngle <= 0.0f && uv <= 0.0f; }
+};
+
+// Open-addressing hash table that welds identical vertices. Only the attributes the
+// VertexFormat marks as present take part: they are packed into a flat byte key that
+// is hashed in one pass and compared with memcmp. Storage is reserved up front from
+// the corner count, so welding a mesh does no per-vertex allocation.
+//
+// With a non-zero WeldTolerance the table instead hashes positions snapped to a grid of
+// WeldTolerance::position sized cells. A vertex is welded to an earlier vertex in its own
+// or one of the 26 neighbouring cells whose attributes are all within tolerance; the
+// stored vertex is kept unchanged, so welded data is always data from the source mesh.
+class VertexWelder
+{
+public:
+    VertexWelder(const ItpMesh::VertexFormat& format, size_t expectedCorners, const WeldTolerance& tolerance = WeldTolerance());
+
+    // Returns the index of the welded vertex equal to vert. isNew is set when vert
+    // wasn't seen before; its index is then the previous GetVertexCount().
+    uint32_t Weld(const VertexData& vert, bool& isNew);
+
+    size_t GetVertexCount() const { return hashes.size(); }
+
+private:
+    static const uint32_t EmptySlot = 0xFFFFFFFF;
+    static const size_t MaxKeySize = 96;
+
+    struct Cell
+    {
+        int32_t x, y, z;
+    };
+
+    // Fills key; false when the vertex has a NaN and must not weld to anything
+    bool BuildKey(const VertexData& vert, uint8_t* key) const;
+    static uint64_t HashKey(const uint8_t* key, size_t size);
+    void Grow();
+
+    uint32_t WeldExact(const VertexData& vert, bool& isNew);
+    uint32_t WeldTolerant(const VertexData& vert, bool& isNew);
+    Cell GetCell(const Vector3& pos) const;
+    static uint32_t HashCell(const Cell& cell);
+    size_t FindCellSlot(const Cell& cell, uint32_t hash) const;
+    bool IsWithinTolerance(const VertexData& a, const VertexData& b) const;
+
+    ItpMesh::VertexFormat format;
+    size_t keySize = 0;                 // bytes, rounded up to a multiple of 8
+    size_t usedSlots = 0;
+    std::vector<uint32_t> slots;        // vertex index or EmptySlot, size is a power of two
+    std::vector<uint32_t> hashes;       // per vertex, low 32 bits of its hash
+    std::vector<uint8_t> keys;          // per vertex, keySize bytes
+
+    // tolerance mode: slots hold the newest vertex of each grid cell, chained through next
+    WeldTolerance tolerance;
+    bool exact = true;
+    float invCellSize = 0.0f;
+    float minNormalDot = 1.0f;
+    std::vector<VertexData> verts;
+    std::vector<Cell> cells;
+    std::vector<uint32_t> next;
+};